@@ -0,0 +1,304 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Platform independent part of the warping engine API declared
+ *            in warping_engine.h. Register writes go to a shadow copy, a
+ *            job start hands all job registers to the platform code in one
+ *            batch. All functions are thread safe.
+ ****************************************************************************/
+
+#include "warping_engine_base.h"
+
+/* revision register layout */
+#define WARPING_ENGINE_REVISION_MAJOR(rev)   (((rev) >> 16) & 0xff)
+#define WARPING_ENGINE_REVISION_MINOR(rev)   (((rev) >> 8) & 0xff)
+
+#define WARPING_ENGINE_PFC_COUNT             (WARPING_ENGINE_PFC_VALUE_REG_BASE - WARPING_ENGINE_PFC_EVENT_SELECT_REG_BASE)
+
+warping_engine_context *warping_engine_validateContext(warping_engine_ptr a_context)
+{
+  warping_engine_context *context = (warping_engine_context *) a_context;
+
+  if(context == NULL || context->m_size != sizeof(warping_engine_context))
+    return NULL;
+
+  return context;
+}
+
+/* forget the shadow, every register is written again with the next job */
+void warping_engine_resetRegisters(warping_engine_context *a_context)
+{
+  warping_engine_uint32 i;
+
+  for(i = 0; i < WARPING_ENGINE_SHADOW_REGS; i++)
+    a_context->m_shadow[i] = 0;
+}
+
+/* write a register to the shadow, the next job start picks it up */
+void warping_engine_writeShadow(warping_engine_context *a_context, warping_engine_uint32 a_regAddress,
+                                warping_engine_uint32 a_value)
+{
+  a_context->m_shadow[a_regAddress] = a_value;
+}
+
+static void warping_engine_setShadow(warping_engine_handle a_handle, warping_engine_uint32 a_regAddress,
+                                     warping_engine_uint32 a_value)
+{
+  warping_engine_context *context = warping_engine_validateContext(a_handle);
+
+  if(context == NULL)
+    return;
+
+  warping_engine_arch_lock(context);
+  warping_engine_writeShadow(context, a_regAddress, a_value);
+  warping_engine_arch_unlock(context);
+}
+
+warping_engine_handle warping_engine_init(warping_engine_platform_settings a_platform)
+{
+  warping_engine_context *context;
+
+  context = (warping_engine_context *) warping_engine_arch_malloc(sizeof(warping_engine_context));
+  if(context == NULL)
+    return NULL;
+
+  context->m_size = sizeof(warping_engine_context);
+  context->m_platform = a_platform;
+  context->m_config = 0;
+  context->m_enabled = WARPING_ENGINE_FALSE;
+  context->m_irq = NULL;
+  context->m_irq_data = 0;
+  context->m_arch = NULL;
+  warping_engine_resetRegisters(context);
+
+  if(!warping_engine_arch_init(context, a_platform))
+  {
+    context->m_size = 0;
+    warping_engine_arch_free(context);
+    return NULL;
+  }
+
+  context->m_hw_revision = warping_engine_arch_readReg(context, WARPING_ENGINE_H_W_REVISION_REG);
+
+  return context;
+}
+
+void warping_engine_exit(warping_engine_handle a_handle)
+{
+  warping_engine_context *context = warping_engine_validateContext(a_handle);
+
+  if(context == NULL)
+    return;
+
+  if(context->m_irq != NULL)
+    warping_engine_arch_deinitIRQ(context);
+  warping_engine_arch_exit(context);
+
+  context->m_size = 0;
+  warping_engine_arch_free(context);
+}
+
+warping_engine_config warping_engine_getConfig(warping_engine_handle a_handle)
+{
+  warping_engine_context *context = warping_engine_validateContext(a_handle);
+  warping_engine_config config = { 0 };
+
+  if(context == NULL)
+    return config;
+
+  config.m_revision_major = WARPING_ENGINE_REVISION_MAJOR(context->m_hw_revision);
+  config.m_revision_minor = WARPING_ENGINE_REVISION_MINOR(context->m_hw_revision);
+  config.m_status_registers = 1;
+
+  return config;
+}
+
+/* the callback runs in a thread of the platform code for every finished job */
+void warping_engine_registerISR(warping_engine_handle a_handle, warping_engine_irq_type a_type,
+                                warping_engine_isr_callback a_callback, warping_engine_uint32 a_data)
+{
+  warping_engine_context *context = warping_engine_validateContext(a_handle);
+
+  if(context == NULL || a_type != WARPING_ENGINE_IRQ_WARPING_FINISHED)
+    return;
+
+  /* the old callback may be running and waiting for the lock */
+  warping_engine_arch_lock(context);
+  if(context->m_irq != NULL)
+  {
+    warping_engine_arch_unlock(context);
+    warping_engine_arch_deinitIRQ(context);
+    warping_engine_arch_lock(context);
+  }
+
+  context->m_irq = a_callback;
+  context->m_irq_data = a_data;
+  if(a_callback != NULL && !warping_engine_arch_initIRQ(context))
+    context->m_irq = NULL;
+  warping_engine_arch_unlock(context);
+}
+
+/* enabling starts a job with the current register values. The engine stops
+ * by itself when the frame is done, disabling has no effect on it */
+void warping_engine_setEnabled(warping_engine_handle a_handle, warping_engine_bool a_enable)
+{
+  warping_engine_context *context = warping_engine_validateContext(a_handle);
+
+  if(context == NULL)
+    return;
+
+  warping_engine_arch_lock(context);
+  context->m_enabled = a_enable ? WARPING_ENGINE_TRUE : WARPING_ENGINE_FALSE;
+  if(context->m_enabled)
+  {
+    context->m_config |= 1;
+    /* every job is submitted with all registers of the shadow */
+    warping_engine_writeShadow(context, WARPING_ENGINE_CONFIG_REG, context->m_config);
+    warping_engine_arch_startJob(context);
+  }
+  warping_engine_arch_unlock(context);
+}
+
+void warping_engine_setCoordinatesAddress(warping_engine_handle a_handle, warping_engine_uint32 a_address)
+{
+  warping_engine_setShadow(a_handle, WARPING_ENGINE_COORDINATES_ADDRESS_REG, a_address);
+}
+
+void warping_engine_setCoordinatesCount(warping_engine_handle a_handle, warping_engine_uint32 a_count)
+{
+  warping_engine_setShadow(a_handle, WARPING_ENGINE_COORDINATES_COUNT_REG, a_count);
+}
+
+void warping_engine_setInputImageAddress(warping_engine_handle a_handle, warping_engine_uint32 a_address)
+{
+  warping_engine_setShadow(a_handle, WARPING_ENGINE_INPUT_ADDRESS_REG, a_address);
+}
+
+void warping_engine_setInputImageSize(warping_engine_handle a_handle, warping_engine_uint16 a_width,
+                                      warping_engine_uint16 a_height)
+{
+  warping_engine_setShadow(a_handle, WARPING_ENGINE_INPUT_SIZE_REG, WARPING_ENGINE_MAKE_SIZE(a_width, a_height));
+}
+
+/* pitch in pixels, the byte pitch follows from it */
+void warping_engine_setInputImagePitch(warping_engine_handle a_handle, warping_engine_uint16 a_pitch)
+{
+  warping_engine_context *context = warping_engine_validateContext(a_handle);
+
+  if(context == NULL)
+    return;
+
+  warping_engine_arch_lock(context);
+  warping_engine_writeShadow(context, WARPING_ENGINE_INPUT_PITCH_REG, a_pitch);
+  warping_engine_writeShadow(context, WARPING_ENGINE_INPUT_BYTE_PITCH_REG, a_pitch * BYTES_PER_PIXEL);
+  warping_engine_arch_unlock(context);
+}
+
+void warping_engine_setOutsideColor(warping_engine_handle a_handle, warping_engine_uint32 a_color)
+{
+  warping_engine_setShadow(a_handle, WARPING_ENGINE_OUTSIDE_COLOR_REG, a_color);
+}
+
+void warping_engine_setOutputImageAddress(warping_engine_handle a_handle, warping_engine_uint32 a_address)
+{
+  warping_engine_setShadow(a_handle, WARPING_ENGINE_OUTPUT_ADDRESS_REG, a_address);
+}
+
+void warping_engine_setOutputImageSize(warping_engine_handle a_handle, warping_engine_uint16 a_width,
+                                       warping_engine_uint16 a_height)
+{
+  warping_engine_setShadow(a_handle, WARPING_ENGINE_OUTPUT_SIZE_REG, WARPING_ENGINE_MAKE_SIZE(a_width, a_height));
+}
+
+void warping_engine_setOutputImagePitch(warping_engine_handle a_handle, warping_engine_uint16 a_pitch)
+{
+  warping_engine_setShadow(a_handle, WARPING_ENGINE_OUTPUT_PITCH_REG, a_pitch);
+}
+
+void warping_engine_setStripeWidth(warping_engine_handle a_handle, warping_engine_uint16 a_stripe_width)
+{
+  warping_engine_setShadow(a_handle, WARPING_ENGINE_STRIPE_WIDTH_REG, a_stripe_width);
+}
+
+/* commands are not shadowed, they take effect immediately */
+void warping_engine_resetPipeline(warping_engine_handle a_handle)
+{
+  warping_engine_context *context = warping_engine_validateContext(a_handle);
+
+  if(context == NULL)
+    return;
+
+  warping_engine_arch_lock(context);
+  warping_engine_arch_writeReg(context, WARPING_ENGINE_RESET_PIPE_REG, 1);
+  warping_engine_arch_writeReg(context, WARPING_ENGINE_RESET_PIPE_REG, 0);
+  warping_engine_arch_unlock(context);
+}
+
+/* Performance counters are programmed with the next job and restart from 0
+ * with it. The values of the last finished job can be read until the next
+ * one finishes. A job carries WARPING_ENGINE_JOB_PFC_MAX counters, the ones
+ * above cannot be enabled */
+void warping_engine_enablePerformanceCounters(warping_engine_handle a_handle, warping_engine_uint32 a_enable_mask)
+{
+  warping_engine_setShadow(a_handle, WARPING_ENGINE_PFC_ENABLE_REG,
+                           a_enable_mask & ((1u << WARPING_ENGINE_JOB_PFC_MAX) - 1));
+}
+
+void warping_engine_clearPerformanceCounters(warping_engine_handle a_handle, warping_engine_uint32 a_clear_mask)
+{
+  warping_engine_context *context = warping_engine_validateContext(a_handle);
+
+  if(context == NULL)
+    return;
+
+  warping_engine_arch_lock(context);
+  warping_engine_arch_writeReg(context, WARPING_ENGINE_PFC_CLEAR_REG, a_clear_mask);
+  warping_engine_arch_unlock(context);
+}
+
+void warping_engine_enablePerformanceCounter(warping_engine_handle a_handle, warping_engine_uint8 a_pfc_number)
+{
+  warping_engine_context *context = warping_engine_validateContext(a_handle);
+
+  if(context == NULL || a_pfc_number >= WARPING_ENGINE_JOB_PFC_MAX)
+    return;
+
+  warping_engine_arch_lock(context);
+  warping_engine_writeShadow(context, WARPING_ENGINE_PFC_ENABLE_REG,
+                             context->m_shadow[WARPING_ENGINE_PFC_ENABLE_REG] | (1u << a_pfc_number));
+  warping_engine_arch_unlock(context);
+}
+
+void warping_engine_clearPerformanceCounter(warping_engine_handle a_handle, warping_engine_uint8 a_pfc_number)
+{
+  if(a_pfc_number >= WARPING_ENGINE_PFC_COUNT)
+    return;
+
+  warping_engine_clearPerformanceCounters(a_handle, 1u << a_pfc_number);
+}
+
+void warping_engine_setPerformanceCounterEvent(warping_engine_handle a_handle, warping_engine_uint8 a_pfc_number,
+                                               warping_engine_pfc_event_t a_pfc_event)
+{
+  if(a_pfc_number >= WARPING_ENGINE_JOB_PFC_MAX)
+    return;
+
+  warping_engine_setShadow(a_handle, WARPING_ENGINE_PFC_EVENT_SELECT_REG_BASE + a_pfc_number, a_pfc_event);
+}
+
+warping_engine_uint32 warping_engine_getPerformanceCounterValue(warping_engine_handle a_handle,
+                                                                warping_engine_uint8 a_pfc_number)
+{
+  warping_engine_context *context = warping_engine_validateContext(a_handle);
+  warping_engine_uint32 value;
+
+  if(context == NULL || a_pfc_number >= WARPING_ENGINE_PFC_COUNT)
+    return 0;
+
+  warping_engine_arch_lock(context);
+  value = warping_engine_arch_getPerformanceCounterValue(context, a_pfc_number);
+  warping_engine_arch_unlock(context);
+
+  return value;
+}
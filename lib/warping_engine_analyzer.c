@@ -0,0 +1,211 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Cache and memory traffic analysis, see warping_engine_analyzer.h
+ ****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "warping_engine_analyzer.h"
+#include "warping_engine_cache.h"
+
+/* compared counters, in this order */
+static const warping_engine_pfc_event_t warping_engine_analyzer_events[WARPING_ENGINE_ANALYZER_CHECK_CNT] = {
+  WARPING_ENGINE_PFC_EVENT_CLOCK,
+  WARPING_ENGINE_PFC_EVENT_TXS_PREFETCH_MISS,
+  WARPING_ENGINE_PFC_EVENT_TXC_BURST_READ,
+  WARPING_ENGINE_PFC_EVENT_TXC_WORD_READ,
+  WARPING_ENGINE_PFC_EVENT_TXC_PIXEL_READ,
+  WARPING_ENGINE_PFC_EVENT_TXC_PIXEL_READ_HIT,
+  WARPING_ENGINE_PFC_EVENT_TXC_PIXEL_READ_FETCH_WAIT,
+  WARPING_ENGINE_PFC_EVENT_WRITE_ASSEMBLY_BURST_WRITE,
+};
+
+#define WARPING_ENGINE_ANALYZER_WORD_BYTES   (sizeof(warping_engine_uint32))
+
+/* replay state */
+typedef struct
+{
+  warping_engine_cache m_cache;
+  unsigned char *m_seen;                    /* bit per input line, fetched  */
+  warping_engine_uint32 m_lines;
+} warping_engine_analyzer_state;
+
+/* fetch of one pixel, counts into the frame, its stripe and its block */
+static void warping_engine_analyzer_fetch(warping_engine_analyzer_state *a_state, const warping_engine_analyzer_job *a_job,
+                                          warping_engine_coordinate a_pos, warping_engine_analyzer_report *a_report,
+                                          warping_engine_analyzer_stripe *a_stripe, warping_engine_analyzer_block *a_block)
+{
+  warping_engine_uint32 missed[WARPING_ENGINE_CACHE_FETCH_MAX];
+  warping_engine_uint64 *events = a_report->m_events;
+  unsigned int misses, i;
+
+  misses = warping_engine_cache_fetch(&a_state->m_cache, a_pos, a_job->m_input_width, a_job->m_input_height,
+                                      a_job->m_input_pitch, missed);
+
+  events[WARPING_ENGINE_PFC_EVENT_TXC_PIXEL_READ]++;
+  a_stripe->m_pixels++;
+  a_block->m_pixels++;
+  if(!misses)
+  {
+    events[WARPING_ENGINE_PFC_EVENT_TXC_PIXEL_READ_HIT]++;
+    return;
+  }
+
+  events[WARPING_ENGINE_PFC_EVENT_TXS_PREFETCH_MISS] += misses;
+  events[WARPING_ENGINE_PFC_EVENT_TXC_BURST_READ] += misses;
+  events[WARPING_ENGINE_PFC_EVENT_TXC_WORD_READ] += misses * WARPING_ENGINE_CACHE_LINE_PIXELS;
+  events[WARPING_ENGINE_PFC_EVENT_TXC_PIXEL_READ_FETCH_WAIT] += misses * WARPING_ENGINE_CACHE_MISS_CYCLES;
+  a_stripe->m_burst_read += misses;
+  a_stripe->m_fetch_wait += misses * WARPING_ENGINE_CACHE_MISS_CYCLES;
+  a_block->m_misses += misses;
+
+  for(i = 0; i < misses; i++)
+  {
+    /* lines beyond the pitch only exist with a pitch below the width */
+    if(missed[i] >= a_state->m_lines)
+      continue;
+    if(a_state->m_seen[missed[i] / 8] & (1u << (missed[i] % 8)))
+    {
+      a_report->m_refetch++;
+      a_stripe->m_refetch++;
+      a_block->m_refetch++;
+    }
+    a_state->m_seen[missed[i] / 8] |= (unsigned char)(1u << (missed[i] % 8));
+  }
+}
+
+/* the same pixel order and event formulas as the simulated engine */
+warping_engine_analyzer_report *warping_engine_analyzer_run(const warping_engine_analyzer_job *a_job)
+{
+  warping_engine_uint32 out_w = a_job->m_output_width, out_h = a_job->m_output_height;
+  warping_engine_uint32 stripe = a_job->m_stripe_width ? a_job->m_stripe_width : out_w;
+  warping_engine_uint32 percent = a_job->m_thrash_percent ? a_job->m_thrash_percent : WARPING_ENGINE_ANALYZER_THRASH_PERCENT;
+  warping_engine_uint32 count = a_job->m_count;
+  warping_engine_analyzer_report *report;
+  warping_engine_analyzer_stripe *s;
+  warping_engine_analyzer_block *block;
+  warping_engine_analyzer_state state;
+  warping_engine_uint64 *events;
+  warping_engine_uint32 sx, x, y, end, idx, i, lines_per_row;
+
+  if(out_w == 0 || out_h == 0 || (count && a_job->m_coordinates == NULL))
+    return NULL;
+  if((warping_engine_uint64) count > (warping_engine_uint64) out_w * out_h)
+    count = out_w * out_h;
+
+  /* the rows below the image hold lines of a pitch below the width */
+  lines_per_row = (a_job->m_input_pitch + WARPING_ENGINE_CACHE_LINE_PIXELS - 1) / WARPING_ENGINE_CACHE_LINE_PIXELS;
+  state.m_lines = lines_per_row * a_job->m_input_height;
+  state.m_seen = (unsigned char *) calloc(1, state.m_lines / 8 + 1);
+  report = (warping_engine_analyzer_report *) calloc(1, sizeof(*report));
+  if(state.m_seen == NULL || report == NULL)
+    goto FAIL;
+
+  report->m_stripe_count = (out_w + stripe - 1) / stripe;
+  report->m_blocks_x = (out_w + WARPING_ENGINE_ANALYZER_BLOCK - 1) / WARPING_ENGINE_ANALYZER_BLOCK;
+  report->m_blocks_y = (out_h + WARPING_ENGINE_ANALYZER_BLOCK - 1) / WARPING_ENGINE_ANALYZER_BLOCK;
+  report->m_stripes = (warping_engine_analyzer_stripe *) calloc(report->m_stripe_count, sizeof(*report->m_stripes));
+  report->m_blocks = (warping_engine_analyzer_block *) calloc(report->m_blocks_x * report->m_blocks_y,
+                                                              sizeof(*report->m_blocks));
+  if(report->m_stripes == NULL || report->m_blocks == NULL)
+    goto FAIL;
+
+  events = report->m_events;
+  warping_engine_cache_reset(&state.m_cache);
+
+  for(sx = 0, s = report->m_stripes; sx < out_w; sx += stripe, s++)
+  {
+    end = sx + stripe < out_w ? sx + stripe : out_w;
+    s->m_x = sx;
+    s->m_width = end - sx;
+    for(y = 0; y < out_h; y++)
+    {
+      for(x = sx; x < end; x++)
+      {
+        idx = y * out_w + x;
+        if(idx >= count)
+          continue;
+        block = &report->m_blocks[(y / WARPING_ENGINE_ANALYZER_BLOCK) * report->m_blocks_x +
+                                  x / WARPING_ENGINE_ANALYZER_BLOCK];
+        warping_engine_analyzer_fetch(&state, a_job, a_job->m_coordinates[idx], report, s, block);
+      }
+    }
+
+    events[WARPING_ENGINE_PFC_EVENT_WRITE_ASSEMBLY_BURST_WRITE] +=
+      (warping_engine_uint64) out_h * ((s->m_width + WARPING_ENGINE_MBI_BURST_WORDS - 1) / WARPING_ENGINE_MBI_BURST_WORDS);
+    /* every pixel is written, the pixel reads are those with a coordinate */
+    s->m_clock = (warping_engine_uint64) s->m_width * out_h + s->m_fetch_wait;
+    s->m_bytes = (s->m_burst_read * WARPING_ENGINE_CACHE_LINE_PIXELS + s->m_pixels * 2 +
+                  (warping_engine_uint64) s->m_width * out_h) * WARPING_ENGINE_ANALYZER_WORD_BYTES;
+  }
+
+  events[WARPING_ENGINE_PFC_EVENT_WRITE_ASSEMBLY_WORD_WRITE] = (warping_engine_uint64) out_w * out_h;
+  events[WARPING_ENGINE_PFC_EVENT_COORDINATES_READ_WORD_READ] = (warping_engine_uint64) count * 2;
+  events[WARPING_ENGINE_PFC_EVENT_COORDINATES_READ_BURST_READ] =
+    ((warping_engine_uint64) count * 2 + WARPING_ENGINE_MBI_BURST_WORDS - 1) / WARPING_ENGINE_MBI_BURST_WORDS;
+  events[WARPING_ENGINE_PFC_EVENT_CLOCK] = (warping_engine_uint64) out_w * out_h +
+    events[WARPING_ENGINE_PFC_EVENT_TXC_PIXEL_READ_FETCH_WAIT];
+
+  report->m_bytes = (events[WARPING_ENGINE_PFC_EVENT_TXC_WORD_READ] +
+                     events[WARPING_ENGINE_PFC_EVENT_COORDINATES_READ_WORD_READ] +
+                     events[WARPING_ENGINE_PFC_EVENT_WRITE_ASSEMBLY_WORD_WRITE]) * WARPING_ENGINE_ANALYZER_WORD_BYTES;
+  report->m_min_bytes = report->m_bytes -
+    report->m_refetch * WARPING_ENGINE_CACHE_LINE_PIXELS * WARPING_ENGINE_ANALYZER_WORD_BYTES;
+
+  for(i = 0; i < report->m_blocks_x * report->m_blocks_y; i++)
+  {
+    block = &report->m_blocks[i];
+    block->m_thrashing = block->m_refetch && (warping_engine_uint64) block->m_refetch * 100 >=
+                                             (warping_engine_uint64) block->m_pixels * percent;
+    if(block->m_thrashing)
+      report->m_thrashing++;
+  }
+
+  free(state.m_seen);
+  return report;
+
+FAIL:
+  free(state.m_seen);
+  warping_engine_analyzer_free(report);
+  return NULL;
+}
+
+void warping_engine_analyzer_free(warping_engine_analyzer_report *a_report)
+{
+  if(a_report == NULL)
+    return;
+
+  free(a_report->m_blocks);
+  free(a_report->m_stripes);
+  free(a_report);
+}
+
+warping_engine_bool warping_engine_analyzer_validate(warping_engine_handle a_handle,
+                                                     const warping_engine_analyzer_report *a_report,
+                                                     warping_engine_analyzer_check a_checks[WARPING_ENGINE_ANALYZER_CHECK_CNT])
+{
+  warping_engine_uint32 seq = warping_engine_linux_getSequence(a_handle);
+  warping_engine_completion record;
+  warping_engine_uint32 i;
+
+  for(i = 0; i < WARPING_ENGINE_ANALYZER_CHECK_CNT; i++)
+    warping_engine_setPerformanceCounterEvent(a_handle, (warping_engine_uint8) i, warping_engine_analyzer_events[i]);
+  warping_engine_enablePerformanceCounters(a_handle, (1u << WARPING_ENGINE_ANALYZER_CHECK_CNT) - 1);
+
+  warping_engine_setEnabled(a_handle, WARPING_ENGINE_TRUE);
+  if(warping_engine_linux_getSequence(a_handle) == seq || !warping_engine_linux_waitIdle(a_handle) ||
+     !warping_engine_linux_getCompletion(a_handle, &record) || !(record.status & WARPING_ENGINE_IRQ_WARPING_FINISHED))
+    return WARPING_ENGINE_FALSE;
+
+  /* the values latched at the end of the job */
+  for(i = 0; i < WARPING_ENGINE_ANALYZER_CHECK_CNT; i++)
+  {
+    a_checks[i].m_event = warping_engine_analyzer_events[i];
+    a_checks[i].m_predicted = a_report->m_events[warping_engine_analyzer_events[i]];
+    a_checks[i].m_measured = warping_engine_getPerformanceCounterValue(a_handle, (warping_engine_uint8) i);
+  }
+
+  return WARPING_ENGINE_TRUE;
+}
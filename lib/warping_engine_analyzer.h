@@ -0,0 +1,107 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Offline texture cache and memory traffic analysis of a mesh.
+ *            A coordinates table is replayed with a stripe width through the
+ *            cache model of warping_engine_cache.h, in the order the engine
+ *            processes the pixels. The report predicts the performance
+ *            counter events of the frame, the burst reads, fetch waits and
+ *            MBI bytes of every stripe, and marks the blocks of the output
+ *            that thrash the cache: their misses fetch lines again that were
+ *            evicted before.
+ *            The prediction can be checked against the counters of a run of
+ *            the job on the engine.
+ ****************************************************************************/
+
+#ifndef WARPING_ENGINE_ANALYZER_H_
+#define WARPING_ENGINE_ANALYZER_H_
+
+#include "warping_engine_linux.h"
+#include "warping_engine_sample.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WARPING_ENGINE_ANALYZER_EVENT_CNT    (WARPING_ENGINE_PFC_EVENT_CLOCK + 1)
+/* output pixels of a block, in both directions */
+#define WARPING_ENGINE_ANALYZER_BLOCK        (32)
+/* refetched lines per 100 pixels of a thrashing block, by default */
+#define WARPING_ENGINE_ANALYZER_THRASH_PERCENT (25)
+/* counters compared by warping_engine_analyzer_validate() */
+#define WARPING_ENGINE_ANALYZER_CHECK_CNT    (8)
+
+typedef struct
+{
+  const warping_engine_coordinate *m_coordinates;
+  warping_engine_uint32 m_count;            /* coordinates                  */
+  warping_engine_uint32 m_input_width;
+  warping_engine_uint32 m_input_height;
+  warping_engine_uint32 m_input_pitch;      /* in pixels                    */
+  warping_engine_uint32 m_output_width;
+  warping_engine_uint32 m_output_height;
+  warping_engine_uint32 m_stripe_width;     /* 0: output width              */
+  warping_engine_uint32 m_thrash_percent;   /* 0: the default               */
+} warping_engine_analyzer_job;
+
+typedef struct
+{
+  warping_engine_uint32 m_x;                /* first column                 */
+  warping_engine_uint32 m_width;
+  warping_engine_uint64 m_pixels;           /* pixel reads                  */
+  warping_engine_uint64 m_burst_read;       /* texture cache bursts         */
+  warping_engine_uint64 m_refetch;          /* of lines fetched before      */
+  warping_engine_uint64 m_fetch_wait;       /* cycles                       */
+  warping_engine_uint64 m_clock;
+  warping_engine_uint64 m_bytes;            /* texture, coordinates, output */
+} warping_engine_analyzer_stripe;
+
+typedef struct
+{
+  warping_engine_uint32 m_pixels;           /* pixel reads                  */
+  warping_engine_uint32 m_misses;
+  warping_engine_uint32 m_refetch;
+  warping_engine_bool m_thrashing;
+} warping_engine_analyzer_block;
+
+typedef struct
+{
+  /* predicted value of every counter event of the frame */
+  warping_engine_uint64 m_events[WARPING_ENGINE_ANALYZER_EVENT_CNT];
+  warping_engine_uint64 m_bytes;            /* all MBI traffic              */
+  warping_engine_uint64 m_refetch;
+  warping_engine_uint64 m_min_bytes;        /* every line used fetched once */
+  warping_engine_uint32 m_stripe_count;
+  warping_engine_analyzer_stripe *m_stripes;
+  warping_engine_uint32 m_blocks_x;         /* blocks per row               */
+  warping_engine_uint32 m_blocks_y;
+  warping_engine_analyzer_block *m_blocks;  /* in raster order              */
+  warping_engine_uint32 m_thrashing;        /* blocks                       */
+} warping_engine_analyzer_report;
+
+/* a predicted counter and its value on the engine */
+typedef struct
+{
+  warping_engine_pfc_event_t m_event;
+  warping_engine_uint64 m_predicted;
+  warping_engine_uint32 m_measured;
+} warping_engine_analyzer_check;
+
+/* analyze a job, NULL if out of memory. Free with
+ * warping_engine_analyzer_free() */
+warping_engine_analyzer_report *warping_engine_analyzer_run(const warping_engine_analyzer_job *a_job);
+void warping_engine_analyzer_free(warping_engine_analyzer_report *a_report);
+
+/* run the job set up in the engine registers, the one a_report was made
+ * for, with the counters 0 to 7 on the compared events. a_checks gets the
+ * predicted and measured values. False if the job failed */
+warping_engine_bool warping_engine_analyzer_validate(warping_engine_handle a_handle,
+                                                     const warping_engine_analyzer_report *a_report,
+                                                     warping_engine_analyzer_check a_checks[WARPING_ENGINE_ANALYZER_CHECK_CNT]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WARPING_ENGINE_ANALYZER_H_
@@ -0,0 +1,192 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Predicts the texture cache and MBI traffic of a mesh file and
+ *            shows the blocks of the output that thrash the cache. With a
+ *            device the job is run on the engine and the prediction is
+ *            compared with its performance counters.
+ *            usage: warping_engine_analyzer_tool mesh-file input-width
+ *                   input-height [stripe-width [device]]
+ *            A stripe width of 0 takes the one of the file.
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "warping_engine_analyzer.h"
+#include "warping_engine_meshfile.h"
+
+static const char *warping_engine_analyzer_tool_event(warping_engine_pfc_event_t a_event)
+{
+  switch(a_event)
+  {
+    case WARPING_ENGINE_PFC_EVENT_CLOCK:                       return "CLOCK";
+    case WARPING_ENGINE_PFC_EVENT_TXS_PREFETCH_MISS:           return "TXS_PREFETCH_MISS";
+    case WARPING_ENGINE_PFC_EVENT_TXC_BURST_READ:              return "TXC_BURST_READ";
+    case WARPING_ENGINE_PFC_EVENT_TXC_WORD_READ:               return "TXC_WORD_READ";
+    case WARPING_ENGINE_PFC_EVENT_TXC_PIXEL_READ:              return "TXC_PIXEL_READ";
+    case WARPING_ENGINE_PFC_EVENT_TXC_PIXEL_READ_HIT:          return "TXC_PIXEL_READ_HIT";
+    case WARPING_ENGINE_PFC_EVENT_TXC_PIXEL_READ_FETCH_WAIT:   return "TXC_PIXEL_READ_FETCH_WAIT";
+    case WARPING_ENGINE_PFC_EVENT_WRITE_ASSEMBLY_BURST_WRITE:  return "WRITE_ASSEMBLY_BURST_WRITE";
+    default:                                                   return "?";
+  }
+}
+
+static void warping_engine_analyzer_tool_print(const warping_engine_analyzer_report *a_report)
+{
+  const warping_engine_analyzer_stripe *s;
+  warping_engine_uint32 i, x, y;
+
+  printf("stripe  width      pixels  burst read     refetch    fetch wait         clock     bytes/pixel\n");
+  for(i = 0; i < a_report->m_stripe_count; i++)
+  {
+    s = &a_report->m_stripes[i];
+    printf("%6u %6u %11llu %11llu %11llu %13llu %13llu %15.2f\n", s->m_x, s->m_width,
+           (unsigned long long) s->m_pixels, (unsigned long long) s->m_burst_read,
+           (unsigned long long) s->m_refetch, (unsigned long long) s->m_fetch_wait,
+           (unsigned long long) s->m_clock, s->m_pixels ? (double) s->m_bytes / s->m_pixels : 0.0);
+  }
+
+  /* one character per block: '.' fine, '#' thrashing, ' ' no pixel reads */
+  printf("\nthrashing %u of %u blocks of %ux%u pixels:\n", a_report->m_thrashing,
+         a_report->m_blocks_x * a_report->m_blocks_y, WARPING_ENGINE_ANALYZER_BLOCK, WARPING_ENGINE_ANALYZER_BLOCK);
+  for(y = 0; y < a_report->m_blocks_y; y++)
+  {
+    for(x = 0; x < a_report->m_blocks_x; x++)
+    {
+      const warping_engine_analyzer_block *block = &a_report->m_blocks[y * a_report->m_blocks_x + x];
+      putchar(block->m_thrashing ? '#' : block->m_pixels ? '.' : ' ');
+    }
+    putchar('\n');
+  }
+
+  printf("\nclock %llu, MBI %llu bytes (%.2f per cycle), %llu refetched lines, %llu bytes without refetches\n",
+         (unsigned long long) a_report->m_events[WARPING_ENGINE_PFC_EVENT_CLOCK],
+         (unsigned long long) a_report->m_bytes,
+         (double) a_report->m_bytes / a_report->m_events[WARPING_ENGINE_PFC_EVENT_CLOCK],
+         (unsigned long long) a_report->m_refetch, (unsigned long long) a_report->m_min_bytes);
+}
+
+/* run the job on the engine and compare the counters */
+static int warping_engine_analyzer_tool_validate(const char *a_path, char *a_device,
+                                                 const warping_engine_analyzer_job *a_job,
+                                                 const warping_engine_analyzer_report *a_report)
+{
+  warping_engine_analyzer_check checks[WARPING_ENGINE_ANALYZER_CHECK_CNT];
+  warping_engine_linux_buffer mesh, input, output;
+  warping_engine_meshfile_header header;
+  warping_engine_handle engine;
+  warping_engine_uint32 i;
+  int failed = 1;
+
+  engine = warping_engine_init(a_device);
+  if(engine == NULL)
+  {
+    fprintf(stderr, "%s: cannot open the engine\n", a_device);
+    return 1;
+  }
+
+  memset(&input, 0, sizeof(input));
+  memset(&output, 0, sizeof(output));
+  if(!warping_engine_meshfile_load(a_path, engine, &header, &mesh))
+  {
+    fprintf(stderr, "%s: not a mesh file\n", a_path);
+    goto EXIT;
+  }
+  if(!warping_engine_linux_allocBuffer(engine, a_job->m_input_pitch * a_job->m_input_height *
+                                       sizeof(warping_engine_uint32), 0, &input) ||
+     !warping_engine_linux_allocBuffer(engine, header.m_width * header.m_height * sizeof(warping_engine_uint32), 0, &output))
+  {
+    fprintf(stderr, "out of video memory\n");
+    goto FREE;
+  }
+  /* the pattern does not matter, the cache only sees addresses */
+  memset(input.m_virt, 0x80, input.m_size);
+
+  warping_engine_setCoordinatesAddress(engine, mesh.m_phys);
+  warping_engine_setCoordinatesCount(engine, a_job->m_count);
+  warping_engine_setInputImageAddress(engine, input.m_phys);
+  warping_engine_setInputImageSize(engine, a_job->m_input_width, a_job->m_input_height);
+  warping_engine_setInputImagePitch(engine, a_job->m_input_pitch);
+  warping_engine_setOutsideColor(engine, 0);
+  warping_engine_setOutputImageAddress(engine, output.m_phys);
+  warping_engine_setOutputImageSize(engine, a_job->m_output_width, a_job->m_output_height);
+  warping_engine_setOutputImagePitch(engine, a_job->m_output_width);
+  warping_engine_setStripeWidth(engine, (warping_engine_uint16) a_job->m_stripe_width);
+
+  if(!warping_engine_analyzer_validate(engine, a_report, checks))
+  {
+    fprintf(stderr, "the job failed\n");
+    goto FREE;
+  }
+
+  /* the counters are 32 bits wide */
+  printf("\nevent                          predicted      measured  deviation\n");
+  for(i = 0; i < WARPING_ENGINE_ANALYZER_CHECK_CNT; i++)
+    printf("%-26s %13llu %13u %9.2f%%\n", warping_engine_analyzer_tool_event(checks[i].m_event),
+           (unsigned long long) checks[i].m_predicted, checks[i].m_measured,
+           checks[i].m_predicted ? 100.0 * ((double) checks[i].m_measured - (double) checks[i].m_predicted) /
+                                   (double) checks[i].m_predicted : 0.0);
+  failed = 0;
+
+FREE:
+  warping_engine_linux_freeBuffer(engine, &output);
+  warping_engine_linux_freeBuffer(engine, &input);
+  warping_engine_linux_freeBuffer(engine, &mesh);
+EXIT:
+  warping_engine_exit(engine);
+
+  return failed;
+}
+
+int main(int argc, char **argv)
+{
+  warping_engine_analyzer_report *report;
+  warping_engine_meshfile_mapping mapping;
+  warping_engine_analyzer_job job;
+  int failed = 0;
+
+  if(argc < 4)
+  {
+    fprintf(stderr, "usage: %s mesh-file input-width input-height [stripe-width [device]]\n", argv[0]);
+    return 1;
+  }
+  if(!warping_engine_meshfile_map(argv[1], &mapping))
+  {
+    fprintf(stderr, "%s: not a mesh file\n", argv[1]);
+    return 1;
+  }
+
+  memset(&job, 0, sizeof(job));
+  job.m_coordinates = mapping.m_table;
+  job.m_count = mapping.m_header->m_count;
+  job.m_input_width = strtoul(argv[2], NULL, 0);
+  job.m_input_height = strtoul(argv[3], NULL, 0);
+  job.m_input_pitch = job.m_input_width;
+  job.m_output_width = mapping.m_header->m_width;
+  job.m_output_height = mapping.m_header->m_height;
+  job.m_stripe_width = argc >= 5 ? strtoul(argv[4], NULL, 0) : 0;
+  if(job.m_stripe_width == 0)
+    job.m_stripe_width = mapping.m_header->m_stripe_width;
+
+  report = warping_engine_analyzer_run(&job);
+  if(report == NULL)
+  {
+    fprintf(stderr, "%s: cannot analyze\n", argv[1]);
+    warping_engine_meshfile_unmap(&mapping);
+    return 1;
+  }
+
+  printf("%s: %ux%u from %ux%u, stripe width %u\n\n", argv[1], job.m_output_width, job.m_output_height,
+         job.m_input_width, job.m_input_height, job.m_stripe_width ? job.m_stripe_width : job.m_output_width);
+  warping_engine_analyzer_tool_print(report);
+
+  if(argc >= 6)
+    failed = warping_engine_analyzer_tool_validate(argv[1], argv[5], &job, report);
+
+  warping_engine_analyzer_free(report);
+  warping_engine_meshfile_unmap(&mapping);
+
+  return failed;
+}
@@ -0,0 +1,535 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Linux platform code of the warping engine API on top of the
+ *            kernel module. A job start is a single WARPING_ENGINE_IOCTL_SUBMIT
+ *            built from the register shadow, register reads use the read
+ *            only register mapping.
+ ****************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include "warping_engine_base.h"
+#include "warping_engine_linux.h"
+
+#define WARPING_ENGINE_LINUX_POLL_MS         100
+
+typedef struct
+{
+  int m_fd;                                 /* non blocking device file     */
+  const volatile warping_engine_uint32 *m_regs; /* register window or NULL  */
+  size_t m_regs_size;
+  pthread_mutex_t m_lock;                   /* API lock, recursive          */
+  pthread_mutex_t m_drain_lock;             /* one reader of m_fd at a time */
+
+  /* completions, protected by m_completion_lock */
+  pthread_mutex_t m_completion_lock;
+  pthread_cond_t m_completion_cond;
+  warping_engine_uint32 m_submitted;        /* sequence of the last job     */
+  warping_engine_uint32 m_completed;        /* sequence of the last record  */
+  warping_engine_bool m_has_record;
+  warping_engine_completion m_record;       /* record of the last job       */
+
+  /* completion thread, runs while an ISR callback is registered */
+  pthread_t m_thread;
+  warping_engine_bool m_thread_running;
+  int m_stop_fd;
+} warping_engine_linux;
+
+static warping_engine_linux *warping_engine_linux_get(warping_engine_handle a_handle)
+{
+  warping_engine_context *context = warping_engine_validateContext(a_handle);
+
+  return context != NULL ? (warping_engine_linux *) context->m_arch : NULL;
+}
+
+warping_engine_ptr warping_engine_arch_malloc(warping_engine_uint32 a_size)
+{
+  return calloc(1, a_size);
+}
+
+void warping_engine_arch_free(warping_engine_ptr a_ptr)
+{
+  free(a_ptr);
+}
+
+warping_engine_bool warping_engine_arch_init(warping_engine_context *a_base, warping_engine_platform_settings a_platform)
+{
+  const char *path = a_platform != NULL ? (const char *) a_platform : WARPING_ENGINE_LINUX_DEVICE;
+  warping_engine_linux *arch;
+  warping_engine_settings settings;
+  pthread_mutexattr_t attr;
+  void *regs;
+
+  arch = (warping_engine_linux *) calloc(1, sizeof(*arch));
+  if(arch == NULL)
+    return WARPING_ENGINE_FALSE;
+
+  /* submits must not block, completions are read by the same thread */
+  arch->m_fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if(arch->m_fd < 0)
+  {
+    free(arch);
+    return WARPING_ENGINE_FALSE;
+  }
+
+  /* older modules have no register mapping, reads fall back to ioctls */
+  if(ioctl(arch->m_fd, WARPING_ENGINE_IOCTL_GET_SETTINGS, &settings) == 0)
+  {
+    arch->m_regs_size = settings.span + 1;
+    regs = mmap(NULL, arch->m_regs_size, PROT_READ, MAP_SHARED, arch->m_fd,
+                (off_t) WARPING_ENGINE_MMAP_REGS_PGOFF * sysconf(_SC_PAGESIZE));
+    if(regs != MAP_FAILED)
+      arch->m_regs = (const volatile warping_engine_uint32 *) regs;
+  }
+
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&arch->m_lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+  pthread_mutex_init(&arch->m_drain_lock, NULL);
+  pthread_mutex_init(&arch->m_completion_lock, NULL);
+  pthread_cond_init(&arch->m_completion_cond, NULL);
+  arch->m_stop_fd = -1;
+
+  a_base->m_arch = arch;
+
+  return WARPING_ENGINE_TRUE;
+}
+
+void warping_engine_arch_exit(warping_engine_context *a_base)
+{
+  warping_engine_linux *arch = (warping_engine_linux *) a_base->m_arch;
+
+  if(arch->m_regs != NULL)
+    munmap((void *) arch->m_regs, arch->m_regs_size);
+  close(arch->m_fd);
+  pthread_cond_destroy(&arch->m_completion_cond);
+  pthread_mutex_destroy(&arch->m_completion_lock);
+  pthread_mutex_destroy(&arch->m_drain_lock);
+  pthread_mutex_destroy(&arch->m_lock);
+  free(arch);
+  a_base->m_arch = NULL;
+}
+
+void warping_engine_arch_lock(warping_engine_context *a_context)
+{
+  pthread_mutex_lock(&((warping_engine_linux *) a_context->m_arch)->m_lock);
+}
+
+void warping_engine_arch_unlock(warping_engine_context *a_context)
+{
+  pthread_mutex_unlock(&((warping_engine_linux *) a_context->m_arch)->m_lock);
+}
+
+warping_engine_uint32 warping_engine_arch_readReg(warping_engine_context *a_context, warping_engine_uint32 a_regAddress)
+{
+  warping_engine_linux *arch = (warping_engine_linux *) a_context->m_arch;
+  warping_engine_uint32 value;
+
+  if(arch->m_regs != NULL && (a_regAddress + 1) * sizeof(warping_engine_uint32) <= arch->m_regs_size)
+    return arch->m_regs[a_regAddress];
+
+  /* the module writes the 32 bit register value */
+  if(ioctl(arch->m_fd, WARPING_ENGINE_IOCTL_RREG(a_regAddress), &value))
+    return 0;
+
+  return value;
+}
+
+void warping_engine_arch_writeReg(warping_engine_context *a_context, warping_engine_uint32 a_regAddress,
+                                  warping_engine_uint32 a_value)
+{
+  warping_engine_linux *arch = (warping_engine_linux *) a_context->m_arch;
+
+  ioctl(arch->m_fd, WARPING_ENGINE_IOCTL_WREG(a_regAddress), (unsigned long) a_value);
+}
+
+/* read all available completion records. Readers are serialized and the
+ * last record only moves forward, so concurrent readers cannot hand out an
+ * older record. Only the completion thread passes a_notify, the ISR
+ * callback never runs on an API caller's thread. Returns false if there
+ * was no record */
+static warping_engine_bool warping_engine_linux_drain(warping_engine_context *a_context, warping_engine_bool a_notify)
+{
+  warping_engine_linux *arch = (warping_engine_linux *) a_context->m_arch;
+  warping_engine_completion records[4];
+  warping_engine_isr_callback callback;
+  warping_engine_bool found = WARPING_ENGINE_FALSE;
+  const warping_engine_completion *last;
+  ssize_t size;
+  size_t i;
+
+  for(;;)
+  {
+    pthread_mutex_lock(&arch->m_drain_lock);
+    size = read(arch->m_fd, records, sizeof(records));
+    if(size < 0 && errno == EINTR)
+    {
+      pthread_mutex_unlock(&arch->m_drain_lock);
+      continue;
+    }
+    if(size < (ssize_t) sizeof(records[0]))
+    {
+      pthread_mutex_unlock(&arch->m_drain_lock);
+      return found;
+    }
+
+    found = WARPING_ENGINE_TRUE;
+    last = &records[size / sizeof(records[0]) - 1];
+    pthread_mutex_lock(&arch->m_completion_lock);
+    if(!arch->m_has_record || (int) (last->seq - arch->m_completed) > 0)
+    {
+      arch->m_completed = last->seq;
+      arch->m_record = *last;
+      arch->m_has_record = WARPING_ENGINE_TRUE;
+    }
+    pthread_cond_broadcast(&arch->m_completion_cond);
+    pthread_mutex_unlock(&arch->m_completion_lock);
+    pthread_mutex_unlock(&arch->m_drain_lock);
+
+    callback = a_notify ? a_context->m_irq : NULL;
+    for(i = 0; callback != NULL && i < size / sizeof(records[0]); i++)
+    {
+      if(records[i].status & WARPING_ENGINE_IRQ_WARPING_FINISHED)
+        callback(a_context->m_irq_data);
+    }
+  }
+}
+
+/* bring the last record up to date. The completion thread does that while
+ * it runs, other threads only read the fd when it does not */
+static void warping_engine_linux_update(warping_engine_context *a_context)
+{
+  warping_engine_linux *arch = (warping_engine_linux *) a_context->m_arch;
+  warping_engine_bool running;
+
+  pthread_mutex_lock(&arch->m_completion_lock);
+  running = arch->m_thread_running;
+  pthread_mutex_unlock(&arch->m_completion_lock);
+
+  if(!running)
+    warping_engine_linux_drain(a_context, WARPING_ENGINE_FALSE);
+}
+
+/* wait for the next completion: the completion thread reads it if it runs,
+ * this thread otherwise */
+static void warping_engine_linux_waitCompletion(warping_engine_context *a_context, warping_engine_uint32 a_completed)
+{
+  warping_engine_linux *arch = (warping_engine_linux *) a_context->m_arch;
+  struct pollfd pfd;
+
+  pthread_mutex_lock(&arch->m_completion_lock);
+  if(arch->m_thread_running)
+  {
+    while(arch->m_completed == a_completed && arch->m_thread_running)
+      pthread_cond_wait(&arch->m_completion_cond, &arch->m_completion_lock);
+    pthread_mutex_unlock(&arch->m_completion_lock);
+    return;
+  }
+  pthread_mutex_unlock(&arch->m_completion_lock);
+
+  /* another thread may read the record first, do not sleep for ever */
+  pfd.fd = arch->m_fd;
+  pfd.events = POLLIN;
+  if(poll(&pfd, 1, WARPING_ENGINE_LINUX_POLL_MS) > 0)
+    warping_engine_linux_drain(a_context, WARPING_ENGINE_FALSE);
+}
+
+static void warping_engine_linux_makeJob(warping_engine_context *a_context, warping_engine_job *a_job)
+{
+  const warping_engine_uint32 *shadow = a_context->m_shadow;
+  warping_engine_uint32 enable = shadow[WARPING_ENGINE_PFC_ENABLE_REG];
+  warping_engine_uint32 i;
+
+  memset(a_job, 0, sizeof(*a_job));
+  a_job->coordinates_address = shadow[WARPING_ENGINE_COORDINATES_ADDRESS_REG];
+  a_job->coordinates_count = shadow[WARPING_ENGINE_COORDINATES_COUNT_REG];
+  a_job->input_address = shadow[WARPING_ENGINE_INPUT_ADDRESS_REG];
+  a_job->input_size = shadow[WARPING_ENGINE_INPUT_SIZE_REG];
+  a_job->input_pitch = shadow[WARPING_ENGINE_INPUT_PITCH_REG];
+  a_job->input_byte_pitch = shadow[WARPING_ENGINE_INPUT_BYTE_PITCH_REG];
+  a_job->outside_color = shadow[WARPING_ENGINE_OUTSIDE_COLOR_REG];
+  a_job->output_address = shadow[WARPING_ENGINE_OUTPUT_ADDRESS_REG];
+  a_job->output_size = shadow[WARPING_ENGINE_OUTPUT_SIZE_REG];
+  a_job->output_pitch = shadow[WARPING_ENGINE_OUTPUT_PITCH_REG];
+  a_job->stripe_width = shadow[WARPING_ENGINE_STRIPE_WIDTH_REG];
+  a_job->config = shadow[WARPING_ENGINE_CONFIG_REG];
+
+  /* the module profiles with the counters 0 to pfc_count-1, so the count
+   * covers the highest enabled counter. Counters below it that are not
+   * enabled run along with the event they select */
+  for(i = 0; i < WARPING_ENGINE_JOB_PFC_MAX; i++)
+  {
+    if(enable & (1u << i))
+      a_job->pfc_count = i + 1;
+  }
+  for(i = 0; i < a_job->pfc_count; i++)
+    a_job->pfc_events[i] = shadow[WARPING_ENGINE_PFC_EVENT_SELECT_REG_BASE + i];
+}
+
+/* hand the shadowed job registers to the module in one call. Called with
+ * the API lock held */
+warping_engine_bool warping_engine_arch_startJob(warping_engine_context *a_context)
+{
+  warping_engine_linux *arch = (warping_engine_linux *) a_context->m_arch;
+  warping_engine_job job;
+  warping_engine_uint32 completed;
+
+  warping_engine_linux_makeJob(a_context, &job);
+
+  for(;;)
+  {
+    pthread_mutex_lock(&arch->m_completion_lock);
+    completed = arch->m_completed;
+    pthread_mutex_unlock(&arch->m_completion_lock);
+
+    if(ioctl(arch->m_fd, WARPING_ENGINE_IOCTL_SUBMIT, &job) == 0)
+      break;
+    if(errno == EINTR)
+      continue;
+    if(errno != EAGAIN)
+      return WARPING_ENGINE_FALSE;
+
+    /* the queue is full of jobs whose completions were not read */
+    warping_engine_linux_waitCompletion(a_context, completed);
+  }
+
+  pthread_mutex_lock(&arch->m_completion_lock);
+  arch->m_submitted = job.seq;
+  pthread_mutex_unlock(&arch->m_completion_lock);
+
+  return WARPING_ENGINE_TRUE;
+}
+
+/* values of the last finished job, running counters if it did not use them */
+warping_engine_uint32 warping_engine_arch_getPerformanceCounterValue(warping_engine_context *a_context,
+                                                                     warping_engine_uint8 a_pfc_number)
+{
+  warping_engine_linux *arch = (warping_engine_linux *) a_context->m_arch;
+  warping_engine_uint32 value;
+  warping_engine_bool latched;
+
+  warping_engine_linux_update(a_context);
+
+  pthread_mutex_lock(&arch->m_completion_lock);
+  latched = arch->m_has_record && a_pfc_number < arch->m_record.pfc_count;
+  value = latched ? arch->m_record.pfc_values[a_pfc_number] : 0;
+  pthread_mutex_unlock(&arch->m_completion_lock);
+
+  if(!latched)
+    value = warping_engine_arch_readReg(a_context, WARPING_ENGINE_PFC_VALUE_REG_BASE + a_pfc_number);
+
+  return value;
+}
+
+static void *warping_engine_linux_thread(void *a_context)
+{
+  warping_engine_context *context = (warping_engine_context *) a_context;
+  warping_engine_linux *arch = (warping_engine_linux *) context->m_arch;
+  struct pollfd pfd[2];
+
+  pfd[0].fd = arch->m_fd;
+  pfd[0].events = POLLIN;
+  pfd[1].fd = arch->m_stop_fd;
+  pfd[1].events = POLLIN;
+
+  for(;;)
+  {
+    if(poll(pfd, 2, -1) < 0 && errno != EINTR)
+      break;
+    if(pfd[1].revents)
+      break;
+    if(pfd[0].revents)
+      warping_engine_linux_drain(context, WARPING_ENGINE_TRUE);
+  }
+
+  return NULL;
+}
+
+warping_engine_bool warping_engine_arch_initIRQ(warping_engine_context *a_context)
+{
+  warping_engine_linux *arch = (warping_engine_linux *) a_context->m_arch;
+
+  arch->m_stop_fd = eventfd(0, EFD_CLOEXEC);
+  if(arch->m_stop_fd < 0)
+    return WARPING_ENGINE_FALSE;
+
+  pthread_mutex_lock(&arch->m_completion_lock);
+  arch->m_thread_running = WARPING_ENGINE_TRUE;
+  pthread_mutex_unlock(&arch->m_completion_lock);
+
+  if(pthread_create(&arch->m_thread, NULL, warping_engine_linux_thread, a_context))
+  {
+    pthread_mutex_lock(&arch->m_completion_lock);
+    arch->m_thread_running = WARPING_ENGINE_FALSE;
+    pthread_mutex_unlock(&arch->m_completion_lock);
+    close(arch->m_stop_fd);
+    arch->m_stop_fd = -1;
+    return WARPING_ENGINE_FALSE;
+  }
+
+  return WARPING_ENGINE_TRUE;
+}
+
+void warping_engine_arch_deinitIRQ(warping_engine_context *a_context)
+{
+  warping_engine_linux *arch = (warping_engine_linux *) a_context->m_arch;
+  uint64_t one = 1;
+
+  if(arch->m_stop_fd < 0)
+    return;
+
+  if(write(arch->m_stop_fd, &one, sizeof(one)) == sizeof(one))
+    pthread_join(arch->m_thread, NULL);
+  close(arch->m_stop_fd);
+  arch->m_stop_fd = -1;
+
+  /* release waiters, they read completions themselves from now on */
+  pthread_mutex_lock(&arch->m_completion_lock);
+  arch->m_thread_running = WARPING_ENGINE_FALSE;
+  pthread_cond_broadcast(&arch->m_completion_cond);
+  pthread_mutex_unlock(&arch->m_completion_lock);
+}
+
+/******************************************************************************
+ *         Linux extensions, see warping_engine_linux.h                       *
+ ******************************************************************************/
+
+int warping_engine_linux_getFd(warping_engine_handle a_handle)
+{
+  warping_engine_linux *arch = warping_engine_linux_get(a_handle);
+
+  return arch != NULL ? arch->m_fd : -1;
+}
+
+warping_engine_bool warping_engine_linux_allocBuffer(warping_engine_handle a_handle, warping_engine_uint32 a_size,
+                                                     warping_engine_uint32 a_flags,
+                                                     warping_engine_linux_buffer *a_buffer)
+{
+  warping_engine_linux *arch = warping_engine_linux_get(a_handle);
+  warping_engine_bo bo;
+  void *virt;
+
+  if(arch == NULL || a_buffer == NULL)
+    return WARPING_ENGINE_FALSE;
+
+  memset(&bo, 0, sizeof(bo));
+  bo.size = a_size;
+  bo.flags = a_flags;
+  if(ioctl(arch->m_fd, WARPING_ENGINE_IOCTL_BO_ALLOC, &bo))
+    return WARPING_ENGINE_FALSE;
+
+  virt = mmap(NULL, a_size, PROT_READ | PROT_WRITE, MAP_SHARED, arch->m_fd, bo.mmap_offset);
+  if(virt == MAP_FAILED)
+  {
+    ioctl(arch->m_fd, WARPING_ENGINE_IOCTL_BO_FREE, (unsigned long) bo.handle);
+    return WARPING_ENGINE_FALSE;
+  }
+
+  a_buffer->m_handle = bo.handle;
+  a_buffer->m_phys = bo.phys;
+  a_buffer->m_size = a_size;
+  a_buffer->m_virt = virt;
+
+  return WARPING_ENGINE_TRUE;
+}
+
+void warping_engine_linux_freeBuffer(warping_engine_handle a_handle, warping_engine_linux_buffer *a_buffer)
+{
+  warping_engine_linux *arch = warping_engine_linux_get(a_handle);
+
+  if(arch == NULL || a_buffer == NULL || a_buffer->m_virt == NULL)
+    return;
+
+  munmap(a_buffer->m_virt, a_buffer->m_size);
+  ioctl(arch->m_fd, WARPING_ENGINE_IOCTL_BO_FREE, (unsigned long) a_buffer->m_handle);
+  a_buffer->m_virt = NULL;
+}
+
+warping_engine_bool warping_engine_linux_syncBuffer(warping_engine_handle a_handle,
+                                                    const warping_engine_linux_buffer *a_buffer,
+                                                    warping_engine_uint32 a_flags, warping_engine_uint32 a_offset,
+                                                    warping_engine_uint32 a_size)
+{
+  warping_engine_linux *arch = warping_engine_linux_get(a_handle);
+  warping_engine_bo_sync sync;
+
+  if(arch == NULL || a_buffer == NULL)
+    return WARPING_ENGINE_FALSE;
+
+  sync.handle = a_buffer->m_handle;
+  sync.flags = a_flags;
+  sync.offset = a_offset;
+  sync.size = a_size;
+
+  return ioctl(arch->m_fd, WARPING_ENGINE_IOCTL_BO_SYNC, &sync) == 0;
+}
+
+warping_engine_uint32 warping_engine_linux_getSequence(warping_engine_handle a_handle)
+{
+  warping_engine_linux *arch = warping_engine_linux_get(a_handle);
+  warping_engine_uint32 seq;
+
+  if(arch == NULL)
+    return 0;
+
+  pthread_mutex_lock(&arch->m_completion_lock);
+  seq = arch->m_submitted;
+  pthread_mutex_unlock(&arch->m_completion_lock);
+
+  return seq;
+}
+
+warping_engine_bool warping_engine_linux_waitIdle(warping_engine_handle a_handle)
+{
+  warping_engine_context *context = warping_engine_validateContext(a_handle);
+  warping_engine_linux *arch = warping_engine_linux_get(a_handle);
+  warping_engine_uint32 completed, submitted;
+
+  if(arch == NULL)
+    return WARPING_ENGINE_FALSE;
+
+  for(;;)
+  {
+    pthread_mutex_lock(&arch->m_completion_lock);
+    completed = arch->m_completed;
+    submitted = arch->m_submitted;
+    pthread_mutex_unlock(&arch->m_completion_lock);
+
+    if(completed == submitted)
+      return WARPING_ENGINE_TRUE;
+    warping_engine_linux_waitCompletion(context, completed);
+  }
+}
+
+warping_engine_bool warping_engine_linux_getCompletion(warping_engine_handle a_handle,
+                                                       warping_engine_completion *a_record)
+{
+  warping_engine_context *context = warping_engine_validateContext(a_handle);
+  warping_engine_linux *arch = warping_engine_linux_get(a_handle);
+  warping_engine_bool result;
+
+  if(arch == NULL || a_record == NULL)
+    return WARPING_ENGINE_FALSE;
+
+  warping_engine_linux_update(context);
+
+  pthread_mutex_lock(&arch->m_completion_lock);
+  result = arch->m_has_record;
+  if(result)
+    *a_record = arch->m_record;
+  pthread_mutex_unlock(&arch->m_completion_lock);
+
+  return result;
+}
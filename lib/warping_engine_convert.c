@@ -0,0 +1,861 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Pixel format conversion, see warping_engine_convert.h. Rows
+ *            are moved in blocks through buffers on the stack: a block is
+ *            loaded from the source row, converted in the cache and stored
+ *            to the destination row in one go. The vector kernels are
+ *            written once with GCC vector types and built for each ISA
+ *            with a target attribute, they use the integer arithmetic of
+ *            the scalar ones.
+ ****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "warping_engine_convert.h"
+#include "warping_engine_pool.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WARPING_ENGINE_CONVERT_X86
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define WARPING_ENGINE_CONVERT_NEON
+#endif
+
+#define WARPING_ENGINE_CONVERT_LANES         8
+/* pixels of a row per block */
+#define WARPING_ENGINE_CONVERT_BLOCK         64
+/* rows per work item, even for NV12 */
+#define WARPING_ENGINE_CONVERT_ROWS          16
+#define WARPING_ENGINE_CONVERT_ALPHA         (0xff000000u)
+
+#define WARPING_ENGINE_CONVERT_INLINE        static inline __attribute__((always_inline))
+
+typedef int warping_engine_convert_vi __attribute__((vector_size(4 * WARPING_ENGINE_CONVERT_LANES)));
+typedef unsigned int warping_engine_convert_vu __attribute__((vector_size(4 * WARPING_ENGINE_CONVERT_LANES)));
+typedef unsigned short warping_engine_convert_vh __attribute__((vector_size(2 * WARPING_ENGINE_CONVERT_LANES)));
+typedef unsigned char warping_engine_convert_vb __attribute__((vector_size(WARPING_ENGINE_CONVERT_LANES)));
+/* pairs of int lanes */
+typedef unsigned long long warping_engine_convert_vp __attribute__((vector_size(4 * WARPING_ENGINE_CONVERT_LANES)));
+/* bytes of a 128 bit vector */
+typedef unsigned char warping_engine_convert_vq __attribute__((vector_size(16)));
+
+/* a_n pixels of a block of a packed format (RGB24, YUYV) to or from
+ * engine pixels, a_n is even */
+typedef void (*warping_engine_convert_unpack)(const warping_engine_uint8 *a_src, warping_engine_uint32 *a_dst,
+                                              warping_engine_uint32 a_n);
+typedef void (*warping_engine_convert_pack)(const warping_engine_uint32 *a_src, warping_engine_uint8 *a_dst,
+                                            warping_engine_uint32 a_n);
+
+typedef struct
+{
+  warping_engine_convert_unpack m_fromRgb24;
+  warping_engine_convert_pack m_toRgb24;
+  warping_engine_convert_unpack m_fromYuyv;
+  warping_engine_convert_pack m_toYuyv;
+  /* two rows of NV12 and their chroma row */
+  void (*m_fromNv12)(const warping_engine_uint8 *a_y0, const warping_engine_uint8 *a_y1, const warping_engine_uint8 *a_uv,
+                     warping_engine_uint32 *a_dst0, warping_engine_uint32 *a_dst1, warping_engine_uint32 a_n);
+  void (*m_toNv12)(const warping_engine_uint32 *a_src0, const warping_engine_uint32 *a_src1, warping_engine_uint8 *a_y0,
+                   warping_engine_uint8 *a_y1, warping_engine_uint8 *a_uv, warping_engine_uint32 a_n);
+} warping_engine_convert_kernels;
+
+/* moves a block between an image row and the stack */
+typedef void (*warping_engine_convert_copy)(void *a_dst, const void *a_src, size_t a_size);
+
+struct warping_engine_convert_tag
+{
+  warping_engine_cpu_isa m_isa;
+  const warping_engine_convert_kernels *m_kernels;
+  /* for images with WARPING_ENGINE_CONVERT_UNCACHED */
+  warping_engine_convert_copy m_load_uncached;
+  warping_engine_convert_copy m_store_uncached;
+  warping_engine_pool *m_pool;
+};
+
+/* argument of the work items of a conversion */
+typedef struct
+{
+  const warping_engine_convert *m_convert;
+  const warping_engine_convert_image *m_source;
+  const warping_engine_convert_image *m_destination;
+  warping_engine_convert_copy m_load;
+  warping_engine_convert_copy m_store;
+  warping_engine_bool m_fence;              /* m_store is weakly ordered    */
+} warping_engine_convert_frame;
+
+/******************************************************************************
+ *         Scalar kernels                                                     *
+ ******************************************************************************/
+
+static inline warping_engine_uint32 warping_engine_convert_clamp(int a_value)
+{
+  return a_value < 0 ? 0 : a_value > 255 ? 255 : (warping_engine_uint32) a_value;
+}
+
+static inline warping_engine_uint32 warping_engine_convert_rgbaFromYuv(int a_y, int a_u, int a_v)
+{
+  int c = (a_y - 16) * 298, d = a_u - 128, e = a_v - 128;
+
+  return warping_engine_convert_clamp((c + 409 * e + 128) >> 8) |
+         warping_engine_convert_clamp((c - 100 * d - 208 * e + 128) >> 8) << 8 |
+         warping_engine_convert_clamp((c + 516 * d + 128) >> 8) << 16 | WARPING_ENGINE_CONVERT_ALPHA;
+}
+
+static inline int warping_engine_convert_luma(int a_r, int a_g, int a_b)
+{
+  return ((66 * a_r + 129 * a_g + 25 * a_b + 128) >> 8) + 16;
+}
+
+static inline int warping_engine_convert_chromaU(int a_r, int a_g, int a_b)
+{
+  return ((-38 * a_r - 74 * a_g + 112 * a_b + 128) >> 8) + 128;
+}
+
+static inline int warping_engine_convert_chromaV(int a_r, int a_g, int a_b)
+{
+  return ((112 * a_r - 94 * a_g - 18 * a_b + 128) >> 8) + 128;
+}
+
+#define WARPING_ENGINE_CONVERT_R(a_pixel)    ((int) ((a_pixel) & 0xff))
+#define WARPING_ENGINE_CONVERT_G(a_pixel)    ((int) (((a_pixel) >> 8) & 0xff))
+#define WARPING_ENGINE_CONVERT_B(a_pixel)    ((int) (((a_pixel) >> 16) & 0xff))
+
+static void warping_engine_convert_fromRgb24Scalar(const warping_engine_uint8 *a_src, warping_engine_uint32 *a_dst,
+                                                   warping_engine_uint32 a_n)
+{
+  warping_engine_uint32 i;
+
+  for(i = 0; i < a_n; i++, a_src += 3)
+    a_dst[i] = a_src[0] | a_src[1] << 8 | a_src[2] << 16 | WARPING_ENGINE_CONVERT_ALPHA;
+}
+
+static void warping_engine_convert_toRgb24Scalar(const warping_engine_uint32 *a_src, warping_engine_uint8 *a_dst,
+                                                 warping_engine_uint32 a_n)
+{
+  warping_engine_uint32 i;
+
+  for(i = 0; i < a_n; i++, a_dst += 3)
+  {
+    a_dst[0] = (warping_engine_uint8) WARPING_ENGINE_CONVERT_R(a_src[i]);
+    a_dst[1] = (warping_engine_uint8) WARPING_ENGINE_CONVERT_G(a_src[i]);
+    a_dst[2] = (warping_engine_uint8) WARPING_ENGINE_CONVERT_B(a_src[i]);
+  }
+}
+
+static void warping_engine_convert_fromYuyvScalar(const warping_engine_uint8 *a_src, warping_engine_uint32 *a_dst,
+                                                  warping_engine_uint32 a_n)
+{
+  warping_engine_uint32 i;
+
+  for(i = 0; i < a_n; i += 2, a_src += 4)
+  {
+    a_dst[i] = warping_engine_convert_rgbaFromYuv(a_src[0], a_src[1], a_src[3]);
+    a_dst[i + 1] = warping_engine_convert_rgbaFromYuv(a_src[2], a_src[1], a_src[3]);
+  }
+}
+
+static void warping_engine_convert_toYuyvScalar(const warping_engine_uint32 *a_src, warping_engine_uint8 *a_dst,
+                                                warping_engine_uint32 a_n)
+{
+  warping_engine_uint32 i;
+  int r, g, b;
+
+  for(i = 0; i < a_n; i += 2, a_dst += 4)
+  {
+    r = (WARPING_ENGINE_CONVERT_R(a_src[i]) + WARPING_ENGINE_CONVERT_R(a_src[i + 1]) + 1) >> 1;
+    g = (WARPING_ENGINE_CONVERT_G(a_src[i]) + WARPING_ENGINE_CONVERT_G(a_src[i + 1]) + 1) >> 1;
+    b = (WARPING_ENGINE_CONVERT_B(a_src[i]) + WARPING_ENGINE_CONVERT_B(a_src[i + 1]) + 1) >> 1;
+    a_dst[0] = (warping_engine_uint8) warping_engine_convert_luma(WARPING_ENGINE_CONVERT_R(a_src[i]),
+                                                                  WARPING_ENGINE_CONVERT_G(a_src[i]),
+                                                                  WARPING_ENGINE_CONVERT_B(a_src[i]));
+    a_dst[1] = (warping_engine_uint8) warping_engine_convert_chromaU(r, g, b);
+    a_dst[2] = (warping_engine_uint8) warping_engine_convert_luma(WARPING_ENGINE_CONVERT_R(a_src[i + 1]),
+                                                                  WARPING_ENGINE_CONVERT_G(a_src[i + 1]),
+                                                                  WARPING_ENGINE_CONVERT_B(a_src[i + 1]));
+    a_dst[3] = (warping_engine_uint8) warping_engine_convert_chromaV(r, g, b);
+  }
+}
+
+static void warping_engine_convert_fromNv12Scalar(const warping_engine_uint8 *a_y0, const warping_engine_uint8 *a_y1,
+                                                  const warping_engine_uint8 *a_uv, warping_engine_uint32 *a_dst0,
+                                                  warping_engine_uint32 *a_dst1, warping_engine_uint32 a_n)
+{
+  warping_engine_uint32 i;
+
+  for(i = 0; i < a_n; i += 2)
+  {
+    a_dst0[i] = warping_engine_convert_rgbaFromYuv(a_y0[i], a_uv[i], a_uv[i + 1]);
+    a_dst0[i + 1] = warping_engine_convert_rgbaFromYuv(a_y0[i + 1], a_uv[i], a_uv[i + 1]);
+    a_dst1[i] = warping_engine_convert_rgbaFromYuv(a_y1[i], a_uv[i], a_uv[i + 1]);
+    a_dst1[i + 1] = warping_engine_convert_rgbaFromYuv(a_y1[i + 1], a_uv[i], a_uv[i + 1]);
+  }
+}
+
+static void warping_engine_convert_toNv12Scalar(const warping_engine_uint32 *a_src0, const warping_engine_uint32 *a_src1,
+                                                warping_engine_uint8 *a_y0, warping_engine_uint8 *a_y1,
+                                                warping_engine_uint8 *a_uv, warping_engine_uint32 a_n)
+{
+  warping_engine_uint32 i, p;
+  int r, g, b;
+
+  for(i = 0; i < a_n; i += 2)
+  {
+    for(p = i; p < i + 2; p++)
+    {
+      a_y0[p] = (warping_engine_uint8) warping_engine_convert_luma(WARPING_ENGINE_CONVERT_R(a_src0[p]),
+                                                                   WARPING_ENGINE_CONVERT_G(a_src0[p]),
+                                                                   WARPING_ENGINE_CONVERT_B(a_src0[p]));
+      a_y1[p] = (warping_engine_uint8) warping_engine_convert_luma(WARPING_ENGINE_CONVERT_R(a_src1[p]),
+                                                                   WARPING_ENGINE_CONVERT_G(a_src1[p]),
+                                                                   WARPING_ENGINE_CONVERT_B(a_src1[p]));
+    }
+    r = (WARPING_ENGINE_CONVERT_R(a_src0[i]) + WARPING_ENGINE_CONVERT_R(a_src0[i + 1]) +
+         WARPING_ENGINE_CONVERT_R(a_src1[i]) + WARPING_ENGINE_CONVERT_R(a_src1[i + 1]) + 2) >> 2;
+    g = (WARPING_ENGINE_CONVERT_G(a_src0[i]) + WARPING_ENGINE_CONVERT_G(a_src0[i + 1]) +
+         WARPING_ENGINE_CONVERT_G(a_src1[i]) + WARPING_ENGINE_CONVERT_G(a_src1[i + 1]) + 2) >> 2;
+    b = (WARPING_ENGINE_CONVERT_B(a_src0[i]) + WARPING_ENGINE_CONVERT_B(a_src0[i + 1]) +
+         WARPING_ENGINE_CONVERT_B(a_src1[i]) + WARPING_ENGINE_CONVERT_B(a_src1[i + 1]) + 2) >> 2;
+    a_uv[i] = (warping_engine_uint8) warping_engine_convert_chromaU(r, g, b);
+    a_uv[i + 1] = (warping_engine_uint8) warping_engine_convert_chromaV(r, g, b);
+  }
+}
+
+static const warping_engine_convert_kernels warping_engine_convert_kernelsScalar = {
+  warping_engine_convert_fromRgb24Scalar,
+  warping_engine_convert_toRgb24Scalar,
+  warping_engine_convert_fromYuyvScalar,
+  warping_engine_convert_toYuyvScalar,
+  warping_engine_convert_fromNv12Scalar,
+  warping_engine_convert_toNv12Scalar,
+};
+
+/******************************************************************************
+ *         Vector kernels                                                     *
+ ******************************************************************************/
+
+WARPING_ENGINE_CONVERT_INLINE warping_engine_convert_vi warping_engine_convert_clampVector(warping_engine_convert_vi a_value)
+{
+  /* without compares, which are split into lanes for 128 bit targets */
+  a_value &= ~(a_value >> 31);
+  return (a_value | ((255 - a_value) >> 31)) & 255;
+}
+
+/* Lane moves within pairs of lanes. They are 64 bit shifts instead of
+ * shuffles, which GCC splits into single lanes for 128 bit targets */
+WARPING_ENGINE_CONVERT_INLINE warping_engine_convert_vi warping_engine_convert_swapPairs(warping_engine_convert_vi a_value)
+{
+  warping_engine_convert_vp pairs = (warping_engine_convert_vp) a_value;
+
+  return (warping_engine_convert_vi) ((pairs << 32) | (pairs >> 32));
+}
+
+/* both lanes of a pair get the even one */
+WARPING_ENGINE_CONVERT_INLINE warping_engine_convert_vi warping_engine_convert_evenPairs(warping_engine_convert_vi a_value)
+{
+  warping_engine_convert_vp pairs = (warping_engine_convert_vp) a_value;
+
+  return (warping_engine_convert_vi) ((pairs << 32) | (pairs & 0xffffffffu));
+}
+
+/* both lanes of a pair get the odd one */
+WARPING_ENGINE_CONVERT_INLINE warping_engine_convert_vi warping_engine_convert_oddPairs(warping_engine_convert_vi a_value)
+{
+  warping_engine_convert_vp pairs = (warping_engine_convert_vp) a_value;
+
+  return (warping_engine_convert_vi) ((pairs >> 32) | (pairs & ~0xffffffffull));
+}
+
+WARPING_ENGINE_CONVERT_INLINE warping_engine_convert_vu warping_engine_convert_rgbaFromYuvVector(warping_engine_convert_vi a_y,
+                                                                                                 warping_engine_convert_vi a_u,
+                                                                                                 warping_engine_convert_vi a_v)
+{
+  warping_engine_convert_vi c = (a_y - 16) * 298, d = a_u - 128, e = a_v - 128;
+  warping_engine_convert_vi r = warping_engine_convert_clampVector((c + 409 * e + 128) >> 8);
+  warping_engine_convert_vi g = warping_engine_convert_clampVector((c - 100 * d - 208 * e + 128) >> 8);
+  warping_engine_convert_vi b = warping_engine_convert_clampVector((c + 516 * d + 128) >> 8);
+
+  return (warping_engine_convert_vu) (r | g << 8 | b << 16) | WARPING_ENGINE_CONVERT_ALPHA;
+}
+
+WARPING_ENGINE_CONVERT_INLINE void warping_engine_convert_channelsVector(const warping_engine_uint32 *a_src,
+                                                                         warping_engine_convert_vi *a_r,
+                                                                         warping_engine_convert_vi *a_g,
+                                                                         warping_engine_convert_vi *a_b)
+{
+  warping_engine_convert_vu pixels;
+
+  memcpy(&pixels, a_src, sizeof(pixels));
+  *a_r = (warping_engine_convert_vi) (pixels & 0xff);
+  *a_g = (warping_engine_convert_vi) ((pixels >> 8) & 0xff);
+  *a_b = (warping_engine_convert_vi) ((pixels >> 16) & 0xff);
+}
+
+WARPING_ENGINE_CONVERT_INLINE warping_engine_convert_vi warping_engine_convert_lumaVector(warping_engine_convert_vi a_r,
+                                                                                         warping_engine_convert_vi a_g,
+                                                                                         warping_engine_convert_vi a_b)
+{
+  return ((66 * a_r + 129 * a_g + 25 * a_b + 128) >> 8) + 16;
+}
+
+/* U in the even lanes, V in the odd lanes. The channels are averages of
+ * pairs of lanes, both lanes of a pair hold the same value */
+WARPING_ENGINE_CONVERT_INLINE warping_engine_convert_vi warping_engine_convert_chromaVector(warping_engine_convert_vi a_r,
+                                                                                           warping_engine_convert_vi a_g,
+                                                                                           warping_engine_convert_vi a_b)
+{
+  const warping_engine_convert_vi even = { -1, 0, -1, 0, -1, 0, -1, 0 };
+  warping_engine_convert_vi u = ((-38 * a_r - 74 * a_g + 112 * a_b + 128) >> 8) + 128;
+  warping_engine_convert_vi v = ((112 * a_r - 94 * a_g - 18 * a_b + 128) >> 8) + 128;
+
+  return (u & even) | (v & ~even);
+}
+
+/* RGB24 is shuffled 4 pixels at a time, in 128 bit vectors on every
+ * target */
+WARPING_ENGINE_CONVERT_INLINE void warping_engine_convert_fromRgb24Vector(const warping_engine_uint8 *a_src,
+                                                                          warping_engine_uint32 *a_dst,
+                                                                          warping_engine_uint32 a_n)
+{
+  /* the alpha byte is taken from anywhere, it is set afterwards */
+  const warping_engine_convert_vq spread = { 0, 1, 2, 0, 3, 4, 5, 0, 6, 7, 8, 0, 9, 10, 11, 0 };
+  warping_engine_convert_vq bytes;
+  warping_engine_uint32 i;
+
+  /* 16 bytes are loaded, the last 4 belong to the next pixels */
+  for(i = 0; i + 6 <= a_n; i += 4)
+  {
+    memcpy(&bytes, a_src + 3 * i, sizeof(bytes));
+    bytes = __builtin_shuffle(bytes, spread) | (warping_engine_convert_vq) { 0, 0, 0, 255, 0, 0, 0, 255,
+                                                                             0, 0, 0, 255, 0, 0, 0, 255 };
+    memcpy(a_dst + i, &bytes, sizeof(bytes));
+  }
+
+  warping_engine_convert_fromRgb24Scalar(a_src + 3 * i, a_dst + i, a_n - i);
+}
+
+WARPING_ENGINE_CONVERT_INLINE void warping_engine_convert_toRgb24Vector(const warping_engine_uint32 *a_src,
+                                                                        warping_engine_uint8 *a_dst,
+                                                                        warping_engine_uint32 a_n)
+{
+  const warping_engine_convert_vq pack = { 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 0, 0, 0, 0 };
+  warping_engine_convert_vq bytes;
+  warping_engine_uint32 i;
+
+  for(i = 0; i + 4 <= a_n; i += 4)
+  {
+    memcpy(&bytes, a_src + i, sizeof(bytes));
+    bytes = __builtin_shuffle(bytes, pack);
+    memcpy(a_dst + 3 * i, &bytes, 12);
+  }
+
+  warping_engine_convert_toRgb24Scalar(a_src + i, a_dst + 3 * i, a_n - i);
+}
+
+WARPING_ENGINE_CONVERT_INLINE void warping_engine_convert_fromYuyvVector(const warping_engine_uint8 *a_src,
+                                                                         warping_engine_uint32 *a_dst,
+                                                                         warping_engine_uint32 a_n)
+{
+  warping_engine_convert_vh pairs;
+  warping_engine_convert_vi y, c;
+  warping_engine_convert_vu pixels;
+  warping_engine_uint32 i;
+
+  for(i = 0; i + WARPING_ENGINE_CONVERT_LANES <= a_n; i += WARPING_ENGINE_CONVERT_LANES)
+  {
+    /* a lane is a luma byte and the U or V byte that follows it */
+    memcpy(&pairs, a_src + 2 * i, sizeof(pairs));
+    y = __builtin_convertvector(pairs & 0xff, warping_engine_convert_vi);
+    c = __builtin_convertvector(pairs >> 8, warping_engine_convert_vi);
+    pixels = warping_engine_convert_rgbaFromYuvVector(y, warping_engine_convert_evenPairs(c), warping_engine_convert_oddPairs(c));
+    memcpy(a_dst + i, &pixels, sizeof(pixels));
+  }
+
+  warping_engine_convert_fromYuyvScalar(a_src + 2 * i, a_dst + i, a_n - i);
+}
+
+WARPING_ENGINE_CONVERT_INLINE void warping_engine_convert_toYuyvVector(const warping_engine_uint32 *a_src,
+                                                                       warping_engine_uint8 *a_dst,
+                                                                       warping_engine_uint32 a_n)
+{
+  warping_engine_convert_vi r, g, b, y, c;
+  warping_engine_convert_vh pairs;
+  warping_engine_uint32 i;
+
+  for(i = 0; i + WARPING_ENGINE_CONVERT_LANES <= a_n; i += WARPING_ENGINE_CONVERT_LANES)
+  {
+    warping_engine_convert_channelsVector(a_src + i, &r, &g, &b);
+    y = warping_engine_convert_lumaVector(r, g, b);
+    r = (r + warping_engine_convert_swapPairs(r) + 1) >> 1;
+    g = (g + warping_engine_convert_swapPairs(g) + 1) >> 1;
+    b = (b + warping_engine_convert_swapPairs(b) + 1) >> 1;
+    c = warping_engine_convert_chromaVector(r, g, b);
+    pairs = __builtin_convertvector(y | c << 8, warping_engine_convert_vh);
+    memcpy(a_dst + 2 * i, &pairs, sizeof(pairs));
+  }
+
+  warping_engine_convert_toYuyvScalar(a_src + i, a_dst + 2 * i, a_n - i);
+}
+
+WARPING_ENGINE_CONVERT_INLINE void warping_engine_convert_fromNv12Vector(const warping_engine_uint8 *a_y0,
+                                                                         const warping_engine_uint8 *a_y1,
+                                                                         const warping_engine_uint8 *a_uv,
+                                                                         warping_engine_uint32 *a_dst0,
+                                                                         warping_engine_uint32 *a_dst1,
+                                                                         warping_engine_uint32 a_n)
+{
+  warping_engine_convert_vi c, u, v;
+  warping_engine_convert_vu pixels;
+  warping_engine_convert_vb bytes;
+  warping_engine_uint32 i;
+
+  for(i = 0; i + WARPING_ENGINE_CONVERT_LANES <= a_n; i += WARPING_ENGINE_CONVERT_LANES)
+  {
+    memcpy(&bytes, a_uv + i, sizeof(bytes));
+    c = __builtin_convertvector(bytes, warping_engine_convert_vi);
+    u = warping_engine_convert_evenPairs(c);
+    v = warping_engine_convert_oddPairs(c);
+
+    memcpy(&bytes, a_y0 + i, sizeof(bytes));
+    pixels = warping_engine_convert_rgbaFromYuvVector(__builtin_convertvector(bytes, warping_engine_convert_vi), u, v);
+    memcpy(a_dst0 + i, &pixels, sizeof(pixels));
+    memcpy(&bytes, a_y1 + i, sizeof(bytes));
+    pixels = warping_engine_convert_rgbaFromYuvVector(__builtin_convertvector(bytes, warping_engine_convert_vi), u, v);
+    memcpy(a_dst1 + i, &pixels, sizeof(pixels));
+  }
+
+  warping_engine_convert_fromNv12Scalar(a_y0 + i, a_y1 + i, a_uv + i, a_dst0 + i, a_dst1 + i, a_n - i);
+}
+
+WARPING_ENGINE_CONVERT_INLINE void warping_engine_convert_toNv12Vector(const warping_engine_uint32 *a_src0,
+                                                                       const warping_engine_uint32 *a_src1,
+                                                                       warping_engine_uint8 *a_y0,
+                                                                       warping_engine_uint8 *a_y1,
+                                                                       warping_engine_uint8 *a_uv,
+                                                                       warping_engine_uint32 a_n)
+{
+  warping_engine_convert_vi r0, g0, b0, r1, g1, b1;
+  warping_engine_convert_vb bytes;
+  warping_engine_uint32 i;
+
+  for(i = 0; i + WARPING_ENGINE_CONVERT_LANES <= a_n; i += WARPING_ENGINE_CONVERT_LANES)
+  {
+    warping_engine_convert_channelsVector(a_src0 + i, &r0, &g0, &b0);
+    warping_engine_convert_channelsVector(a_src1 + i, &r1, &g1, &b1);
+    bytes = __builtin_convertvector(warping_engine_convert_lumaVector(r0, g0, b0), warping_engine_convert_vb);
+    memcpy(a_y0 + i, &bytes, sizeof(bytes));
+    bytes = __builtin_convertvector(warping_engine_convert_lumaVector(r1, g1, b1), warping_engine_convert_vb);
+    memcpy(a_y1 + i, &bytes, sizeof(bytes));
+
+    /* sums of the 2x2 pixels in the even lanes */
+    r0 += r1;
+    g0 += g1;
+    b0 += b1;
+    r0 = (r0 + warping_engine_convert_swapPairs(r0) + 2) >> 2;
+    g0 = (g0 + warping_engine_convert_swapPairs(g0) + 2) >> 2;
+    b0 = (b0 + warping_engine_convert_swapPairs(b0) + 2) >> 2;
+    bytes = __builtin_convertvector(warping_engine_convert_chromaVector(r0, g0, b0),
+                                    warping_engine_convert_vb);
+    memcpy(a_uv + i, &bytes, sizeof(bytes));
+  }
+
+  warping_engine_convert_toNv12Scalar(a_src0 + i, a_src1 + i, a_y0 + i, a_y1 + i, a_uv + i, a_n - i);
+}
+
+/* the kernels of an ISA, a_target is its target attribute */
+#define WARPING_ENGINE_CONVERT_KERNELS(a_isa, a_target)                                                                  \
+a_target static void warping_engine_convert_fromRgb24##a_isa(const warping_engine_uint8 *a_src,                         \
+                                                             warping_engine_uint32 *a_dst, warping_engine_uint32 a_n)    \
+{                                                                                                                        \
+  warping_engine_convert_fromRgb24Vector(a_src, a_dst, a_n);                                                             \
+}                                                                                                                        \
+a_target static void warping_engine_convert_toRgb24##a_isa(const warping_engine_uint32 *a_src,                           \
+                                                           warping_engine_uint8 *a_dst, warping_engine_uint32 a_n)       \
+{                                                                                                                        \
+  warping_engine_convert_toRgb24Vector(a_src, a_dst, a_n);                                                               \
+}                                                                                                                        \
+a_target static void warping_engine_convert_fromYuyv##a_isa(const warping_engine_uint8 *a_src,                          \
+                                                            warping_engine_uint32 *a_dst, warping_engine_uint32 a_n)     \
+{                                                                                                                        \
+  warping_engine_convert_fromYuyvVector(a_src, a_dst, a_n);                                                              \
+}                                                                                                                        \
+a_target static void warping_engine_convert_toYuyv##a_isa(const warping_engine_uint32 *a_src,                            \
+                                                          warping_engine_uint8 *a_dst, warping_engine_uint32 a_n)        \
+{                                                                                                                        \
+  warping_engine_convert_toYuyvVector(a_src, a_dst, a_n);                                                                \
+}                                                                                                                        \
+a_target static void warping_engine_convert_fromNv12##a_isa(const warping_engine_uint8 *a_y0,                           \
+                                                            const warping_engine_uint8 *a_y1,                           \
+                                                            const warping_engine_uint8 *a_uv,                           \
+                                                            warping_engine_uint32 *a_dst0,                              \
+                                                            warping_engine_uint32 *a_dst1, warping_engine_uint32 a_n)   \
+{                                                                                                                        \
+  warping_engine_convert_fromNv12Vector(a_y0, a_y1, a_uv, a_dst0, a_dst1, a_n);                                          \
+}                                                                                                                        \
+a_target static void warping_engine_convert_toNv12##a_isa(const warping_engine_uint32 *a_src0,                           \
+                                                          const warping_engine_uint32 *a_src1,                           \
+                                                          warping_engine_uint8 *a_y0, warping_engine_uint8 *a_y1,        \
+                                                          warping_engine_uint8 *a_uv, warping_engine_uint32 a_n)         \
+{                                                                                                                        \
+  warping_engine_convert_toNv12Vector(a_src0, a_src1, a_y0, a_y1, a_uv, a_n);                                            \
+}                                                                                                                        \
+static const warping_engine_convert_kernels warping_engine_convert_kernels##a_isa = {                                   \
+  warping_engine_convert_fromRgb24##a_isa,                                                                               \
+  warping_engine_convert_toRgb24##a_isa,                                                                                 \
+  warping_engine_convert_fromYuyv##a_isa,                                                                                \
+  warping_engine_convert_toYuyv##a_isa,                                                                                  \
+  warping_engine_convert_fromNv12##a_isa,                                                                                \
+  warping_engine_convert_toNv12##a_isa,                                                                                  \
+};
+
+#ifdef WARPING_ENGINE_CONVERT_X86
+WARPING_ENGINE_CONVERT_KERNELS(Sse41, __attribute__((target("sse4.1"))))
+WARPING_ENGINE_CONVERT_KERNELS(Avx2, __attribute__((target("avx2"))))
+#endif
+#ifdef WARPING_ENGINE_CONVERT_NEON
+WARPING_ENGINE_CONVERT_KERNELS(Neon, )
+#endif
+
+/******************************************************************************
+ *         Loads and stores                                                   *
+ ******************************************************************************/
+
+static void warping_engine_convert_copyPlain(void *a_dst, const void *a_src, size_t a_size)
+{
+  memcpy(a_dst, a_src, a_size);
+}
+
+#ifdef WARPING_ENGINE_CONVERT_X86
+
+/* reads of write combined memory are uncached, streaming loads fetch a
+ * whole line at once */
+__attribute__((target("sse4.1")))
+static void warping_engine_convert_loadStream(void *a_dst, const void *a_src, size_t a_size)
+{
+  const unsigned char *src = (const unsigned char *) a_src;
+  unsigned char *dst = (unsigned char *) a_dst;
+  size_t head = (16 - ((uintptr_t) src & 15)) & 15;
+
+  if(head > a_size)
+    head = a_size;
+  memcpy(dst, src, head);
+  for(src += head, dst += head, a_size -= head; a_size >= 16; src += 16, dst += 16, a_size -= 16)
+    _mm_storeu_si128((__m128i *) dst, _mm_stream_load_si128((__m128i *) src));
+  memcpy(dst, src, a_size);
+}
+
+#ifdef __SSE2__
+/* whole lines that bypass the cache, the destination is not read */
+static void warping_engine_convert_storeStream(void *a_dst, const void *a_src, size_t a_size)
+{
+  const unsigned char *src = (const unsigned char *) a_src;
+  unsigned char *dst = (unsigned char *) a_dst;
+  size_t head = (16 - ((uintptr_t) dst & 15)) & 15;
+
+  if(head > a_size)
+    head = a_size;
+  memcpy(dst, src, head);
+  for(src += head, dst += head, a_size -= head; a_size >= 16; src += 16, dst += 16, a_size -= 16)
+    _mm_stream_si128((__m128i *) dst, _mm_loadu_si128((const __m128i *) src));
+  memcpy(dst, src, a_size);
+}
+#define WARPING_ENGINE_CONVERT_STREAM
+#endif
+
+#endif // WARPING_ENGINE_CONVERT_X86
+
+/******************************************************************************
+ *         Converter                                                          *
+ ******************************************************************************/
+
+static inline warping_engine_uint8 *warping_engine_convert_row(const warping_engine_convert_image *a_image,
+                                                               warping_engine_uint32 a_plane, warping_engine_uint32 a_y)
+{
+  return (warping_engine_uint8 *) a_image->m_plane[a_plane] + (size_t) a_y * a_image->m_pitch[a_plane];
+}
+
+/* bytes per pixel of a packed format */
+static inline warping_engine_uint32 warping_engine_convert_packedBytes(warping_engine_convert_format a_format)
+{
+  return a_format == WARPING_ENGINE_CONVERT_RGB24 ? 3 : 2;
+}
+
+/* row a_y of an RGB24 or YUYV image */
+static void warping_engine_convert_fromPacked(const warping_engine_convert_frame *a_run, warping_engine_uint32 a_y)
+{
+  const warping_engine_convert *convert = a_run->m_convert;
+  const warping_engine_convert_image *source = a_run->m_source;
+  warping_engine_uint32 bytes = warping_engine_convert_packedBytes(source->m_format);
+  warping_engine_convert_unpack unpack = source->m_format == WARPING_ENGINE_CONVERT_RGB24 ?
+                                         convert->m_kernels->m_fromRgb24 : convert->m_kernels->m_fromYuyv;
+  const warping_engine_uint8 *src = warping_engine_convert_row(source, 0, a_y);
+  warping_engine_uint8 *dst = warping_engine_convert_row(a_run->m_destination, 0, a_y);
+  warping_engine_uint8 in[3 * WARPING_ENGINE_CONVERT_BLOCK] __attribute__((aligned(32)));
+  warping_engine_uint32 out[WARPING_ENGINE_CONVERT_BLOCK] __attribute__((aligned(32)));
+  warping_engine_uint32 x, n;
+
+  for(x = 0; x < source->m_width; x += n)
+  {
+    n = source->m_width - x < WARPING_ENGINE_CONVERT_BLOCK ? source->m_width - x : WARPING_ENGINE_CONVERT_BLOCK;
+    a_run->m_load(in, src + (size_t) x * bytes, n * bytes);
+    unpack(in, out, n);
+    a_run->m_store(dst + (size_t) x * sizeof(*out), out, n * sizeof(*out));
+  }
+}
+
+static void warping_engine_convert_toPacked(const warping_engine_convert_frame *a_run, warping_engine_uint32 a_y)
+{
+  const warping_engine_convert *convert = a_run->m_convert;
+  const warping_engine_convert_image *destination = a_run->m_destination;
+  warping_engine_uint32 bytes = warping_engine_convert_packedBytes(destination->m_format);
+  warping_engine_convert_pack pack = destination->m_format == WARPING_ENGINE_CONVERT_RGB24 ?
+                                     convert->m_kernels->m_toRgb24 : convert->m_kernels->m_toYuyv;
+  const warping_engine_uint8 *src = warping_engine_convert_row(a_run->m_source, 0, a_y);
+  warping_engine_uint8 *dst = warping_engine_convert_row(destination, 0, a_y);
+  warping_engine_uint32 in[WARPING_ENGINE_CONVERT_BLOCK] __attribute__((aligned(32)));
+  warping_engine_uint8 out[3 * WARPING_ENGINE_CONVERT_BLOCK] __attribute__((aligned(32)));
+  warping_engine_uint32 x, n;
+
+  for(x = 0; x < destination->m_width; x += n)
+  {
+    n = destination->m_width - x < WARPING_ENGINE_CONVERT_BLOCK ? destination->m_width - x : WARPING_ENGINE_CONVERT_BLOCK;
+    a_run->m_load(in, src + (size_t) x * sizeof(*in), n * sizeof(*in));
+    pack(in, out, n);
+    a_run->m_store(dst + (size_t) x * bytes, out, n * bytes);
+  }
+}
+
+/* rows a_y and a_y + 1 of an NV12 image */
+static void warping_engine_convert_fromNv12(const warping_engine_convert_frame *a_run, warping_engine_uint32 a_y)
+{
+  const warping_engine_convert *convert = a_run->m_convert;
+  const warping_engine_convert_image *source = a_run->m_source;
+  const warping_engine_convert_image *destination = a_run->m_destination;
+  const warping_engine_uint8 *y0 = warping_engine_convert_row(source, 0, a_y);
+  const warping_engine_uint8 *y1 = warping_engine_convert_row(source, 0, a_y + 1);
+  const warping_engine_uint8 *uv = warping_engine_convert_row(source, 1, a_y / 2);
+  warping_engine_uint8 *dst0 = warping_engine_convert_row(destination, 0, a_y);
+  warping_engine_uint8 *dst1 = warping_engine_convert_row(destination, 0, a_y + 1);
+  warping_engine_uint8 in[3][WARPING_ENGINE_CONVERT_BLOCK] __attribute__((aligned(32)));
+  warping_engine_uint32 out[2][WARPING_ENGINE_CONVERT_BLOCK] __attribute__((aligned(32)));
+  warping_engine_uint32 x, n;
+
+  for(x = 0; x < source->m_width; x += n)
+  {
+    n = source->m_width - x < WARPING_ENGINE_CONVERT_BLOCK ? source->m_width - x : WARPING_ENGINE_CONVERT_BLOCK;
+    a_run->m_load(in[0], y0 + x, n);
+    a_run->m_load(in[1], y1 + x, n);
+    a_run->m_load(in[2], uv + x, n);
+    convert->m_kernels->m_fromNv12(in[0], in[1], in[2], out[0], out[1], n);
+    a_run->m_store(dst0 + (size_t) x * sizeof(out[0][0]), out[0], n * sizeof(out[0][0]));
+    a_run->m_store(dst1 + (size_t) x * sizeof(out[1][0]), out[1], n * sizeof(out[1][0]));
+  }
+}
+
+static void warping_engine_convert_toNv12(const warping_engine_convert_frame *a_run, warping_engine_uint32 a_y)
+{
+  const warping_engine_convert *convert = a_run->m_convert;
+  const warping_engine_convert_image *source = a_run->m_source;
+  const warping_engine_convert_image *destination = a_run->m_destination;
+  const warping_engine_uint8 *src0 = warping_engine_convert_row(source, 0, a_y);
+  const warping_engine_uint8 *src1 = warping_engine_convert_row(source, 0, a_y + 1);
+  warping_engine_uint8 *y0 = warping_engine_convert_row(destination, 0, a_y);
+  warping_engine_uint8 *y1 = warping_engine_convert_row(destination, 0, a_y + 1);
+  warping_engine_uint8 *uv = warping_engine_convert_row(destination, 1, a_y / 2);
+  warping_engine_uint32 in[2][WARPING_ENGINE_CONVERT_BLOCK] __attribute__((aligned(32)));
+  warping_engine_uint8 out[3][WARPING_ENGINE_CONVERT_BLOCK] __attribute__((aligned(32)));
+  warping_engine_uint32 x, n;
+
+  for(x = 0; x < destination->m_width; x += n)
+  {
+    n = destination->m_width - x < WARPING_ENGINE_CONVERT_BLOCK ? destination->m_width - x : WARPING_ENGINE_CONVERT_BLOCK;
+    a_run->m_load(in[0], src0 + (size_t) x * sizeof(in[0][0]), n * sizeof(in[0][0]));
+    a_run->m_load(in[1], src1 + (size_t) x * sizeof(in[1][0]), n * sizeof(in[1][0]));
+    convert->m_kernels->m_toNv12(in[0], in[1], out[0], out[1], out[2], n);
+    a_run->m_store(y0 + x, out[0], n);
+    a_run->m_store(y1 + x, out[1], n);
+    a_run->m_store(uv + x, out[2], n);
+  }
+}
+
+static void warping_engine_convert_rows(void *a_run, warping_engine_uint32 a_item)
+{
+  const warping_engine_convert_frame *run = (const warping_engine_convert_frame *) a_run;
+  const warping_engine_convert_image *source = run->m_source;
+  const warping_engine_convert_image *destination = run->m_destination;
+  warping_engine_uint32 y = a_item * WARPING_ENGINE_CONVERT_ROWS;
+  warping_engine_uint32 end = y + WARPING_ENGINE_CONVERT_ROWS;
+
+  if(end > source->m_height)
+    end = source->m_height;
+
+  if(source->m_format == WARPING_ENGINE_CONVERT_NV12)
+  {
+    for(; y < end; y += 2)
+      warping_engine_convert_fromNv12(run, y);
+  }
+  else if(destination->m_format == WARPING_ENGINE_CONVERT_NV12)
+  {
+    for(; y < end; y += 2)
+      warping_engine_convert_toNv12(run, y);
+  }
+  else if(source->m_format != WARPING_ENGINE_CONVERT_RGBA8888)
+  {
+    for(; y < end; y++)
+      warping_engine_convert_fromPacked(run, y);
+  }
+  else
+  {
+    for(; y < end; y++)
+      warping_engine_convert_toPacked(run, y);
+  }
+
+#ifdef WARPING_ENGINE_CONVERT_STREAM
+  /* streaming stores are weakly ordered, the engine may read the image
+   * once the conversion returns */
+  if(run->m_fence)
+    _mm_sfence();
+#endif
+}
+
+/* pick the kernels, NULL if the ISA is not available */
+static const warping_engine_convert_kernels *warping_engine_convert_selectKernels(warping_engine_cpu_isa *a_isa)
+{
+  if(*a_isa == WARPING_ENGINE_CPU_ISA_AUTO)
+  {
+#if defined(WARPING_ENGINE_CONVERT_NEON)
+    *a_isa = WARPING_ENGINE_CPU_ISA_NEON;
+#elif defined(WARPING_ENGINE_CONVERT_X86)
+    if(__builtin_cpu_supports("avx2"))
+      *a_isa = WARPING_ENGINE_CPU_ISA_AVX2;
+    else if(__builtin_cpu_supports("sse4.1"))
+      *a_isa = WARPING_ENGINE_CPU_ISA_SSE41;
+    else
+      *a_isa = WARPING_ENGINE_CPU_ISA_SCALAR;
+#else
+    *a_isa = WARPING_ENGINE_CPU_ISA_SCALAR;
+#endif
+  }
+
+  switch(*a_isa)
+  {
+    case WARPING_ENGINE_CPU_ISA_SCALAR:
+      return &warping_engine_convert_kernelsScalar;
+#ifdef WARPING_ENGINE_CONVERT_X86
+    case WARPING_ENGINE_CPU_ISA_SSE41:
+      return __builtin_cpu_supports("sse4.1") ? &warping_engine_convert_kernelsSse41 : NULL;
+    case WARPING_ENGINE_CPU_ISA_AVX2:
+      return __builtin_cpu_supports("avx2") ? &warping_engine_convert_kernelsAvx2 : NULL;
+#endif
+#ifdef WARPING_ENGINE_CONVERT_NEON
+    case WARPING_ENGINE_CPU_ISA_NEON:
+      return &warping_engine_convert_kernelsNeon;
+#endif
+    default:
+      return NULL;
+  }
+}
+
+warping_engine_convert *warping_engine_convert_create(warping_engine_uint32 a_threads, warping_engine_cpu_isa a_isa)
+{
+  warping_engine_convert *convert;
+
+  convert = (warping_engine_convert *) calloc(1, sizeof(*convert));
+  if(convert == NULL)
+    return NULL;
+
+  convert->m_isa = a_isa;
+  convert->m_kernels = warping_engine_convert_selectKernels(&convert->m_isa);
+  /* the scalar kernels are the reference, they use plain loads and stores */
+  convert->m_load_uncached = warping_engine_convert_copyPlain;
+  convert->m_store_uncached = warping_engine_convert_copyPlain;
+#ifdef WARPING_ENGINE_CONVERT_X86
+  if(convert->m_isa == WARPING_ENGINE_CPU_ISA_SSE41 || convert->m_isa == WARPING_ENGINE_CPU_ISA_AVX2)
+  {
+    convert->m_load_uncached = warping_engine_convert_loadStream;
+#ifdef WARPING_ENGINE_CONVERT_STREAM
+    convert->m_store_uncached = warping_engine_convert_storeStream;
+#endif
+  }
+#endif
+
+  if(convert->m_kernels != NULL)
+    convert->m_pool = warping_engine_pool_create(a_threads);
+  if(convert->m_pool == NULL)
+  {
+    free(convert);
+    return NULL;
+  }
+
+  return convert;
+}
+
+void warping_engine_convert_destroy(warping_engine_convert *a_convert)
+{
+  if(a_convert == NULL)
+    return;
+
+  warping_engine_pool_destroy(a_convert->m_pool);
+  free(a_convert);
+}
+
+warping_engine_cpu_isa warping_engine_convert_getIsa(const warping_engine_convert *a_convert)
+{
+  return a_convert->m_isa;
+}
+
+/* a_image is valid in a format other than RGBA8888 */
+static warping_engine_bool warping_engine_convert_checkYuvRgb(const warping_engine_convert_image *a_image)
+{
+  switch(a_image->m_format)
+  {
+    case WARPING_ENGINE_CONVERT_RGB24:
+      return a_image->m_plane[0] != NULL;
+    case WARPING_ENGINE_CONVERT_YUYV:
+      return a_image->m_plane[0] != NULL && !(a_image->m_width & 1);
+    case WARPING_ENGINE_CONVERT_NV12:
+      return a_image->m_plane[0] != NULL && a_image->m_plane[1] != NULL &&
+             !(a_image->m_width & 1) && !(a_image->m_height & 1);
+    default:
+      return WARPING_ENGINE_FALSE;
+  }
+}
+
+warping_engine_bool warping_engine_convert_run(warping_engine_convert *a_convert,
+                                               const warping_engine_convert_image *a_source,
+                                               const warping_engine_convert_image *a_destination)
+{
+  warping_engine_convert_frame run;
+  const warping_engine_convert_image *rgba, *other;
+
+  if(a_source->m_width != a_destination->m_width || a_source->m_height != a_destination->m_height)
+    return WARPING_ENGINE_FALSE;
+
+  rgba = a_source->m_format == WARPING_ENGINE_CONVERT_RGBA8888 ? a_source : a_destination;
+  other = rgba == a_source ? a_destination : a_source;
+  if(rgba->m_format != WARPING_ENGINE_CONVERT_RGBA8888 || rgba->m_plane[0] == NULL ||
+     !warping_engine_convert_checkYuvRgb(other))
+    return WARPING_ENGINE_FALSE;
+
+  if(a_source->m_width == 0 || a_source->m_height == 0)
+    return WARPING_ENGINE_TRUE;
+
+  /* streaming accesses only pay off in write combined memory, they bypass
+   * the cache */
+  run.m_convert = a_convert;
+  run.m_source = a_source;
+  run.m_destination = a_destination;
+  run.m_load = a_source->m_flags & WARPING_ENGINE_CONVERT_UNCACHED ? a_convert->m_load_uncached :
+               warping_engine_convert_copyPlain;
+  run.m_store = a_destination->m_flags & WARPING_ENGINE_CONVERT_UNCACHED ? a_convert->m_store_uncached :
+                warping_engine_convert_copyPlain;
+  run.m_fence = run.m_store != warping_engine_convert_copyPlain;
+
+  warping_engine_pool_run(a_convert->m_pool, (a_source->m_height + WARPING_ENGINE_CONVERT_ROWS - 1) /
+                          WARPING_ENGINE_CONVERT_ROWS, warping_engine_convert_rows, &run);
+
+  return WARPING_ENGINE_TRUE;
+}
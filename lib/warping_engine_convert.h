@@ -0,0 +1,68 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Pixel format conversion to and from the engine's 32 bit
+ *            pixels, for cameras and encoders that use YUV or packed RGB.
+ *            Images are converted in bands of rows on a pool of threads
+ *            with SSE4.1, AVX2 or NEON kernels, bit exact with the scalar
+ *            ones. Rows are read and written front to back in blocks, images
+ *            marked uncached use streaming loads and stores on x86, so a
+ *            write combined buffer object can be the source or the
+ *            destination without a copy.
+ *            YUV is BT.601 limited range, chroma of subsampled formats is
+ *            the average of its pixels.
+ ****************************************************************************/
+
+#ifndef WARPING_ENGINE_CONVERT_H_
+#define WARPING_ENGINE_CONVERT_H_
+
+#include "warping_engine_cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  WARPING_ENGINE_CONVERT_RGBA8888 = 0,          // engine pixel, R in the low byte, A = 0xff
+  WARPING_ENGINE_CONVERT_RGB24,                 // bytes R, G, B
+  WARPING_ENGINE_CONVERT_YUYV,                  // bytes Y0, U, Y1, V of two pixels
+  WARPING_ENGINE_CONVERT_NV12,                  // Y plane, plane of U, V of 2x2 pixels
+} warping_engine_convert_format;
+
+/* m_flags of an image */
+#define WARPING_ENGINE_CONVERT_UNCACHED   (0x01)  // planes are write combined, a buffer object without WARPING_ENGINE_BO_CACHED
+
+/* NV12 uses both planes, the other formats m_plane[0]. Pitches are in
+ * bytes. YUYV needs an even width, NV12 an even width and height */
+typedef struct
+{
+  warping_engine_convert_format m_format;
+  warping_engine_uint32 m_flags;
+  warping_engine_uint32 m_width;
+  warping_engine_uint32 m_height;
+  void *m_plane[2];
+  warping_engine_uint32 m_pitch[2];
+} warping_engine_convert_image;
+
+typedef struct warping_engine_convert_tag warping_engine_convert;
+
+/* a_threads: worker threads including the caller, 0 for one per CPU.
+ * Returns NULL if the ISA is not supported */
+warping_engine_convert *warping_engine_convert_create(warping_engine_uint32 a_threads, warping_engine_cpu_isa a_isa);
+void warping_engine_convert_destroy(warping_engine_convert *a_convert);
+
+warping_engine_cpu_isa warping_engine_convert_getIsa(const warping_engine_convert *a_convert);
+
+/* convert a_source to a_destination, one of them has to be RGBA8888 and
+ * both the same size. Returns when it is done, calls are serialized.
+ * False if the conversion is not supported */
+warping_engine_bool warping_engine_convert_run(warping_engine_convert *a_convert,
+                                               const warping_engine_convert_image *a_source,
+                                               const warping_engine_convert_image *a_destination);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WARPING_ENGINE_CONVERT_H_
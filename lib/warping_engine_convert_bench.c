@@ -0,0 +1,183 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Benchmark of the pixel format conversion. Converts random
+ *            images to and from RGBA8888 with every ISA and thread count,
+ *            checks the result against the scalar reference and prints the
+ *            throughput. Rows are padded so they are not aligned.
+ *            usage: warping_engine_convert_bench [width height [frames]]
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "warping_engine_convert.h"
+
+#define BENCH_ROW_PADDING          13
+
+typedef struct
+{
+  warping_engine_convert_format m_source;
+  warping_engine_convert_format m_destination;
+} bench_conversion;
+
+static double bench_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static const char *bench_formatName(warping_engine_convert_format a_format)
+{
+  switch(a_format)
+  {
+    case WARPING_ENGINE_CONVERT_RGBA8888: return "rgba";
+    case WARPING_ENGINE_CONVERT_RGB24:    return "rgb24";
+    case WARPING_ENGINE_CONVERT_YUYV:     return "yuyv";
+    case WARPING_ENGINE_CONVERT_NV12:     return "nv12";
+  }
+
+  return "?";
+}
+
+/* allocate an image and fill it with random bytes, returns its size */
+static size_t bench_image(warping_engine_convert_image *a_image, warping_engine_convert_format a_format,
+                          unsigned a_width, unsigned a_height)
+{
+  static const unsigned bytes[] = { 4, 3, 2, 1 };
+  size_t size, i;
+
+  memset(a_image, 0, sizeof(*a_image));
+  a_image->m_format = a_format;
+  a_image->m_width = a_width;
+  a_image->m_height = a_height;
+  a_image->m_pitch[0] = a_width * bytes[a_format] + BENCH_ROW_PADDING;
+  size = (size_t) a_image->m_pitch[0] * a_height;
+  /* the UV plane follows the Y plane */
+  if(a_format == WARPING_ENGINE_CONVERT_NV12)
+  {
+    a_image->m_pitch[1] = a_image->m_pitch[0];
+    size += (size_t) a_image->m_pitch[1] * (a_height / 2);
+  }
+
+  a_image->m_plane[0] = malloc(size);
+  if(a_image->m_plane[0] == NULL)
+    return 0;
+  if(a_format == WARPING_ENGINE_CONVERT_NV12)
+    a_image->m_plane[1] = (unsigned char *) a_image->m_plane[0] + (size_t) a_image->m_pitch[0] * a_height;
+
+  for(i = 0; i < size; i++)
+    ((unsigned char *) a_image->m_plane[0])[i] = (unsigned char) rand();
+
+  return size;
+}
+
+int main(int argc, char **argv)
+{
+  static const warping_engine_cpu_isa isas[] = {
+    WARPING_ENGINE_CPU_ISA_SCALAR, WARPING_ENGINE_CPU_ISA_SSE41,
+    WARPING_ENGINE_CPU_ISA_AVX2, WARPING_ENGINE_CPU_ISA_NEON,
+  };
+  static const bench_conversion conversions[] = {
+    { WARPING_ENGINE_CONVERT_NV12, WARPING_ENGINE_CONVERT_RGBA8888 },
+    { WARPING_ENGINE_CONVERT_RGBA8888, WARPING_ENGINE_CONVERT_NV12 },
+    { WARPING_ENGINE_CONVERT_YUYV, WARPING_ENGINE_CONVERT_RGBA8888 },
+    { WARPING_ENGINE_CONVERT_RGBA8888, WARPING_ENGINE_CONVERT_YUYV },
+    { WARPING_ENGINE_CONVERT_RGB24, WARPING_ENGINE_CONVERT_RGBA8888 },
+    { WARPING_ENGINE_CONVERT_RGBA8888, WARPING_ENGINE_CONVERT_RGB24 },
+  };
+  unsigned width = 1920, height = 1080, frames = 20;
+  unsigned threads, max_threads, c, i, f, flags;
+  warping_engine_convert_image source, destination;
+  warping_engine_convert *convert;
+  unsigned char *reference;
+  double start, elapsed;
+  size_t size;
+  int failed = 0;
+
+  if(argc >= 3)
+  {
+    width = strtoul(argv[1], NULL, 0);
+    height = strtoul(argv[2], NULL, 0);
+  }
+  if(argc >= 4)
+    frames = strtoul(argv[3], NULL, 0);
+  if(width == 0 || height == 0 || (width & 1) || (height & 1) || frames == 0)
+  {
+    fprintf(stderr, "usage: %s [width height [frames]], width and height even\n", argv[0]);
+    return 1;
+  }
+
+  max_threads = (unsigned) sysconf(_SC_NPROCESSORS_ONLN);
+  printf("%ux%u, %u frames\n", width, height, frames);
+
+  srand(1);
+  for(c = 0; c < sizeof(conversions) / sizeof(conversions[0]); c++)
+  {
+    size = bench_image(&destination, conversions[c].m_destination, width, height);
+    reference = malloc(size);
+    if(!bench_image(&source, conversions[c].m_source, width, height) || size == 0 || reference == NULL)
+    {
+      fprintf(stderr, "out of memory\n");
+      return 1;
+    }
+
+    convert = warping_engine_convert_create(1, WARPING_ENGINE_CPU_ISA_SCALAR);
+    memset(destination.m_plane[0], 0, size);
+    warping_engine_convert_run(convert, &source, &destination);
+    memcpy(reference, destination.m_plane[0], size);
+    warping_engine_convert_destroy(convert);
+
+    for(i = 0; i < sizeof(isas) / sizeof(isas[0]); i++)
+    {
+      for(threads = 1;; threads = threads * 2 < max_threads ? threads * 2 : max_threads)
+      {
+        convert = warping_engine_convert_create(threads, isas[i]);
+        if(convert == NULL)
+          break;
+
+        /* the padding is not written, it stays 0. Checked with plain and
+         * with streaming accesses */
+        for(flags = 0; flags <= WARPING_ENGINE_CONVERT_UNCACHED; flags += WARPING_ENGINE_CONVERT_UNCACHED)
+        {
+          source.m_flags = destination.m_flags = flags;
+          memset(destination.m_plane[0], 0, size);
+          warping_engine_convert_run(convert, &source, &destination);
+          if(memcmp(destination.m_plane[0], reference, size))
+          {
+            printf("%5s -> %-5s %-7s %2u threads%s: result differs from the reference\n",
+                   bench_formatName(conversions[c].m_source), bench_formatName(conversions[c].m_destination),
+                   warping_engine_cpu_isaName(isas[i]), threads, flags ? " uncached" : "");
+            failed = 1;
+          }
+        }
+        source.m_flags = destination.m_flags = 0;
+
+        start = bench_now();
+        for(f = 0; f < frames; f++)
+          warping_engine_convert_run(convert, &source, &destination);
+        elapsed = bench_now() - start;
+
+        printf("%5s -> %-5s %-7s %2u threads: %8.2f ms/frame %8.1f Mpixel/s\n",
+               bench_formatName(conversions[c].m_source), bench_formatName(conversions[c].m_destination),
+               warping_engine_cpu_isaName(isas[i]), threads, elapsed * 1e3 / frames,
+               (double) width * height * frames / elapsed * 1e-6);
+        warping_engine_convert_destroy(convert);
+
+        if(threads >= max_threads)
+          break;
+      }
+    }
+
+    free(reference);
+    free(destination.m_plane[0]);
+    free(source.m_plane[0]);
+  }
+
+  return failed;
+}
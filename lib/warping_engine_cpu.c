@@ -0,0 +1,420 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : CPU warper, see warping_engine_cpu.h. The SIMD kernels use the
+ *            arithmetic of warping_engine_blend() in a separable form:
+ *              h0 = 256 * t00 + fx * (t10 - t00)
+ *              h1 = 256 * t01 + fx * (t11 - t01)
+ *              c  = 256 * h0  + fy * (h1 - h0)
+ *            which is the same sum of products, so results are bit exact.
+ ****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "warping_engine_cpu.h"
+#include "warping_engine_pool.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WARPING_ENGINE_CPU_X86
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define WARPING_ENGINE_CPU_NEON
+#endif
+
+/* rows per tile, a tile is one stripe wide */
+#define WARPING_ENGINE_CPU_TILE_ROWS         32
+
+#define WARPING_ENGINE_CPU_ROUND             (1 << (2 * WARPING_ENGINE_WEIGHT_BITS - 1))
+
+/* warp n pixels of a row that all have a coordinate */
+typedef void (*warping_engine_cpu_span)(const warping_engine_cpu_job *a_job,
+                                        const warping_engine_coordinate *a_coords,
+                                        warping_engine_uint32 *a_out, warping_engine_uint32 a_n);
+
+struct warping_engine_cpu_tag
+{
+  warping_engine_cpu_isa m_isa;
+  warping_engine_cpu_span m_span;
+  warping_engine_pool *m_pool;
+};
+
+/* argument of the tiles of a warp */
+typedef struct
+{
+  const warping_engine_cpu *m_cpu;
+  const warping_engine_cpu_job *m_job;
+} warping_engine_cpu_run;
+
+/* fetch the four taps of n <= 8 pixels like warping_engine_sample() does */
+static inline void warping_engine_cpu_taps(const warping_engine_cpu_job *a_job, const warping_engine_coordinate *a_coords,
+                                           warping_engine_uint32 a_n, warping_engine_uint32 a_taps[4][8])
+{
+  warping_engine_uint32 i;
+  int x0, y0;
+
+  for(i = 0; i < a_n; i++)
+  {
+    x0 = a_coords[i].x >> WARPING_ENGINE_COORD_SHIFT;
+    y0 = a_coords[i].y >> WARPING_ENGINE_COORD_SHIFT;
+    a_taps[0][i] = warping_engine_texel(a_job->m_input, a_job->m_input_pitch, a_job->m_input_width,
+                                        a_job->m_input_height, x0, y0, a_job->m_outside_color);
+    a_taps[1][i] = warping_engine_texel(a_job->m_input, a_job->m_input_pitch, a_job->m_input_width,
+                                        a_job->m_input_height, x0 + 1, y0, a_job->m_outside_color);
+    a_taps[2][i] = warping_engine_texel(a_job->m_input, a_job->m_input_pitch, a_job->m_input_width,
+                                        a_job->m_input_height, x0, y0 + 1, a_job->m_outside_color);
+    a_taps[3][i] = warping_engine_texel(a_job->m_input, a_job->m_input_pitch, a_job->m_input_width,
+                                        a_job->m_input_height, x0 + 1, y0 + 1, a_job->m_outside_color);
+  }
+}
+
+static void warping_engine_cpu_spanScalar(const warping_engine_cpu_job *a_job, const warping_engine_coordinate *a_coords,
+                                          warping_engine_uint32 *a_out, warping_engine_uint32 a_n)
+{
+  warping_engine_uint32 i;
+
+  for(i = 0; i < a_n; i++)
+    a_out[i] = warping_engine_sample(a_job->m_input, a_job->m_input_pitch, a_job->m_input_width,
+                                     a_job->m_input_height, a_coords[i], a_job->m_outside_color);
+}
+
+#ifdef WARPING_ENGINE_CPU_X86
+
+__attribute__((target("sse4.1")))
+static inline __m128i warping_engine_cpu_blendSse41(__m128i a_t00, __m128i a_t10, __m128i a_t01, __m128i a_t11,
+                                                    __m128i a_fx, __m128i a_fy)
+{
+  const __m128i mask = _mm_set1_epi32(0xff);
+  const __m128i round = _mm_set1_epi32(WARPING_ENGINE_CPU_ROUND);
+  __m128i result = _mm_setzero_si128();
+  __m128i shift, t00, t10, t01, t11, h0, h1, c;
+  int k;
+
+  for(k = 0; k < 32; k += 8)
+  {
+    shift = _mm_cvtsi32_si128(k);
+    t00 = _mm_and_si128(_mm_srl_epi32(a_t00, shift), mask);
+    t10 = _mm_and_si128(_mm_srl_epi32(a_t10, shift), mask);
+    t01 = _mm_and_si128(_mm_srl_epi32(a_t01, shift), mask);
+    t11 = _mm_and_si128(_mm_srl_epi32(a_t11, shift), mask);
+    h0 = _mm_add_epi32(_mm_slli_epi32(t00, WARPING_ENGINE_WEIGHT_BITS), _mm_mullo_epi32(a_fx, _mm_sub_epi32(t10, t00)));
+    h1 = _mm_add_epi32(_mm_slli_epi32(t01, WARPING_ENGINE_WEIGHT_BITS), _mm_mullo_epi32(a_fx, _mm_sub_epi32(t11, t01)));
+    c = _mm_add_epi32(_mm_slli_epi32(h0, WARPING_ENGINE_WEIGHT_BITS), _mm_mullo_epi32(a_fy, _mm_sub_epi32(h1, h0)));
+    c = _mm_srli_epi32(_mm_add_epi32(c, round), 2 * WARPING_ENGINE_WEIGHT_BITS);
+    result = _mm_or_si128(result, _mm_sll_epi32(c, shift));
+  }
+
+  return result;
+}
+
+/* SSE has no gather, the taps are fetched with scalar loads */
+__attribute__((target("sse4.1")))
+static void warping_engine_cpu_spanSse41(const warping_engine_cpu_job *a_job, const warping_engine_coordinate *a_coords,
+                                         warping_engine_uint32 *a_out, warping_engine_uint32 a_n)
+{
+  const __m128i mask = _mm_set1_epi32(WARPING_ENGINE_WEIGHT_ONE - 1);
+  warping_engine_uint32 taps[4][8];
+  warping_engine_uint32 i;
+  __m128 p0, p1;
+  __m128i fx, fy;
+
+  for(i = 0; i + 4 <= a_n; i += 4)
+  {
+    warping_engine_cpu_taps(a_job, a_coords + i, 4, taps);
+
+    p0 = _mm_loadu_ps((const float *) (a_coords + i));
+    p1 = _mm_loadu_ps((const float *) (a_coords + i + 2));
+    fx = _mm_castps_si128(_mm_shuffle_ps(p0, p1, _MM_SHUFFLE(2, 0, 2, 0)));
+    fy = _mm_castps_si128(_mm_shuffle_ps(p0, p1, _MM_SHUFFLE(3, 1, 3, 1)));
+    fx = _mm_and_si128(_mm_srai_epi32(fx, WARPING_ENGINE_COORD_SHIFT - WARPING_ENGINE_WEIGHT_BITS), mask);
+    fy = _mm_and_si128(_mm_srai_epi32(fy, WARPING_ENGINE_COORD_SHIFT - WARPING_ENGINE_WEIGHT_BITS), mask);
+
+    _mm_storeu_si128((__m128i *) (a_out + i),
+                     warping_engine_cpu_blendSse41(_mm_loadu_si128((const __m128i *) taps[0]),
+                                                   _mm_loadu_si128((const __m128i *) taps[1]),
+                                                   _mm_loadu_si128((const __m128i *) taps[2]),
+                                                   _mm_loadu_si128((const __m128i *) taps[3]), fx, fy));
+  }
+
+  warping_engine_cpu_spanScalar(a_job, a_coords + i, a_out + i, a_n - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i warping_engine_cpu_blendAvx2(__m256i a_t00, __m256i a_t10, __m256i a_t01, __m256i a_t11,
+                                                   __m256i a_fx, __m256i a_fy)
+{
+  const __m256i mask = _mm256_set1_epi32(0xff);
+  const __m256i round = _mm256_set1_epi32(WARPING_ENGINE_CPU_ROUND);
+  __m256i result = _mm256_setzero_si256();
+  __m256i t00, t10, t01, t11, h0, h1, c;
+  __m128i shift;
+  int k;
+
+  for(k = 0; k < 32; k += 8)
+  {
+    shift = _mm_cvtsi32_si128(k);
+    t00 = _mm256_and_si256(_mm256_srl_epi32(a_t00, shift), mask);
+    t10 = _mm256_and_si256(_mm256_srl_epi32(a_t10, shift), mask);
+    t01 = _mm256_and_si256(_mm256_srl_epi32(a_t01, shift), mask);
+    t11 = _mm256_and_si256(_mm256_srl_epi32(a_t11, shift), mask);
+    h0 = _mm256_add_epi32(_mm256_slli_epi32(t00, WARPING_ENGINE_WEIGHT_BITS),
+                          _mm256_mullo_epi32(a_fx, _mm256_sub_epi32(t10, t00)));
+    h1 = _mm256_add_epi32(_mm256_slli_epi32(t01, WARPING_ENGINE_WEIGHT_BITS),
+                          _mm256_mullo_epi32(a_fx, _mm256_sub_epi32(t11, t01)));
+    c = _mm256_add_epi32(_mm256_slli_epi32(h0, WARPING_ENGINE_WEIGHT_BITS),
+                         _mm256_mullo_epi32(a_fy, _mm256_sub_epi32(h1, h0)));
+    c = _mm256_srli_epi32(_mm256_add_epi32(c, round), 2 * WARPING_ENGINE_WEIGHT_BITS);
+    result = _mm256_or_si256(result, _mm256_sll_epi32(c, shift));
+  }
+
+  return result;
+}
+
+/* one tap of 8 pixels, lanes outside the image get the outside color
+ * without touching memory */
+__attribute__((target("avx2")))
+static inline __m256i warping_engine_cpu_gatherAvx2(const warping_engine_cpu_job *a_job, __m256i a_x, __m256i a_y)
+{
+  const __m256i width = _mm256_set1_epi32((int) a_job->m_input_width);
+  const __m256i height = _mm256_set1_epi32((int) a_job->m_input_height);
+  const __m256i minus_one = _mm256_set1_epi32(-1);
+  __m256i inside, index;
+
+  inside = _mm256_and_si256(_mm256_and_si256(_mm256_cmpgt_epi32(a_x, minus_one), _mm256_cmpgt_epi32(width, a_x)),
+                            _mm256_and_si256(_mm256_cmpgt_epi32(a_y, minus_one), _mm256_cmpgt_epi32(height, a_y)));
+  index = _mm256_add_epi32(_mm256_mullo_epi32(a_y, _mm256_set1_epi32((int) a_job->m_input_pitch)), a_x);
+
+  return _mm256_mask_i32gather_epi32(_mm256_set1_epi32((int) a_job->m_outside_color),
+                                     (const int *) a_job->m_input, index, inside, 4);
+}
+
+__attribute__((target("avx2")))
+static void warping_engine_cpu_spanAvx2(const warping_engine_cpu_job *a_job, const warping_engine_coordinate *a_coords,
+                                        warping_engine_uint32 *a_out, warping_engine_uint32 a_n)
+{
+  const __m256i deinterleave = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+  const __m256i mask = _mm256_set1_epi32(WARPING_ENGINE_WEIGHT_ONE - 1);
+  const __m256i one = _mm256_set1_epi32(1);
+  __m256i p0, p1, px, py, x0, y0, x1, y1, fx, fy;
+  warping_engine_uint32 i;
+
+  for(i = 0; i + 8 <= a_n; i += 8)
+  {
+    /* x0 y0 x1 y1 .. to x0 x1 .. and y0 y1 .. */
+    p0 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i *) (a_coords + i)), deinterleave);
+    p1 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i *) (a_coords + i + 4)), deinterleave);
+    px = _mm256_permute2x128_si256(p0, p1, 0x20);
+    py = _mm256_permute2x128_si256(p0, p1, 0x31);
+
+    x0 = _mm256_srai_epi32(px, WARPING_ENGINE_COORD_SHIFT);
+    y0 = _mm256_srai_epi32(py, WARPING_ENGINE_COORD_SHIFT);
+    x1 = _mm256_add_epi32(x0, one);
+    y1 = _mm256_add_epi32(y0, one);
+    fx = _mm256_and_si256(_mm256_srai_epi32(px, WARPING_ENGINE_COORD_SHIFT - WARPING_ENGINE_WEIGHT_BITS), mask);
+    fy = _mm256_and_si256(_mm256_srai_epi32(py, WARPING_ENGINE_COORD_SHIFT - WARPING_ENGINE_WEIGHT_BITS), mask);
+
+    _mm256_storeu_si256((__m256i *) (a_out + i),
+                        warping_engine_cpu_blendAvx2(warping_engine_cpu_gatherAvx2(a_job, x0, y0),
+                                                     warping_engine_cpu_gatherAvx2(a_job, x1, y0),
+                                                     warping_engine_cpu_gatherAvx2(a_job, x0, y1),
+                                                     warping_engine_cpu_gatherAvx2(a_job, x1, y1), fx, fy));
+  }
+
+  warping_engine_cpu_spanScalar(a_job, a_coords + i, a_out + i, a_n - i);
+}
+
+#endif // WARPING_ENGINE_CPU_X86
+
+#ifdef WARPING_ENGINE_CPU_NEON
+
+static inline uint32x4_t warping_engine_cpu_blendNeon(uint32x4_t a_t00, uint32x4_t a_t10, uint32x4_t a_t01,
+                                                      uint32x4_t a_t11, int32x4_t a_fx, int32x4_t a_fy)
+{
+  const uint32x4_t mask = vdupq_n_u32(0xff);
+  const uint32x4_t round = vdupq_n_u32(WARPING_ENGINE_CPU_ROUND);
+  uint32x4_t result = vdupq_n_u32(0);
+  int32x4_t t00, t10, t01, t11, h0, h1, c;
+  int32x4_t down, up;
+  int k;
+
+  for(k = 0; k < 32; k += 8)
+  {
+    down = vdupq_n_s32(-k);
+    up = vdupq_n_s32(k);
+    t00 = vreinterpretq_s32_u32(vandq_u32(vshlq_u32(a_t00, down), mask));
+    t10 = vreinterpretq_s32_u32(vandq_u32(vshlq_u32(a_t10, down), mask));
+    t01 = vreinterpretq_s32_u32(vandq_u32(vshlq_u32(a_t01, down), mask));
+    t11 = vreinterpretq_s32_u32(vandq_u32(vshlq_u32(a_t11, down), mask));
+    h0 = vmlaq_s32(vshlq_n_s32(t00, WARPING_ENGINE_WEIGHT_BITS), a_fx, vsubq_s32(t10, t00));
+    h1 = vmlaq_s32(vshlq_n_s32(t01, WARPING_ENGINE_WEIGHT_BITS), a_fx, vsubq_s32(t11, t01));
+    c = vmlaq_s32(vshlq_n_s32(h0, WARPING_ENGINE_WEIGHT_BITS), a_fy, vsubq_s32(h1, h0));
+    result = vorrq_u32(result, vshlq_u32(vshrq_n_u32(vaddq_u32(vreinterpretq_u32_s32(c), round),
+                                                     2 * WARPING_ENGINE_WEIGHT_BITS), up));
+  }
+
+  return result;
+}
+
+static void warping_engine_cpu_spanNeon(const warping_engine_cpu_job *a_job, const warping_engine_coordinate *a_coords,
+                                        warping_engine_uint32 *a_out, warping_engine_uint32 a_n)
+{
+  const int32x4_t mask = vdupq_n_s32(WARPING_ENGINE_WEIGHT_ONE - 1);
+  warping_engine_uint32 taps[4][8];
+  warping_engine_uint32 i;
+  int32x4x2_t p;
+  int32x4_t fx, fy;
+
+  for(i = 0; i + 4 <= a_n; i += 4)
+  {
+    warping_engine_cpu_taps(a_job, a_coords + i, 4, taps);
+
+    p = vld2q_s32((const int32_t *) (a_coords + i));
+    fx = vandq_s32(vshrq_n_s32(p.val[0], WARPING_ENGINE_COORD_SHIFT - WARPING_ENGINE_WEIGHT_BITS), mask);
+    fy = vandq_s32(vshrq_n_s32(p.val[1], WARPING_ENGINE_COORD_SHIFT - WARPING_ENGINE_WEIGHT_BITS), mask);
+
+    vst1q_u32(a_out + i, warping_engine_cpu_blendNeon(vld1q_u32(taps[0]), vld1q_u32(taps[1]),
+                                                      vld1q_u32(taps[2]), vld1q_u32(taps[3]), fx, fy));
+  }
+
+  warping_engine_cpu_spanScalar(a_job, a_coords + i, a_out + i, a_n - i);
+}
+
+#endif // WARPING_ENGINE_CPU_NEON
+
+/* pick the span kernel, NULL if the ISA is not available */
+static warping_engine_cpu_span warping_engine_cpu_selectSpan(warping_engine_cpu_isa *a_isa)
+{
+  if(*a_isa == WARPING_ENGINE_CPU_ISA_AUTO)
+  {
+#if defined(WARPING_ENGINE_CPU_NEON)
+    *a_isa = WARPING_ENGINE_CPU_ISA_NEON;
+#elif defined(WARPING_ENGINE_CPU_X86)
+    if(__builtin_cpu_supports("avx2"))
+      *a_isa = WARPING_ENGINE_CPU_ISA_AVX2;
+    else if(__builtin_cpu_supports("sse4.1"))
+      *a_isa = WARPING_ENGINE_CPU_ISA_SSE41;
+    else
+      *a_isa = WARPING_ENGINE_CPU_ISA_SCALAR;
+#else
+    *a_isa = WARPING_ENGINE_CPU_ISA_SCALAR;
+#endif
+  }
+
+  switch(*a_isa)
+  {
+    case WARPING_ENGINE_CPU_ISA_SCALAR:
+      return warping_engine_cpu_spanScalar;
+#ifdef WARPING_ENGINE_CPU_X86
+    case WARPING_ENGINE_CPU_ISA_SSE41:
+      return __builtin_cpu_supports("sse4.1") ? warping_engine_cpu_spanSse41 : NULL;
+    case WARPING_ENGINE_CPU_ISA_AVX2:
+      return __builtin_cpu_supports("avx2") ? warping_engine_cpu_spanAvx2 : NULL;
+#endif
+#ifdef WARPING_ENGINE_CPU_NEON
+    case WARPING_ENGINE_CPU_ISA_NEON:
+      return warping_engine_cpu_spanNeon;
+#endif
+    default:
+      return NULL;
+  }
+}
+
+/* tiles are numbered stripe by stripe, top to bottom within a stripe */
+static void warping_engine_cpu_tile(void *a_run, warping_engine_uint32 a_tile)
+{
+  const warping_engine_cpu_run *run = (const warping_engine_cpu_run *) a_run;
+  const warping_engine_cpu_job *job = run->m_job;
+  warping_engine_uint32 stripe = job->m_stripe_width ? job->m_stripe_width : job->m_output_width;
+  warping_engine_uint32 row_blocks = (job->m_output_height + WARPING_ENGINE_CPU_TILE_ROWS - 1) /
+                                     WARPING_ENGINE_CPU_TILE_ROWS;
+  warping_engine_uint32 sx = (a_tile / row_blocks) * stripe;
+  warping_engine_uint32 width = job->m_output_width - sx < stripe ? job->m_output_width - sx : stripe;
+  warping_engine_uint32 y = (a_tile % row_blocks) * WARPING_ENGINE_CPU_TILE_ROWS;
+  warping_engine_uint32 end = y + WARPING_ENGINE_CPU_TILE_ROWS;
+  warping_engine_uint32 valid, x;
+  warping_engine_uint64 index;
+  warping_engine_uint32 *out;
+
+  if(end > job->m_output_height)
+    end = job->m_output_height;
+
+  for(; y < end; y++)
+  {
+    index = (warping_engine_uint64) y * job->m_output_width + sx;
+    valid = 0;
+    if(index < job->m_coordinates_count)
+      valid = job->m_coordinates_count - index < width ? (warping_engine_uint32) (job->m_coordinates_count - index) : width;
+
+    out = job->m_output + (size_t) y * job->m_output_pitch + sx;
+    if(valid)
+      run->m_cpu->m_span(job, job->m_coordinates + index, out, valid);
+    for(x = valid; x < width; x++)
+      out[x] = job->m_outside_color;
+  }
+}
+
+warping_engine_cpu *warping_engine_cpu_create(warping_engine_uint32 a_threads, warping_engine_cpu_isa a_isa)
+{
+  warping_engine_cpu *cpu;
+
+  cpu = (warping_engine_cpu *) calloc(1, sizeof(*cpu));
+  if(cpu == NULL)
+    return NULL;
+
+  cpu->m_isa = a_isa;
+  cpu->m_span = warping_engine_cpu_selectSpan(&cpu->m_isa);
+  if(cpu->m_span != NULL)
+    cpu->m_pool = warping_engine_pool_create(a_threads);
+  if(cpu->m_pool == NULL)
+  {
+    free(cpu);
+    return NULL;
+  }
+
+  return cpu;
+}
+
+void warping_engine_cpu_destroy(warping_engine_cpu *a_cpu)
+{
+  if(a_cpu == NULL)
+    return;
+
+  warping_engine_pool_destroy(a_cpu->m_pool);
+  free(a_cpu);
+}
+
+warping_engine_cpu_isa warping_engine_cpu_getIsa(const warping_engine_cpu *a_cpu)
+{
+  return a_cpu->m_isa;
+}
+
+const char *warping_engine_cpu_isaName(warping_engine_cpu_isa a_isa)
+{
+  switch(a_isa)
+  {
+    case WARPING_ENGINE_CPU_ISA_AUTO:   return "auto";
+    case WARPING_ENGINE_CPU_ISA_SCALAR: return "scalar";
+    case WARPING_ENGINE_CPU_ISA_SSE41:  return "sse4.1";
+    case WARPING_ENGINE_CPU_ISA_AVX2:   return "avx2";
+    case WARPING_ENGINE_CPU_ISA_NEON:   return "neon";
+  }
+
+  return "unknown";
+}
+
+void warping_engine_cpu_warp(warping_engine_cpu *a_cpu, const warping_engine_cpu_job *a_job)
+{
+  warping_engine_cpu_run run = { a_cpu, a_job };
+  warping_engine_uint32 stripe, stripes, row_blocks;
+
+  if(a_job->m_output_width == 0 || a_job->m_output_height == 0)
+    return;
+
+  stripe = a_job->m_stripe_width ? a_job->m_stripe_width : a_job->m_output_width;
+  stripes = (a_job->m_output_width + stripe - 1) / stripe;
+  row_blocks = (a_job->m_output_height + WARPING_ENGINE_CPU_TILE_ROWS - 1) / WARPING_ENGINE_CPU_TILE_ROWS;
+
+  warping_engine_pool_run(a_cpu->m_pool, stripes * row_blocks, warping_engine_cpu_tile, &run);
+}
@@ -0,0 +1,67 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : CPU implementation of the engine's warp for machines without
+ *            the engine or when it is overloaded. Output is bit exact with
+ *            the reference pixel pipeline in warping_engine_sample.h.
+ *            Frames are split into tiles of one stripe and a block of rows
+ *            that run on a pool of threads, pixels are sampled with SSE4.1,
+ *            AVX2 or NEON where available.
+ ****************************************************************************/
+
+#ifndef WARPING_ENGINE_CPU_H_
+#define WARPING_ENGINE_CPU_H_
+
+#include "warping_engine_sample.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  WARPING_ENGINE_CPU_ISA_AUTO = 0,              // best one the CPU supports
+  WARPING_ENGINE_CPU_ISA_SCALAR,
+  WARPING_ENGINE_CPU_ISA_SSE41,
+  WARPING_ENGINE_CPU_ISA_AVX2,
+  WARPING_ENGINE_CPU_ISA_NEON,
+} warping_engine_cpu_isa;
+
+/* A job with the meaning of warping_engine_job, but with CPU pointers.
+ * Pitches are in pixels. A band of output rows is warped by moving
+ * m_output and m_coordinates to its first row and reducing
+ * m_coordinates_count accordingly, like the engine does for bands. */
+typedef struct
+{
+  const warping_engine_coordinate *m_coordinates;
+  warping_engine_uint32 m_coordinates_count;
+  const warping_engine_uint32 *m_input;
+  warping_engine_uint32 m_input_width;
+  warping_engine_uint32 m_input_height;
+  warping_engine_uint32 m_input_pitch;
+  warping_engine_uint32 m_outside_color;
+  warping_engine_uint32 *m_output;
+  warping_engine_uint32 m_output_width;
+  warping_engine_uint32 m_output_height;
+  warping_engine_uint32 m_output_pitch;
+  warping_engine_uint32 m_stripe_width;         // 0: one stripe
+} warping_engine_cpu_job;
+
+typedef struct warping_engine_cpu_tag warping_engine_cpu;
+
+/* a_threads: worker threads including the caller, 0 for one per CPU.
+ * Returns NULL if the ISA is not supported */
+warping_engine_cpu *warping_engine_cpu_create(warping_engine_uint32 a_threads, warping_engine_cpu_isa a_isa);
+void warping_engine_cpu_destroy(warping_engine_cpu *a_cpu);
+
+warping_engine_cpu_isa warping_engine_cpu_getIsa(const warping_engine_cpu *a_cpu);
+const char *warping_engine_cpu_isaName(warping_engine_cpu_isa a_isa);
+
+/* warp a frame, returns when it is done. Calls are serialized */
+void warping_engine_cpu_warp(warping_engine_cpu *a_cpu, const warping_engine_cpu_job *a_job);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WARPING_ENGINE_CPU_H_
@@ -0,0 +1,154 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Benchmark of the CPU warper. Warps a rotated and scaled mesh
+ *            with every ISA and thread count, checks the output against the
+ *            scalar reference and prints the throughput.
+ *            usage: warping_engine_cpu_bench [width height [frames]]
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "warping_engine_cpu.h"
+
+#define BENCH_INPUT_WIDTH          1920
+#define BENCH_INPUT_HEIGHT         1080
+#define BENCH_STRIPE_WIDTH         128
+
+static double bench_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* rotate by 10 degrees around the center and scale by 1.1, corners fall
+ * outside the input */
+static void bench_mesh(warping_engine_coordinate *a_mesh, unsigned a_width, unsigned a_height)
+{
+  double c = cos(10.0 * M_PI / 180.0) / 1.1, s = sin(10.0 * M_PI / 180.0) / 1.1;
+  double sx = (double) BENCH_INPUT_WIDTH / a_width, sy = (double) BENCH_INPUT_HEIGHT / a_height;
+  double dx, dy;
+  unsigned x, y;
+
+  for(y = 0; y < a_height; y++)
+  {
+    for(x = 0; x < a_width; x++)
+    {
+      dx = (x - a_width / 2.0) * sx;
+      dy = (y - a_height / 2.0) * sy;
+      a_mesh[y * a_width + x].x = (int) ((c * dx - s * dy + BENCH_INPUT_WIDTH / 2.0) * WARPING_ENGINE_COORD_ONE);
+      a_mesh[y * a_width + x].y = (int) ((s * dx + c * dy + BENCH_INPUT_HEIGHT / 2.0) * WARPING_ENGINE_COORD_ONE);
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  static const warping_engine_cpu_isa isas[] = {
+    WARPING_ENGINE_CPU_ISA_SCALAR, WARPING_ENGINE_CPU_ISA_SSE41,
+    WARPING_ENGINE_CPU_ISA_AVX2, WARPING_ENGINE_CPU_ISA_NEON,
+  };
+  unsigned width = 1920, height = 1080, frames = 20;
+  unsigned threads, max_threads, i, f;
+  warping_engine_uint32 *input, *reference, *output;
+  warping_engine_coordinate *mesh;
+  warping_engine_cpu_job job;
+  warping_engine_cpu *cpu;
+  double start, elapsed;
+  int failed = 0;
+
+  if(argc >= 3)
+  {
+    width = strtoul(argv[1], NULL, 0);
+    height = strtoul(argv[2], NULL, 0);
+  }
+  if(argc >= 4)
+    frames = strtoul(argv[3], NULL, 0);
+  if(width == 0 || height == 0 || frames == 0)
+  {
+    fprintf(stderr, "usage: %s [width height [frames]]\n", argv[0]);
+    return 1;
+  }
+
+  input = malloc(sizeof(*input) * BENCH_INPUT_WIDTH * BENCH_INPUT_HEIGHT);
+  mesh = malloc(sizeof(*mesh) * width * height);
+  reference = malloc(sizeof(*reference) * width * height);
+  output = malloc(sizeof(*output) * width * height);
+  if(!input || !mesh || !reference || !output)
+  {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  srand(1);
+  for(i = 0; i < BENCH_INPUT_WIDTH * BENCH_INPUT_HEIGHT; i++)
+    input[i] = ((warping_engine_uint32) rand() << 16) ^ (warping_engine_uint32) rand();
+  bench_mesh(mesh, width, height);
+
+  memset(&job, 0, sizeof(job));
+  job.m_coordinates = mesh;
+  job.m_coordinates_count = width * height;
+  job.m_input = input;
+  job.m_input_width = BENCH_INPUT_WIDTH;
+  job.m_input_height = BENCH_INPUT_HEIGHT;
+  job.m_input_pitch = BENCH_INPUT_WIDTH;
+  job.m_outside_color = 0xff000000u;
+  job.m_output_width = width;
+  job.m_output_height = height;
+  job.m_output_pitch = width;
+  job.m_stripe_width = BENCH_STRIPE_WIDTH;
+
+  cpu = warping_engine_cpu_create(1, WARPING_ENGINE_CPU_ISA_SCALAR);
+  job.m_output = reference;
+  warping_engine_cpu_warp(cpu, &job);
+  warping_engine_cpu_destroy(cpu);
+
+  max_threads = (unsigned) sysconf(_SC_NPROCESSORS_ONLN);
+  printf("%ux%u from %ux%u, stripe width %u, %u frames\n", width, height,
+         BENCH_INPUT_WIDTH, BENCH_INPUT_HEIGHT, BENCH_STRIPE_WIDTH, frames);
+
+  job.m_output = output;
+  for(i = 0; i < sizeof(isas) / sizeof(isas[0]); i++)
+  {
+    for(threads = 1;; threads = threads * 2 < max_threads ? threads * 2 : max_threads)
+    {
+      cpu = warping_engine_cpu_create(threads, isas[i]);
+      if(cpu == NULL)
+        break;
+
+      memset(output, 0, sizeof(*output) * width * height);
+      warping_engine_cpu_warp(cpu, &job);
+      if(memcmp(output, reference, sizeof(*output) * width * height))
+      {
+        printf("%-7s %2u threads: output differs from the reference\n", warping_engine_cpu_isaName(isas[i]), threads);
+        failed = 1;
+      }
+
+      start = bench_now();
+      for(f = 0; f < frames; f++)
+        warping_engine_cpu_warp(cpu, &job);
+      elapsed = bench_now() - start;
+
+      printf("%-7s %2u threads: %8.2f ms/frame %8.1f Mpixel/s\n", warping_engine_cpu_isaName(isas[i]), threads,
+             elapsed * 1e3 / frames, (double) width * height * frames / elapsed * 1e-6);
+      warping_engine_cpu_destroy(cpu);
+
+      if(threads >= max_threads)
+        break;
+    }
+  }
+
+  free(output);
+  free(reference);
+  free(mesh);
+  free(input);
+
+  return failed;
+}
@@ -0,0 +1,245 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Engine and CPU frame split, see warping_engine_hybrid.h.
+ *            With q the time a job waits for the engine, e the engine time
+ *            and c the CPU time per row, the CPU gets the r of h rows with
+ *              q + (h - r) * e = r * c
+ ****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "warping_engine_hybrid.h"
+
+/* meshes whose engine throughput is tracked */
+#define WARPING_ENGINE_HYBRID_MESHES         16
+/* share of rows given to the CPU until both sides were measured */
+#define WARPING_ENGINE_HYBRID_PROBE_SHARE    8
+/* weight of a new sample in the running averages */
+#define WARPING_ENGINE_HYBRID_AVERAGE        8
+
+typedef struct
+{
+  warping_engine_uint32 m_address;          /* coordinates address          */
+  warping_engine_uint32 m_size;             /* WARPING_ENGINE_MAKE_SIZE     */
+  warping_engine_uint64 m_used;             /* for replacing, 0: free       */
+  double m_cycles_per_row;                  /* engine, 0: not measured      */
+  double m_cpu_ns_per_row;                  /* CPU, 0: not measured         */
+} warping_engine_hybrid_mesh;
+
+struct warping_engine_hybrid_tag
+{
+  warping_engine_handle m_engine;
+  warping_engine_cpu *m_cpu;
+  warping_engine_uint32 m_max_cpu_percent;
+
+  double m_ns_per_cycle;                    /* engine clock, 0: not measured */
+  double m_queue_ns;                        /* waiting for the engine       */
+  warping_engine_uint64 m_frames;
+  warping_engine_hybrid_mesh m_mesh[WARPING_ENGINE_HYBRID_MESHES];
+
+  warping_engine_hybrid_stats m_stats;
+};
+
+static warping_engine_uint64 warping_engine_hybrid_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (warping_engine_uint64) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* running average, rates start with their first sample */
+static void warping_engine_hybrid_average(double *a_average, double a_sample)
+{
+  if(*a_average == 0)
+    *a_average = a_sample;
+  else
+    *a_average += (a_sample - *a_average) / WARPING_ENGINE_HYBRID_AVERAGE;
+}
+
+static warping_engine_hybrid_mesh *warping_engine_hybrid_lookup(warping_engine_hybrid *a_hybrid,
+                                                                warping_engine_uint32 a_address,
+                                                                warping_engine_uint32 a_size)
+{
+  warping_engine_hybrid_mesh *mesh = &a_hybrid->m_mesh[0];
+  warping_engine_uint32 i;
+
+  for(i = 0; i < WARPING_ENGINE_HYBRID_MESHES; i++)
+  {
+    if(a_hybrid->m_mesh[i].m_used && a_hybrid->m_mesh[i].m_address == a_address &&
+       a_hybrid->m_mesh[i].m_size == a_size)
+    {
+      mesh = &a_hybrid->m_mesh[i];
+      mesh->m_used = ++a_hybrid->m_frames;
+      return mesh;
+    }
+    if(a_hybrid->m_mesh[i].m_used < mesh->m_used)
+      mesh = &a_hybrid->m_mesh[i];
+  }
+
+  /* replace the least recently used one */
+  memset(mesh, 0, sizeof(*mesh));
+  mesh->m_address = a_address;
+  mesh->m_size = a_size;
+  mesh->m_used = ++a_hybrid->m_frames;
+
+  return mesh;
+}
+
+static warping_engine_uint32 warping_engine_hybrid_split(const warping_engine_hybrid *a_hybrid,
+                                                         const warping_engine_hybrid_mesh *a_mesh,
+                                                         warping_engine_uint32 a_height)
+{
+  warping_engine_uint32 limit = (warping_engine_uint32) ((warping_engine_uint64) a_height *
+                                                         a_hybrid->m_max_cpu_percent / 100);
+  double engine_row, rows;
+
+  /* the engine keeps a row so it is measured further */
+  if(limit >= a_height)
+    limit = a_height - 1;
+
+  if(a_mesh->m_cycles_per_row == 0 || a_mesh->m_cpu_ns_per_row == 0 || a_hybrid->m_ns_per_cycle == 0)
+  {
+    rows = a_height / WARPING_ENGINE_HYBRID_PROBE_SHARE;
+  }
+  else
+  {
+    engine_row = a_mesh->m_cycles_per_row * a_hybrid->m_ns_per_cycle;
+    rows = (a_hybrid->m_queue_ns + a_height * engine_row) / (engine_row + a_mesh->m_cpu_ns_per_row) + 0.5;
+  }
+
+  return rows < limit ? (warping_engine_uint32) rows : limit;
+}
+
+/* start the upper a_rows of the frame on the engine, false if the engine
+ * did not take the job */
+static warping_engine_bool warping_engine_hybrid_submit(warping_engine_hybrid *a_hybrid,
+                                                        const warping_engine_hybrid_frame *a_frame,
+                                                        warping_engine_uint32 a_rows, warping_engine_uint32 *a_seq)
+{
+  const warping_engine_cpu_job *job = &a_frame->m_cpu;
+  warping_engine_handle engine = a_hybrid->m_engine;
+  warping_engine_uint64 count = (warping_engine_uint64) a_rows * job->m_output_width;
+  warping_engine_uint32 seq = warping_engine_linux_getSequence(engine);
+
+  if(count > job->m_coordinates_count)
+    count = job->m_coordinates_count;
+
+  warping_engine_setCoordinatesAddress(engine, a_frame->m_coordinates_address);
+  warping_engine_setCoordinatesCount(engine, (warping_engine_uint32) count);
+  warping_engine_setInputImageAddress(engine, a_frame->m_input_address);
+  warping_engine_setInputImageSize(engine, job->m_input_width, job->m_input_height);
+  warping_engine_setInputImagePitch(engine, job->m_input_pitch);
+  warping_engine_setOutsideColor(engine, job->m_outside_color);
+  warping_engine_setOutputImageAddress(engine, a_frame->m_output_address);
+  warping_engine_setOutputImageSize(engine, job->m_output_width, a_rows);
+  warping_engine_setOutputImagePitch(engine, job->m_output_pitch);
+  warping_engine_setStripeWidth(engine, job->m_stripe_width);
+  warping_engine_setPerformanceCounterEvent(engine, 0, WARPING_ENGINE_PFC_EVENT_CLOCK);
+  warping_engine_enablePerformanceCounters(engine, 1);
+  warping_engine_setEnabled(engine, WARPING_ENGINE_TRUE);
+
+  *a_seq = warping_engine_linux_getSequence(engine);
+
+  return *a_seq != seq;
+}
+
+warping_engine_hybrid *warping_engine_hybrid_create(warping_engine_handle a_engine, warping_engine_cpu *a_cpu,
+                                                    warping_engine_uint32 a_max_cpu_percent)
+{
+  warping_engine_hybrid *hybrid;
+
+  if(a_engine == NULL || a_cpu == NULL)
+    return NULL;
+
+  hybrid = (warping_engine_hybrid *) calloc(1, sizeof(*hybrid));
+  if(hybrid == NULL)
+    return NULL;
+
+  hybrid->m_engine = a_engine;
+  hybrid->m_cpu = a_cpu;
+  hybrid->m_max_cpu_percent = a_max_cpu_percent > 100 ? 100 : a_max_cpu_percent;
+
+  return hybrid;
+}
+
+void warping_engine_hybrid_destroy(warping_engine_hybrid *a_hybrid)
+{
+  free(a_hybrid);
+}
+
+warping_engine_bool warping_engine_hybrid_warp(warping_engine_hybrid *a_hybrid,
+                                               const warping_engine_hybrid_frame *a_frame)
+{
+  const warping_engine_cpu_job *job = &a_frame->m_cpu;
+  warping_engine_hybrid_stats *stats = &a_hybrid->m_stats;
+  warping_engine_hybrid_mesh *mesh;
+  warping_engine_completion record;
+  warping_engine_cpu_job band;
+  warping_engine_uint32 rows, seq = 0;
+  warping_engine_uint64 start, offset;
+  warping_engine_bool submitted;
+
+  if(job->m_output_width == 0 || job->m_output_height == 0)
+    return WARPING_ENGINE_TRUE;
+
+  mesh = warping_engine_hybrid_lookup(a_hybrid, a_frame->m_coordinates_address,
+                                      WARPING_ENGINE_MAKE_SIZE(job->m_output_width, job->m_output_height));
+  memset(stats, 0, sizeof(*stats));
+  stats->m_cpu_rows = warping_engine_hybrid_split(a_hybrid, mesh, job->m_output_height);
+
+  rows = job->m_output_height - stats->m_cpu_rows;
+  submitted = warping_engine_hybrid_submit(a_hybrid, a_frame, rows, &seq);
+  if(!submitted)
+  {
+    rows = 0;
+    stats->m_cpu_rows = job->m_output_height;
+  }
+
+  /* the CPU band starts below the engine band */
+  band = *job;
+  offset = (warping_engine_uint64) rows * job->m_output_width;
+  band.m_coordinates_count = offset < job->m_coordinates_count ? job->m_coordinates_count - (warping_engine_uint32) offset : 0;
+  if(band.m_coordinates_count)
+    band.m_coordinates += offset;
+  band.m_output += (size_t) rows * job->m_output_pitch;
+  band.m_output_height = stats->m_cpu_rows;
+
+  start = warping_engine_hybrid_now();
+  if(stats->m_cpu_rows)
+    warping_engine_cpu_warp(a_hybrid->m_cpu, &band);
+  stats->m_cpu_ns = warping_engine_hybrid_now() - start;
+  if(stats->m_cpu_rows)
+    warping_engine_hybrid_average(&mesh->m_cpu_ns_per_row, (double) stats->m_cpu_ns / stats->m_cpu_rows);
+
+  if(!submitted)
+    return WARPING_ENGINE_TRUE;
+
+  /* the handle is ours, the last record is the one of this job */
+  if(!warping_engine_linux_waitIdle(a_hybrid->m_engine) ||
+     !warping_engine_linux_getCompletion(a_hybrid->m_engine, &record) || record.seq != seq ||
+     !(record.status & WARPING_ENGINE_IRQ_WARPING_FINISHED))
+    return WARPING_ENGINE_FALSE;
+
+  stats->m_engine_ns = record.complete_ns - record.submit_ns;
+  stats->m_queue_ns = record.start_ns - record.submit_ns;
+  stats->m_engine_cycles = record.pfc_count ? record.pfc_values[0] : 0;
+
+  a_hybrid->m_queue_ns += ((double) stats->m_queue_ns - a_hybrid->m_queue_ns) / WARPING_ENGINE_HYBRID_AVERAGE;
+  if(stats->m_engine_cycles)
+  {
+    warping_engine_hybrid_average(&a_hybrid->m_ns_per_cycle,
+                                  (double) (record.complete_ns - record.start_ns) / stats->m_engine_cycles);
+    warping_engine_hybrid_average(&mesh->m_cycles_per_row, (double) stats->m_engine_cycles / rows);
+  }
+
+  return WARPING_ENGINE_TRUE;
+}
+
+void warping_engine_hybrid_getStats(const warping_engine_hybrid *a_hybrid, warping_engine_hybrid_stats *a_stats)
+{
+  *a_stats = a_hybrid->m_stats;
+}
@@ -0,0 +1,67 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Splits frames between the engine and the CPU warper. The
+ *            engine warps the upper band of the output, the CPU the lower
+ *            band, and the split is chosen so both finish at the same time:
+ *            engine cycles per row are measured per mesh with the CLOCK
+ *            performance counter, the cycle time and the time frames wait
+ *            behind other streams come from the completion timestamps.
+ *            When the engine is overloaded the queueing time grows and the
+ *            CPU takes a larger band.
+ ****************************************************************************/
+
+#ifndef WARPING_ENGINE_HYBRID_H_
+#define WARPING_ENGINE_HYBRID_H_
+
+#include "warping_engine_linux.h"
+#include "warping_engine_cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A frame in both views: m_cpu holds the CPU mappings of the buffers and
+ * the geometry, the addresses are the ones of the same buffers for the
+ * engine. The throughput of the engine is tracked per coordinates address
+ * and output size, so a mesh should stay at the same address */
+typedef struct
+{
+  warping_engine_cpu_job m_cpu;
+  warping_engine_uint32 m_coordinates_address;
+  warping_engine_uint32 m_input_address;
+  warping_engine_uint32 m_output_address;
+} warping_engine_hybrid_frame;
+
+/* how the last frame went */
+typedef struct
+{
+  warping_engine_uint32 m_cpu_rows;         /* rows warped by the CPU       */
+  warping_engine_uint64 m_engine_ns;        /* submit to finished interrupt */
+  warping_engine_uint64 m_queue_ns;         /* of that waiting for the engine */
+  warping_engine_uint64 m_cpu_ns;           /* CPU warp                     */
+  warping_engine_uint32 m_engine_cycles;    /* CLOCK counter of the job     */
+} warping_engine_hybrid_stats;
+
+typedef struct warping_engine_hybrid_tag warping_engine_hybrid;
+
+/* a_engine is used by the hybrid only, it owns performance counter 0.
+ * a_max_cpu_percent limits the share of rows given to the CPU */
+warping_engine_hybrid *warping_engine_hybrid_create(warping_engine_handle a_engine, warping_engine_cpu *a_cpu,
+                                                    warping_engine_uint32 a_max_cpu_percent);
+void warping_engine_hybrid_destroy(warping_engine_hybrid *a_hybrid);
+
+/* warp a frame, returns when both parts are done. Frames the engine could
+ * not take are warped on the CPU completely. False if the engine job
+ * failed, the engine band of the output is undefined then */
+warping_engine_bool warping_engine_hybrid_warp(warping_engine_hybrid *a_hybrid,
+                                               const warping_engine_hybrid_frame *a_frame);
+
+void warping_engine_hybrid_getStats(const warping_engine_hybrid *a_hybrid, warping_engine_hybrid_stats *a_stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WARPING_ENGINE_HYBRID_H_
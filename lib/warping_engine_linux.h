@@ -0,0 +1,62 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Linux extensions of the warping engine API. The platform
+ *            settings passed to warping_engine_init() are the device path
+ *            (const char *), NULL opens /dev/warpingengine.
+ ****************************************************************************/
+
+#ifndef WARPING_ENGINE_LINUX_H_
+#define WARPING_ENGINE_LINUX_H_
+
+#include <sys/ioctl.h>
+#include "warping_engine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WARPING_ENGINE_LINUX_DEVICE          "/dev/warpingengine"
+
+/* buffer object allocated from the video memory and mapped for the CPU */
+typedef struct
+{
+  warping_engine_uint32 m_handle;
+  warping_engine_uint32 m_phys;             /* address for the engine       */
+  warping_engine_uint32 m_size;
+  void *m_virt;                             /* CPU mapping                  */
+} warping_engine_linux_buffer;
+
+/* device file of the handle, e.g. for further ioctls */
+int warping_engine_linux_getFd(warping_engine_handle a_handle);
+
+/* a_flags: WARPING_ENGINE_BO_* */
+warping_engine_bool warping_engine_linux_allocBuffer(warping_engine_handle a_handle, warping_engine_uint32 a_size,
+                                                     warping_engine_uint32 a_flags,
+                                                     warping_engine_linux_buffer *a_buffer);
+void warping_engine_linux_freeBuffer(warping_engine_handle a_handle, warping_engine_linux_buffer *a_buffer);
+
+/* cache maintenance around CPU accesses to a WARPING_ENGINE_BO_CACHED
+ * buffer, a_flags: WARPING_ENGINE_BO_SYNC_*. A size of 0 covers the buffer
+ * from a_offset to its end */
+warping_engine_bool warping_engine_linux_syncBuffer(warping_engine_handle a_handle,
+                                                    const warping_engine_linux_buffer *a_buffer,
+                                                    warping_engine_uint32 a_flags, warping_engine_uint32 a_offset,
+                                                    warping_engine_uint32 a_size);
+
+/* sequence number of the last job started with warping_engine_setEnabled() */
+warping_engine_uint32 warping_engine_linux_getSequence(warping_engine_handle a_handle);
+
+/* wait until all started jobs finished */
+warping_engine_bool warping_engine_linux_waitIdle(warping_engine_handle a_handle);
+
+/* completion record of the last finished job, false if there is none */
+warping_engine_bool warping_engine_linux_getCompletion(warping_engine_handle a_handle,
+                                                       warping_engine_completion *a_record);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WARPING_ENGINE_LINUX_H_
@@ -0,0 +1,428 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Coordinate table generator, see warping_engine_mesh.h. The
+ *            vector kernel is written once with GCC vector types and built
+ *            for each ISA with a target attribute.
+ ****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "warping_engine_mesh.h"
+#include "warping_engine_pool.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WARPING_ENGINE_MESH_X86
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define WARPING_ENGINE_MESH_NEON
+#endif
+
+#define WARPING_ENGINE_MESH_LANES            8
+/* rows per work item */
+#define WARPING_ENGINE_MESH_ROWS             8
+/* 15.16 range of a source position in pixels */
+#define WARPING_ENGINE_MESH_MIN              (-32768.0)
+#define WARPING_ENGINE_MESH_MAX              (32767.0)
+
+#define WARPING_ENGINE_MESH_INLINE           static inline __attribute__((always_inline))
+
+typedef float warping_engine_mesh_vf __attribute__((vector_size(4 * WARPING_ENGINE_MESH_LANES)));
+typedef int warping_engine_mesh_vi __attribute__((vector_size(4 * WARPING_ENGINE_MESH_LANES)));
+
+/* build row y of the table */
+typedef void (*warping_engine_mesh_row)(const warping_engine_mesh_desc *a_desc, warping_engine_uint32 a_y,
+                                        warping_engine_coordinate *a_row);
+
+struct warping_engine_mesh_tag
+{
+  warping_engine_cpu_isa m_isa;
+  warping_engine_mesh_row m_row;
+  warping_engine_pool *m_pool;
+};
+
+/* argument of the work items of a build */
+typedef struct
+{
+  const warping_engine_mesh *m_mesh;
+  const warping_engine_mesh_desc *m_desc;
+  warping_engine_coordinate *m_table;
+} warping_engine_mesh_run;
+
+/******************************************************************************
+ *         Double precision reference                                         *
+ ******************************************************************************/
+
+static void warping_engine_mesh_stagePoint(const warping_engine_mesh_stage *a_stage, double *a_x, double *a_y)
+{
+  const warping_engine_float *h = a_stage->m_homography;
+  const warping_engine_float *k = a_stage->m_k;
+  double x = *a_x, y = *a_y;
+  double xn, yn, r2, radial, r, theta, theta2, scale;
+
+  switch(a_stage->m_model)
+  {
+    case WARPING_ENGINE_MESH_HOMOGRAPHY:
+      r = h[6] * x + h[7] * y + h[8];
+      *a_x = (h[0] * x + h[1] * y + h[2]) / r;
+      *a_y = (h[3] * x + h[4] * y + h[5]) / r;
+      break;
+
+    case WARPING_ENGINE_MESH_RADIAL:
+      xn = (x - a_stage->m_cx) / a_stage->m_fx;
+      yn = (y - a_stage->m_cy) / a_stage->m_fy;
+      r2 = xn * xn + yn * yn;
+      radial = 1 + r2 * (k[0] + r2 * (k[1] + r2 * k[2]));
+      *a_x = (xn * radial + 2 * a_stage->m_p[0] * xn * yn + a_stage->m_p[1] * (r2 + 2 * xn * xn)) *
+             a_stage->m_fx + a_stage->m_cx;
+      *a_y = (yn * radial + a_stage->m_p[0] * (r2 + 2 * yn * yn) + 2 * a_stage->m_p[1] * xn * yn) *
+             a_stage->m_fy + a_stage->m_cy;
+      break;
+
+    case WARPING_ENGINE_MESH_FISHEYE:
+      xn = (x - a_stage->m_cx) / a_stage->m_fx;
+      yn = (y - a_stage->m_cy) / a_stage->m_fy;
+      r = sqrt(xn * xn + yn * yn);
+      theta = atan(r);
+      theta2 = theta * theta;
+      scale = r > 1e-8 ? theta * (1 + theta2 * (k[0] + theta2 * (k[1] + theta2 * (k[2] + theta2 * k[3])))) / r : 1;
+      *a_x = xn * scale * a_stage->m_fx + a_stage->m_cx;
+      *a_y = yn * scale * a_stage->m_fy + a_stage->m_cy;
+      break;
+  }
+}
+
+void warping_engine_mesh_mapPoint(const warping_engine_mesh_desc *a_desc, double a_x, double a_y,
+                                  double *a_source_x, double *a_source_y)
+{
+  warping_engine_uint32 i;
+
+  for(i = 0; i < a_desc->m_stage_count; i++)
+    warping_engine_mesh_stagePoint(&a_desc->m_stage[i], &a_x, &a_y);
+
+  *a_source_x = a_x;
+  *a_source_y = a_y;
+}
+
+static int warping_engine_mesh_fixed(double a_value)
+{
+  if(!(a_value >= WARPING_ENGINE_MESH_MIN))
+    a_value = WARPING_ENGINE_MESH_MIN;
+  if(a_value > WARPING_ENGINE_MESH_MAX)
+    a_value = WARPING_ENGINE_MESH_MAX;
+
+  return (int) floor(a_value * WARPING_ENGINE_COORD_ONE + 0.5);
+}
+
+static void warping_engine_mesh_rowScalar(const warping_engine_mesh_desc *a_desc, warping_engine_uint32 a_y,
+                                          warping_engine_coordinate *a_row)
+{
+  warping_engine_uint32 x;
+  double sx, sy;
+
+  for(x = 0; x < a_desc->m_width; x++)
+  {
+    warping_engine_mesh_mapPoint(a_desc, x, a_y, &sx, &sy);
+    a_row[x].x = warping_engine_mesh_fixed(sx);
+    a_row[x].y = warping_engine_mesh_fixed(sy);
+  }
+}
+
+/******************************************************************************
+ *         Vector kernel                                                      *
+ ******************************************************************************/
+
+WARPING_ENGINE_MESH_INLINE warping_engine_mesh_vf warping_engine_mesh_splat(float a_value)
+{
+  return (warping_engine_mesh_vf) {} + a_value;
+}
+
+/* lanes of a where the mask is set, of b elsewhere */
+WARPING_ENGINE_MESH_INLINE warping_engine_mesh_vf warping_engine_mesh_select(warping_engine_mesh_vi a_mask,
+                                                                             warping_engine_mesh_vf a_a,
+                                                                             warping_engine_mesh_vf a_b)
+{
+  return (warping_engine_mesh_vf) (((warping_engine_mesh_vi) a_a & a_mask) | ((warping_engine_mesh_vi) a_b & ~a_mask));
+}
+
+WARPING_ENGINE_MESH_INLINE warping_engine_mesh_vf warping_engine_mesh_sqrt(warping_engine_mesh_vf a_value)
+{
+#if defined(WARPING_ENGINE_MESH_X86) && defined(__SSE2__)
+  __m128 half[2];
+
+  memcpy(half, &a_value, sizeof(half));
+  half[0] = _mm_sqrt_ps(half[0]);
+  half[1] = _mm_sqrt_ps(half[1]);
+  memcpy(&a_value, half, sizeof(half));
+#elif defined(WARPING_ENGINE_MESH_NEON) && defined(__aarch64__)
+  float32x4_t half[2];
+
+  memcpy(half, &a_value, sizeof(half));
+  half[0] = vsqrtq_f32(half[0]);
+  half[1] = vsqrtq_f32(half[1]);
+  memcpy(&a_value, half, sizeof(half));
+#else
+  int i;
+
+  for(i = 0; i < WARPING_ENGINE_MESH_LANES; i++)
+    a_value[i] = sqrtf(a_value[i]);
+#endif
+
+  return a_value;
+}
+
+/* arctangent of values >= 0, reduced to |u| <= tan(pi/8) and the
+ * polynomial of the Cephes atanf() */
+WARPING_ENGINE_MESH_INLINE warping_engine_mesh_vf warping_engine_mesh_atan(warping_engine_mesh_vf a_value)
+{
+  warping_engine_mesh_vi big = a_value > 1.0f;
+  warping_engine_mesh_vf t = warping_engine_mesh_select(big, 1.0f / a_value, a_value);
+  warping_engine_mesh_vi mid = t > 0.414213562f;
+  warping_engine_mesh_vf u = warping_engine_mesh_select(mid, (t - 1.0f) / (t + 1.0f), t);
+  warping_engine_mesh_vf z = u * u;
+  warping_engine_mesh_vf p;
+
+  p = (((8.05374449538e-2f * z - 1.38776856032e-1f) * z + 1.99777106478e-1f) * z - 3.33329491539e-1f) * z * u + u;
+  p += warping_engine_mesh_select(mid, warping_engine_mesh_splat((float) M_PI_4), warping_engine_mesh_splat(0));
+
+  return warping_engine_mesh_select(big, (float) M_PI_2 - p, p);
+}
+
+WARPING_ENGINE_MESH_INLINE void warping_engine_mesh_stageVector(const warping_engine_mesh_stage *a_stage,
+                                                                warping_engine_mesh_vf *a_x,
+                                                                warping_engine_mesh_vf *a_y)
+{
+  const warping_engine_float *h = a_stage->m_homography;
+  const warping_engine_float *k = a_stage->m_k;
+  const warping_engine_float p1 = a_stage->m_p[0], p2 = a_stage->m_p[1];
+  warping_engine_mesh_vf x = *a_x, y = *a_y;
+  warping_engine_mesh_vf xn, yn, r2, radial, r, theta, theta2, scale;
+
+  switch(a_stage->m_model)
+  {
+    case WARPING_ENGINE_MESH_HOMOGRAPHY:
+      r = h[6] * x + h[7] * y + h[8];
+      *a_x = (h[0] * x + h[1] * y + h[2]) / r;
+      *a_y = (h[3] * x + h[4] * y + h[5]) / r;
+      break;
+
+    case WARPING_ENGINE_MESH_RADIAL:
+      xn = (x - a_stage->m_cx) * (1.0f / a_stage->m_fx);
+      yn = (y - a_stage->m_cy) * (1.0f / a_stage->m_fy);
+      r2 = xn * xn + yn * yn;
+      radial = 1.0f + r2 * (k[0] + r2 * (k[1] + r2 * k[2]));
+      *a_x = (xn * radial + 2 * p1 * xn * yn + p2 * (r2 + 2 * xn * xn)) * a_stage->m_fx + a_stage->m_cx;
+      *a_y = (yn * radial + p1 * (r2 + 2 * yn * yn) + 2 * p2 * xn * yn) * a_stage->m_fy + a_stage->m_cy;
+      break;
+
+    case WARPING_ENGINE_MESH_FISHEYE:
+      xn = (x - a_stage->m_cx) * (1.0f / a_stage->m_fx);
+      yn = (y - a_stage->m_cy) * (1.0f / a_stage->m_fy);
+      r = warping_engine_mesh_sqrt(xn * xn + yn * yn);
+      theta = warping_engine_mesh_atan(r);
+      theta2 = theta * theta;
+      scale = theta * (1.0f + theta2 * (k[0] + theta2 * (k[1] + theta2 * (k[2] + theta2 * k[3])))) / r;
+      scale = warping_engine_mesh_select(r > 1e-8f, scale, warping_engine_mesh_splat(1));
+      *a_x = xn * scale * a_stage->m_fx + a_stage->m_cx;
+      *a_y = yn * scale * a_stage->m_fy + a_stage->m_cy;
+      break;
+  }
+}
+
+/* 15.16 with the clamping and rounding of warping_engine_mesh_fixed() */
+WARPING_ENGINE_MESH_INLINE warping_engine_mesh_vi warping_engine_mesh_fixedVector(warping_engine_mesh_vf a_value)
+{
+  warping_engine_mesh_vi result;
+
+  a_value = warping_engine_mesh_select(a_value >= (float) WARPING_ENGINE_MESH_MIN, a_value,
+                                       warping_engine_mesh_splat(WARPING_ENGINE_MESH_MIN));
+  a_value = warping_engine_mesh_select(a_value <= (float) WARPING_ENGINE_MESH_MAX, a_value,
+                                       warping_engine_mesh_splat(WARPING_ENGINE_MESH_MAX));
+  a_value = a_value * (float) WARPING_ENGINE_COORD_ONE + 0.5f;
+
+  /* conversion truncates, step down where that rounded up */
+  result = __builtin_convertvector(a_value, warping_engine_mesh_vi);
+  return result + (__builtin_convertvector(result, warping_engine_mesh_vf) > a_value);
+}
+
+WARPING_ENGINE_MESH_INLINE void warping_engine_mesh_rowVector(const warping_engine_mesh_desc *a_desc,
+                                                              warping_engine_uint32 a_y,
+                                                              warping_engine_coordinate *a_row)
+{
+  const warping_engine_mesh_vf ramp = { 0, 1, 2, 3, 4, 5, 6, 7 };
+  int fx[WARPING_ENGINE_MESH_LANES], fy[WARPING_ENGINE_MESH_LANES];
+  warping_engine_uint32 x, i, n;
+  warping_engine_mesh_vf vx, vy;
+  warping_engine_mesh_vi ix, iy;
+
+  for(x = 0; x < a_desc->m_width; x += WARPING_ENGINE_MESH_LANES)
+  {
+    vx = ramp + (float) x;
+    vy = warping_engine_mesh_splat((float) a_y);
+    for(i = 0; i < a_desc->m_stage_count; i++)
+      warping_engine_mesh_stageVector(&a_desc->m_stage[i], &vx, &vy);
+
+    ix = warping_engine_mesh_fixedVector(vx);
+    iy = warping_engine_mesh_fixedVector(vy);
+    memcpy(fx, &ix, sizeof(fx));
+    memcpy(fy, &iy, sizeof(fy));
+
+    /* the table may be write combined, fill it front to back */
+    n = a_desc->m_width - x < WARPING_ENGINE_MESH_LANES ? a_desc->m_width - x : WARPING_ENGINE_MESH_LANES;
+    for(i = 0; i < n; i++)
+    {
+      a_row[x + i].x = fx[i];
+      a_row[x + i].y = fy[i];
+    }
+  }
+}
+
+#ifdef WARPING_ENGINE_MESH_X86
+
+__attribute__((target("sse4.1")))
+static void warping_engine_mesh_rowSse41(const warping_engine_mesh_desc *a_desc, warping_engine_uint32 a_y,
+                                         warping_engine_coordinate *a_row)
+{
+  warping_engine_mesh_rowVector(a_desc, a_y, a_row);
+}
+
+__attribute__((target("avx2,fma")))
+static void warping_engine_mesh_rowAvx2(const warping_engine_mesh_desc *a_desc, warping_engine_uint32 a_y,
+                                        warping_engine_coordinate *a_row)
+{
+  warping_engine_mesh_rowVector(a_desc, a_y, a_row);
+}
+
+#endif // WARPING_ENGINE_MESH_X86
+
+#ifdef WARPING_ENGINE_MESH_NEON
+
+static void warping_engine_mesh_rowNeon(const warping_engine_mesh_desc *a_desc, warping_engine_uint32 a_y,
+                                        warping_engine_coordinate *a_row)
+{
+  warping_engine_mesh_rowVector(a_desc, a_y, a_row);
+}
+
+#endif // WARPING_ENGINE_MESH_NEON
+
+/******************************************************************************
+ *         Generator                                                          *
+ ******************************************************************************/
+
+/* pick the row kernel, NULL if the ISA is not available */
+static warping_engine_mesh_row warping_engine_mesh_selectRow(warping_engine_cpu_isa *a_isa)
+{
+  if(*a_isa == WARPING_ENGINE_CPU_ISA_AUTO)
+  {
+#if defined(WARPING_ENGINE_MESH_NEON)
+    *a_isa = WARPING_ENGINE_CPU_ISA_NEON;
+#elif defined(WARPING_ENGINE_MESH_X86)
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+      *a_isa = WARPING_ENGINE_CPU_ISA_AVX2;
+    else if(__builtin_cpu_supports("sse4.1"))
+      *a_isa = WARPING_ENGINE_CPU_ISA_SSE41;
+    else
+      *a_isa = WARPING_ENGINE_CPU_ISA_SCALAR;
+#else
+    *a_isa = WARPING_ENGINE_CPU_ISA_SCALAR;
+#endif
+  }
+
+  switch(*a_isa)
+  {
+    case WARPING_ENGINE_CPU_ISA_SCALAR:
+      return warping_engine_mesh_rowScalar;
+#ifdef WARPING_ENGINE_MESH_X86
+    case WARPING_ENGINE_CPU_ISA_SSE41:
+      return __builtin_cpu_supports("sse4.1") ? warping_engine_mesh_rowSse41 : NULL;
+    case WARPING_ENGINE_CPU_ISA_AVX2:
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ? warping_engine_mesh_rowAvx2 : NULL;
+#endif
+#ifdef WARPING_ENGINE_MESH_NEON
+    case WARPING_ENGINE_CPU_ISA_NEON:
+      return warping_engine_mesh_rowNeon;
+#endif
+    default:
+      return NULL;
+  }
+}
+
+static void warping_engine_mesh_rows(void *a_run, warping_engine_uint32 a_item)
+{
+  const warping_engine_mesh_run *run = (const warping_engine_mesh_run *) a_run;
+  const warping_engine_mesh_desc *desc = run->m_desc;
+  warping_engine_uint32 y = a_item * WARPING_ENGINE_MESH_ROWS;
+  warping_engine_uint32 end = y + WARPING_ENGINE_MESH_ROWS;
+
+  if(end > desc->m_height)
+    end = desc->m_height;
+
+  for(; y < end; y++)
+    run->m_mesh->m_row(desc, y, run->m_table + (size_t) y * desc->m_width);
+}
+
+warping_engine_mesh *warping_engine_mesh_create(warping_engine_uint32 a_threads, warping_engine_cpu_isa a_isa)
+{
+  warping_engine_mesh *mesh;
+
+  mesh = (warping_engine_mesh *) calloc(1, sizeof(*mesh));
+  if(mesh == NULL)
+    return NULL;
+
+  mesh->m_isa = a_isa;
+  mesh->m_row = warping_engine_mesh_selectRow(&mesh->m_isa);
+  if(mesh->m_row != NULL)
+    mesh->m_pool = warping_engine_pool_create(a_threads);
+  if(mesh->m_pool == NULL)
+  {
+    free(mesh);
+    return NULL;
+  }
+
+  return mesh;
+}
+
+void warping_engine_mesh_destroy(warping_engine_mesh *a_mesh)
+{
+  if(a_mesh == NULL)
+    return;
+
+  warping_engine_pool_destroy(a_mesh->m_pool);
+  free(a_mesh);
+}
+
+warping_engine_cpu_isa warping_engine_mesh_getIsa(const warping_engine_mesh *a_mesh)
+{
+  return a_mesh->m_isa;
+}
+
+warping_engine_bool warping_engine_mesh_build(warping_engine_mesh *a_mesh, const warping_engine_mesh_desc *a_desc,
+                                              warping_engine_coordinate *a_table)
+{
+  warping_engine_mesh_run run = { a_mesh, a_desc, a_table };
+  const warping_engine_mesh_stage *stage;
+  warping_engine_uint32 i;
+
+  /* the engine takes 16 bit output sizes */
+  if(a_desc->m_width == 0 || a_desc->m_width > 0xffff || a_desc->m_height == 0 || a_desc->m_height > 0xffff ||
+     a_desc->m_stage_count > WARPING_ENGINE_MESH_STAGES_MAX || a_table == NULL)
+    return WARPING_ENGINE_FALSE;
+
+  for(i = 0; i < a_desc->m_stage_count; i++)
+  {
+    stage = &a_desc->m_stage[i];
+    if(stage->m_model > WARPING_ENGINE_MESH_FISHEYE)
+      return WARPING_ENGINE_FALSE;
+    if(stage->m_model != WARPING_ENGINE_MESH_HOMOGRAPHY && (stage->m_fx == 0 || stage->m_fy == 0))
+      return WARPING_ENGINE_FALSE;
+  }
+
+  warping_engine_pool_run(a_mesh->m_pool, (a_desc->m_height + WARPING_ENGINE_MESH_ROWS - 1) / WARPING_ENGINE_MESH_ROWS,
+                          warping_engine_mesh_rows, &run);
+
+  return WARPING_ENGINE_TRUE;
+}
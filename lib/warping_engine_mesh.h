@@ -0,0 +1,80 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Generator of coordinate tables from lens and projection
+ *            models. The table has the engine layout (one 15.16 source
+ *            position per output pixel, row by row) and is written straight
+ *            into a buffer mapped with warping_engine_linux_allocBuffer().
+ *            Rows are built in parallel with SIMD code in single precision,
+ *            the error stays far below the 1/256 pixel step of the
+ *            bilinear weights.
+ ****************************************************************************/
+
+#ifndef WARPING_ENGINE_MESH_H_
+#define WARPING_ENGINE_MESH_H_
+
+#include "warping_engine_cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WARPING_ENGINE_MESH_STAGES_MAX       (8)
+
+typedef enum {
+  /* (x, y, 1) times the row major 3x3 matrix, divided by the third row */
+  WARPING_ENGINE_MESH_HOMOGRAPHY = 0,
+  /* Brown-Conrady: radial k1 k2 k3 and tangential p1 p2 distortion */
+  WARPING_ENGINE_MESH_RADIAL,
+  /* equidistant fisheye: theta * (1 + k1 theta^2 + .. + k4 theta^8) */
+  WARPING_ENGINE_MESH_FISHEYE,
+} warping_engine_mesh_model;
+
+/* A stage maps a position to another one. The lens models map undistorted
+ * pixels to distorted ones, the homography maps any projective transform,
+ * e.g. a zoom, a rotation or a rectification */
+typedef struct
+{
+  warping_engine_mesh_model m_model;
+  warping_engine_float m_homography[9];     /* HOMOGRAPHY                   */
+  warping_engine_float m_fx, m_fy;          /* lens: focal length in pixels */
+  warping_engine_float m_cx, m_cy;          /* lens: principal point        */
+  warping_engine_float m_k[4];              /* RADIAL: k1-k3, FISHEYE: k1-k4 */
+  warping_engine_float m_p[2];              /* RADIAL: p1, p2               */
+} warping_engine_mesh_stage;
+
+/* The source position of output pixel (x, y) is the result of the stages
+ * applied to (x, y) in order. Positions beyond the 15.16 range are clamped */
+typedef struct
+{
+  warping_engine_uint32 m_width;            /* output size                  */
+  warping_engine_uint32 m_height;
+  warping_engine_uint32 m_stage_count;
+  warping_engine_mesh_stage m_stage[WARPING_ENGINE_MESH_STAGES_MAX];
+} warping_engine_mesh_desc;
+
+typedef struct warping_engine_mesh_tag warping_engine_mesh;
+
+/* a_threads: worker threads including the caller, 0 for one per CPU.
+ * WARPING_ENGINE_CPU_ISA_SCALAR evaluates the models in double precision
+ * pixel by pixel. Returns NULL if the ISA is not supported */
+warping_engine_mesh *warping_engine_mesh_create(warping_engine_uint32 a_threads, warping_engine_cpu_isa a_isa);
+void warping_engine_mesh_destroy(warping_engine_mesh *a_mesh);
+
+warping_engine_cpu_isa warping_engine_mesh_getIsa(const warping_engine_mesh *a_mesh);
+
+/* write the m_width * m_height entries of the table. False if the
+ * description is invalid */
+warping_engine_bool warping_engine_mesh_build(warping_engine_mesh *a_mesh, const warping_engine_mesh_desc *a_desc,
+                                              warping_engine_coordinate *a_table);
+
+/* source position of a single output position in double precision */
+void warping_engine_mesh_mapPoint(const warping_engine_mesh_desc *a_desc, double a_x, double a_y,
+                                  double *a_source_x, double *a_source_y);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WARPING_ENGINE_MESH_H_
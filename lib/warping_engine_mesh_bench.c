@@ -0,0 +1,167 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Benchmark of the mesh generator. Rebuilds the tables of a
+ *            lens undistortion and of a fisheye view with zoom for full HD
+ *            and 4K with every ISA and thread count, and prints the rebuild
+ *            time and the largest deviation from the double precision
+ *            tables.
+ *            usage: warping_engine_mesh_bench [rebuilds]
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "warping_engine_mesh.h"
+
+static double bench_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* radial and tangential distortion of a typical wide angle lens */
+static void bench_radial(warping_engine_mesh_desc *a_desc, unsigned a_width, unsigned a_height)
+{
+  warping_engine_mesh_stage *stage = &a_desc->m_stage[0];
+
+  memset(a_desc, 0, sizeof(*a_desc));
+  a_desc->m_width = a_width;
+  a_desc->m_height = a_height;
+  a_desc->m_stage_count = 1;
+  stage->m_model = WARPING_ENGINE_MESH_RADIAL;
+  stage->m_fx = stage->m_fy = a_width * 0.8f;
+  stage->m_cx = a_width / 2.0f;
+  stage->m_cy = a_height / 2.0f;
+  stage->m_k[0] = -0.28f;
+  stage->m_k[1] = 0.09f;
+  stage->m_k[2] = -0.012f;
+  stage->m_p[0] = 0.0007f;
+  stage->m_p[1] = -0.0004f;
+}
+
+/* 2x zoom into a 190 degree fisheye image */
+static void bench_fisheye(warping_engine_mesh_desc *a_desc, unsigned a_width, unsigned a_height)
+{
+  warping_engine_mesh_stage *zoom = &a_desc->m_stage[0];
+  warping_engine_mesh_stage *lens = &a_desc->m_stage[1];
+
+  memset(a_desc, 0, sizeof(*a_desc));
+  a_desc->m_width = a_width;
+  a_desc->m_height = a_height;
+  a_desc->m_stage_count = 2;
+  zoom->m_model = WARPING_ENGINE_MESH_HOMOGRAPHY;
+  zoom->m_homography[0] = 0.5f;
+  zoom->m_homography[2] = a_width / 4.0f;
+  zoom->m_homography[4] = 0.5f;
+  zoom->m_homography[5] = a_height / 4.0f;
+  zoom->m_homography[8] = 1.0f;
+  lens->m_model = WARPING_ENGINE_MESH_FISHEYE;
+  lens->m_fx = lens->m_fy = a_height / 3.3f;
+  lens->m_cx = a_width / 2.0f;
+  lens->m_cy = a_height / 2.0f;
+  lens->m_k[0] = 0.02f;
+  lens->m_k[1] = -0.004f;
+  lens->m_k[2] = 0.0006f;
+  lens->m_k[3] = -0.00003f;
+}
+
+static int bench_run(const char *a_name, const warping_engine_mesh_desc *a_desc, unsigned a_rebuilds)
+{
+  static const warping_engine_cpu_isa isas[] = {
+    WARPING_ENGINE_CPU_ISA_SCALAR, WARPING_ENGINE_CPU_ISA_SSE41,
+    WARPING_ENGINE_CPU_ISA_AVX2, WARPING_ENGINE_CPU_ISA_NEON,
+  };
+  size_t entries = (size_t) a_desc->m_width * a_desc->m_height, e;
+  unsigned threads, max_threads, i, r;
+  warping_engine_coordinate *reference, *table;
+  warping_engine_mesh *mesh;
+  double start, elapsed;
+  int error, max_error;
+
+  reference = malloc(sizeof(*reference) * entries);
+  table = malloc(sizeof(*table) * entries);
+  if(!reference || !table)
+  {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  mesh = warping_engine_mesh_create(0, WARPING_ENGINE_CPU_ISA_SCALAR);
+  warping_engine_mesh_build(mesh, a_desc, reference);
+  warping_engine_mesh_destroy(mesh);
+
+  max_threads = (unsigned) sysconf(_SC_NPROCESSORS_ONLN);
+  printf("%s %ux%u, %u rebuilds\n", a_name, a_desc->m_width, a_desc->m_height, a_rebuilds);
+
+  for(i = 0; i < sizeof(isas) / sizeof(isas[0]); i++)
+  {
+    for(threads = 1;; threads = threads * 2 < max_threads ? threads * 2 : max_threads)
+    {
+      mesh = warping_engine_mesh_create(threads, isas[i]);
+      if(mesh == NULL)
+        break;
+
+      warping_engine_mesh_build(mesh, a_desc, table);
+      max_error = 0;
+      for(e = 0; e < entries; e++)
+      {
+        error = abs(table[e].x - reference[e].x);
+        if(error > max_error)
+          max_error = error;
+        error = abs(table[e].y - reference[e].y);
+        if(error > max_error)
+          max_error = error;
+      }
+
+      start = bench_now();
+      for(r = 0; r < a_rebuilds; r++)
+        warping_engine_mesh_build(mesh, a_desc, table);
+      elapsed = bench_now() - start;
+
+      printf("  %-7s %2u threads: %8.2f ms/rebuild, max deviation %.5f pixels\n",
+             warping_engine_cpu_isaName(isas[i]), threads, elapsed * 1e3 / a_rebuilds,
+             (double) max_error / WARPING_ENGINE_COORD_ONE);
+      warping_engine_mesh_destroy(mesh);
+
+      if(threads >= max_threads)
+        break;
+    }
+  }
+
+  free(table);
+  free(reference);
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  static const unsigned sizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+  warping_engine_mesh_desc desc;
+  unsigned rebuilds = 10, s;
+  int failed = 0;
+
+  if(argc >= 2)
+    rebuilds = strtoul(argv[1], NULL, 0);
+  if(rebuilds == 0)
+  {
+    fprintf(stderr, "usage: %s [rebuilds]\n", argv[0]);
+    return 1;
+  }
+
+  for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+  {
+    bench_radial(&desc, sizes[s][0], sizes[s][1]);
+    failed |= bench_run("radial", &desc, rebuilds);
+    bench_fisheye(&desc, sizes[s][0], sizes[s][1]);
+    failed |= bench_run("fisheye zoom", &desc, rebuilds);
+  }
+
+  return failed;
+}
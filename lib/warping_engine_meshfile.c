@@ -0,0 +1,332 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Mesh files and the mesh cache, see warping_engine_meshfile.h
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "warping_engine_meshfile.h"
+
+#define WARPING_ENGINE_MESHFILE_FNV_BASIS    (0xcbf29ce484222325ull)
+#define WARPING_ENGINE_MESHFILE_FNV_PRIME    (0x100000001b3ull)
+
+typedef char warping_engine_meshfile_header_fits[sizeof(warping_engine_meshfile_header) <=
+                                                 WARPING_ENGINE_MESHFILE_TABLE_OFFSET ? 1 : -1];
+
+static warping_engine_uint64 warping_engine_meshfile_fnv(warping_engine_uint64 a_hash, const void *a_data,
+                                                         size_t a_size)
+{
+  const unsigned char *data = (const unsigned char *) a_data;
+
+  while(a_size--)
+  {
+    a_hash ^= *data++;
+    a_hash *= WARPING_ENGINE_MESHFILE_FNV_PRIME;
+  }
+
+  return a_hash;
+}
+
+/* member by member, padding of the description does not count */
+warping_engine_uint64 warping_engine_meshfile_hashDesc(const warping_engine_mesh_desc *a_desc)
+{
+  warping_engine_uint64 hash = WARPING_ENGINE_MESHFILE_FNV_BASIS;
+  const warping_engine_mesh_stage *stage;
+  warping_engine_uint32 version = WARPING_ENGINE_MESHFILE_VERSION, model, i;
+
+  hash = warping_engine_meshfile_fnv(hash, &version, sizeof(version));
+  hash = warping_engine_meshfile_fnv(hash, &a_desc->m_width, sizeof(a_desc->m_width));
+  hash = warping_engine_meshfile_fnv(hash, &a_desc->m_height, sizeof(a_desc->m_height));
+  hash = warping_engine_meshfile_fnv(hash, &a_desc->m_stage_count, sizeof(a_desc->m_stage_count));
+
+  for(i = 0; i < a_desc->m_stage_count && i < WARPING_ENGINE_MESH_STAGES_MAX; i++)
+  {
+    stage = &a_desc->m_stage[i];
+    model = stage->m_model;
+    hash = warping_engine_meshfile_fnv(hash, &model, sizeof(model));
+    hash = warping_engine_meshfile_fnv(hash, stage->m_homography, sizeof(stage->m_homography));
+    hash = warping_engine_meshfile_fnv(hash, &stage->m_fx, sizeof(stage->m_fx));
+    hash = warping_engine_meshfile_fnv(hash, &stage->m_fy, sizeof(stage->m_fy));
+    hash = warping_engine_meshfile_fnv(hash, &stage->m_cx, sizeof(stage->m_cx));
+    hash = warping_engine_meshfile_fnv(hash, &stage->m_cy, sizeof(stage->m_cy));
+    hash = warping_engine_meshfile_fnv(hash, stage->m_k, sizeof(stage->m_k));
+    hash = warping_engine_meshfile_fnv(hash, stage->m_p, sizeof(stage->m_p));
+  }
+
+  return hash;
+}
+
+/* sizes are bounded like in warping_engine_mesh_build(), the count is
+ * checked in 64 bits so a forged size cannot wrap to a small table */
+static warping_engine_bool warping_engine_meshfile_valid(const warping_engine_meshfile_header *a_header,
+                                                         warping_engine_uint64 a_file_size)
+{
+  return a_header->m_magic == WARPING_ENGINE_MESHFILE_MAGIC &&
+         a_header->m_version == WARPING_ENGINE_MESHFILE_VERSION &&
+         a_header->m_table_offset >= sizeof(*a_header) &&
+         a_header->m_width <= 0xffff && a_header->m_height <= 0xffff &&
+         a_header->m_count == (warping_engine_uint64) a_header->m_width * a_header->m_height &&
+         a_header->m_table_size == (warping_engine_uint64) a_header->m_count * sizeof(warping_engine_coordinate) &&
+         a_header->m_table_offset + a_header->m_table_size <= a_file_size;
+}
+
+static void warping_engine_meshfile_makeHeader(warping_engine_meshfile_header *a_header, warping_engine_uint32 a_width,
+                                               warping_engine_uint32 a_height, warping_engine_uint32 a_stripe_width,
+                                               warping_engine_uint64 a_hash)
+{
+  memset(a_header, 0, sizeof(*a_header));
+  a_header->m_magic = WARPING_ENGINE_MESHFILE_MAGIC;
+  a_header->m_version = WARPING_ENGINE_MESHFILE_VERSION;
+  a_header->m_table_offset = WARPING_ENGINE_MESHFILE_TABLE_OFFSET;
+  a_header->m_width = a_width;
+  a_header->m_height = a_height;
+  a_header->m_stripe_width = a_stripe_width;
+  a_header->m_count = a_width * a_height;
+  a_header->m_hash = a_hash;
+  a_header->m_table_size = (warping_engine_uint64) a_header->m_count * sizeof(warping_engine_coordinate);
+}
+
+static warping_engine_bool warping_engine_meshfile_writeAll(int a_fd, const void *a_data, size_t a_size)
+{
+  const char *data = (const char *) a_data;
+  ssize_t done;
+
+  while(a_size)
+  {
+    done = write(a_fd, data, a_size);
+    if(done < 0 && errno == EINTR)
+      continue;
+    if(done <= 0)
+      return WARPING_ENGINE_FALSE;
+    data += done;
+    a_size -= done;
+  }
+
+  return WARPING_ENGINE_TRUE;
+}
+
+static warping_engine_bool warping_engine_meshfile_readAll(int a_fd, void *a_data, size_t a_size, off_t a_offset)
+{
+  char *data = (char *) a_data;
+  ssize_t done;
+
+  while(a_size)
+  {
+    done = pread(a_fd, data, a_size, a_offset);
+    if(done < 0 && errno == EINTR)
+      continue;
+    if(done <= 0)
+      return WARPING_ENGINE_FALSE;
+    data += done;
+    a_size -= done;
+    a_offset += done;
+  }
+
+  return WARPING_ENGINE_TRUE;
+}
+
+warping_engine_bool warping_engine_meshfile_write(const char *a_path, const warping_engine_meshfile_header *a_header,
+                                                  const warping_engine_coordinate *a_table)
+{
+  char page[WARPING_ENGINE_MESHFILE_TABLE_OFFSET];
+  warping_engine_meshfile_header header;
+  char *temp;
+  int fd;
+  warping_engine_bool result;
+
+  warping_engine_meshfile_makeHeader(&header, a_header->m_width, a_header->m_height, a_header->m_stripe_width,
+                                     a_header->m_hash);
+  memset(page, 0, sizeof(page));
+  memcpy(page, &header, sizeof(header));
+
+  /* readers see the old file or the complete new one */
+  temp = (char *) malloc(strlen(a_path) + 32);
+  if(temp == NULL)
+    return WARPING_ENGINE_FALSE;
+  sprintf(temp, "%s.tmp.%ld", a_path, (long) getpid());
+
+  fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if(fd < 0)
+  {
+    free(temp);
+    return WARPING_ENGINE_FALSE;
+  }
+
+  result = warping_engine_meshfile_writeAll(fd, page, sizeof(page)) &&
+           warping_engine_meshfile_writeAll(fd, a_table, (size_t) header.m_table_size);
+  if(close(fd))
+    result = WARPING_ENGINE_FALSE;
+  if(result && rename(temp, a_path))
+    result = WARPING_ENGINE_FALSE;
+  if(!result)
+    unlink(temp);
+
+  free(temp);
+
+  return result;
+}
+
+warping_engine_bool warping_engine_meshfile_setStripeWidth(const char *a_path, warping_engine_uint32 a_stripe_width)
+{
+  warping_engine_meshfile_header header;
+  struct stat st;
+  warping_engine_bool result;
+  int fd;
+
+  fd = open(a_path, O_RDWR | O_CLOEXEC);
+  if(fd < 0)
+    return WARPING_ENGINE_FALSE;
+
+  result = !fstat(fd, &st) && warping_engine_meshfile_readAll(fd, &header, sizeof(header), 0) &&
+           warping_engine_meshfile_valid(&header, st.st_size);
+  if(result)
+  {
+    header.m_stripe_width = a_stripe_width;
+    header.m_flags |= WARPING_ENGINE_MESHFILE_TUNED;
+    result = pwrite(fd, &header, sizeof(header), 0) == sizeof(header);
+  }
+
+  if(close(fd))
+    result = WARPING_ENGINE_FALSE;
+
+  return result;
+}
+
+warping_engine_bool warping_engine_meshfile_map(const char *a_path, warping_engine_meshfile_mapping *a_mapping)
+{
+  struct stat st;
+  void *base;
+  int fd;
+
+  memset(a_mapping, 0, sizeof(*a_mapping));
+
+  fd = open(a_path, O_RDONLY | O_CLOEXEC);
+  if(fd < 0)
+    return WARPING_ENGINE_FALSE;
+
+  if(fstat(fd, &st) || (size_t) st.st_size < sizeof(warping_engine_meshfile_header))
+  {
+    close(fd);
+    return WARPING_ENGINE_FALSE;
+  }
+
+  base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(base == MAP_FAILED)
+    return WARPING_ENGINE_FALSE;
+
+  if(!warping_engine_meshfile_valid((const warping_engine_meshfile_header *) base, st.st_size))
+  {
+    munmap(base, st.st_size);
+    return WARPING_ENGINE_FALSE;
+  }
+
+  a_mapping->m_base = base;
+  a_mapping->m_size = st.st_size;
+  a_mapping->m_header = (const warping_engine_meshfile_header *) base;
+  a_mapping->m_table = (const warping_engine_coordinate *) ((const char *) base + a_mapping->m_header->m_table_offset);
+
+  return WARPING_ENGINE_TRUE;
+}
+
+void warping_engine_meshfile_unmap(warping_engine_meshfile_mapping *a_mapping)
+{
+  if(a_mapping->m_base != NULL)
+    munmap(a_mapping->m_base, a_mapping->m_size);
+  memset(a_mapping, 0, sizeof(*a_mapping));
+}
+
+warping_engine_bool warping_engine_meshfile_load(const char *a_path, warping_engine_handle a_handle,
+                                                 warping_engine_meshfile_header *a_header,
+                                                 warping_engine_linux_buffer *a_buffer)
+{
+  struct stat st;
+  int fd;
+
+  fd = open(a_path, O_RDONLY | O_CLOEXEC);
+  if(fd < 0)
+    return WARPING_ENGINE_FALSE;
+
+  if(fstat(fd, &st) || !warping_engine_meshfile_readAll(fd, a_header, sizeof(*a_header), 0) ||
+     !warping_engine_meshfile_valid(a_header, st.st_size) || a_header->m_table_size > 0xffffffffull ||
+     !warping_engine_linux_allocBuffer(a_handle, (warping_engine_uint32) a_header->m_table_size, 0, a_buffer))
+  {
+    close(fd);
+    return WARPING_ENGINE_FALSE;
+  }
+
+  /* straight from the page cache into the buffer object */
+  if(!warping_engine_meshfile_readAll(fd, a_buffer->m_virt, (size_t) a_header->m_table_size,
+                                      a_header->m_table_offset))
+  {
+    warping_engine_linux_freeBuffer(a_handle, a_buffer);
+    close(fd);
+    return WARPING_ENGINE_FALSE;
+  }
+
+  close(fd);
+
+  return WARPING_ENGINE_TRUE;
+}
+
+warping_engine_bool warping_engine_meshfile_cachePath(const char *a_dir, warping_engine_uint64 a_hash,
+                                                      char *a_path, size_t a_size)
+{
+  int length = snprintf(a_path, a_size, "%s/%016llx" WARPING_ENGINE_MESHFILE_SUFFIX, a_dir, a_hash);
+
+  return length > 0 && (size_t) length < a_size;
+}
+
+warping_engine_bool warping_engine_meshfile_cached(const char *a_dir, warping_engine_mesh *a_mesh,
+                                                   const warping_engine_mesh_desc *a_desc,
+                                                   warping_engine_uint32 a_stripe_width, warping_engine_handle a_handle,
+                                                   warping_engine_meshfile_header *a_header,
+                                                   warping_engine_linux_buffer *a_buffer)
+{
+  warping_engine_uint64 hash = warping_engine_meshfile_hashDesc(a_desc);
+  warping_engine_uint64 size = (warping_engine_uint64) a_desc->m_width * a_desc->m_height *
+                               sizeof(warping_engine_coordinate);
+  warping_engine_coordinate *table;
+  char path[4096];
+
+  if(!warping_engine_meshfile_cachePath(a_dir, hash, path, sizeof(path)) || size > 0xffffffffull)
+    return WARPING_ENGINE_FALSE;
+
+  if(warping_engine_meshfile_load(path, a_handle, a_header, a_buffer))
+  {
+    if(a_header->m_hash == hash && a_header->m_width == a_desc->m_width && a_header->m_height == a_desc->m_height)
+      return WARPING_ENGINE_TRUE;
+    warping_engine_linux_freeBuffer(a_handle, a_buffer);
+  }
+
+  /* build in cached memory, buffer objects are usually write combined and
+   * slow to read back for the file */
+  table = (warping_engine_coordinate *) malloc((size_t) size);
+  if(table == NULL)
+    return WARPING_ENGINE_FALSE;
+
+  if(!warping_engine_mesh_build(a_mesh, a_desc, table) ||
+     !warping_engine_linux_allocBuffer(a_handle, (warping_engine_uint32) size, 0, a_buffer))
+  {
+    free(table);
+    return WARPING_ENGINE_FALSE;
+  }
+  memcpy(a_buffer->m_virt, table, (size_t) size);
+
+  /* a cache that cannot be written only costs the next start */
+  warping_engine_meshfile_makeHeader(a_header, a_desc->m_width, a_desc->m_height, a_stripe_width, hash);
+  if(mkdir(a_dir, 0755) == 0 || errno == EEXIST)
+    warping_engine_meshfile_write(path, a_header, table);
+
+  free(table);
+
+  return WARPING_ENGINE_TRUE;
+}
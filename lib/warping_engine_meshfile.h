@@ -0,0 +1,98 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : On disk coordinate tables, so processes do not rebuild their
+ *            meshes on every start. A file is a header followed by the table
+ *            in the engine layout at WARPING_ENGINE_MESHFILE_TABLE_OFFSET,
+ *            page aligned, so the table can be mmap()ed on its own or read
+ *            into a buffer object with a single copy. Files are in host
+ *            byte order, a foreign one fails the magic check.
+ *            A cache directory holds the tables by the hash of their mesh
+ *            description.
+ ****************************************************************************/
+
+#ifndef WARPING_ENGINE_MESHFILE_H_
+#define WARPING_ENGINE_MESHFILE_H_
+
+#include "warping_engine_linux.h"
+#include "warping_engine_mesh.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WARPING_ENGINE_MESHFILE_MAGIC        (0x48534d57u)        /* "WMSH" */
+#define WARPING_ENGINE_MESHFILE_VERSION      (1)
+#define WARPING_ENGINE_MESHFILE_TABLE_OFFSET (4096)
+#define WARPING_ENGINE_MESHFILE_SUFFIX       ".wmesh"
+
+/* header flags */
+#define WARPING_ENGINE_MESHFILE_TUNED        (0x01)    /* stripe width was measured */
+
+typedef struct
+{
+  warping_engine_uint32 m_magic;            /* WARPING_ENGINE_MESHFILE_MAGIC */
+  warping_engine_uint32 m_version;          /* WARPING_ENGINE_MESHFILE_VERSION */
+  warping_engine_uint32 m_table_offset;     /* byte offset of the table     */
+  warping_engine_uint32 m_width;            /* output size                  */
+  warping_engine_uint32 m_height;
+  warping_engine_uint32 m_stripe_width;     /* stripe width to use          */
+  warping_engine_uint32 m_count;            /* coordinates                  */
+  warping_engine_uint32 m_flags;            /* WARPING_ENGINE_MESHFILE_*    */
+  warping_engine_uint64 m_hash;             /* of the calibration           */
+  warping_engine_uint64 m_table_size;       /* in bytes                     */
+  warping_engine_uint32 m_reserved1[4];
+} warping_engine_meshfile_header;
+
+/* read only mapping of a whole file */
+typedef struct
+{
+  const warping_engine_meshfile_header *m_header;
+  const warping_engine_coordinate *m_table;
+  void *m_base;
+  size_t m_size;
+} warping_engine_meshfile_mapping;
+
+/* hash of a mesh description, the calibration hash of its tables */
+warping_engine_uint64 warping_engine_meshfile_hashDesc(const warping_engine_mesh_desc *a_desc);
+
+/* write a table of a_header->m_width * m_height coordinates, of the header
+ * only the size, m_stripe_width and m_hash are taken. The file is replaced
+ * atomically */
+warping_engine_bool warping_engine_meshfile_write(const char *a_path, const warping_engine_meshfile_header *a_header,
+                                                  const warping_engine_coordinate *a_table);
+
+/* store a measured stripe width in the header of a file, sets
+ * WARPING_ENGINE_MESHFILE_TUNED */
+warping_engine_bool warping_engine_meshfile_setStripeWidth(const char *a_path, warping_engine_uint32 a_stripe_width);
+
+warping_engine_bool warping_engine_meshfile_map(const char *a_path, warping_engine_meshfile_mapping *a_mapping);
+void warping_engine_meshfile_unmap(warping_engine_meshfile_mapping *a_mapping);
+
+/* read the header of a file and its table into a new buffer object */
+warping_engine_bool warping_engine_meshfile_load(const char *a_path, warping_engine_handle a_handle,
+                                                 warping_engine_meshfile_header *a_header,
+                                                 warping_engine_linux_buffer *a_buffer);
+
+/* path of the table of a calibration hash in a cache directory, false if
+ * a_size is too small */
+warping_engine_bool warping_engine_meshfile_cachePath(const char *a_dir, warping_engine_uint64 a_hash,
+                                                      char *a_path, size_t a_size);
+
+/* table of a mesh description in a new buffer object: loaded from the
+ * cache directory if it holds it, built with a_mesh and stored there
+ * otherwise (with a_stripe_width). a_header returns the header, its stripe
+ * width is the one stored with the table, the tuned one if m_flags has
+ * WARPING_ENGINE_MESHFILE_TUNED */
+warping_engine_bool warping_engine_meshfile_cached(const char *a_dir, warping_engine_mesh *a_mesh,
+                                                   const warping_engine_mesh_desc *a_desc,
+                                                   warping_engine_uint32 a_stripe_width, warping_engine_handle a_handle,
+                                                   warping_engine_meshfile_header *a_header,
+                                                   warping_engine_linux_buffer *a_buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WARPING_ENGINE_MESHFILE_H_
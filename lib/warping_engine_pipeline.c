@@ -0,0 +1,203 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Conversion pipeline, see warping_engine_pipeline.h
+ ****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "warping_engine_pipeline.h"
+
+struct warping_engine_pipeline_tag
+{
+  warping_engine_handle m_engine;
+  warping_engine_convert *m_convert;
+  warping_engine_pipeline_desc m_desc;
+  warping_engine_linux_buffer m_input[2];
+  warping_engine_linux_buffer m_output[2];
+  warping_engine_uint32 m_current;          /* buffers of the next frame    */
+  warping_engine_bool m_pending;            /* the other buffers are warped */
+  warping_engine_uint32 m_seq;              /* of the pending job           */
+};
+
+/* engine view of a buffer object, written and read by the CPU once per
+ * frame so it stays write combined */
+static void warping_engine_pipeline_image(const warping_engine_linux_buffer *a_buffer, warping_engine_uint32 a_width,
+                                          warping_engine_uint32 a_height, warping_engine_convert_image *a_image)
+{
+  memset(a_image, 0, sizeof(*a_image));
+  a_image->m_format = WARPING_ENGINE_CONVERT_RGBA8888;
+  a_image->m_flags = WARPING_ENGINE_CONVERT_UNCACHED;
+  a_image->m_width = a_width;
+  a_image->m_height = a_height;
+  a_image->m_plane[0] = a_buffer->m_virt;
+  a_image->m_pitch[0] = a_width * sizeof(warping_engine_uint32);
+}
+
+/* start the warp of the current buffers, false if the engine did not take
+ * the job */
+static warping_engine_bool warping_engine_pipeline_submit(warping_engine_pipeline *a_pipeline)
+{
+  const warping_engine_pipeline_desc *desc = &a_pipeline->m_desc;
+  warping_engine_handle engine = a_pipeline->m_engine;
+  warping_engine_uint32 seq = warping_engine_linux_getSequence(engine);
+
+  warping_engine_setCoordinatesAddress(engine, desc->m_coordinates_address);
+  warping_engine_setCoordinatesCount(engine, desc->m_coordinates_count);
+  warping_engine_setInputImageAddress(engine, a_pipeline->m_input[a_pipeline->m_current].m_phys);
+  warping_engine_setInputImageSize(engine, desc->m_input_width, desc->m_input_height);
+  warping_engine_setInputImagePitch(engine, desc->m_input_width);
+  warping_engine_setOutsideColor(engine, desc->m_outside_color);
+  warping_engine_setOutputImageAddress(engine, a_pipeline->m_output[a_pipeline->m_current].m_phys);
+  warping_engine_setOutputImageSize(engine, desc->m_output_width, desc->m_output_height);
+  warping_engine_setOutputImagePitch(engine, desc->m_output_width);
+  warping_engine_setStripeWidth(engine, (warping_engine_uint16) desc->m_stripe_width);
+  warping_engine_setEnabled(engine, WARPING_ENGINE_TRUE);
+
+  a_pipeline->m_seq = warping_engine_linux_getSequence(engine);
+
+  return a_pipeline->m_seq != seq;
+}
+
+/* wait for the pending job, the handle is ours so the last record is the
+ * one of that job */
+static warping_engine_bool warping_engine_pipeline_wait(warping_engine_pipeline *a_pipeline)
+{
+  warping_engine_completion record;
+
+  a_pipeline->m_pending = WARPING_ENGINE_FALSE;
+
+  return warping_engine_linux_waitIdle(a_pipeline->m_engine) &&
+         warping_engine_linux_getCompletion(a_pipeline->m_engine, &record) && record.seq == a_pipeline->m_seq &&
+         (record.status & WARPING_ENGINE_IRQ_WARPING_FINISHED);
+}
+
+warping_engine_pipeline *warping_engine_pipeline_create(warping_engine_handle a_engine, warping_engine_convert *a_convert,
+                                                        const warping_engine_pipeline_desc *a_desc)
+{
+  warping_engine_uint64 input_size, output_size;
+  warping_engine_pipeline *pipeline;
+  warping_engine_uint32 i;
+
+  if(a_engine == NULL || a_convert == NULL || a_desc->m_input_width == 0 || a_desc->m_input_height == 0 ||
+     a_desc->m_output_width == 0 || a_desc->m_output_height == 0)
+    return NULL;
+
+  input_size = (warping_engine_uint64) a_desc->m_input_width * a_desc->m_input_height * sizeof(warping_engine_uint32);
+  output_size = (warping_engine_uint64) a_desc->m_output_width * a_desc->m_output_height * sizeof(warping_engine_uint32);
+  if(input_size > 0xffffffffu || output_size > 0xffffffffu)
+    return NULL;
+
+  pipeline = (warping_engine_pipeline *) calloc(1, sizeof(*pipeline));
+  if(pipeline == NULL)
+    return NULL;
+
+  pipeline->m_engine = a_engine;
+  pipeline->m_convert = a_convert;
+  pipeline->m_desc = *a_desc;
+
+  /* write combined, the CPU only streams through them */
+  for(i = 0; i < 2; i++)
+  {
+    if(!warping_engine_linux_allocBuffer(a_engine, (warping_engine_uint32) input_size, 0, &pipeline->m_input[i]) ||
+       !warping_engine_linux_allocBuffer(a_engine, (warping_engine_uint32) output_size, 0, &pipeline->m_output[i]))
+    {
+      warping_engine_pipeline_destroy(pipeline);
+      return NULL;
+    }
+  }
+
+  return pipeline;
+}
+
+void warping_engine_pipeline_destroy(warping_engine_pipeline *a_pipeline)
+{
+  warping_engine_uint32 i;
+
+  if(a_pipeline == NULL)
+    return;
+
+  /* the engine must not write to freed buffers */
+  if(a_pipeline->m_pending)
+    warping_engine_linux_waitIdle(a_pipeline->m_engine);
+
+  for(i = 0; i < 2; i++)
+  {
+    if(a_pipeline->m_input[i].m_virt != NULL)
+      warping_engine_linux_freeBuffer(a_pipeline->m_engine, &a_pipeline->m_input[i]);
+    if(a_pipeline->m_output[i].m_virt != NULL)
+      warping_engine_linux_freeBuffer(a_pipeline->m_engine, &a_pipeline->m_output[i]);
+  }
+
+  free(a_pipeline);
+}
+
+warping_engine_bool warping_engine_pipeline_push(warping_engine_pipeline *a_pipeline,
+                                                 const warping_engine_convert_image *a_source,
+                                                 const warping_engine_convert_image *a_result,
+                                                 warping_engine_bool *a_done)
+{
+  const warping_engine_pipeline_desc *desc = &a_pipeline->m_desc;
+  warping_engine_uint32 current = a_pipeline->m_current;
+  warping_engine_convert_image input, output;
+  warping_engine_bool pending = a_pipeline->m_pending;
+  warping_engine_bool ok = WARPING_ENGINE_TRUE;
+
+  *a_done = WARPING_ENGINE_FALSE;
+  if(a_source->m_width != desc->m_input_width || a_source->m_height != desc->m_input_height ||
+     a_result->m_width != desc->m_output_width || a_result->m_height != desc->m_output_height)
+    return WARPING_ENGINE_FALSE;
+
+  /* overlaps the warp of the previous frame */
+  warping_engine_pipeline_image(&a_pipeline->m_input[current], desc->m_input_width, desc->m_input_height, &input);
+  if(!warping_engine_convert_run(a_pipeline->m_convert, a_source, &input))
+    return WARPING_ENGINE_FALSE;
+
+  if(pending && !warping_engine_pipeline_wait(a_pipeline))
+  {
+    /* the previous result is lost, this frame can still go */
+    pending = WARPING_ENGINE_FALSE;
+    ok = WARPING_ENGINE_FALSE;
+  }
+
+  if(warping_engine_pipeline_submit(a_pipeline))
+  {
+    a_pipeline->m_pending = WARPING_ENGINE_TRUE;
+    a_pipeline->m_current = current ^ 1;
+  }
+  else
+  {
+    ok = WARPING_ENGINE_FALSE;
+  }
+
+  /* the result of the previous frame, overlaps the warp of this one */
+  if(pending)
+  {
+    warping_engine_pipeline_image(&a_pipeline->m_output[current ^ 1], desc->m_output_width, desc->m_output_height,
+                                  &output);
+    *a_done = warping_engine_convert_run(a_pipeline->m_convert, &output, a_result);
+  }
+
+  return ok;
+}
+
+warping_engine_bool warping_engine_pipeline_flush(warping_engine_pipeline *a_pipeline,
+                                                  const warping_engine_convert_image *a_result,
+                                                  warping_engine_bool *a_done)
+{
+  const warping_engine_pipeline_desc *desc = &a_pipeline->m_desc;
+  warping_engine_convert_image output;
+
+  *a_done = WARPING_ENGINE_FALSE;
+  if(!a_pipeline->m_pending)
+    return WARPING_ENGINE_TRUE;
+  if(!warping_engine_pipeline_wait(a_pipeline))
+    return WARPING_ENGINE_FALSE;
+
+  warping_engine_pipeline_image(&a_pipeline->m_output[a_pipeline->m_current ^ 1], desc->m_output_width,
+                                desc->m_output_height, &output);
+  *a_done = warping_engine_convert_run(a_pipeline->m_convert, &output, a_result);
+
+  return WARPING_ENGINE_TRUE;
+}
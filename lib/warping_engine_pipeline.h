@@ -0,0 +1,65 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Conversion pipeline for streams in other pixel formats. The
+ *            pipeline owns two input and two output buffer objects and
+ *            alternates between them: while the engine warps frame N, the
+ *            CPU converts frame N + 1 into the other input buffer and the
+ *            result of frame N - 1 out of the other output buffer. A result
+ *            is returned one frame after its source.
+ ****************************************************************************/
+
+#ifndef WARPING_ENGINE_PIPELINE_H_
+#define WARPING_ENGINE_PIPELINE_H_
+
+#include "warping_engine_linux.h"
+#include "warping_engine_convert.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the warp of every frame, the mesh is in video memory already. Pitches
+ * of the engine buffers are the widths */
+typedef struct
+{
+  warping_engine_uint32 m_coordinates_address;
+  warping_engine_uint32 m_coordinates_count;
+  warping_engine_uint32 m_input_width;
+  warping_engine_uint32 m_input_height;
+  warping_engine_uint32 m_output_width;
+  warping_engine_uint32 m_output_height;
+  warping_engine_uint32 m_stripe_width;         // 0: one stripe
+  warping_engine_uint32 m_outside_color;
+} warping_engine_pipeline_desc;
+
+typedef struct warping_engine_pipeline_tag warping_engine_pipeline;
+
+/* a_engine and a_convert are used by the pipeline only while it exists.
+ * Returns NULL if the buffers cannot be allocated */
+warping_engine_pipeline *warping_engine_pipeline_create(warping_engine_handle a_engine, warping_engine_convert *a_convert,
+                                                        const warping_engine_pipeline_desc *a_desc);
+/* waits for the engine, a pending result is dropped */
+void warping_engine_pipeline_destroy(warping_engine_pipeline *a_pipeline);
+
+/* start the warp of a_source, input size. a_result, output size, gets the
+ * result of the previous frame, *a_done tells if there was one. Returns
+ * when a_source was converted and a_result is written, the engine still
+ * warps a_source then. False if an engine job failed, a_source is dropped */
+warping_engine_bool warping_engine_pipeline_push(warping_engine_pipeline *a_pipeline,
+                                                 const warping_engine_convert_image *a_source,
+                                                 const warping_engine_convert_image *a_result,
+                                                 warping_engine_bool *a_done);
+
+/* wait for the last frame and write its result to a_result, *a_done tells
+ * if there was one */
+warping_engine_bool warping_engine_pipeline_flush(warping_engine_pipeline *a_pipeline,
+                                                  const warping_engine_convert_image *a_result,
+                                                  warping_engine_bool *a_done);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WARPING_ENGINE_PIPELINE_H_
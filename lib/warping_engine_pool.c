@@ -0,0 +1,153 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Thread pool, see warping_engine_pool.h
+ ****************************************************************************/
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "warping_engine_pool.h"
+
+struct warping_engine_pool_tag
+{
+  pthread_mutex_t m_run_lock;               /* serializes runs              */
+  pthread_mutex_t m_lock;                   /* protects the members below   */
+  pthread_cond_t m_start;
+  pthread_cond_t m_done;
+  warping_engine_pool_task m_task;
+  void *m_arg;
+  warping_engine_uint32 m_generation;       /* bumped for every run         */
+  warping_engine_uint32 m_items;
+  warping_engine_uint32 m_next_item;        /* atomic                       */
+  warping_engine_uint32 m_busy;             /* workers still on the run     */
+  int m_exit;
+
+  warping_engine_uint32 m_workers;
+  pthread_t *m_worker;
+};
+
+static void warping_engine_pool_work(warping_engine_pool *a_pool, warping_engine_pool_task a_task, void *a_arg)
+{
+  warping_engine_uint32 item;
+
+  for(;;)
+  {
+    item = __atomic_fetch_add(&a_pool->m_next_item, 1, __ATOMIC_RELAXED);
+    if(item >= a_pool->m_items)
+      return;
+    a_task(a_arg, item);
+  }
+}
+
+static void *warping_engine_pool_worker(void *a_pool)
+{
+  warping_engine_pool *pool = (warping_engine_pool *) a_pool;
+  warping_engine_uint32 generation = 0;
+  warping_engine_pool_task task;
+  void *arg;
+
+  for(;;)
+  {
+    pthread_mutex_lock(&pool->m_lock);
+    while(pool->m_generation == generation && !pool->m_exit)
+      pthread_cond_wait(&pool->m_start, &pool->m_lock);
+    if(pool->m_exit)
+    {
+      pthread_mutex_unlock(&pool->m_lock);
+      return NULL;
+    }
+    generation = pool->m_generation;
+    task = pool->m_task;
+    arg = pool->m_arg;
+    pthread_mutex_unlock(&pool->m_lock);
+
+    warping_engine_pool_work(pool, task, arg);
+
+    pthread_mutex_lock(&pool->m_lock);
+    if(--pool->m_busy == 0)
+      pthread_cond_signal(&pool->m_done);
+    pthread_mutex_unlock(&pool->m_lock);
+  }
+}
+
+warping_engine_pool *warping_engine_pool_create(warping_engine_uint32 a_threads)
+{
+  warping_engine_pool *pool;
+  long cpus;
+
+  pool = (warping_engine_pool *) calloc(1, sizeof(*pool));
+  if(pool == NULL)
+    return NULL;
+
+  if(a_threads == 0)
+  {
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    a_threads = cpus > 0 ? (warping_engine_uint32) cpus : 1;
+  }
+
+  pthread_mutex_init(&pool->m_run_lock, NULL);
+  pthread_mutex_init(&pool->m_lock, NULL);
+  pthread_cond_init(&pool->m_start, NULL);
+  pthread_cond_init(&pool->m_done, NULL);
+
+  /* the caller of warping_engine_pool_run() is one of the threads, a pool
+   * without workers still runs everything on the caller */
+  pool->m_worker = (pthread_t *) calloc(a_threads, sizeof(pthread_t));
+  for(pool->m_workers = 0; pool->m_worker != NULL && pool->m_workers < a_threads - 1; pool->m_workers++)
+  {
+    if(pthread_create(&pool->m_worker[pool->m_workers], NULL, warping_engine_pool_worker, pool))
+      break;
+  }
+
+  return pool;
+}
+
+void warping_engine_pool_destroy(warping_engine_pool *a_pool)
+{
+  warping_engine_uint32 i;
+
+  if(a_pool == NULL)
+    return;
+
+  pthread_mutex_lock(&a_pool->m_lock);
+  a_pool->m_exit = 1;
+  pthread_cond_broadcast(&a_pool->m_start);
+  pthread_mutex_unlock(&a_pool->m_lock);
+
+  for(i = 0; i < a_pool->m_workers; i++)
+    pthread_join(a_pool->m_worker[i], NULL);
+
+  pthread_cond_destroy(&a_pool->m_done);
+  pthread_cond_destroy(&a_pool->m_start);
+  pthread_mutex_destroy(&a_pool->m_lock);
+  pthread_mutex_destroy(&a_pool->m_run_lock);
+  free(a_pool->m_worker);
+  free(a_pool);
+}
+
+void warping_engine_pool_run(warping_engine_pool *a_pool, warping_engine_uint32 a_items,
+                             warping_engine_pool_task a_task, void *a_arg)
+{
+  pthread_mutex_lock(&a_pool->m_run_lock);
+
+  pthread_mutex_lock(&a_pool->m_lock);
+  a_pool->m_task = a_task;
+  a_pool->m_arg = a_arg;
+  a_pool->m_items = a_items;
+  a_pool->m_next_item = 0;
+  a_pool->m_busy = a_pool->m_workers;
+  a_pool->m_generation++;
+  pthread_cond_broadcast(&a_pool->m_start);
+  pthread_mutex_unlock(&a_pool->m_lock);
+
+  warping_engine_pool_work(a_pool, a_task, a_arg);
+
+  pthread_mutex_lock(&a_pool->m_lock);
+  while(a_pool->m_busy)
+    pthread_cond_wait(&a_pool->m_done, &a_pool->m_lock);
+  pthread_mutex_unlock(&a_pool->m_lock);
+
+  pthread_mutex_unlock(&a_pool->m_run_lock);
+}
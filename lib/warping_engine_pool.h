@@ -0,0 +1,36 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Thread pool of the CPU side of the library. A run hands out
+ *            the items 0 to n-1 through an atomic counter to the workers
+ *            and the calling thread, so items should be about equally big.
+ ****************************************************************************/
+
+#ifndef WARPING_ENGINE_POOL_H_
+#define WARPING_ENGINE_POOL_H_
+
+#include "warping_engine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*warping_engine_pool_task)(void *a_arg, warping_engine_uint32 a_item);
+
+typedef struct warping_engine_pool_tag warping_engine_pool;
+
+/* a_threads: threads including the caller of a run, 0 for one per CPU */
+warping_engine_pool *warping_engine_pool_create(warping_engine_uint32 a_threads);
+void warping_engine_pool_destroy(warping_engine_pool *a_pool);
+
+/* call a_task for every item, returns when all are done. Runs are
+ * serialized */
+void warping_engine_pool_run(warping_engine_pool *a_pool, warping_engine_uint32 a_items,
+                             warping_engine_pool_task a_task, void *a_arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WARPING_ENGINE_POOL_H_
@@ -0,0 +1,129 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Benchmark of CPU readback from buffer objects. Copies a
+ *            buffer written by the device into system memory, once from a
+ *            write combined and once from a WARPING_ENGINE_BO_CACHED
+ *            buffer. The cached timing includes the WARPING_ENGINE_IOCTL_BO_SYNC
+ *            calls that bracket every read.
+ *            usage: warping_engine_readback_bench [device [size [loops]]]
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "warping_engine_base.h"
+#include "warping_engine_linux.h"
+
+static double bench_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* cache maintenance of cached buffers, write combined ones need none */
+static warping_engine_bool bench_sync(warping_engine_handle a_engine, const warping_engine_linux_buffer *a_buffer,
+                                      warping_engine_bool a_cached, warping_engine_uint32 a_flags)
+{
+  return !a_cached || warping_engine_linux_syncBuffer(a_engine, a_buffer, a_flags, 0, 0);
+}
+
+/* time a_loops copies of a_buffer to a_copy, -1 if a sync failed */
+static double bench_readback(warping_engine_handle a_engine, const warping_engine_linux_buffer *a_buffer,
+                             warping_engine_bool a_cached, void *a_copy, unsigned a_loops)
+{
+  double start, elapsed = 0;
+  unsigned i;
+
+  for(i = 0; i < a_loops; i++)
+  {
+    /* stands in for the device writing the buffer, the sync leaves none of
+     * its lines in the CPU caches */
+    if(!bench_sync(a_engine, a_buffer, a_cached, WARPING_ENGINE_BO_SYNC_WRITE | WARPING_ENGINE_BO_SYNC_START))
+      return -1;
+    memset(a_buffer->m_virt, (int) i, a_buffer->m_size);
+    if(!bench_sync(a_engine, a_buffer, a_cached, WARPING_ENGINE_BO_SYNC_WRITE | WARPING_ENGINE_BO_SYNC_END))
+      return -1;
+
+    start = bench_now();
+    if(!bench_sync(a_engine, a_buffer, a_cached, WARPING_ENGINE_BO_SYNC_READ | WARPING_ENGINE_BO_SYNC_START))
+      return -1;
+    memcpy(a_copy, a_buffer->m_virt, a_buffer->m_size);
+    if(!bench_sync(a_engine, a_buffer, a_cached, WARPING_ENGINE_BO_SYNC_READ | WARPING_ENGINE_BO_SYNC_END))
+      return -1;
+    elapsed += bench_now() - start;
+  }
+
+  return elapsed;
+}
+
+static void bench_print(const char *a_name, warping_engine_uint32 a_size, unsigned a_loops, double a_elapsed)
+{
+  printf("%-16s %9.2f ms/read %9.1f MiB/s\n", a_name, a_elapsed * 1e3 / a_loops,
+         (double) a_size * a_loops / (1024.0 * 1024.0) / a_elapsed);
+}
+
+int main(int argc, char **argv)
+{
+  char *device = argc >= 2 ? argv[1] : NULL;
+  warping_engine_uint32 size = argc >= 3 ? strtoul(argv[2], NULL, 0) : 1024 * 1024;
+  unsigned loops = argc >= 4 ? strtoul(argv[3], NULL, 0) : 100;
+  warping_engine_linux_buffer wc, cached;
+  warping_engine_handle engine;
+  double elapsed;
+  void *copy;
+  int failed = 1;
+
+  if(size == 0 || loops == 0)
+  {
+    fprintf(stderr, "usage: %s [device [size [loops]]]\n", argv[0]);
+    return 1;
+  }
+
+  copy = malloc(size);
+  if(copy == NULL)
+    return 1;
+
+  engine = warping_engine_init(device);
+  if(engine == NULL)
+  {
+    fprintf(stderr, "%s: cannot open the engine\n", device ? device : WARPING_ENGINE_LINUX_DEVICE);
+    free(copy);
+    return 1;
+  }
+
+  memset(&wc, 0, sizeof(wc));
+  memset(&cached, 0, sizeof(cached));
+  if(!warping_engine_linux_allocBuffer(engine, size, 0, &wc) ||
+     !warping_engine_linux_allocBuffer(engine, size, WARPING_ENGINE_BO_CACHED, &cached))
+  {
+    fprintf(stderr, "cannot allocate two buffers of %u bytes\n", size);
+    goto FREE;
+  }
+
+  printf("%u bytes, %u reads\n", size, loops);
+
+  elapsed = bench_readback(engine, &wc, WARPING_ENGINE_FALSE, copy, loops);
+  bench_print("write combined", size, loops, elapsed);
+
+  elapsed = bench_readback(engine, &cached, WARPING_ENGINE_TRUE, copy, loops);
+  if(elapsed < 0)
+  {
+    perror("WARPING_ENGINE_IOCTL_BO_SYNC");
+    goto FREE;
+  }
+  bench_print("cached + sync", size, loops, elapsed);
+  failed = 0;
+
+FREE:
+  warping_engine_linux_freeBuffer(engine, &cached);
+  warping_engine_linux_freeBuffer(engine, &wc);
+  warping_engine_exit(engine);
+  free(copy);
+
+  return failed;
+}
@@ -0,0 +1,235 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Benchmark of the job submit path. Times the CPU cost of
+ *            handing a small job to the module per frame: one register
+ *            write ioctl per job register, one WARPING_ENGINE_IOCTL_SUBMIT,
+ *            and the API with its register shadow. Only the calls are
+ *            timed, waiting for completions is not.
+ *            usage: warping_engine_submit_bench [device [frames]]
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include "warping_engine_base.h"
+#include "warping_engine_linux.h"
+#include "warping_engine_sample.h"
+
+#define BENCH_SIZE                 16       /* input and output edge        */
+#define BENCH_BATCH                8        /* jobs between completion waits*/
+
+static double bench_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* wait for the interrupt of a job started by register writes, false on a
+ * timeout */
+static int bench_wait_irq(int a_fd)
+{
+  struct pollfd pfd;
+  int status;
+
+  pfd.fd = a_fd;
+  pfd.events = POLLIN;
+  if(poll(&pfd, 1, 1000) <= 0)
+    return 0;
+
+  return read(a_fd, &status, sizeof(status)) == sizeof(status);
+}
+
+/* read a_count completion records of raw submits, false on a timeout */
+static int bench_drain(int a_fd, unsigned a_count)
+{
+  warping_engine_completion records[BENCH_BATCH];
+  struct pollfd pfd;
+  ssize_t size;
+
+  pfd.fd = a_fd;
+  pfd.events = POLLIN;
+  while(a_count)
+  {
+    if(poll(&pfd, 1, 1000) <= 0)
+      return 0;
+    size = read(a_fd, records, sizeof(records));
+    if(size < 0 && (errno == EAGAIN || errno == EINTR))
+      continue;
+    if(size < (ssize_t) sizeof(records[0]))
+      return 0;
+    a_count -= (unsigned) (size / sizeof(records[0])) < a_count ? (unsigned) (size / sizeof(records[0])) : a_count;
+  }
+
+  return 1;
+}
+
+static void bench_print(const char *a_name, unsigned a_calls, unsigned a_frames, double a_elapsed)
+{
+  printf("%-18s %3u calls/frame %9.2f us/frame\n", a_name, a_calls, a_elapsed * 1e6 / a_frames);
+}
+
+int main(int argc, char **argv)
+{
+  static const warping_engine_uint32 regs[] = {
+    WARPING_ENGINE_COORDINATES_ADDRESS_REG, WARPING_ENGINE_COORDINATES_COUNT_REG, WARPING_ENGINE_INPUT_ADDRESS_REG,
+    WARPING_ENGINE_INPUT_SIZE_REG, WARPING_ENGINE_INPUT_PITCH_REG, WARPING_ENGINE_INPUT_BYTE_PITCH_REG,
+    WARPING_ENGINE_OUTSIDE_COLOR_REG, WARPING_ENGINE_OUTPUT_ADDRESS_REG, WARPING_ENGINE_OUTPUT_SIZE_REG,
+    WARPING_ENGINE_OUTPUT_PITCH_REG, WARPING_ENGINE_STRIPE_WIDTH_REG, WARPING_ENGINE_CONFIG_REG,
+  };
+  char *device = argc >= 2 ? argv[1] : NULL;
+  unsigned frames = argc >= 3 ? strtoul(argv[2], NULL, 0) : 10000;
+  warping_engine_linux_buffer mesh, input, output;
+  warping_engine_uint32 values[sizeof(regs) / sizeof(regs[0])];
+  warping_engine_coordinate *coordinates;
+  warping_engine_handle engine;
+  warping_engine_job job;
+  double start, elapsed;
+  unsigned f, i, n;
+  int fd, failed = 1;
+
+  if(frames == 0)
+  {
+    fprintf(stderr, "usage: %s [device [frames]]\n", argv[0]);
+    return 1;
+  }
+
+  engine = warping_engine_init(device);
+  if(engine == NULL)
+  {
+    fprintf(stderr, "%s: cannot open the engine\n", device ? device : WARPING_ENGINE_LINUX_DEVICE);
+    return 1;
+  }
+  fd = warping_engine_linux_getFd(engine);
+
+  memset(&mesh, 0, sizeof(mesh));
+  memset(&input, 0, sizeof(input));
+  memset(&output, 0, sizeof(output));
+  if(!warping_engine_linux_allocBuffer(engine, BENCH_SIZE * BENCH_SIZE * sizeof(warping_engine_coordinate), 0, &mesh) ||
+     !warping_engine_linux_allocBuffer(engine, BENCH_SIZE * BENCH_SIZE * BYTES_PER_PIXEL, 0, &input) ||
+     !warping_engine_linux_allocBuffer(engine, BENCH_SIZE * BENCH_SIZE * BYTES_PER_PIXEL, 0, &output))
+  {
+    fprintf(stderr, "out of video memory\n");
+    goto EXIT;
+  }
+
+  /* identity mesh */
+  coordinates = (warping_engine_coordinate *) mesh.m_virt;
+  for(i = 0; i < BENCH_SIZE * BENCH_SIZE; i++)
+  {
+    coordinates[i].x = (int) (i % BENCH_SIZE) * WARPING_ENGINE_COORD_ONE + WARPING_ENGINE_COORD_ONE / 2;
+    coordinates[i].y = (int) (i / BENCH_SIZE) * WARPING_ENGINE_COORD_ONE + WARPING_ENGINE_COORD_ONE / 2;
+  }
+
+  memset(&job, 0, sizeof(job));
+  job.coordinates_address = mesh.m_phys;
+  job.coordinates_count = BENCH_SIZE * BENCH_SIZE;
+  job.input_address = input.m_phys;
+  job.input_size = WARPING_ENGINE_MAKE_SIZE(BENCH_SIZE, BENCH_SIZE);
+  job.input_pitch = BENCH_SIZE;
+  job.input_byte_pitch = BENCH_SIZE * BYTES_PER_PIXEL;
+  job.output_address = output.m_phys;
+  job.output_size = WARPING_ENGINE_MAKE_SIZE(BENCH_SIZE, BENCH_SIZE);
+  job.output_pitch = BENCH_SIZE;
+  job.stripe_width = BENCH_SIZE;
+  job.config = 1;
+
+  printf("%ux%u jobs, %u frames\n", BENCH_SIZE, BENCH_SIZE, frames);
+
+  values[0] = job.coordinates_address;
+  values[1] = job.coordinates_count;
+  values[2] = job.input_address;
+  values[3] = job.input_size;
+  values[4] = job.input_pitch;
+  values[5] = job.input_byte_pitch;
+  values[6] = job.outside_color;
+  values[7] = job.output_address;
+  values[8] = job.output_size;
+  values[9] = job.output_pitch;
+  values[10] = job.stripe_width;
+  values[11] = job.config;
+
+  /* the submit path before the job queue: every register by hand, the
+   * config register starts the job. The file has not submitted a job yet,
+   * so 4 byte reads return the raw interrupt status */
+  elapsed = 0;
+  for(f = 0; f < frames; f++)
+  {
+    start = bench_now();
+    for(i = 0; i < sizeof(regs) / sizeof(regs[0]); i++)
+      ioctl(fd, WARPING_ENGINE_IOCTL_WREG(regs[i]), (unsigned long) values[i]);
+    elapsed += bench_now() - start;
+    if(!bench_wait_irq(fd))
+    {
+      fprintf(stderr, "jobs do not finish\n");
+      goto FREE;
+    }
+  }
+  bench_print("register ioctls", sizeof(regs) / sizeof(regs[0]), frames, elapsed);
+
+  elapsed = 0;
+  for(f = 0; f < frames; f += n)
+  {
+    for(n = 0; n < BENCH_BATCH && f + n < frames; n++)
+    {
+      start = bench_now();
+      if(ioctl(fd, WARPING_ENGINE_IOCTL_SUBMIT, &job))
+      {
+        perror("WARPING_ENGINE_IOCTL_SUBMIT");
+        goto FREE;
+      }
+      elapsed += bench_now() - start;
+    }
+    if(!bench_drain(fd, n))
+    {
+      fprintf(stderr, "jobs do not finish\n");
+      goto FREE;
+    }
+  }
+  bench_print("submit ioctl", 1, frames, elapsed);
+
+  /* a stream that only changes the buffers, the setters only write the
+   * shadow and setEnabled submits it */
+  elapsed = 0;
+  for(f = 0; f < frames; f++)
+  {
+    start = bench_now();
+    warping_engine_setCoordinatesAddress(engine, mesh.m_phys);
+    warping_engine_setCoordinatesCount(engine, BENCH_SIZE * BENCH_SIZE);
+    warping_engine_setInputImageAddress(engine, f & 1 ? output.m_phys : input.m_phys);
+    warping_engine_setInputImageSize(engine, BENCH_SIZE, BENCH_SIZE);
+    warping_engine_setInputImagePitch(engine, BENCH_SIZE);
+    warping_engine_setOutsideColor(engine, 0);
+    warping_engine_setOutputImageAddress(engine, f & 1 ? input.m_phys : output.m_phys);
+    warping_engine_setOutputImageSize(engine, BENCH_SIZE, BENCH_SIZE);
+    warping_engine_setOutputImagePitch(engine, BENCH_SIZE);
+    warping_engine_setStripeWidth(engine, BENCH_SIZE);
+    warping_engine_setEnabled(engine, WARPING_ENGINE_TRUE);
+    elapsed += bench_now() - start;
+
+    if((f + 1) % BENCH_BATCH == 0 && !warping_engine_linux_waitIdle(engine))
+    {
+      fprintf(stderr, "jobs do not finish\n");
+      goto FREE;
+    }
+  }
+  warping_engine_linux_waitIdle(engine);
+  bench_print("API with shadow", 1, frames, elapsed);
+  failed = 0;
+
+FREE:
+  warping_engine_linux_freeBuffer(engine, &output);
+  warping_engine_linux_freeBuffer(engine, &input);
+  warping_engine_linux_freeBuffer(engine, &mesh);
+EXIT:
+  warping_engine_exit(engine);
+
+  return failed;
+}
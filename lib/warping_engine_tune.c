@@ -0,0 +1,105 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Stripe width tuning, see warping_engine_tune.h
+ ****************************************************************************/
+
+#include <string.h>
+#include "warping_engine_tune.h"
+
+/* counters used for tuning, in this order */
+static const warping_engine_pfc_event_t warping_engine_tune_events[] = {
+  WARPING_ENGINE_PFC_EVENT_CLOCK,
+  WARPING_ENGINE_PFC_EVENT_TXS_PREFETCH_MISS,
+  WARPING_ENGINE_PFC_EVENT_TXC_PIXEL_READ_FETCH_WAIT,
+  WARPING_ENGINE_PFC_EVENT_TXC_JOB_LINE_WAIT,
+};
+
+#define WARPING_ENGINE_TUNE_PFC_CNT          (sizeof(warping_engine_tune_events) / sizeof(warping_engine_tune_events[0]))
+
+/* multiples of the 16 pixel cache line */
+static const warping_engine_uint32 warping_engine_tune_widths[] = {
+  16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048,
+};
+
+warping_engine_uint32 warping_engine_tune_defaultWidths(warping_engine_uint32 a_output_width,
+                                                        warping_engine_uint32 a_widths[WARPING_ENGINE_TUNE_WIDTHS_MAX])
+{
+  warping_engine_uint32 count = 0, i;
+
+  for(i = 0; i < sizeof(warping_engine_tune_widths) / sizeof(warping_engine_tune_widths[0]); i++)
+  {
+    if(warping_engine_tune_widths[i] < a_output_width)
+      a_widths[count++] = warping_engine_tune_widths[i];
+  }
+  a_widths[count++] = a_output_width;
+
+  return count;
+}
+
+/* one run of the set up job, false if it did not finish */
+static warping_engine_bool warping_engine_tune_run(warping_engine_handle a_handle,
+                                                   warping_engine_uint32 a_values[WARPING_ENGINE_TUNE_PFC_CNT])
+{
+  warping_engine_completion record;
+  warping_engine_uint32 seq = warping_engine_linux_getSequence(a_handle);
+  warping_engine_uint32 i;
+
+  warping_engine_setEnabled(a_handle, WARPING_ENGINE_TRUE);
+  if(warping_engine_linux_getSequence(a_handle) == seq || !warping_engine_linux_waitIdle(a_handle) ||
+     !warping_engine_linux_getCompletion(a_handle, &record) || !(record.status & WARPING_ENGINE_IRQ_WARPING_FINISHED))
+    return WARPING_ENGINE_FALSE;
+
+  /* the values latched at the end of the job */
+  for(i = 0; i < WARPING_ENGINE_TUNE_PFC_CNT; i++)
+    a_values[i] = warping_engine_getPerformanceCounterValue(a_handle, (warping_engine_uint8) i);
+
+  return WARPING_ENGINE_TRUE;
+}
+
+warping_engine_bool warping_engine_tune_sweep(warping_engine_handle a_handle, const warping_engine_uint32 *a_widths,
+                                              warping_engine_uint32 a_count, warping_engine_uint32 a_runs,
+                                              warping_engine_tune_result *a_results, warping_engine_uint32 *a_best)
+{
+  warping_engine_uint32 values[WARPING_ENGINE_TUNE_PFC_CNT];
+  warping_engine_tune_result *result;
+  warping_engine_uint32 i, run;
+
+  if(a_count == 0 || a_runs == 0)
+    return WARPING_ENGINE_FALSE;
+
+  for(i = 0; i < WARPING_ENGINE_TUNE_PFC_CNT; i++)
+    warping_engine_setPerformanceCounterEvent(a_handle, (warping_engine_uint8) i, warping_engine_tune_events[i]);
+  warping_engine_enablePerformanceCounters(a_handle, (1u << WARPING_ENGINE_TUNE_PFC_CNT) - 1);
+
+  *a_best = 0;
+  for(i = 0; i < a_count; i++)
+  {
+    result = &a_results[i];
+    memset(result, 0, sizeof(*result));
+    result->m_stripe_width = a_widths[i];
+    warping_engine_setStripeWidth(a_handle, (warping_engine_uint16) a_widths[i]);
+
+    /* other traffic only adds cycles, keep the fastest run */
+    for(run = 0; run < a_runs; run++)
+    {
+      if(!warping_engine_tune_run(a_handle, values))
+        return WARPING_ENGINE_FALSE;
+      if(run == 0 || values[0] < result->m_clock)
+      {
+        result->m_clock = values[0];
+        result->m_prefetch_miss = values[1];
+        result->m_fetch_wait = values[2];
+        result->m_line_wait = values[3];
+      }
+    }
+
+    if(result->m_clock < a_results[*a_best].m_clock)
+      *a_best = i;
+  }
+
+  warping_engine_setStripeWidth(a_handle, (warping_engine_uint16) a_widths[*a_best]);
+
+  return WARPING_ENGINE_TRUE;
+}
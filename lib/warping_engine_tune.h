@@ -0,0 +1,51 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Stripe width tuning. The job set up in the engine registers is
+ *            run with a range of stripe widths while performance counters 0
+ *            to 3 count CLOCK and the texture cache waits, the width with
+ *            the fewest cycles wins. The result can be stored with the mesh
+ *            in its mesh file, warping_engine_meshfile_cached() returns it
+ *            from then on.
+ ****************************************************************************/
+
+#ifndef WARPING_ENGINE_TUNE_H_
+#define WARPING_ENGINE_TUNE_H_
+
+#include "warping_engine_linux.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* widths of the default sweep, plus the output width */
+#define WARPING_ENGINE_TUNE_WIDTHS_MAX       (16)
+
+/* counters of the run of a width with the fewest cycles */
+typedef struct
+{
+  warping_engine_uint32 m_stripe_width;
+  warping_engine_uint32 m_clock;            /* CLOCK                        */
+  warping_engine_uint32 m_prefetch_miss;    /* TXS_PREFETCH_MISS            */
+  warping_engine_uint32 m_fetch_wait;       /* TXC_PIXEL_READ_FETCH_WAIT    */
+  warping_engine_uint32 m_line_wait;        /* TXC_JOB_LINE_WAIT            */
+} warping_engine_tune_result;
+
+/* default sweep for an output width, returns the number of widths */
+warping_engine_uint32 warping_engine_tune_defaultWidths(warping_engine_uint32 a_output_width,
+                                                        warping_engine_uint32 a_widths[WARPING_ENGINE_TUNE_WIDTHS_MAX]);
+
+/* run the set up job a_runs times with each of the a_count widths, a_results
+ * gets one entry per width. a_best returns the index of the best width.
+ * The stripe width register is left at the best width, the counters 0 to 3
+ * at their tuning events. False if a job failed */
+warping_engine_bool warping_engine_tune_sweep(warping_engine_handle a_handle, const warping_engine_uint32 *a_widths,
+                                              warping_engine_uint32 a_count, warping_engine_uint32 a_runs,
+                                              warping_engine_tune_result *a_results, warping_engine_uint32 *a_best);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WARPING_ENGINE_TUNE_H_
@@ -0,0 +1,98 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Tunes the stripe width of a mesh file on the engine and stores
+ *            the best width in the file.
+ *            usage: warping_engine_tune_tool mesh-file input-width
+ *                   input-height [runs [device]]
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "warping_engine_meshfile.h"
+#include "warping_engine_tune.h"
+
+int main(int argc, char **argv)
+{
+  warping_engine_tune_result results[WARPING_ENGINE_TUNE_WIDTHS_MAX];
+  warping_engine_uint32 widths[WARPING_ENGINE_TUNE_WIDTHS_MAX];
+  warping_engine_linux_buffer mesh, input, output;
+  warping_engine_meshfile_header header;
+  warping_engine_uint32 in_w, in_h, runs = 3, count, best, i;
+  warping_engine_handle engine;
+  int failed = 1;
+
+  if(argc < 4)
+  {
+    fprintf(stderr, "usage: %s mesh-file input-width input-height [runs [device]]\n", argv[0]);
+    return 1;
+  }
+  in_w = strtoul(argv[2], NULL, 0);
+  in_h = strtoul(argv[3], NULL, 0);
+  if(argc >= 5)
+    runs = strtoul(argv[4], NULL, 0);
+
+  engine = warping_engine_init(argc >= 6 ? argv[5] : NULL);
+  if(engine == NULL)
+  {
+    fprintf(stderr, "cannot open the engine\n");
+    return 1;
+  }
+
+  memset(&input, 0, sizeof(input));
+  memset(&output, 0, sizeof(output));
+  if(!warping_engine_meshfile_load(argv[1], engine, &header, &mesh))
+  {
+    fprintf(stderr, "%s: not a mesh file\n", argv[1]);
+    goto EXIT;
+  }
+  if(!warping_engine_linux_allocBuffer(engine, in_w * in_h * sizeof(warping_engine_uint32), 0, &input) ||
+     !warping_engine_linux_allocBuffer(engine, header.m_width * header.m_height * sizeof(warping_engine_uint32), 0, &output))
+  {
+    fprintf(stderr, "out of video memory\n");
+    goto FREE;
+  }
+  /* the pattern does not matter, the cache only sees addresses */
+  memset(input.m_virt, 0x80, input.m_size);
+
+  warping_engine_setCoordinatesAddress(engine, mesh.m_phys);
+  warping_engine_setCoordinatesCount(engine, header.m_count);
+  warping_engine_setInputImageAddress(engine, input.m_phys);
+  warping_engine_setInputImageSize(engine, in_w, in_h);
+  warping_engine_setInputImagePitch(engine, in_w);
+  warping_engine_setOutsideColor(engine, 0);
+  warping_engine_setOutputImageAddress(engine, output.m_phys);
+  warping_engine_setOutputImageSize(engine, header.m_width, header.m_height);
+  warping_engine_setOutputImagePitch(engine, header.m_width);
+
+  count = warping_engine_tune_defaultWidths(header.m_width, widths);
+  if(!warping_engine_tune_sweep(engine, widths, count, runs, results, &best))
+  {
+    fprintf(stderr, "a tuning job failed\n");
+    goto FREE;
+  }
+
+  printf("stripe        clock   prefetch miss      fetch wait       line wait\n");
+  for(i = 0; i < count; i++)
+    printf("%6u %12u %15u %15u %15u%s\n", results[i].m_stripe_width, results[i].m_clock,
+           results[i].m_prefetch_miss, results[i].m_fetch_wait, results[i].m_line_wait, i == best ? " *" : "");
+
+  if(!warping_engine_meshfile_setStripeWidth(argv[1], results[best].m_stripe_width))
+  {
+    fprintf(stderr, "%s: cannot store the stripe width\n", argv[1]);
+    goto FREE;
+  }
+  printf("%s: stripe width %u stored (was %u)\n", argv[1], results[best].m_stripe_width, header.m_stripe_width);
+  failed = 0;
+
+FREE:
+  warping_engine_linux_freeBuffer(engine, &output);
+  warping_engine_linux_freeBuffer(engine, &input);
+  warping_engine_linux_freeBuffer(engine, &mesh);
+EXIT:
+  warping_engine_exit(engine);
+
+  return failed;
+}
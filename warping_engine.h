@@ -73,6 +73,12 @@ typedef unsigned warping_engine_uint32;
  */
 typedef unsigned warping_engine_sint32;
 
+/* 
+ * Type: warping_engine_uint64 
+ *  64 bit unsigned integer type
+ */
+typedef unsigned long long warping_engine_uint64;
+
 /* 
  * Type: warping_engine_ptr 
  *  Multipurpose pointer (e.g. for malloc or free)
@@ -137,11 +143,40 @@ typedef struct warping_engine_status_tag
 #define WARPING_ENGINE_IOCTL_TYPE 'B'
 #define WARPING_ENGINE_IOCTL_REG_PREFIX     (0x80)
 #define WARPING_ENGINE_IOCTL_NR_SETTINGS    (0x01)
+#define WARPING_ENGINE_IOCTL_NR_SUBMIT      (0x02)
+#define WARPING_ENGINE_IOCTL_NR_EVENTFD     (0x03)
+#define WARPING_ENGINE_IOCTL_NR_BO_ALLOC    (0x04)
+#define WARPING_ENGINE_IOCTL_NR_BO_FREE     (0x05)
+#define WARPING_ENGINE_IOCTL_NR_BO_EXPORT   (0x06)
+#define WARPING_ENGINE_IOCTL_NR_BO_IMPORT   (0x07)
+#define WARPING_ENGINE_IOCTL_NR_BO_SYNC     (0x08)
+#define WARPING_ENGINE_IOCTL_NR_BANDS       (0x09)
+#define WARPING_ENGINE_IOCTL_NR_BUSY_POLL   (0x0A)
 #define WARPING_ENGINE_IOCTL_MAKE_REG(reg)  (reg|WARPING_ENGINE_IOCTL_REG_PREFIX)
 #define WARPING_ENGINE_IOCTL_GET_REG(nr)    (nr&(~WARPING_ENGINE_IOCTL_REG_PREFIX))
 #define WARPING_ENGINE_IOCTL_WREG(reg)      (_IOW(WARPING_ENGINE_IOCTL_TYPE,WARPING_ENGINE_IOCTL_MAKE_REG(reg),unsigned long))
 #define WARPING_ENGINE_IOCTL_RREG(reg)      (_IOR(WARPING_ENGINE_IOCTL_TYPE,WARPING_ENGINE_IOCTL_MAKE_REG(reg),unsigned long))
 #define WARPING_ENGINE_IOCTL_GET_SETTINGS   (_IOR(WARPING_ENGINE_IOCTL_TYPE,WARPING_ENGINE_IOCTL_NR_SETTINGS,warping_engine_settings))
+#define WARPING_ENGINE_IOCTL_SUBMIT         (_IOWR(WARPING_ENGINE_IOCTL_TYPE,WARPING_ENGINE_IOCTL_NR_SUBMIT,warping_engine_job))
+#define WARPING_ENGINE_IOCTL_SET_EVENTFD    (_IOW(WARPING_ENGINE_IOCTL_TYPE,WARPING_ENGINE_IOCTL_NR_EVENTFD,int))
+#define WARPING_ENGINE_IOCTL_BO_ALLOC       (_IOWR(WARPING_ENGINE_IOCTL_TYPE,WARPING_ENGINE_IOCTL_NR_BO_ALLOC,warping_engine_bo))
+#define WARPING_ENGINE_IOCTL_BO_FREE        (_IOW(WARPING_ENGINE_IOCTL_TYPE,WARPING_ENGINE_IOCTL_NR_BO_FREE,warping_engine_uint32))
+#define WARPING_ENGINE_IOCTL_BO_EXPORT      (_IOWR(WARPING_ENGINE_IOCTL_TYPE,WARPING_ENGINE_IOCTL_NR_BO_EXPORT,warping_engine_bo_dmabuf))
+#define WARPING_ENGINE_IOCTL_BO_IMPORT      (_IOWR(WARPING_ENGINE_IOCTL_TYPE,WARPING_ENGINE_IOCTL_NR_BO_IMPORT,warping_engine_bo_dmabuf))
+#define WARPING_ENGINE_IOCTL_BO_SYNC        (_IOW(WARPING_ENGINE_IOCTL_TYPE,WARPING_ENGINE_IOCTL_NR_BO_SYNC,warping_engine_bo_sync))
+#define WARPING_ENGINE_IOCTL_SET_BANDS      (_IOW(WARPING_ENGINE_IOCTL_TYPE,WARPING_ENGINE_IOCTL_NR_BANDS,int))
+#define WARPING_ENGINE_IOCTL_SET_BUSY_POLL  (_IOW(WARPING_ENGINE_IOCTL_TYPE,WARPING_ENGINE_IOCTL_NR_BUSY_POLL,int))
+
+/* Image size register layout: width in the lower, height in the upper half */
+#define WARPING_ENGINE_MAKE_SIZE(w,h)       ((((warping_engine_uint32)(h))<<16)|((warping_engine_uint32)(w)&0xffff))
+#define WARPING_ENGINE_SIZE_WIDTH(size)     ((size)&0xffff)
+#define WARPING_ENGINE_SIZE_HEIGHT(size)    (((size)>>16)&0xffff)
+
+/* mmap() page offset of the register window. The window is read only, it
+ * lets status and performance counter registers be sampled without a
+ * system call. Register n is the 32 bit word n of the mapping. The byte
+ * offset is WARPING_ENGINE_MMAP_REGS_PGOFF times the page size */
+#define WARPING_ENGINE_MMAP_REGS_PGOFF      (0x10000)
 
 /* warping_engine physical memory layout */
 typedef struct
@@ -151,6 +186,142 @@ typedef struct
   unsigned long mem_base_phys;  /* video memory start address       */
   unsigned long mem_span;       /* last video memory cell offset    */
 } warping_engine_settings;
+
+/* Per job profiling: performance counter n counts pfc_events[n]
+ * (warping_engine_pfc_event_t) while the job runs, the counter values are
+ * returned in the completion record of the job. Profiled jobs take over
+ * the counters 0 to pfc_count-1. */
+#define WARPING_ENGINE_JOB_PFC_MAX          (8)
+
+/* warping_engine job description (WARPING_ENGINE_IOCTL_SUBMIT)
+ * Every member holds the raw value of the register with the same name.
+ * All addresses are physical and have to point into the video memory or
+ * into a dma-buf imported with WARPING_ENGINE_IOCTL_BO_IMPORT.
+ * The config register is written last, it starts the engine.
+ * Jobs are queued per open file and started back to back, files are served
+ * round robin. The per file sequence number of the job is returned in seq. */
+typedef struct
+{
+  warping_engine_uint32 coordinates_address;
+  warping_engine_uint32 coordinates_count;
+  warping_engine_uint32 input_address;
+  warping_engine_uint32 input_size;         /* WARPING_ENGINE_MAKE_SIZE     */
+  warping_engine_uint32 input_pitch;        /* in pixels                    */
+  warping_engine_uint32 input_byte_pitch;   /* in bytes, input_pitch * 4    */
+  warping_engine_uint32 outside_color;
+  warping_engine_uint32 output_address;
+  warping_engine_uint32 output_size;        /* WARPING_ENGINE_MAKE_SIZE     */
+  warping_engine_uint32 output_pitch;       /* in pixels                    */
+  warping_engine_uint32 stripe_width;       /* 0: one stripe                */
+  warping_engine_uint32 config;
+  warping_engine_uint32 pfc_count;          /* counters to latch, 0: none   */
+  warping_engine_uint32 pfc_events[WARPING_ENGINE_JOB_PFC_MAX];
+  warping_engine_uint32 seq;                /* out: job sequence number     */
+} warping_engine_job;
+
+/* warping_engine job completion record
+ * A read() with a buffer of at least this size returns the completion
+ * records of finished jobs in submission order. The device can be polled
+ * for completions (POLLIN) and free queue slots (POLLOUT). Alternatively
+ * an eventfd registered with WARPING_ENGINE_IOCTL_SET_EVENTFD is signalled
+ * for every finished job (pass -1 to unregister it).
+ * Timestamps are CLOCK_MONOTONIC nanoseconds; complete_ns is taken on
+ * entry of the finished interrupt, before any scheduling delay. */
+typedef struct
+{
+  warping_engine_uint32 seq;                /* sequence number of the job   */
+  warping_engine_uint32 status;             /* IRQ status the job ended with*/
+  warping_engine_uint64 submit_ns;          /* job queued                   */
+  warping_engine_uint64 start_ns;           /* job started on the engine    */
+  warping_engine_uint64 complete_ns;        /* finished interrupt           */
+  warping_engine_uint32 pfc_count;          /* pfc_count of the job         */
+  warping_engine_uint32 reserved;
+  warping_engine_uint32 pfc_values[WARPING_ENGINE_JOB_PFC_MAX];
+} warping_engine_completion;
+
+/* completion status of a job the watchdog aborted: the engine did not
+ * finish it in time and the pipeline was reset */
+#define WARPING_ENGINE_STATUS_TIMEOUT       (0x80000000u)
+
+/* completion status of a job the engine dropped because it names memory
+ * outside of the video memory and the buffers of the job (simulated engine
+ * only) */
+#define WARPING_ENGINE_STATUS_FAULT         (0x40000000u)
+
+/* Busy polling (WARPING_ENGINE_IOCTL_SET_BUSY_POLL, argument in us)
+ * Blocking read() of the file spins on the IRQ status register for up to
+ * this long while a job is outstanding, and completes the job itself when
+ * it finishes. It sleeps when the budget is used up, poll() never spins.
+ * 0 turns busy polling off (default). */
+#define WARPING_ENGINE_BUSY_POLL_MAX_US     (10000)
+
+/* warping_engine buffer object (WARPING_ENGINE_IOCTL_BO_ALLOC)
+ * Buffer objects are allocated from the video memory and belong to the
+ * open file, they are freed with WARPING_ENGINE_IOCTL_BO_FREE (argument is
+ * the handle) or when the file is closed. Queued jobs keep the memory of
+ * their buffers until they finish. mmap() at mmap_offset maps the
+ * buffer, offset 0 still maps the whole video memory.
+ * Buffers are mapped write combined unless WARPING_ENGINE_BO_CACHED is set,
+ * cached mappings need WARPING_ENGINE_IOCTL_BO_SYNC around CPU accesses.
+ * Cached buffers are physically contiguous pages outside the video memory,
+ * their size is limited by the page allocator (4 MiB by default). */
+#define WARPING_ENGINE_BO_CACHED            (0x01)
+
+typedef struct
+{
+  warping_engine_uint32 size;               /* in: size in bytes            */
+  warping_engine_uint32 align;              /* in: alignment, 0 for a page  */
+  warping_engine_uint32 flags;              /* in: WARPING_ENGINE_BO_*      */
+  warping_engine_uint32 handle;             /* out: buffer handle           */
+  warping_engine_uint32 phys;               /* out: address for the engine  */
+  warping_engine_uint32 mmap_offset;        /* out: offset for mmap()       */
+} warping_engine_bo;
+
+/* warping_engine dma-buf sharing
+ * WARPING_ENGINE_IOCTL_BO_EXPORT creates a dma-buf fd for the buffer object
+ * handle (flags: O_CLOEXEC and the access mode of the fd, O_RDWR for
+ * writable mappings). WARPING_ENGINE_IOCTL_BO_IMPORT turns a
+ * physically contiguous dma-buf fd into a buffer object of this file, its
+ * address may be used in jobs like the one of an allocated buffer. */
+typedef struct
+{
+  warping_engine_uint32 handle;             /* export: in, import: out      */
+  int fd;                                   /* export: out, import: in      */
+  warping_engine_uint32 flags;              /* export: in                   */
+  warping_engine_uint32 phys;               /* import: out                  */
+  warping_engine_uint32 size;               /* import: out                  */
+  warping_engine_uint32 mmap_offset;        /* import: out                  */
+} warping_engine_bo_dmabuf;
+
+/* warping_engine CPU access synchronisation (WARPING_ENGINE_IOCTL_BO_SYNC)
+ * Brackets CPU accesses to a buffer: START before the CPU reads or writes
+ * the range, END once it is done. READ and WRITE give the CPU access
+ * direction. A size of 0 covers the buffer from offset to its end. */
+#define WARPING_ENGINE_BO_SYNC_READ         (0x01)
+#define WARPING_ENGINE_BO_SYNC_WRITE        (0x02)
+#define WARPING_ENGINE_BO_SYNC_START        (0x00)
+#define WARPING_ENGINE_BO_SYNC_END          (0x04)
+
+typedef struct
+{
+  warping_engine_uint32 handle;
+  warping_engine_uint32 flags;              /* WARPING_ENGINE_BO_SYNC_*     */
+  warping_engine_uint32 offset;             /* range start in the buffer    */
+  warping_engine_uint32 size;               /* range size, 0 up to the end  */
+} warping_engine_bo_sync;
+
+/* warping_engine V4L2 mem2mem controls (optional front end)
+ * The coordinates table is set as dma-buf fd while both queues are
+ * stopped, -1 drops it. A coordinates count of 0 uses one coordinate per
+ * output pixel. Sizes and pitches follow the queue formats. Buffers of a
+ * frame whose table does not fit the dma-buf are returned with an error. */
+#define WARPING_ENGINE_CID_BASE             (0x00980900 + 0x10f0)
+#define WARPING_ENGINE_CID_MESH_FD          (WARPING_ENGINE_CID_BASE + 0)
+#define WARPING_ENGINE_CID_COORDINATES_COUNT (WARPING_ENGINE_CID_BASE + 1)
+#define WARPING_ENGINE_CID_OUTSIDE_COLOR    (WARPING_ENGINE_CID_BASE + 2)
+#define WARPING_ENGINE_CID_STRIPE_WIDTH     (WARPING_ENGINE_CID_BASE + 3)
+#define WARPING_ENGINE_CID_CONFIG           (WARPING_ENGINE_CID_BASE + 4)
+
 typedef struct warping_engine_config_tag
 {
   warping_engine_uint32 m_revision_major:8;
@@ -202,6 +373,8 @@ void warping_engine_setOutputImagePitch(warping_engine_handle a_handle, warping_
 void warping_engine_setStripeWidth(warping_engine_handle a_handle, warping_engine_uint16 a_stripe_width);
 void warping_engine_resetPipeline(warping_engine_handle a_handle);
 
+/* jobs profile with the counters 0 to WARPING_ENGINE_JOB_PFC_MAX-1, enabling
+ * or selecting an event for a higher counter is ignored */
 void warping_engine_enablePerformanceCounters(warping_engine_handle a_handle, warping_engine_uint32 a_enable_mask);
 void warping_engine_clearPerformanceCounters(warping_engine_handle a_handle, warping_engine_uint32 a_clear_mask);
 void warping_engine_enablePerformanceCounter(warping_engine_handle a_handle, warping_engine_uint8 a_pfc_number);
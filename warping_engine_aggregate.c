@@ -0,0 +1,463 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Aggregate device spreading jobs over all engine instances.
+ *            Jobs go to the least loaded instance, or are split into
+ *            horizontal bands that run on several instances in parallel.
+ *            Completions are reported in submission order.
+ ****************************************************************************/
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/device.h>
+#include <linux/uaccess.h>
+#include "warping_engine_module.h"
+#include "warping_engine_base.h"
+#include "warping_engine_sample.h"
+
+static bool aggregate;
+module_param(aggregate, bool, 0444);
+MODULE_PARM_DESC(aggregate, "Create " WARPING_ENGINE_AGGREGATE_NAME ", spreading jobs over all instances");
+
+#define WARPING_ENGINE_AGG_INST_MAX WARPING_ENGINE_AGGREGATE_MINOR
+
+/* probed instances, the first one is the primary: aggregate files allocate
+ * their buffers on it. Instances share the memory bus, so addresses of the
+ * primary are valid on all of them */
+static LIST_HEAD(warping_engine_agg_devs);
+static LIST_HEAD(warping_engine_agg_files);     /* open aggregate files   */
+static DEFINE_MUTEX(warping_engine_agg_mutex);
+
+static struct cdev warping_engine_agg_cdev;
+static struct class *warping_engine_agg_class;
+static dev_t warping_engine_agg_devt;
+static struct device *warping_engine_agg_device;
+
+/* job of an aggregate file, possibly split over several instances */
+struct warping_engine_agg_job
+{
+  struct list_head list;                /* entry in agg->jobs               */
+  warping_engine_completion record;     /* merged from all bands            */
+  unsigned int pending;                 /* bands still running              */
+  bool failed;                          /* a band did not finish            */
+  struct warping_engine_bo *bos[WARPING_ENGINE_JOB_BOS]; /* used by the bands */
+};
+
+static void warping_engine_agg_job_free(struct warping_engine_agg_job *ajob)
+{
+  warping_engine_bo_put_job(ajob->bos);
+  kfree(ajob);
+}
+
+/* an instance as seen by one aggregate file */
+struct warping_engine_agg_inst
+{
+  struct warping_engine_agg *agg;
+  struct warping_engine_ctx *core;      /* kernel client on the instance,
+                                         * NULL once the instance is gone   */
+  /* owners of the jobs queued on core, in order */
+  struct warping_engine_agg_job *owner[WARPING_ENGINE_QUEUE_DEPTH];
+  unsigned int owner_head;
+  unsigned int owner_cnt;
+};
+
+struct warping_engine_agg
+{
+  struct warping_engine_ctx *ctx;       /* file context on the primary      */
+  struct list_head list;                /* entry in warping_engine_agg_files */
+  spinlock_t lock;                      /* protects jobs and the instances  */
+  struct list_head jobs;                /* in submission order              */
+  int bands;
+  unsigned int count;
+  unsigned int attached;                /* instances with a core            */
+  struct warping_engine_agg_inst inst[WARPING_ENGINE_AGG_INST_MAX];
+};
+
+/* publish finished jobs in submission order. Called with agg->lock held */
+static void warping_engine_agg_publish(struct warping_engine_agg *agg)
+{
+  struct warping_engine_ctx *ctx = agg->ctx;
+  struct warping_engine_agg_job *ajob;
+  unsigned long flags;
+
+  while(!list_empty(&agg->jobs))
+  {
+    ajob = list_first_entry(&agg->jobs, struct warping_engine_agg_job, list);
+    if(ajob->pending)
+      break;
+
+    list_del(&ajob->list);
+    if(ajob->failed)
+      ajob->record.status &= ~WARPING_ENGINE_IRQ_WARPING_FINISHED;
+    /* no band started */
+    if(ajob->record.start_ns == U64_MAX)
+      ajob->record.start_ns = 0;
+    spin_lock_irqsave(&ctx->dev->irq_slck, flags);
+    warping_engine_ctx_complete(ctx, &ajob->record);
+    spin_unlock_irqrestore(&ctx->dev->irq_slck, flags);
+    warping_engine_agg_job_free(ajob);
+  }
+}
+
+/* completion of one band, called from the instance's IRQ handler */
+static void warping_engine_agg_job_done(struct warping_engine_ctx *core, const warping_engine_job *job,
+                                        const warping_engine_completion *record)
+{
+  struct warping_engine_agg_inst *inst = core->priv;
+  struct warping_engine_agg *agg = inst->agg;
+  struct warping_engine_agg_job *ajob;
+  warping_engine_completion *merged;
+  unsigned long flags;
+  unsigned int i;
+
+  spin_lock_irqsave(&agg->lock, flags);
+  if(WARN_ON(!inst->owner_cnt))
+  {
+    spin_unlock_irqrestore(&agg->lock, flags);
+    return;
+  }
+  ajob = inst->owner[inst->owner_head];
+  inst->owner_head = (inst->owner_head + 1) % WARPING_ENGINE_QUEUE_DEPTH;
+  inst->owner_cnt--;
+
+  /* the job finished when all bands did, it spans the earliest start to the
+   * latest completion. Counters are summed over the bands */
+  merged = &ajob->record;
+  if(!(record->status & WARPING_ENGINE_IRQ_WARPING_FINISHED))
+    ajob->failed = true;
+  merged->status |= record->status;
+  merged->start_ns = min(merged->start_ns, record->start_ns);
+  merged->complete_ns = max(merged->complete_ns, record->complete_ns);
+  for(i = 0; i < merged->pfc_count; i++)
+    merged->pfc_values[i] += record->pfc_values[i];
+
+  if(!--ajob->pending)
+    warping_engine_agg_publish(agg);
+  spin_unlock_irqrestore(&agg->lock, flags);
+}
+
+/* instance with the fewest jobs queued, skipping the ones already used */
+static struct warping_engine_agg_inst *warping_engine_agg_pick(struct warping_engine_agg *agg,
+                                                               unsigned long used)
+{
+  struct warping_engine_agg_inst *best = NULL;
+  unsigned int i, load, best_load = UINT_MAX;
+
+  for(i = 0; i < agg->count; i++)
+  {
+    if((used & BIT(i)) || !agg->inst[i].core)
+      continue;
+    load = warping_engine_dev_load(agg->inst[i].core->dev);
+    if(load < best_load)
+    {
+      best = &agg->inst[i];
+      best_load = load;
+    }
+  }
+
+  return best;
+}
+
+int warping_engine_agg_submit(struct warping_engine_ctx *ctx, struct file *fp, unsigned long arg)
+{
+  struct warping_engine_agg *agg = ctx->agg;
+  struct warping_engine_agg_inst *inst;
+  struct warping_engine_agg_job *ajob;
+  warping_engine_job job, band;
+  u32 out_w, out_h, rows, y0, seq;
+  unsigned int n, i;
+  unsigned long used = 0;
+  unsigned long flags;
+  int result;
+
+  if(copy_from_user(&job, (void __user *) arg, sizeof(job)))
+    return -EFAULT;
+
+  ajob = kzalloc(sizeof(*ajob), GFP_KERNEL);
+  if(!ajob)
+    return -ENOMEM;
+
+  result = warping_engine_validate_job(ctx, &job, ajob->bos);
+  if(result)
+  {
+    dev_dbg(ctx->dev->device, "rejected invalid job (%d)\n", result);
+    kfree(ajob);
+    return result;
+  }
+
+  out_w = WARPING_ENGINE_SIZE_WIDTH(job.output_size);
+  out_h = WARPING_ENGINE_SIZE_HEIGHT(job.output_size);
+
+  result = warping_engine_wait_slot(ctx, fp, &flags);
+  if(result)
+  {
+    warping_engine_agg_job_free(ajob);
+    return result;
+  }
+  seq = ++ctx->job_seq;
+  ctx->job_inflight++;
+  spin_unlock_irqrestore(&ctx->dev->irq_slck, flags);
+
+  ajob->record.seq = seq;
+  ajob->record.submit_ns = ktime_get_ns();
+  ajob->record.start_ns = U64_MAX;
+  ajob->record.pfc_count = job.pfc_count;
+
+  spin_lock_irqsave(&agg->lock, flags);
+  n = 1;
+  if(agg->bands > 1)
+    n = min3((u32) agg->bands, (u32) agg->attached, out_h);
+  n = min(n, agg->attached);
+  rows = out_h;
+  if(n)
+  {
+    rows = DIV_ROUND_UP(out_h, n);
+    n = DIV_ROUND_UP(out_h, rows);
+  }
+  ajob->pending = n;
+  list_add_tail(&ajob->list, &agg->jobs);
+  /* all instances are gone */
+  if(!n)
+  {
+    ajob->failed = true;
+    warping_engine_agg_publish(agg);
+  }
+  for(i = 0; i < n; i++)
+  {
+    /* the coordinates table is in raster order, a band of rows is a
+     * contiguous range of it */
+    y0 = i * rows;
+    band = job;
+    band.output_address += y0 * job.output_pitch * BYTES_PER_PIXEL;
+    band.output_size = WARPING_ENGINE_MAKE_SIZE(out_w, min(rows, out_h - y0));
+    band.coordinates_address += y0 * out_w * sizeof(warping_engine_coordinate);
+    band.coordinates_count = clamp_t(s64, (s64) job.coordinates_count - (s64) y0 * out_w,
+                                     0, (s64) rows * out_w);
+
+    /* the table ends before this band, it and the bands below it have
+     * nothing to warp */
+    if(!band.coordinates_count)
+    {
+      ajob->pending -= n - i;
+      if(!ajob->pending)
+        warping_engine_agg_publish(agg);
+      break;
+    }
+
+    inst = warping_engine_agg_pick(agg, used);
+    used |= BIT(inst - agg->inst);
+
+    inst->owner[(inst->owner_head + inst->owner_cnt) % WARPING_ENGINE_QUEUE_DEPTH] = ajob;
+    inst->owner_cnt++;
+    result = warping_engine_queue_job(inst->core, &band);
+    if(result < 0)
+    {
+      /* report the bands that did not run as failed */
+      inst->owner_cnt--;
+      ajob->failed = true;
+      ajob->pending -= n - i;
+      if(!ajob->pending)
+        warping_engine_agg_publish(agg);
+      break;
+    }
+  }
+  spin_unlock_irqrestore(&agg->lock, flags);
+
+  if(put_user(seq, &((warping_engine_job __user *) arg)->seq))
+    return -EFAULT;
+
+  return 0;
+}
+
+int warping_engine_agg_set_bands(struct warping_engine_agg *agg, int bands)
+{
+  unsigned long flags;
+
+  if(bands < 0)
+    return -EINVAL;
+
+  spin_lock_irqsave(&agg->lock, flags);
+  agg->bands = bands;
+  spin_unlock_irqrestore(&agg->lock, flags);
+
+  return 0;
+}
+
+int warping_engine_agg_open(struct file *fp)
+{
+  struct warping_engine_dev *dev;
+  struct warping_engine_agg *agg;
+  struct warping_engine_ctx *ctx;
+  unsigned int i;
+  int result = -ENODEV;
+
+  agg = kzalloc(sizeof(*agg), GFP_KERNEL);
+  if(!agg)
+    return -ENOMEM;
+  spin_lock_init(&agg->lock);
+  INIT_LIST_HEAD(&agg->jobs);
+
+  mutex_lock(&warping_engine_agg_mutex);
+  list_for_each_entry(dev, &warping_engine_agg_devs, agg_list)
+  {
+    if(agg->count == WARPING_ENGINE_AGG_INST_MAX)
+      break;
+
+    agg->inst[agg->count].agg = agg;
+    agg->inst[agg->count].core = warping_engine_ctx_create(dev);
+    if(!agg->inst[agg->count].core)
+    {
+      result = -ENOMEM;
+      goto FAILED;
+    }
+    agg->inst[agg->count].core->job_done = warping_engine_agg_job_done;
+    agg->inst[agg->count].core->priv = &agg->inst[agg->count];
+    agg->count++;
+  }
+  agg->attached = agg->count;
+  if(!agg->count)
+    goto FAILED;
+
+  /* the file itself is a regular context on the primary instance */
+  ctx = warping_engine_ctx_create(agg->inst[0].core->dev);
+  if(!ctx)
+  {
+    result = -ENOMEM;
+    goto FAILED;
+  }
+  agg->ctx = ctx;
+  list_add_tail(&agg->list, &warping_engine_agg_files);
+  mutex_unlock(&warping_engine_agg_mutex);
+
+  ctx->agg = agg;
+  fp->private_data = ctx;
+
+  return 0;
+
+FAILED:
+  mutex_unlock(&warping_engine_agg_mutex);
+  for(i = 0; i < agg->count; i++)
+    warping_engine_ctx_destroy(agg->inst[i].core);
+  kfree(agg);
+  return result;
+}
+
+/* called before the file context is destroyed */
+void warping_engine_agg_release(struct warping_engine_agg *agg)
+{
+  struct warping_engine_agg_job *ajob, *tmp;
+  unsigned int i;
+
+  /* a removed instance cannot detach from the file any more */
+  mutex_lock(&warping_engine_agg_mutex);
+  list_del(&agg->list);
+  mutex_unlock(&warping_engine_agg_mutex);
+
+  /* waits for running bands and their callbacks */
+  for(i = 0; i < agg->count; i++)
+  {
+    if(agg->inst[i].core)
+      warping_engine_ctx_destroy(agg->inst[i].core);
+  }
+
+  list_for_each_entry_safe(ajob, tmp, &agg->jobs, list)
+    warping_engine_agg_job_free(ajob);
+  kfree(agg);
+}
+
+void warping_engine_agg_add_dev(struct warping_engine_dev *dev)
+{
+  mutex_lock(&warping_engine_agg_mutex);
+  list_add_tail(&dev->agg_list, &warping_engine_agg_devs);
+  mutex_unlock(&warping_engine_agg_mutex);
+}
+
+/* detach an instance from an open aggregate file. Bands queued on it are
+ * dropped, their jobs complete as failed. Called with
+ * warping_engine_agg_mutex held */
+static void warping_engine_agg_detach(struct warping_engine_agg_inst *inst)
+{
+  struct warping_engine_agg *agg = inst->agg;
+  struct warping_engine_ctx *core;
+  unsigned long flags;
+
+  /* no new bands once the core is gone from the instance */
+  spin_lock_irqsave(&agg->lock, flags);
+  core = inst->core;
+  inst->core = NULL;
+  agg->attached--;
+  spin_unlock_irqrestore(&agg->lock, flags);
+
+  /* waits for the running band and its callback */
+  warping_engine_ctx_destroy(core);
+
+  spin_lock_irqsave(&agg->lock, flags);
+  while(inst->owner_cnt)
+  {
+    inst->owner[inst->owner_head]->failed = true;
+    inst->owner[inst->owner_head]->pending--;
+    inst->owner_head = (inst->owner_head + 1) % WARPING_ENGINE_QUEUE_DEPTH;
+    inst->owner_cnt--;
+  }
+  warping_engine_agg_publish(agg);
+  spin_unlock_irqrestore(&agg->lock, flags);
+}
+
+/* open aggregate files stop using the instance. Their own context is on
+ * the primary instance like any other file of it */
+void warping_engine_agg_remove_dev(struct warping_engine_dev *dev)
+{
+  struct warping_engine_agg *agg;
+  unsigned int i;
+
+  mutex_lock(&warping_engine_agg_mutex);
+  list_del(&dev->agg_list);
+  list_for_each_entry(agg, &warping_engine_agg_files, list)
+  {
+    for(i = 0; i < agg->count; i++)
+    {
+      if(agg->inst[i].core && agg->inst[i].core->dev == dev)
+        warping_engine_agg_detach(&agg->inst[i]);
+    }
+  }
+  mutex_unlock(&warping_engine_agg_mutex);
+}
+
+int warping_engine_agg_register(struct class *class, dev_t devt, const struct file_operations *fops)
+{
+  int result;
+
+  if(!aggregate)
+    return 0;
+
+  cdev_init(&warping_engine_agg_cdev, fops);
+  warping_engine_agg_cdev.owner = THIS_MODULE;
+  result = cdev_add(&warping_engine_agg_cdev, devt, 1);
+  if(result)
+    return result;
+
+  warping_engine_agg_device = device_create(class, NULL, devt, NULL, WARPING_ENGINE_AGGREGATE_NAME);
+  if(IS_ERR(warping_engine_agg_device))
+  {
+    cdev_del(&warping_engine_agg_cdev);
+    return PTR_ERR(warping_engine_agg_device);
+  }
+  warping_engine_agg_class = class;
+  warping_engine_agg_devt = devt;
+
+  return 0;
+}
+
+void warping_engine_agg_unregister(void)
+{
+  if(!warping_engine_agg_class)
+    return;
+
+  device_destroy(warping_engine_agg_class, warping_engine_agg_devt);
+  cdev_del(&warping_engine_agg_cdev);
+  warping_engine_agg_class = NULL;
+}
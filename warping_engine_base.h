@@ -56,6 +56,9 @@
 #define WARPING_ENGINE_PFC_VALUE_REG_BASE              ( 64)
 
 
+// registers below the performance counter values are shadowed
+#define WARPING_ENGINE_SHADOW_REGS                     WARPING_ENGINE_PFC_VALUE_REG_BASE
+
 typedef struct warping_engine_context_tag
 {
   warping_engine_uint32 m_size;
@@ -70,6 +73,13 @@ typedef struct warping_engine_context_tag
   warping_engine_isr_callback m_irq;
   warping_engine_uint32 m_irq_data;
   
+  // register shadow: last value of every register, a job start submits
+  // all of them
+  warping_engine_uint32 m_shadow[WARPING_ENGINE_SHADOW_REGS];
+  
+  // platform code data
+  warping_engine_ptr m_arch;
+  
 } warping_engine_context;
 
 // functions defined in warping engine platform code:
@@ -82,9 +92,14 @@ warping_engine_ptr warping_engine_arch_malloc(warping_engine_uint32 a_size);
 void warping_engine_arch_free(warping_engine_ptr a_ptr);
 warping_engine_uint32 warping_engine_arch_readReg(warping_engine_context *a_context, warping_engine_uint32 a_regAddress);
 void warping_engine_arch_writeReg(warping_engine_context *a_context, warping_engine_uint32 a_regAddress, warping_engine_uint32 a_value);
+warping_engine_bool warping_engine_arch_startJob(warping_engine_context *a_context);
+void warping_engine_arch_lock(warping_engine_context *a_context);
+void warping_engine_arch_unlock(warping_engine_context *a_context);
+warping_engine_uint32 warping_engine_arch_getPerformanceCounterValue(warping_engine_context *a_context, warping_engine_uint8 a_pfc_number);
 
 // internal functions
 warping_engine_context *warping_engine_validateContext(warping_engine_ptr a_context);
 void warping_engine_resetRegisters(warping_engine_context *a_context);
+void warping_engine_writeShadow(warping_engine_context *a_context, warping_engine_uint32 a_regAddress, warping_engine_uint32 a_value);
 
 #endif // WARPING_ENGINE_BASE_H_
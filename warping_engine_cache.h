@@ -0,0 +1,79 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Model of the engine's texture cache and memory interface (MBI).
+ *            Shared by the simulation backend, whose performance counters
+ *            it drives, and the offline traffic analyzer, so predictions
+ *            and simulated counters agree.
+ *            The cache has direct mapped lines of 16 pixels of an input
+ *            row, a missed line is one burst read and stalls the pipeline.
+ ****************************************************************************/
+
+#ifndef WARPING_ENGINE_CACHE_H_
+#define WARPING_ENGINE_CACHE_H_
+
+#include "warping_engine_sample.h"
+
+#define WARPING_ENGINE_CACHE_LINE_PIXELS    (16)
+#define WARPING_ENGINE_CACHE_LINES          (256)
+#define WARPING_ENGINE_CACHE_MISS_CYCLES    (16)
+/* words of a burst of the coordinates reader and the write assembly */
+#define WARPING_ENGINE_MBI_BURST_WORDS      (16)
+/* lines a pixel can miss: two taps wide, two rows high */
+#define WARPING_ENGINE_CACHE_FETCH_MAX      (4)
+
+typedef struct
+{
+  warping_engine_uint32 tags[WARPING_ENGINE_CACHE_LINES];
+} warping_engine_cache;
+
+/* empty cache, at the start of a frame */
+static inline void warping_engine_cache_reset(warping_engine_cache *cache)
+{
+  unsigned int i;
+
+  for(i = 0; i < WARPING_ENGINE_CACHE_LINES; i++)
+    cache->tags[i] = ~0u;
+}
+
+/* Fetch the lines of the taps of the pixel at pos. A line is numbered
+ * row * lines per pitch + line in the row. Returns the number of missed
+ * lines, their numbers go to missed (may be NULL) */
+static inline unsigned int warping_engine_cache_fetch(warping_engine_cache *cache, warping_engine_coordinate pos,
+                                                      warping_engine_uint32 width, warping_engine_uint32 height,
+                                                      warping_engine_uint32 pitch,
+                                                      warping_engine_uint32 *missed)
+{
+  int x0 = pos.x >> WARPING_ENGINE_COORD_SHIFT;
+  int y0 = pos.y >> WARPING_ENGINE_COORD_SHIFT;
+  warping_engine_uint32 lines_per_row = (pitch + WARPING_ENGINE_CACHE_LINE_PIXELS - 1) / WARPING_ENGINE_CACHE_LINE_PIXELS;
+  int first = x0 > 0 ? x0 : 0;
+  int last = x0 + 1 < (int)width - 1 ? x0 + 1 : (int)width - 1;
+  int y_last = y0 + 1 < (int)height - 1 ? y0 + 1 : (int)height - 1;
+  unsigned int misses = 0;
+  warping_engine_uint32 line, tag;
+  int y;
+
+  if(first > last)
+    return 0;
+
+  for(y = y0 > 0 ? y0 : 0; y <= y_last; y++)
+  {
+    for(line = first / WARPING_ENGINE_CACHE_LINE_PIXELS; line <= (warping_engine_uint32)last / WARPING_ENGINE_CACHE_LINE_PIXELS; line++)
+    {
+      tag = (warping_engine_uint32)y * lines_per_row + line;
+      if(cache->tags[tag % WARPING_ENGINE_CACHE_LINES] == tag)
+        continue;
+
+      cache->tags[tag % WARPING_ENGINE_CACHE_LINES] = tag;
+      if(missed)
+        missed[misses] = tag;
+      misses++;
+    }
+  }
+
+  return misses;
+}
+
+#endif // WARPING_ENGINE_CACHE_H_
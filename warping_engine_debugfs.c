@@ -0,0 +1,179 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Always-on latency histograms of the job path, exposed in
+ *            debugfs as <debugfs>/warpingengine/<device>/latency.
+ ****************************************************************************/
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/bitops.h>
+#include "warping_engine_module.h"
+#include "warping_engine_base.h"
+
+static struct dentry *warping_engine_debugfs_root;
+
+static const char * const warping_engine_stage_names[WARPING_ENGINE_STAGE_CNT] = {
+  [WARPING_ENGINE_STAGE_QUEUE] = "queue",
+  [WARPING_ENGINE_STAGE_EXEC] = "exec",
+  [WARPING_ENGINE_STAGE_IRQ] = "irq",
+  [WARPING_ENGINE_STAGE_WAKEUP] = "wakeup",
+  [WARPING_ENGINE_STAGE_SPIN] = "spin",
+};
+
+/* add the latency from..to to a stage histogram. Called with irq_slck held */
+void warping_engine_hist_add(struct warping_engine_dev *dev, enum warping_engine_stage stage,
+                             ktime_t from, ktime_t to)
+{
+  struct warping_engine_hist *hist = &dev->hist[stage];
+  s64 delta = ktime_to_ns(ktime_sub(to, from));
+  u64 ns = delta > 0 ? delta : 0;
+
+  hist->count++;
+  hist->sum_ns += ns;
+  hist->max_ns = max(hist->max_ns, ns);
+  hist->buckets[min_t(unsigned int, fls64(ns), WARPING_ENGINE_HIST_BUCKETS - 1)]++;
+}
+
+/* upper bound of the bucket holding the given fraction (per mille) */
+static u64 warping_engine_hist_percentile(const struct warping_engine_hist *hist, unsigned int permille)
+{
+  u64 target = DIV_ROUND_UP_ULL(hist->count * permille, 1000);
+  u64 sum = 0;
+  unsigned int i;
+
+  for(i = 0; i < WARPING_ENGINE_HIST_BUCKETS; i++)
+  {
+    sum += hist->buckets[i];
+    if(sum >= target)
+      return 1ull << i;
+  }
+
+  return hist->max_ns;
+}
+
+static int warping_engine_latency_show(struct seq_file *s, void *unused)
+{
+  struct warping_engine_dev *dev = s->private;
+  struct warping_engine_hist *hist;
+  struct warping_engine_poll_stats stats;
+  struct warping_engine_hang_stats hangs;
+  unsigned long flags;
+  unsigned int i, j;
+
+  hist = kmalloc_array(WARPING_ENGINE_STAGE_CNT, sizeof(*hist), GFP_KERNEL);
+  if(!hist)
+    return -ENOMEM;
+
+  spin_lock_irqsave(&dev->irq_slck, flags);
+  memcpy(hist, dev->hist, WARPING_ENGINE_STAGE_CNT * sizeof(*hist));
+  stats = dev->poll_stats;
+  hangs = dev->hang_stats;
+  spin_unlock_irqrestore(&dev->irq_slck, flags);
+
+  seq_printf(s, "%-8s %12s %12s %12s %12s %12s %12s\n",
+             "stage", "count", "mean_ns", "max_ns", "p50_ns<=", "p99_ns<=", "p999_ns<=");
+  for(j = 0; j < WARPING_ENGINE_STAGE_CNT; j++)
+  {
+    seq_printf(s, "%-8s %12llu %12llu %12llu %12llu %12llu %12llu\n",
+               warping_engine_stage_names[j], hist[j].count,
+               hist[j].count ? div64_u64(hist[j].sum_ns, hist[j].count) : 0,
+               hist[j].max_ns,
+               warping_engine_hist_percentile(&hist[j], 500),
+               warping_engine_hist_percentile(&hist[j], 990),
+               warping_engine_hist_percentile(&hist[j], 999));
+  }
+
+  seq_printf(s, "\nbusy poll: %llu spins, %llu hits, %llu misses, %llu ns spun\n",
+             stats.spins, stats.hits, stats.spins - stats.hits, stats.spin_ns);
+  seq_printf(s, "watchdog: %llu hangs, %llu retried, %llu failed\n",
+             hangs.hangs, hangs.retries, hangs.failures);
+
+  seq_printf(s, "\n%-14s", "ns<");
+  for(j = 0; j < WARPING_ENGINE_STAGE_CNT; j++)
+    seq_printf(s, " %12s", warping_engine_stage_names[j]);
+  seq_putc(s, '\n');
+  for(i = 0; i < WARPING_ENGINE_HIST_BUCKETS; i++)
+  {
+    for(j = 0; j < WARPING_ENGINE_STAGE_CNT; j++)
+    {
+      if(hist[j].buckets[i])
+        break;
+    }
+    if(j == WARPING_ENGINE_STAGE_CNT)
+      continue;
+
+    seq_printf(s, "%-14llu", 1ull << i);
+    for(j = 0; j < WARPING_ENGINE_STAGE_CNT; j++)
+      seq_printf(s, " %12llu", hist[j].buckets[i]);
+    seq_putc(s, '\n');
+  }
+
+  kfree(hist);
+
+  return 0;
+}
+
+static int warping_engine_latency_open(struct inode *inode, struct file *file)
+{
+  return single_open(file, warping_engine_latency_show, inode->i_private);
+}
+
+/* any write resets the histograms and the counters */
+static ssize_t warping_engine_latency_write(struct file *file, const char __user *buf,
+                                            size_t count, loff_t *ppos)
+{
+  struct warping_engine_dev *dev = ((struct seq_file *) file->private_data)->private;
+  unsigned long flags;
+
+  spin_lock_irqsave(&dev->irq_slck, flags);
+  memset(dev->hist, 0, sizeof(dev->hist));
+  memset(&dev->poll_stats, 0, sizeof(dev->poll_stats));
+  memset(&dev->hang_stats, 0, sizeof(dev->hang_stats));
+  spin_unlock_irqrestore(&dev->irq_slck, flags);
+
+  return count;
+}
+
+static const struct file_operations warping_engine_latency_fops = {
+  .owner = THIS_MODULE,
+  .open = warping_engine_latency_open,
+  .read = seq_read,
+  .write = warping_engine_latency_write,
+  .llseek = seq_lseek,
+  .release = single_release,
+};
+
+/* debugfs is optional, failures are not reported */
+void warping_engine_debugfs_init(struct warping_engine_dev *dev)
+{
+  if(IS_ERR_OR_NULL(warping_engine_debugfs_root))
+    return;
+
+  dev->debugfs = debugfs_create_dir(dev_name(dev->device), warping_engine_debugfs_root);
+  if(IS_ERR_OR_NULL(dev->debugfs))
+    return;
+
+  debugfs_create_file("latency", 0600, dev->debugfs, dev, &warping_engine_latency_fops);
+}
+
+void warping_engine_debugfs_exit(struct warping_engine_dev *dev)
+{
+  debugfs_remove_recursive(dev->debugfs);
+  dev->debugfs = NULL;
+}
+
+void warping_engine_debugfs_register(void)
+{
+  warping_engine_debugfs_root = debugfs_create_dir(WARPING_ENGINE_DEVICE_NAME, NULL);
+}
+
+void warping_engine_debugfs_unregister(void)
+{
+  debugfs_remove_recursive(warping_engine_debugfs_root);
+  warping_engine_debugfs_root = NULL;
+}
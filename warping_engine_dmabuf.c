@@ -0,0 +1,297 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : dma-buf export of buffer objects and import of contiguous
+ *            dma-bufs from other drivers (camera, display, udmabuf).
+ ****************************************************************************/
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/fcntl.h>
+#include <linux/file.h>
+#include <linux/uaccess.h>
+#include <linux/dma-mapping.h>
+#include <linux/dma-buf.h>
+#include <linux/scatterlist.h>
+#include "warping_engine_module.h"
+#include "warping_engine_base.h"
+
+/* exporter side */
+static struct sg_table *warping_engine_dmabuf_map(struct dma_buf_attachment *attach,
+                                                  enum dma_data_direction dir)
+{
+  struct warping_engine_bo *bo = attach->dmabuf->priv;
+  struct sg_table *sgt;
+  int result;
+
+  sgt = kzalloc(sizeof(*sgt), GFP_KERNEL);
+  if(!sgt)
+    return ERR_PTR(-ENOMEM);
+
+  /* cached buffers are plain pages, not coherent DMA memory */
+  if(bo->pages)
+  {
+    result = sg_alloc_table(sgt, 1, GFP_KERNEL);
+    if(!result)
+      sg_set_page(sgt->sgl, bo->pages, bo->size, 0);
+  }
+  else
+  {
+    result = dma_get_sgtable(bo->vidmem->device, sgt, bo->virt, bo->phys, bo->size);
+  }
+  if(result)
+    goto SGT_FAILED;
+
+  sgt->nents = dma_map_sg(attach->dev, sgt->sgl, sgt->orig_nents, dir);
+  if(!sgt->nents)
+  {
+    result = -ENOMEM;
+    goto MAP_FAILED;
+  }
+
+  return sgt;
+
+MAP_FAILED:
+  sg_free_table(sgt);
+SGT_FAILED:
+  kfree(sgt);
+  return ERR_PTR(result);
+}
+
+static void warping_engine_dmabuf_unmap(struct dma_buf_attachment *attach,
+                                        struct sg_table *sgt, enum dma_data_direction dir)
+{
+  dma_unmap_sg(attach->dev, sgt->sgl, sgt->orig_nents, dir);
+  sg_free_table(sgt);
+  kfree(sgt);
+}
+
+static void warping_engine_dmabuf_release(struct dma_buf *dmabuf)
+{
+  warping_engine_bo_put(dmabuf->priv);
+}
+
+static void *warping_engine_dmabuf_kmap(struct dma_buf *dmabuf, unsigned long page_num)
+{
+  struct warping_engine_bo *bo = dmabuf->priv;
+
+  return bo->virt + (page_num << PAGE_SHIFT);
+}
+
+static void *warping_engine_dmabuf_vmap(struct dma_buf *dmabuf)
+{
+  struct warping_engine_bo *bo = dmabuf->priv;
+
+  return bo->virt;
+}
+
+static int warping_engine_dmabuf_mmap(struct dma_buf *dmabuf, struct vm_area_struct *vma)
+{
+  return warping_engine_bo_map_vma(dmabuf->priv, vma);
+}
+
+static u32 warping_engine_dmabuf_sync_flags(enum dma_data_direction dir)
+{
+  switch(dir)
+  {
+    case DMA_TO_DEVICE:
+      return WARPING_ENGINE_BO_SYNC_WRITE;
+    case DMA_FROM_DEVICE:
+      return WARPING_ENGINE_BO_SYNC_READ;
+    default:
+      return WARPING_ENGINE_BO_SYNC_READ | WARPING_ENGINE_BO_SYNC_WRITE;
+  }
+}
+
+static int warping_engine_dmabuf_begin_cpu_access(struct dma_buf *dmabuf, enum dma_data_direction dir)
+{
+  return warping_engine_bo_sync(dmabuf->priv,
+            warping_engine_dmabuf_sync_flags(dir) | WARPING_ENGINE_BO_SYNC_START, 0, 0);
+}
+
+static int warping_engine_dmabuf_end_cpu_access(struct dma_buf *dmabuf, enum dma_data_direction dir)
+{
+  return warping_engine_bo_sync(dmabuf->priv,
+            warping_engine_dmabuf_sync_flags(dir) | WARPING_ENGINE_BO_SYNC_END, 0, 0);
+}
+
+static const struct dma_buf_ops warping_engine_dmabuf_ops = {
+  .map_dma_buf = warping_engine_dmabuf_map,
+  .unmap_dma_buf = warping_engine_dmabuf_unmap,
+  .release = warping_engine_dmabuf_release,
+  .map = warping_engine_dmabuf_kmap,
+  .map_atomic = warping_engine_dmabuf_kmap,
+  .vmap = warping_engine_dmabuf_vmap,
+  .mmap = warping_engine_dmabuf_mmap,
+  .begin_cpu_access = warping_engine_dmabuf_begin_cpu_access,
+  .end_cpu_access = warping_engine_dmabuf_end_cpu_access,
+};
+
+int warping_engine_dmabuf_export(struct warping_engine_ctx *ctx, unsigned long arg)
+{
+  DEFINE_DMA_BUF_EXPORT_INFO(exp_info);
+  warping_engine_bo_dmabuf req;
+  struct warping_engine_bo *bo;
+  struct dma_buf *dmabuf;
+  int fd;
+
+  if(copy_from_user(&req, (void __user *) arg, sizeof(req)))
+    return -EFAULT;
+
+  if(req.flags & ~(O_CLOEXEC | O_ACCMODE))
+    return -EINVAL;
+
+  bo = warping_engine_bo_lookup(ctx, req.handle);
+  if(!bo)
+    return -EINVAL;
+
+  /* re-exporting a foreign buffer is up to its exporter */
+  if(bo->import)
+  {
+    warping_engine_bo_put(bo);
+    return -EINVAL;
+  }
+
+  /* the dma-buf takes over the lookup reference */
+  exp_info.ops = &warping_engine_dmabuf_ops;
+  exp_info.size = bo->size;
+  exp_info.flags = req.flags & O_ACCMODE;
+  exp_info.priv = bo;
+  dmabuf = dma_buf_export(&exp_info);
+  if(IS_ERR(dmabuf))
+  {
+    warping_engine_bo_put(bo);
+    return PTR_ERR(dmabuf);
+  }
+
+  /* the fd is only installed once it has been reported, it cannot be
+   * closed again on a failed copy */
+  fd = get_unused_fd_flags(req.flags & O_CLOEXEC);
+  if(fd < 0)
+  {
+    dma_buf_put(dmabuf);
+    return fd;
+  }
+
+  req.fd = fd;
+  if(copy_to_user((void __user *) arg, &req, sizeof(req)))
+  {
+    put_unused_fd(fd);
+    dma_buf_put(dmabuf);
+    return -EFAULT;
+  }
+  fd_install(fd, dmabuf->file);
+
+  return 0;
+}
+
+/* importer side */
+void warping_engine_dmabuf_detach(struct warping_engine_bo *bo)
+{
+  dma_buf_unmap_attachment(bo->attach, bo->sgt, DMA_BIDIRECTIONAL);
+  dma_buf_detach(bo->import, bo->attach);
+  dma_buf_put(bo->import);
+}
+
+/* import a contiguous dma-buf as buffer object without a handle */
+struct warping_engine_bo *warping_engine_dmabuf_import_fd(struct warping_engine_dev *dev, int fd)
+{
+  struct warping_engine_bo *bo;
+  struct scatterlist *sg;
+  dma_addr_t next;
+  unsigned int i;
+  int result;
+
+  bo = kzalloc(sizeof(*bo), GFP_KERNEL);
+  if(!bo)
+    return ERR_PTR(-ENOMEM);
+
+  kref_init(&bo->ref);
+
+  bo->import = dma_buf_get(fd);
+  if(IS_ERR(bo->import))
+  {
+    result = PTR_ERR(bo->import);
+    goto GET_FAILED;
+  }
+
+  bo->attach = dma_buf_attach(bo->import, dev->device);
+  if(IS_ERR(bo->attach))
+  {
+    result = PTR_ERR(bo->attach);
+    goto ATTACH_FAILED;
+  }
+
+  bo->sgt = dma_buf_map_attachment(bo->attach, DMA_BIDIRECTIONAL);
+  if(IS_ERR(bo->sgt))
+  {
+    result = PTR_ERR(bo->sgt);
+    goto MAP_FAILED;
+  }
+
+  /* the engine has no MMU, the buffer has to be contiguous for it and
+   * reachable with 32 bit addresses */
+  next = sg_dma_address(bo->sgt->sgl);
+  for_each_sg(bo->sgt->sgl, sg, bo->sgt->nents, i)
+  {
+    if(sg_dma_address(sg) != next)
+    {
+      dev_dbg(dev->device, "imported dma-buf is not contiguous\n");
+      result = -EINVAL;
+      goto CHECK_FAILED;
+    }
+    next += sg_dma_len(sg);
+  }
+  if((u64) next > (u64) U32_MAX + 1)
+  {
+    result = -EINVAL;
+    goto CHECK_FAILED;
+  }
+
+  bo->phys = sg_dma_address(bo->sgt->sgl);
+  bo->size = bo->import->size;
+
+  return bo;
+
+CHECK_FAILED:
+  dma_buf_unmap_attachment(bo->attach, bo->sgt, DMA_BIDIRECTIONAL);
+MAP_FAILED:
+  dma_buf_detach(bo->import, bo->attach);
+ATTACH_FAILED:
+  dma_buf_put(bo->import);
+GET_FAILED:
+  kfree(bo);
+  return ERR_PTR(result);
+}
+
+int warping_engine_dmabuf_import(struct warping_engine_ctx *ctx, unsigned long arg)
+{
+  warping_engine_bo_dmabuf req;
+  struct warping_engine_bo *bo;
+  int result;
+
+  if(copy_from_user(&req, (void __user *) arg, sizeof(req)))
+    return -EFAULT;
+
+  bo = warping_engine_dmabuf_import_fd(ctx->dev, req.fd);
+  if(IS_ERR(bo))
+    return PTR_ERR(bo);
+
+  result = warping_engine_bo_add_handle(ctx, bo);
+  if(result)
+    return result;
+
+  req.handle = bo->handle;
+  req.phys = bo->phys;
+  req.size = bo->size;
+  req.mmap_offset = bo->handle << PAGE_SHIFT;
+  if(copy_to_user((void __user *) arg, &req, sizeof(req)))
+  {
+    warping_engine_bo_free(ctx, req.handle);
+    return -EFAULT;
+  }
+
+  return 0;
+}
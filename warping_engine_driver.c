@@ -29,32 +29,182 @@
 #include <linux/platform_device.h>
 #include <linux/mm.h>
 #include <linux/dma-mapping.h>
+#include <linux/slab.h>
+#include <linux/list.h>
+#include <linux/poll.h>
+#include <linux/eventfd.h>
 #include <asm/io.h>
 #include <asm/uaccess.h>
 #include "warping_engine_module.h"
 #include "warping_engine_base.h"
+#include "warping_engine_sample.h"
 
-/* store class globally. */
+#define CREATE_TRACE_POINTS
+#include "warping_engine_trace.h"
+
+/* Watchdog: a job taking longer than watchdog_ms plus its output pixels at
+ * watchdog_mpix Mpixel/s is considered hung. The pipeline is reset and the
+ * job restarted up to watchdog_retries times, then it fails. Jobs of
+ * closed files are not restarted */
+static unsigned int watchdog_ms = 100;
+module_param(watchdog_ms, uint, 0644);
+MODULE_PARM_DESC(watchdog_ms, "Job timeout base in ms, 0 disables the watchdog (default 100)");
+
+static unsigned int watchdog_mpix = 10;
+module_param(watchdog_mpix, uint, 0644);
+MODULE_PARM_DESC(watchdog_mpix, "Slowest expected throughput in Mpixel/s, scales the job timeout (default 10)");
+
+static unsigned int watchdog_retries = 1;
+module_param(watchdog_retries, uint, 0644);
+MODULE_PARM_DESC(watchdog_retries, "Restarts of a hung job before it fails (default 1)");
+
+/* store class and char device region globally, they are shared by all
+ * instances. Instances take the minors below WARPING_ENGINE_AGGREGATE_MINOR */
 struct class *warping_engine_class;
+static dev_t warping_engine_devt;
+static DEFINE_IDA(warping_engine_minors);
+
+/* free a job and drop its buffer references, may be called in atomic
+ * context */
+static void warping_engine_kjob_free(struct warping_engine_kjob *kjob)
+{
+  if(!kjob)
+    return;
+  warping_engine_bo_put_job(kjob->bos);
+  kfree(kjob);
+}
+
+static bool warping_engine_ctx_running(struct warping_engine_ctx *ctx)
+{
+  unsigned long flags;
+  bool result;
+
+  spin_lock_irqsave(&ctx->dev->irq_slck, flags);
+  result = (ctx->dev->job_active && ctx->dev->job_active->ctx == ctx) || ctx->callback_pending;
+  spin_unlock_irqrestore(&ctx->dev->irq_slck, flags);
+
+  return result;
+}
+
+/* create a job queue client, for an open file or a kernel front end */
+struct warping_engine_ctx *warping_engine_ctx_create(struct warping_engine_dev *dev)
+{
+  struct warping_engine_ctx *ctx;
+  unsigned long flags;
+
+  ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+  if(!ctx)
+    return NULL;
+
+  ctx->dev = dev;
+  init_waitqueue_head(&ctx->waitq);
+  INIT_LIST_HEAD(&ctx->job_queue);
+  warping_engine_bo_init_ctx(ctx);
+
+  spin_lock_irqsave(&dev->irq_slck, flags);
+  list_add_tail(&ctx->list, &dev->ctx_list);
+  spin_unlock_irqrestore(&dev->irq_slck, flags);
+
+  return ctx;
+}
+
+void warping_engine_ctx_destroy(struct warping_engine_ctx *ctx)
+{
+  struct warping_engine_dev *dev = ctx->dev;
+  struct warping_engine_kjob *kjob, *tmp;
+  unsigned long flags;
+  LIST_HEAD(dropped);
+
+  spin_lock_irqsave(&dev->irq_slck, flags);
+  list_del(&ctx->list);
+  list_splice_init(&ctx->job_queue, &dropped);
+  spin_unlock_irqrestore(&dev->irq_slck, flags);
+
+  list_for_each_entry_safe(kjob, tmp, &dropped, list)
+    warping_engine_kjob_free(kjob);
+
+  /* a running job cannot be stopped, let it finish before its buffers are
+   * freed, and let a kernel client's callback return. If the job does not
+   * finish, it is freed on completion */
+  wait_event_timeout(ctx->waitq, !warping_engine_ctx_running(ctx), HZ);
+  spin_lock_irqsave(&dev->irq_slck, flags);
+  if(dev->job_active && dev->job_active->ctx == ctx)
+    dev->job_active->ctx = NULL;
+  spin_unlock_irqrestore(&dev->irq_slck, flags);
+
+  warping_engine_bo_release_ctx(ctx);
+  if(ctx->eventfd)
+    eventfd_ctx_put(ctx->eventfd);
+  kfree(ctx);
+}
 
 /* fops functions */
 static int warping_engine_open(struct inode *ip, struct file *fp)
 {
   struct warping_engine_dev *dev;
+  struct warping_engine_ctx *ctx;
+
+  if(iminor(ip) == WARPING_ENGINE_AGGREGATE_MINOR)
+    return warping_engine_agg_open(fp);
 
-  /* extract the device structure and add it to the file pointer for easier
-   * access */
+  /* extract the device structure and create a context for this file */
   dev = container_of(ip->i_cdev, struct warping_engine_dev, cdev);
-  fp->private_data = dev;
+
+  ctx = warping_engine_ctx_create(dev);
+  if(!ctx)
+    return -ENOMEM;
+
+  fp->private_data = ctx;
+
+  return 0;
+}
+
+static int warping_engine_release(struct inode *ip, struct file *fp)
+{
+  struct warping_engine_ctx *ctx = fp->private_data;
+
+  if(ctx->agg)
+    warping_engine_agg_release(ctx->agg);
+  warping_engine_ctx_destroy(ctx);
 
   return 0;
 }
 
+/* map the register window read only, reads have no side effects */
+static int warping_engine_regs_mmap(struct warping_engine_dev *dev, struct vm_area_struct *vma)
+{
+  unsigned long size = vma->vm_end - vma->vm_start;
+
+  if(vma->vm_flags & VM_WRITE)
+    return -EPERM;
+  vma->vm_flags &= ~VM_MAYWRITE;
+  vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+
+  if(dev->sim)
+    return warping_engine_sim_mmap(dev->sim, vma);
+
+  if(size > PAGE_ALIGN(dev->span + 1))
+    return -EINVAL;
+
+  vma->vm_flags |= VM_IO;
+  vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+
+  return io_remap_pfn_range(vma, vma->vm_start, PHYS_PFN(dev->base_phys), size, vma->vm_page_prot);
+}
+
 static int warping_engine_mmap(struct file *fp, struct vm_area_struct *vma)
 {
-  struct warping_engine_dev *dev = fp->private_data;
+  struct warping_engine_ctx *ctx = fp->private_data;
+  struct warping_engine_dev *dev = ctx->dev;
   int ret;
 
+  if(vma->vm_pgoff == WARPING_ENGINE_MMAP_REGS_PGOFF)
+    return warping_engine_regs_mmap(dev, vma);
+
+  /* page offset 0 maps the whole video memory, others a buffer object */
+  if(vma->vm_pgoff)
+    return warping_engine_bo_mmap(ctx, vma);
+
   vma->vm_flags &= ~VM_PFNMAP;
   vma->vm_pgoff = 0;
 
@@ -65,9 +215,353 @@ static int warping_engine_mmap(struct file *fp, struct vm_area_struct *vma)
   return ret;
 }
 
+/* check that [addr, addr+size) is memory the engine may access for this
+ * file: a buffer of it or the video memory. A buffer is referenced in *bo
+ * until the job is done, so freeing its handle cannot free the memory */
+static bool warping_engine_addr_valid(struct warping_engine_ctx *ctx, u32 addr, u64 size,
+                                      struct warping_engine_bo **bo)
+{
+  *bo = warping_engine_bo_find(ctx, addr, size);
+  return *bo || warping_engine_mem_contains(ctx->dev, addr, size);
+}
+
+int warping_engine_validate_job(struct warping_engine_ctx *ctx, const warping_engine_job *job,
+                                struct warping_engine_bo *bos[WARPING_ENGINE_JOB_BOS])
+{
+  u32 in_w = WARPING_ENGINE_SIZE_WIDTH(job->input_size);
+  u32 in_h = WARPING_ENGINE_SIZE_HEIGHT(job->input_size);
+  u32 out_w = WARPING_ENGINE_SIZE_WIDTH(job->output_size);
+  u32 out_h = WARPING_ENGINE_SIZE_HEIGHT(job->output_size);
+  unsigned int i;
+
+  memset(bos, 0, WARPING_ENGINE_JOB_BOS * sizeof(bos[0]));
+
+  if(!in_w || !in_h || !out_w || !out_h || !job->coordinates_count)
+    return -EINVAL;
+
+  /* the engine steps rows by the pixel pitch, the byte pitch has to name
+   * the same rows or the buffer check below covers the wrong range */
+  if(job->input_pitch < in_w || (u64)job->input_pitch * BYTES_PER_PIXEL != job->input_byte_pitch ||
+     job->output_pitch < out_w)
+    return -EINVAL;
+
+  if(job->pfc_count > WARPING_ENGINE_JOB_PFC_MAX)
+    return -EINVAL;
+  for(i = 0; i < job->pfc_count; i++)
+  {
+    if(job->pfc_events[i] > WARPING_ENGINE_PFC_EVENT_CLOCK)
+      return -EINVAL;
+  }
+
+  if(!warping_engine_addr_valid(ctx, job->coordinates_address,
+                                (u64)job->coordinates_count * sizeof(warping_engine_coordinate), &bos[0]) ||
+     !warping_engine_addr_valid(ctx, job->input_address, (u64)job->input_byte_pitch * in_h, &bos[1]) ||
+     !warping_engine_addr_valid(ctx, job->output_address,
+                                (u64)job->output_pitch * out_h * BYTES_PER_PIXEL, &bos[2]))
+  {
+    warping_engine_bo_put_job(bos);
+    return -EFAULT;
+  }
+
+  return 0;
+}
+
+/* program all job registers in one go, the config register starts the engine */
+static void warping_engine_start_job(struct warping_engine_dev *dev, const warping_engine_job *job)
+{
+  unsigned int i;
+
+  /* profiled job: select the events and restart the counters from 0 */
+  if(job->pfc_count)
+  {
+    for(i = 0; i < job->pfc_count; i++)
+      warping_engine_write_reg(dev, WARPING_ENGINE_PFC_EVENT_SELECT_REG_BASE + i, job->pfc_events[i]);
+    warping_engine_write_reg(dev, WARPING_ENGINE_PFC_CLEAR_REG, BIT(job->pfc_count) - 1);
+    warping_engine_write_reg(dev, WARPING_ENGINE_PFC_ENABLE_REG, BIT(job->pfc_count) - 1);
+  }
+
+  warping_engine_write_reg(dev, WARPING_ENGINE_COORDINATES_ADDRESS_REG, job->coordinates_address);
+  warping_engine_write_reg(dev, WARPING_ENGINE_COORDINATES_COUNT_REG, job->coordinates_count);
+  warping_engine_write_reg(dev, WARPING_ENGINE_INPUT_ADDRESS_REG, job->input_address);
+  warping_engine_write_reg(dev, WARPING_ENGINE_INPUT_SIZE_REG, job->input_size);
+  warping_engine_write_reg(dev, WARPING_ENGINE_INPUT_PITCH_REG, job->input_pitch);
+  warping_engine_write_reg(dev, WARPING_ENGINE_INPUT_BYTE_PITCH_REG, job->input_byte_pitch);
+  warping_engine_write_reg(dev, WARPING_ENGINE_OUTSIDE_COLOR_REG, job->outside_color);
+  warping_engine_write_reg(dev, WARPING_ENGINE_OUTPUT_ADDRESS_REG, job->output_address);
+  warping_engine_write_reg(dev, WARPING_ENGINE_OUTPUT_SIZE_REG, job->output_size);
+  warping_engine_write_reg(dev, WARPING_ENGINE_OUTPUT_PITCH_REG, job->output_pitch);
+  /* 0 is one stripe over the whole output, as in the simulation and the
+   * CPU warper */
+  warping_engine_write_reg(dev, WARPING_ENGINE_STRIPE_WIDTH_REG,
+                           job->stripe_width ? job->stripe_width : WARPING_ENGINE_SIZE_WIDTH(job->output_size));
+  warping_engine_write_reg(dev, WARPING_ENGINE_IRQ_ENABLE_REG, WARPING_ENGINE_IRQ_WARPING_FINISHED);
+  warping_engine_write_reg(dev, WARPING_ENGINE_CONFIG_REG, job->config);
+}
+
+/* arm the watchdog for a job that just started. Called with irq_slck held */
+static void warping_engine_watchdog_arm(struct warping_engine_dev *dev, struct warping_engine_kjob *kjob)
+{
+  u64 pixels = (u64)WARPING_ENGINE_SIZE_WIDTH(kjob->job.output_size) *
+               WARPING_ENGINE_SIZE_HEIGHT(kjob->job.output_size);
+  u64 timeout;
+
+  if(!watchdog_ms)
+    return;
+
+  timeout = (u64)watchdog_ms * NSEC_PER_MSEC + div_u64(pixels * NSEC_PER_USEC, max(watchdog_mpix, 1u));
+  dev->watchdog_deadline = ktime_add_ns(kjob->started, timeout);
+  mod_timer(&dev->watchdog, jiffies + nsecs_to_jiffies(timeout) + 1);
+}
+
+/* start the next job if the engine is idle. Contexts are served round
+ * robin, one job at a time. Called with irq_slck held */
+static void warping_engine_kick_queue(struct warping_engine_dev *dev)
+{
+  struct warping_engine_kjob *kjob;
+  struct warping_engine_ctx *ctx;
+
+  if(dev->job_active)
+    return;
+
+  list_for_each_entry(ctx, &dev->ctx_list, list)
+  {
+    if(list_empty(&ctx->job_queue))
+      continue;
+
+    kjob = list_first_entry(&ctx->job_queue, struct warping_engine_kjob, list);
+    list_del(&kjob->list);
+    dev->job_active = kjob;
+    /* move the served context behind all others */
+    list_move_tail(&ctx->list, &dev->ctx_list);
+    warping_engine_start_job(dev, &kjob->job);
+
+    kjob->started = ktime_get();
+    warping_engine_watchdog_arm(dev, kjob);
+    warping_engine_hist_add(dev, WARPING_ENGINE_STAGE_QUEUE, kjob->submitted, kjob->started);
+    trace_warping_engine_start(dev->device, ctx, kjob->job.seq, ktime_to_ns(kjob->started));
+    return;
+  }
+}
+
+/* add a completion record to the ring of a file and notify its readers.
+ * Called with irq_slck of the file's device held */
+void warping_engine_ctx_complete(struct warping_engine_ctx *ctx, const warping_engine_completion *record)
+{
+  ctx->completions[(ctx->completion_head + ctx->completion_cnt) % WARPING_ENGINE_QUEUE_DEPTH] = *record;
+  ctx->completion_cnt++;
+
+  if(ctx->eventfd)
+    eventfd_signal(ctx->eventfd, 1);
+  wake_up_interruptible(&ctx->waitq);
+}
+
+/* record the completion of the active job in the owning context and start
+ * the next job. Jobs of kernel clients are returned, their callback has to
+ * be called once irq_slck is released. irq_time is the IRQ entry time.
+ * Called with irq_slck held */
+static struct warping_engine_kjob *warping_engine_complete_job(struct warping_engine_dev *dev, u32 status,
+                                                               ktime_t irq_time)
+{
+  struct warping_engine_kjob *kjob = dev->job_active;
+  warping_engine_completion *record;
+  struct warping_engine_ctx *ctx;
+  unsigned int i;
+
+  if(!kjob)
+    return NULL;
+
+  record = &kjob->record;
+  memset(record, 0, sizeof(*record));
+  record->seq = kjob->job.seq;
+  record->status = status;
+  record->submit_ns = ktime_to_ns(kjob->submitted);
+  record->start_ns = ktime_to_ns(kjob->started);
+  record->complete_ns = ktime_to_ns(irq_time);
+  /* latch the counters before the next job restarts them */
+  record->pfc_count = kjob->job.pfc_count;
+  for(i = 0; i < kjob->job.pfc_count; i++)
+    record->pfc_values[i] = warping_engine_read_reg(dev, WARPING_ENGINE_PFC_VALUE_REG_BASE + i);
+
+  dev->job_active = NULL;
+  warping_engine_hist_add(dev, WARPING_ENGINE_STAGE_EXEC, kjob->started, irq_time);
+  warping_engine_kick_queue(dev);
+
+  ctx = kjob->ctx;
+  trace_warping_engine_complete(dev->device, ctx, kjob->job.seq, ktime_to_ns(irq_time));
+  if(ctx && ctx->job_done)
+  {
+    ctx->callback_pending++;
+    return kjob;
+  }
+
+  if(ctx)
+    warping_engine_ctx_complete(ctx, record);
+  warping_engine_kjob_free(kjob);
+
+  return NULL;
+}
+
+/* queue a job of a kernel client. The job is trusted and not validated,
+ * completion is reported through ctx->job_done. May be called in atomic
+ * context, returns the sequence number of the job */
+int warping_engine_queue_job(struct warping_engine_ctx *ctx, const warping_engine_job *job)
+{
+  struct warping_engine_dev *dev = ctx->dev;
+  struct warping_engine_kjob *kjob;
+  unsigned long flags;
+  u32 seq;
+
+  kjob = kmalloc(sizeof(*kjob), GFP_ATOMIC);
+  if(!kjob)
+    return -ENOMEM;
+
+  kjob->job = *job;
+  kjob->ctx = ctx;
+  kjob->submitted = ktime_get();
+  kjob->retries = 0;
+  kjob->trusted = true;
+  memset(kjob->bos, 0, sizeof(kjob->bos));
+
+  spin_lock_irqsave(&dev->irq_slck, flags);
+  seq = ++ctx->job_seq;
+  kjob->job.seq = seq;
+  trace_warping_engine_submit(dev->device, ctx, seq, ktime_to_ns(kjob->submitted));
+  list_add_tail(&kjob->list, &ctx->job_queue);
+  warping_engine_kick_queue(dev);
+  spin_unlock_irqrestore(&dev->irq_slck, flags);
+
+  return seq & INT_MAX;
+}
+
+/* number of jobs queued or running on the engine */
+unsigned int warping_engine_dev_load(struct warping_engine_dev *dev)
+{
+  struct warping_engine_ctx *ctx;
+  struct list_head *pos;
+  unsigned long flags;
+  unsigned int load;
+
+  spin_lock_irqsave(&dev->irq_slck, flags);
+  load = dev->job_active ? 1 : 0;
+  list_for_each_entry(ctx, &dev->ctx_list, list)
+  {
+    list_for_each(pos, &ctx->job_queue)
+      load++;
+  }
+  spin_unlock_irqrestore(&dev->irq_slck, flags);
+
+  return load;
+}
+
+static bool warping_engine_queue_has_space(struct warping_engine_ctx *ctx)
+{
+  unsigned long flags;
+  bool result;
+
+  spin_lock_irqsave(&ctx->dev->irq_slck, flags);
+  result = ctx->job_inflight < WARPING_ENGINE_QUEUE_DEPTH;
+  spin_unlock_irqrestore(&ctx->dev->irq_slck, flags);
+
+  return result;
+}
+
+/* wait for a free slot, the queue depth also bounds the completion ring.
+ * Returns 0 with irq_slck held */
+int warping_engine_wait_slot(struct warping_engine_ctx *ctx, struct file *fp, unsigned long *flags)
+{
+  for(;;)
+  {
+    spin_lock_irqsave(&ctx->dev->irq_slck, *flags);
+    if(ctx->job_inflight < WARPING_ENGINE_QUEUE_DEPTH)
+      return 0;
+    spin_unlock_irqrestore(&ctx->dev->irq_slck, *flags);
+
+    if(fp->f_flags & O_NONBLOCK)
+      return -EAGAIN;
+    if(wait_event_interruptible(ctx->waitq, warping_engine_queue_has_space(ctx)))
+      return -ERESTARTSYS;
+  }
+}
+
+static int warping_engine_submit(struct warping_engine_ctx *ctx, struct file *fp, unsigned long arg)
+{
+  struct warping_engine_dev *dev = ctx->dev;
+  struct warping_engine_kjob *kjob;
+  unsigned long flags;
+  u32 seq;
+  int result;
+
+  kjob = kzalloc(sizeof(*kjob), GFP_KERNEL);
+  if(!kjob)
+    return -ENOMEM;
+
+  if(copy_from_user(&kjob->job, (void __user *) arg, sizeof(kjob->job)))
+  {
+    result = -EFAULT;
+    goto FAILED;
+  }
+
+  result = warping_engine_validate_job(ctx, &kjob->job, kjob->bos);
+  if(result)
+  {
+    dev_dbg(dev->device, "rejected invalid job (%d)\n", result);
+    goto FAILED;
+  }
+
+  result = warping_engine_wait_slot(ctx, fp, &flags);
+  if(result)
+    goto FAILED;
+
+  seq = ++ctx->job_seq;
+  kjob->job.seq = seq;
+  kjob->ctx = ctx;
+  kjob->submitted = ktime_get();
+  kjob->retries = 0;
+  trace_warping_engine_submit(dev->device, ctx, seq, ktime_to_ns(kjob->submitted));
+  ctx->job_inflight++;
+  list_add_tail(&kjob->list, &ctx->job_queue);
+  warping_engine_kick_queue(dev);
+  spin_unlock_irqrestore(&dev->irq_slck, flags);
+
+  /* the job may already be finished and freed, report the local copy */
+  if(put_user(seq, &((warping_engine_job __user *) arg)->seq))
+    return -EFAULT;
+
+  return 0;
+
+FAILED:
+  warping_engine_kjob_free(kjob);
+  return result;
+}
+
+static int warping_engine_set_eventfd(struct warping_engine_ctx *ctx, int fd)
+{
+  struct eventfd_ctx *eventfd = NULL;
+  struct eventfd_ctx *old;
+  unsigned long flags;
+
+  if(fd >= 0)
+  {
+    eventfd = eventfd_ctx_fdget(fd);
+    if(IS_ERR(eventfd))
+      return PTR_ERR(eventfd);
+  }
+
+  spin_lock_irqsave(&ctx->dev->irq_slck, flags);
+  old = ctx->eventfd;
+  ctx->eventfd = eventfd;
+  spin_unlock_irqrestore(&ctx->dev->irq_slck, flags);
+
+  if(old)
+    eventfd_ctx_put(old);
+
+  return 0;
+}
+
 static long warping_engine_ioctl(struct file *fp, unsigned int cmd, unsigned long arg)
 {
-  struct warping_engine_dev *dev = fp->private_data;
+  struct warping_engine_ctx *ctx = fp->private_data;
+  struct warping_engine_dev *dev = ctx->dev;
   warping_engine_settings wpset;
   unsigned int cmd_nr;
 
@@ -80,19 +574,42 @@ static long warping_engine_ioctl(struct file *fp, unsigned int cmd, unsigned lon
     if (cmd_nr & WARPING_ENGINE_IOCTL_REG_PREFIX)
     {
       /* direct register write: Register value in argument */
-    WARPING_ENGINE_IO_WREG( WARPING_ENGINE_IO_RADDR(dev->base_virt,
-                            WARPING_ENGINE_IOCTL_GET_REG(cmd_nr)),
-                            arg);
+      warping_engine_write_reg(dev, WARPING_ENGINE_IOCTL_GET_REG(cmd_nr), arg);
       return 0;
     }
+
+    switch(cmd_nr)
+    {
+      case WARPING_ENGINE_IOCTL_NR_EVENTFD:
+        return warping_engine_set_eventfd(ctx, (int) arg);
+
+      case WARPING_ENGINE_IOCTL_NR_BO_FREE:
+        return warping_engine_bo_free(ctx, (u32) arg);
+
+      case WARPING_ENGINE_IOCTL_NR_BO_SYNC:
+        return warping_engine_bo_sync_ioctl(ctx, arg);
+
+      case WARPING_ENGINE_IOCTL_NR_BUSY_POLL:
+        if((int) arg < 0 || (int) arg > WARPING_ENGINE_BUSY_POLL_MAX_US)
+          return -EINVAL;
+        ctx->busy_poll_us = (int) arg;
+        return 0;
+
+      case WARPING_ENGINE_IOCTL_NR_BANDS:
+        if(!ctx->agg)
+          return -EINVAL;
+        return warping_engine_agg_set_bands(ctx->agg, (int) arg);
+
+      default:
+        return -EINVAL;
+    }
   }
   else if (_IOC_DIR(cmd) == _IOC_READ)
   {
     if (cmd_nr & WARPING_ENGINE_IOCTL_REG_PREFIX)
     {  /* direct register read: Argument is a pointer */
-      if(!put_user(WARPING_ENGINE_IO_RREG(WARPING_ENGINE_IO_RADDR(dev->base_virt, 
-                                          WARPING_ENGINE_IOCTL_GET_REG(cmd_nr))), 
-                                          (unsigned long*) arg))
+      if(put_user(warping_engine_read_reg(dev, WARPING_ENGINE_IOCTL_GET_REG(cmd_nr)),
+                                         (u32 __user *) arg))
         return -EFAULT;
       return 0;
     }
@@ -109,7 +626,7 @@ static long warping_engine_ioctl(struct file *fp, unsigned int cmd, unsigned lon
                           (void*) &wpset,
                           sizeof(warping_engine_settings))  ) 
         {
-          dev_err(fp->private_data,
+          dev_err(dev->device,
             "error while copying settings to user space\n");
           return -EFAULT;
         }
@@ -119,22 +636,158 @@ static long warping_engine_ioctl(struct file *fp, unsigned int cmd, unsigned lon
         return -EINVAL;
     }
   }
+  else if (_IOC_DIR(cmd) == (_IOC_READ|_IOC_WRITE))
+  {
+    switch(cmd_nr)
+    {
+      case WARPING_ENGINE_IOCTL_NR_SUBMIT:
+        if(ctx->agg)
+          return warping_engine_agg_submit(ctx, fp, arg);
+        return warping_engine_submit(ctx, fp, arg);
+
+      case WARPING_ENGINE_IOCTL_NR_BO_ALLOC:
+        return warping_engine_bo_alloc(ctx, arg);
+
+      case WARPING_ENGINE_IOCTL_NR_BO_EXPORT:
+        return warping_engine_dmabuf_export(ctx, arg);
+
+      case WARPING_ENGINE_IOCTL_NR_BO_IMPORT:
+        return warping_engine_dmabuf_import(ctx, arg);
+
+      default:
+        return -EINVAL;
+    }
+  }
   return -EINVAL;
 }
 
-ssize_t warping_engine_read(struct file *filp, char __user *buff, size_t count, loff_t *offp)
+static bool warping_engine_has_completion(struct warping_engine_ctx *ctx)
 {
-  struct warping_engine_dev *dev = filp->private_data;
   unsigned long flags;
-  int temp;
+  bool result;
+
+  spin_lock_irqsave(&ctx->dev->irq_slck, flags);
+  result = ctx->completion_cnt != 0;
+  spin_unlock_irqrestore(&ctx->dev->irq_slck, flags);
 
-  wait_event_interruptible(dev->irq_waitq, dev->irq_stat);
+  return result;
+}
+
+static void warping_engine_handle_irq(struct warping_engine_dev *warping_engined, ktime_t now);
+
+/* spin on the status register for up to busy_poll_us before a blocking
+ * read() sleeps. Returns true if a completion arrived within the budget */
+static bool warping_engine_busy_poll(struct warping_engine_ctx *ctx)
+{
+  struct warping_engine_dev *dev = ctx->dev;
+  unsigned long flags;
+  ktime_t start, end, now;
+  bool outstanding, hit = false;
+
+  /* jobs of aggregate files finish on other instances */
+  if(!ctx->busy_poll_us || ctx->agg)
+    return false;
+
+  spin_lock_irqsave(&dev->irq_slck, flags);
+  outstanding = !ctx->completion_cnt && ctx->job_inflight;
+  spin_unlock_irqrestore(&dev->irq_slck, flags);
+  if(!outstanding)
+    return false;
+
+  start = ktime_get();
+  end = ktime_add_us(start, ctx->busy_poll_us);
+  do
+  {
+    if(warping_engine_read_reg(dev, WARPING_ENGINE_IRQ_STATUS_REG) & WARPING_ENGINE_IRQ_WARPING_FINISHED)
+    {
+      local_irq_save(flags);
+      warping_engine_handle_irq(dev, ktime_get());
+      local_irq_restore(flags);
+    }
+    if(warping_engine_has_completion(ctx))
+    {
+      hit = true;
+      break;
+    }
+    cpu_relax();
+    now = ktime_get();
+  } while(ktime_before(now, end) && !need_resched() && !signal_pending(current));
 
+  now = ktime_get();
   spin_lock_irqsave(&dev->irq_slck, flags);
-  temp = dev->irq_stat;
-  dev->irq_stat = 0;
+  dev->poll_stats.spins++;
+  dev->poll_stats.spin_ns += ktime_to_ns(ktime_sub(now, start));
+  if(hit)
+  {
+    dev->poll_stats.hits++;
+    warping_engine_hist_add(dev, WARPING_ENGINE_STAGE_SPIN, start, now);
+  }
   spin_unlock_irqrestore(&dev->irq_slck, flags);
 
+  return hit;
+}
+
+/* return as many completion records as fit into the user buffer */
+static ssize_t warping_engine_read_completions(struct warping_engine_ctx *ctx, struct file *filp,
+                                               char __user *buff, size_t count)
+{
+  struct warping_engine_dev *dev = ctx->dev;
+  warping_engine_completion record;
+  unsigned long flags;
+  size_t done = 0;
+  ktime_t now;
+
+  if(!(filp->f_flags & O_NONBLOCK) && !warping_engine_busy_poll(ctx))
+  {
+    if(wait_event_interruptible(ctx->waitq, warping_engine_has_completion(ctx)))
+      return -ERESTARTSYS;
+  }
+
+  /* one record at a time, they are too large to batch on the stack */
+  while(count - done >= sizeof(record))
+  {
+    spin_lock_irqsave(&dev->irq_slck, flags);
+    if(!ctx->completion_cnt)
+    {
+      spin_unlock_irqrestore(&dev->irq_slck, flags);
+      break;
+    }
+    record = ctx->completions[ctx->completion_head];
+    now = ktime_get();
+    warping_engine_hist_add(dev, WARPING_ENGINE_STAGE_WAKEUP, ns_to_ktime(record.complete_ns), now);
+    trace_warping_engine_wakeup(dev->device, ctx, record.seq, ktime_to_ns(now));
+    ctx->completion_head = (ctx->completion_head + 1) % WARPING_ENGINE_QUEUE_DEPTH;
+    ctx->completion_cnt--;
+    ctx->job_inflight--;
+    spin_unlock_irqrestore(&dev->irq_slck, flags);
+
+    /* free slot for blocked submitters */
+    wake_up_interruptible(&ctx->waitq);
+
+    if(copy_to_user(buff + done, &record, sizeof(record)))
+      return done ? done : -EFAULT;
+    done += sizeof(record);
+  }
+
+  return done ? done : -EAGAIN;
+}
+
+ssize_t warping_engine_read(struct file *filp, char __user *buff, size_t count, loff_t *offp)
+{
+  struct warping_engine_ctx *ctx = filp->private_data;
+  unsigned long flags;
+  int temp;
+
+  if(count >= sizeof(warping_engine_completion))
+    return warping_engine_read_completions(ctx, filp, buff, count);
+
+  wait_event_interruptible(ctx->waitq, ctx->irq_stat);
+
+  spin_lock_irqsave(&ctx->dev->irq_slck, flags);
+  temp = ctx->irq_stat;
+  ctx->irq_stat = 0;
+  spin_unlock_irqrestore(&ctx->dev->irq_slck, flags);
+
   if(count==sizeof(temp))
   {
     put_user(temp, buff);
@@ -144,34 +797,167 @@ ssize_t warping_engine_read(struct file *filp, char __user *buff, size_t count,
   return 0;
 }
 
+static unsigned int warping_engine_poll(struct file *filp, poll_table *wait)
+{
+  struct warping_engine_ctx *ctx = filp->private_data;
+  unsigned int mask = 0;
+  unsigned long flags;
+
+  /* no busy polling here: the first pass of select()/poll() and
+   * epoll_ctl() registration cannot be told from a waiter */
+  poll_wait(filp, &ctx->waitq, wait);
+
+  spin_lock_irqsave(&ctx->dev->irq_slck, flags);
+  if(ctx->completion_cnt || ctx->irq_stat)
+    mask |= POLLIN | POLLRDNORM;
+  if(ctx->job_inflight < WARPING_ENGINE_QUEUE_DEPTH)
+    mask |= POLLOUT | POLLWRNORM;
+  spin_unlock_irqrestore(&ctx->dev->irq_slck, flags);
+
+  return mask;
+}
+
 static struct file_operations warping_engine_fops = {
   .owner = THIS_MODULE,
   .open = warping_engine_open,
+  .release = warping_engine_release,
   .mmap = warping_engine_mmap,
   .unlocked_ioctl = warping_engine_ioctl,
   .read = warping_engine_read,
+  .poll = warping_engine_poll,
 };
 
-static irqreturn_t std_irq_handler(int irq, void *dev_id)
+/* report a job returned by warping_engine_complete_job() to its kernel
+ * client. Called without irq_slck held */
+static void warping_engine_job_callback(struct warping_engine_dev *dev, struct warping_engine_kjob *done)
 {
+  struct warping_engine_ctx *ctx = done->ctx;
   unsigned long flags;
-  struct warping_engine_dev *warping_engined = dev_id;
-  int status;
 
-  status = WARPING_ENGINE_IO_RREG(WARPING_ENGINE_IO_RADDR(warping_engined->base_virt,WARPING_ENGINE_IRQ_STATUS_REG));
-  WARPING_ENGINE_IO_WREG(WARPING_ENGINE_IO_RADDR(warping_engined->base_virt, WARPING_ENGINE_IRQ_CLEAR_REG), status);
+  ctx->job_done(ctx, &done->job, &done->record);
+  warping_engine_kjob_free(done);
+
+  spin_lock_irqsave(&dev->irq_slck, flags);
+  ctx->callback_pending--;
+  spin_unlock_irqrestore(&dev->irq_slck, flags);
+  wake_up(&ctx->waitq);
+}
+
+/* acknowledge the interrupt status and complete the finished job. Runs in
+ * the IRQ handler and in busy polling waiters, status is read and cleared
+ * under irq_slck so only one of them sees it. Called with local IRQs off */
+static void warping_engine_handle_irq(struct warping_engine_dev *warping_engined, ktime_t now)
+{
+  unsigned long flags;
+  struct warping_engine_kjob *done = NULL;
+  struct warping_engine_ctx *ctx;
+  int status;
 
   spin_lock_irqsave(&warping_engined->irq_slck, flags);
-  warping_engined->irq_stat |= status;
+  status = warping_engine_read_reg(warping_engined, WARPING_ENGINE_IRQ_STATUS_REG);
+  warping_engine_write_reg(warping_engined, WARPING_ENGINE_IRQ_CLEAR_REG, status);
+  trace_warping_engine_irq(warping_engined->device, status, ktime_to_ns(now));
+
+  /* raw status goes to all clients that do not use the job queue */
+  list_for_each_entry(ctx, &warping_engined->ctx_list, list)
+  {
+    if(ctx->job_seq || ctx->job_done)
+      continue;
+    ctx->irq_stat |= status;
+    wake_up_interruptible(&ctx->waitq);
+  }
+  if(status & (WARPING_ENGINE_IRQ_WARPING_FINISHED | WARPING_ENGINE_STATUS_FAULT))
+  {
+    done = warping_engine_complete_job(warping_engined, status, now);
+    warping_engine_hist_add(warping_engined, WARPING_ENGINE_STAGE_IRQ, now, ktime_get());
+  }
   spin_unlock_irqrestore(&warping_engined->irq_slck, flags);
 
-  wake_up_interruptible(&warping_engined->irq_waitq);
+  if(done)
+    warping_engine_job_callback(warping_engined, done);
+}
+
+static irqreturn_t std_irq_handler(int irq, void *dev_id)
+{
+  warping_engine_handle_irq(dev_id, ktime_get());
 
   return IRQ_HANDLED;
 }
 
+/* the active job did not finish in time: reset the pipeline, then restart
+ * or fail the job. Timer context */
+static void warping_engine_watchdog(struct timer_list *t)
+{
+  struct warping_engine_dev *dev = from_timer(dev, t, watchdog);
+  struct warping_engine_kjob *kjob, *done = NULL;
+  ktime_t now = ktime_get();
+  unsigned long flags;
+  bool failed = false;
+  u32 seq;
+
+  spin_lock_irqsave(&dev->irq_slck, flags);
+  kjob = dev->job_active;
+  if(!kjob || !watchdog_ms)
+  {
+    spin_unlock_irqrestore(&dev->irq_slck, flags);
+    return;
+  }
+  /* fired early by jiffies rounding */
+  if(ktime_before(now, dev->watchdog_deadline))
+  {
+    mod_timer(&dev->watchdog, jiffies + nsecs_to_jiffies(ktime_to_ns(ktime_sub(dev->watchdog_deadline, now))) + 1);
+    spin_unlock_irqrestore(&dev->irq_slck, flags);
+    return;
+  }
+  /* the job finished, its interrupt is on the way */
+  if(warping_engine_read_reg(dev, WARPING_ENGINE_IRQ_STATUS_REG) & WARPING_ENGINE_IRQ_WARPING_FINISHED)
+  {
+    mod_timer(&dev->watchdog, jiffies + 1);
+    spin_unlock_irqrestore(&dev->irq_slck, flags);
+    return;
+  }
+
+  seq = kjob->job.seq;
+  dev->hang_stats.hangs++;
+  warping_engine_write_reg(dev, WARPING_ENGINE_RESET_PIPE_REG, 1);
+  warping_engine_write_reg(dev, WARPING_ENGINE_RESET_PIPE_REG, 0);
+  warping_engine_write_reg(dev, WARPING_ENGINE_IRQ_CLEAR_REG, ~0u);
+
+  /* the job of a closed file fails at once, nobody waits for its result and
+   * its memory may be reused already */
+  if(kjob->ctx && kjob->retries < watchdog_retries)
+  {
+    kjob->retries++;
+    dev->hang_stats.retries++;
+    warping_engine_start_job(dev, &kjob->job);
+    kjob->started = ktime_get();
+    warping_engine_watchdog_arm(dev, kjob);
+  }
+  else
+  {
+    dev->hang_stats.failures++;
+    failed = true;
+    done = warping_engine_complete_job(dev, WARPING_ENGINE_STATUS_TIMEOUT, now);
+  }
+  spin_unlock_irqrestore(&dev->irq_slck, flags);
+
+  dev_warn_ratelimited(dev->device, "job %u hung, pipeline reset, job %s\n",
+                       seq, failed ? "failed" : "restarted");
+
+  if(done)
+  {
+    local_irq_save(flags);
+    warping_engine_job_callback(dev, done);
+    local_irq_restore(flags);
+  }
+}
+
 static int register_irq(struct warping_engine_dev *dev)
 {
+  /* the simulation calls the handler directly */
+  if(dev->sim)
+    return 0;
+
   if(request_irq(dev->irq_no, std_irq_handler, 0, "TES WARPING_ENGINE", (void*) dev))
   {
     dev_err(dev->device, "irq cannot be registered\n");
@@ -183,32 +969,54 @@ static int register_irq(struct warping_engine_dev *dev)
 
 static void unregister_irq(struct warping_engine_dev *dev)
 {
-  free_irq(dev->irq_no, (void*) dev);
+  if(dev->sim)
+    warping_engine_sim_stop(dev);
+  else
+    free_irq(dev->irq_no, (void*) dev);
+}
+
+static void warping_engine_unmap_regs(struct warping_engine_dev *dev)
+{
+  if(dev->sim)
+  {
+    warping_engine_sim_exit(dev);
+    return;
+  }
+
+  iounmap(dev->base_virt);
+  release_mem_region(dev->base_phys, dev->span);
+}
+
+/* drop the job still owned by the engine. All files are closed and the IRQ
+ * is unregistered at this point */
+static void warping_engine_flush_queue(struct warping_engine_dev *dev)
+{
+  warping_engine_kjob_free(dev->job_active);
+  dev->job_active = NULL;
 }
 
 /* create character class and devices */
 static int warping_engine_setup_device(struct warping_engine_dev *dev)
 {
   int result = 0;
+  int minor;
 
-  result = alloc_chrdev_region(&dev->dev, 0, WARPING_ENGINE_DEVICE_CNT,
-      WARPING_ENGINE_DEVICE_NAME);
-
-  if (result < 0) {
-    dev_err(dev->device, "can't alloc_chrdev_region\n");
-    goto CHR_FAILED;
-  }
-
-  warping_engine_class = class_create(THIS_MODULE, WARPING_ENGINE_DEVICE_CLASS);
-  if(!warping_engine_class)
+  minor = ida_simple_get(&warping_engine_minors, 0, WARPING_ENGINE_AGGREGATE_MINOR, GFP_KERNEL);
+  if(minor < 0)
   {
-    dev_err(dev->device, "cannot create class %s\n", WARPING_ENGINE_DEVICE_CLASS);
-    result = -EBUSY;
-    goto CLASS_FAILED;
+    dev_err(dev->device, "no free minor, too many instances\n");
+    return minor;
   }
-
-  dev->device = device_create(warping_engine_class, NULL, dev->dev, dev, WARPING_ENGINE_DEVICE_NAME);
-  if(!dev->device)
+  dev->dev = MKDEV(MAJOR(warping_engine_devt), minor);
+
+  /* the first instance keeps the plain name */
+  if(minor)
+    dev->chr_device = device_create(warping_engine_class, dev->device, dev->dev, dev,
+                                    WARPING_ENGINE_DEVICE_NAME "%d", minor);
+  else
+    dev->chr_device = device_create(warping_engine_class, dev->device, dev->dev, dev,
+                                    WARPING_ENGINE_DEVICE_NAME);
+  if(IS_ERR_OR_NULL(dev->chr_device))
   {
     dev_err(dev->device, "cannot create device %s\n", WARPING_ENGINE_DEVICE_NAME);
     result = -EBUSY;
@@ -218,7 +1026,7 @@ static int warping_engine_setup_device(struct warping_engine_dev *dev)
   cdev_init(&dev->cdev, &warping_engine_fops);
   dev->cdev.owner = THIS_MODULE;
 
-  result = cdev_add(&dev->cdev, dev->dev, WARPING_ENGINE_DEVICE_CNT);
+  result = cdev_add(&dev->cdev, dev->dev, 1);
   if(result)
   {
     dev_err(dev->device, "can't register char device\n");
@@ -230,10 +1038,7 @@ static int warping_engine_setup_device(struct warping_engine_dev *dev)
 DEV_FAILED:
   device_destroy(warping_engine_class, dev->dev);
 DEVICE_FAILED:
-  class_destroy(warping_engine_class);
-CLASS_FAILED:
-  unregister_chrdev_region(dev->dev, WARPING_ENGINE_DEVICE_CNT);
-CHR_FAILED:
+  ida_simple_remove(&warping_engine_minors, minor);
 
   return result;
 }
@@ -242,17 +1047,16 @@ static void warping_engine_log_params(struct warping_engine_dev *dev)
 {
   dev_info(dev->device, "Base address:\t0x%08lx - 0x%08lx\n",
       dev->base_phys, dev->base_phys + dev->span);
-  dev_info(dev->device, "Video RAM:\t%pad\n",
-      &dev->mem_base_phys);
+  dev_info(dev->device, "Video RAM:\t%pad (%zu of max. %zu bytes)\n",
+      &dev->mem_base_phys, dev->mem_total, dev->mem_max);
   dev_info(dev->device, "IRQ:\t%d\n", dev->irq_no);
 }
 
 static void warping_engine_shutdown_device(struct warping_engine_dev *dev)
 {
-  device_destroy(warping_engine_class, dev->dev);
-  class_destroy(warping_engine_class);
-  unregister_chrdev_region(dev->dev, WARPING_ENGINE_DEVICE_CNT);
   cdev_del(&dev->cdev);
+  device_destroy(warping_engine_class, dev->dev);
+  ida_simple_remove(&warping_engine_minors, MINOR(dev->dev));
 }
 
 /* platform device functions:
@@ -276,45 +1080,56 @@ static int warping_engine_probe(struct platform_device *pdev)
   platform_set_drvdata(pdev, warping_engine);
   warping_engine->device = &pdev->dev;
   np = pdev->dev.of_node;
-  if(!np)
-  {
-    dev_err(&pdev->dev,
-      "driver should only be instanciated over device tree!\n");
-    return -ENODEV;
-  }
-
-  of_address_to_resource(np, 0, &rsrc);
-  warping_engine->base_phys = rsrc.start;
-  warping_engine->span = rsrc.end - rsrc.start;
-  warping_engine->irq_no = of_irq_to_resource(np, 0, &rsrc);
-
-  warping_engine_log_params(warping_engine);
 
   spin_lock_init(&warping_engine->irq_slck);
-  init_waitqueue_head(&warping_engine->irq_waitq);
+  INIT_LIST_HEAD(&warping_engine->ctx_list);
+  timer_setup(&warping_engine->watchdog, warping_engine_watchdog, 0);
 
-  if (!request_mem_region(warping_engine->base_phys, warping_engine->span, "TES WARPING_ENGINE"))
+  if(platform_get_device_id(pdev))
   {
-    dev_err(&pdev->dev, "memory region already in use\n");
-    return -EBUSY;
+    /* simulated engine: no MMIO region and no IRQ line */
+    result = warping_engine_sim_init(warping_engine, std_irq_handler);
+    if(result)
+      return result;
   }
-
-  warping_engine->base_virt = ioremap_nocache(warping_engine->base_phys, warping_engine->span);
-  if (!warping_engine->base_virt)
+  else
   {
-    dev_err(&pdev->dev, "ioremap failed\n");
-    result = -EBUSY;
-    goto IO_FAILED;
+    if(!np)
+    {
+      dev_err(&pdev->dev,
+        "driver should only be instanciated over device tree!\n");
+      return -ENODEV;
+    }
+
+    of_address_to_resource(np, 0, &rsrc);
+    warping_engine->base_phys = rsrc.start;
+    warping_engine->span = rsrc.end - rsrc.start;
+    warping_engine->irq_no = of_irq_to_resource(np, 0, &rsrc);
+
+    warping_engine_log_params(warping_engine);
+
+    if (!request_mem_region(warping_engine->base_phys, warping_engine->span, "TES WARPING_ENGINE"))
+    {
+      dev_err(&pdev->dev, "memory region already in use\n");
+      return -EBUSY;
+    }
+
+    warping_engine->base_virt = ioremap_nocache(warping_engine->base_phys, warping_engine->span);
+    if (!warping_engine->base_virt)
+    {
+      dev_err(&pdev->dev, "ioremap failed\n");
+      result = -EBUSY;
+      goto IO_FAILED;
+    }
   }
 
-  result = WARPING_ENGINE_IO_RREG(WARPING_ENGINE_IO_RADDR(warping_engine->base_virt,
-        WARPING_ENGINE_H_W_REVISION_REG));
+  result = warping_engine_read_reg(warping_engine, WARPING_ENGINE_H_W_REVISION_REG);
   dev_info(&pdev->dev, "Found WARPING_ENGINE rev. 0x%08X\n", result);
 
   /* Allocate Vidmem */
-  warping_engine->mem_span = 16*1024*1024;
-  warping_engine->mem_base_virt = dma_alloc_writecombine(warping_engine->device, warping_engine->mem_span, &warping_engine->mem_base_phys,  GFP_KERNEL | __GFP_NOWARN);
-  if(!warping_engine->mem_base_virt) {
+  result = warping_engine_mem_init(warping_engine);
+  if(result)
+  {
     dev_err(&pdev->dev, "allocating video memory failed\n");
     goto IO_VID_FAILED;
   }
@@ -335,14 +1150,28 @@ static int warping_engine_probe(struct platform_device *pdev)
     goto IRQ_FAILED;
   }
 
+  result = warping_engine_v4l2_register(warping_engine);
+  if(result)
+  {
+    dev_err(&pdev->dev, "can't register V4L2 mem2mem device\n");
+    goto V4L2_FAILED;
+  }
+
+  warping_engine_debugfs_init(warping_engine);
+  warping_engine_agg_add_dev(warping_engine);
+
   return 0;
 
+V4L2_FAILED:
+  unregister_irq(warping_engine);
 IRQ_FAILED:
   warping_engine_shutdown_device(warping_engine);
 DEV_FAILED:
-  dma_free_writecombine(warping_engine->device, warping_engine->mem_span, warping_engine->mem_base_virt, warping_engine->mem_base_phys);
+  warping_engine_mem_exit(warping_engine);
 IO_VID_FAILED:
-  iounmap(warping_engine->base_virt);
+  warping_engine_unmap_regs(warping_engine);
+  return -EBUSY;
+
 IO_FAILED:
   release_mem_region(warping_engine->base_phys, warping_engine->span);
 
@@ -352,11 +1181,14 @@ IO_FAILED:
 static int warping_engine_remove(struct platform_device *pdev)
 {
   struct warping_engine_dev *warping_engine = platform_get_drvdata(pdev);
+  warping_engine_agg_remove_dev(warping_engine);
+  warping_engine_debugfs_exit(warping_engine);
+  warping_engine_v4l2_unregister(warping_engine);
   unregister_irq(warping_engine);
-  iounmap(warping_engine->mem_base_virt);
-  iounmap(warping_engine->base_virt);
-  release_mem_region(warping_engine->base_phys, warping_engine->span);
-  release_mem_region(warping_engine->mem_base_phys, warping_engine->mem_span);
+  del_timer_sync(&warping_engine->watchdog);
+  warping_engine_flush_queue(warping_engine);
+  warping_engine_mem_exit(warping_engine);
+  warping_engine_unmap_regs(warping_engine);
   warping_engine_shutdown_device(warping_engine);
   devm_kfree(&pdev->dev, warping_engine);
   return 0;
@@ -369,12 +1201,20 @@ static const struct of_device_id warping_engine_of_ids[] = {
   { }
 };
 
+static const struct platform_device_id warping_engine_ids[] = {
+  {
+    .name = WARPING_ENGINE_SIM_NAME,
+  },
+  { }
+};
+
 static struct platform_driver warping_engine_driver = {
   .driver = {
     .name = WARPING_ENGINE_DEVICE_NAME,
     .owner = THIS_MODULE,
     .of_match_table = of_match_ptr(warping_engine_of_ids),
   },
+  .id_table = warping_engine_ids,
   .probe = warping_engine_probe,
   .remove = warping_engine_remove,
 };
@@ -383,17 +1223,64 @@ static int __init _warping_engine_init(void)
 {
   int result = 0;
 
+  result = alloc_chrdev_region(&warping_engine_devt, 0, WARPING_ENGINE_DEVICE_CNT,
+      WARPING_ENGINE_DEVICE_NAME);
+  if(result < 0)
+  {
+    printk(KERN_ALERT "%s: can't alloc_chrdev_region\n", __func__);
+    return result;
+  }
+
+  warping_engine_class = class_create(THIS_MODULE, WARPING_ENGINE_DEVICE_CLASS);
+  if(IS_ERR(warping_engine_class))
+  {
+    printk(KERN_ALERT "%s: cannot create class %s\n", __func__, WARPING_ENGINE_DEVICE_CLASS);
+    result = PTR_ERR(warping_engine_class);
+    goto CLASS_FAILED;
+  }
+
+  warping_engine_debugfs_register();
+
   result = platform_driver_register(&warping_engine_driver);
   if(result)
+  {
     printk(KERN_ALERT "%s: failed to register platform driver\n", __func__);
+    goto DRIVER_FAILED;
+  }
+
+  result = warping_engine_sim_register();
+  if(result)
+    goto SIM_FAILED;
 
+  result = warping_engine_agg_register(warping_engine_class,
+                                       MKDEV(MAJOR(warping_engine_devt), WARPING_ENGINE_AGGREGATE_MINOR),
+                                       &warping_engine_fops);
+  if(result)
+    goto AGG_FAILED;
+
+  return 0;
+
+AGG_FAILED:
+  warping_engine_sim_unregister();
+SIM_FAILED:
+  platform_driver_unregister(&warping_engine_driver);
+DRIVER_FAILED:
+  warping_engine_debugfs_unregister();
+  class_destroy(warping_engine_class);
+CLASS_FAILED:
+  unregister_chrdev_region(warping_engine_devt, WARPING_ENGINE_DEVICE_CNT);
   return result;
 
 }
 
 static void __exit _warping_engine_exit(void)
 {
+  warping_engine_agg_unregister();
+  warping_engine_sim_unregister();
   platform_driver_unregister(&warping_engine_driver);
+  warping_engine_debugfs_unregister();
+  class_destroy(warping_engine_class);
+  unregister_chrdev_region(warping_engine_devt, WARPING_ENGINE_DEVICE_CNT);
 }
 
 module_init(_warping_engine_init);
@@ -0,0 +1,656 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Video memory management. Buffer objects allocated from the
+ *            video memory block and mapped into user space.
+ ****************************************************************************/
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/of.h>
+#include <linux/of_reserved_mem.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/uaccess.h>
+#include <linux/dma-mapping.h>
+#include <linux/genalloc.h>
+#include <linux/idr.h>
+#include <linux/dma-buf.h>
+#include <linux/workqueue.h>
+#include "warping_engine_module.h"
+#include "warping_engine_base.h"
+
+/* handles double as mmap page offsets, page offset 0 maps the whole vidmem
+ * and the register window follows the last handle */
+#define WARPING_ENGINE_BO_HANDLE_MIN      1
+#define WARPING_ENGINE_BO_HANDLE_MAX      WARPING_ENGINE_MMAP_REGS_PGOFF
+
+/* Vidmem size: a non zero module parameter overrides the device tree
+ * properties "tes,vidmem-size", "tes,vidmem-max-size" and
+ * "tes,vidmem-chunk-size". Memory comes from the "memory-region" of the
+ * node (CMA or reserved memory) if there is one, from the default CMA area
+ * otherwise. The pool grows in chunks on demand up to the maximum size */
+static unsigned long vidmem_size;
+module_param(vidmem_size, ulong, 0444);
+MODULE_PARM_DESC(vidmem_size, "Initial video memory size in bytes (default 16 MiB)");
+
+static unsigned long vidmem_max_size;
+module_param(vidmem_max_size, ulong, 0444);
+MODULE_PARM_DESC(vidmem_max_size, "Maximum video memory size in bytes for lazy growth (default: no growth)");
+
+static unsigned long vidmem_chunk_size;
+module_param(vidmem_chunk_size, ulong, 0444);
+MODULE_PARM_DESC(vidmem_chunk_size, "Video memory growth granularity in bytes (default 4 MiB)");
+
+#define WARPING_ENGINE_VIDMEM_SIZE_DEFAULT    (16*1024*1024)
+#define WARPING_ENGINE_VIDMEM_CHUNK_DEFAULT   (4*1024*1024)
+
+/* the last reference of a buffer may be dropped by a job completing in the
+ * IRQ handler, detaching an imported dma-buf sleeps. Such buffers are
+ * destroyed from a work item */
+static void warping_engine_bo_reap(struct work_struct *work);
+static LLIST_HEAD(warping_engine_bo_graveyard);
+static DECLARE_WORK(warping_engine_bo_reaper, warping_engine_bo_reap);
+
+static size_t warping_engine_mem_param(struct warping_engine_dev *dev, unsigned long param,
+                                       const char *prop, size_t def)
+{
+  u32 value;
+
+  if(param)
+    return PAGE_ALIGN(param);
+  if(dev->device->of_node && !of_property_read_u32(dev->device->of_node, prop, &value))
+    return PAGE_ALIGN(value);
+  return def;
+}
+
+/* allocate a new vidmem block and add it to the pool. Called with mem_lock
+ * held or during init */
+static struct warping_engine_mem_chunk *warping_engine_mem_add_chunk(struct warping_engine_dev *dev,
+                                                                     size_t size)
+{
+  struct warping_engine_mem_chunk *chunk;
+
+  chunk = kzalloc(sizeof(*chunk), GFP_KERNEL);
+  if(!chunk)
+    return NULL;
+
+  chunk->size = size;
+  chunk->virt = dma_alloc_writecombine(dev->device, size, &chunk->phys, GFP_KERNEL | __GFP_NOWARN);
+  if(!chunk->virt)
+    goto ALLOC_FAILED;
+
+  if(gen_pool_add_virt(dev->vidmem->pool, (unsigned long) chunk->virt, chunk->phys, size, -1))
+    goto POOL_FAILED;
+
+  list_add_tail(&chunk->list, &dev->vidmem->chunks);
+  dev->mem_total += size;
+
+  return chunk;
+
+POOL_FAILED:
+  dma_free_writecombine(dev->device, size, chunk->virt, chunk->phys);
+ALLOC_FAILED:
+  kfree(chunk);
+  return NULL;
+}
+
+/* free the video memory once the device and all buffers are gone */
+static void warping_engine_vidmem_release(struct kref *ref)
+{
+  struct warping_engine_vidmem *vidmem = container_of(ref, struct warping_engine_vidmem, ref);
+  struct warping_engine_mem_chunk *chunk, *tmp;
+
+  gen_pool_destroy(vidmem->pool);
+  list_for_each_entry_safe(chunk, tmp, &vidmem->chunks, list)
+  {
+    list_del(&chunk->list);
+    dma_free_writecombine(vidmem->device, chunk->size, chunk->virt, chunk->phys);
+    kfree(chunk);
+  }
+
+  of_reserved_mem_device_release(vidmem->device);
+  put_device(vidmem->device);
+  kfree(vidmem);
+}
+
+static void warping_engine_vidmem_put(struct warping_engine_vidmem *vidmem)
+{
+  kref_put(&vidmem->ref, warping_engine_vidmem_release);
+}
+
+int warping_engine_mem_init(struct warping_engine_dev *dev)
+{
+  struct warping_engine_vidmem *vidmem;
+  struct warping_engine_mem_chunk *chunk;
+  size_t size;
+  int result;
+
+  mutex_init(&dev->mem_lock);
+
+  size = warping_engine_mem_param(dev, vidmem_size, "tes,vidmem-size",
+                                  WARPING_ENGINE_VIDMEM_SIZE_DEFAULT);
+  dev->mem_max = max(size, warping_engine_mem_param(dev, vidmem_max_size,
+                                                    "tes,vidmem-max-size", size));
+  dev->mem_chunk = warping_engine_mem_param(dev, vidmem_chunk_size, "tes,vidmem-chunk-size",
+                                            WARPING_ENGINE_VIDMEM_CHUNK_DEFAULT);
+
+  vidmem = kzalloc(sizeof(*vidmem), GFP_KERNEL);
+  if(!vidmem)
+    return -ENOMEM;
+  kref_init(&vidmem->ref);
+  INIT_LIST_HEAD(&vidmem->chunks);
+
+  /* no memory-region is fine, the default CMA area is used then */
+  result = of_reserved_mem_device_init(dev->device);
+  if(result && result != -ENODEV)
+    dev_warn(dev->device, "cannot use reserved memory region (%d)\n", result);
+
+  vidmem->pool = gen_pool_create(PAGE_SHIFT, -1);
+  if(!vidmem->pool)
+  {
+    result = -ENOMEM;
+    goto POOL_FAILED;
+  }
+  vidmem->device = get_device(dev->device);
+  dev->vidmem = vidmem;
+
+  chunk = warping_engine_mem_add_chunk(dev, size);
+  if(!chunk)
+  {
+    dev_err(dev->device, "allocating %zu bytes of video memory failed\n", size);
+    result = -ENOMEM;
+    goto CHUNK_FAILED;
+  }
+
+  /* the first block is the one reported by GET_SETTINGS and mapped at 0 */
+  dev->mem_base_virt = chunk->virt;
+  dev->mem_base_phys = chunk->phys;
+  dev->mem_span = chunk->size;
+
+  return 0;
+
+CHUNK_FAILED:
+  /* also releases the reserved memory */
+  dev->vidmem = NULL;
+  warping_engine_vidmem_put(vidmem);
+  return result;
+POOL_FAILED:
+  of_reserved_mem_device_release(dev->device);
+  kfree(vidmem);
+  return result;
+}
+
+void warping_engine_mem_exit(struct warping_engine_dev *dev)
+{
+  if(!dev->vidmem)
+    return;
+
+  /* buffers released by the last jobs */
+  flush_work(&warping_engine_bo_reaper);
+  /* exported buffers keep the memory until their last user is gone */
+  warping_engine_vidmem_put(dev->vidmem);
+  dev->vidmem = NULL;
+  dev->mem_total = 0;
+}
+
+static struct warping_engine_mem_chunk *warping_engine_mem_find_chunk(struct warping_engine_dev *dev,
+                                                                      dma_addr_t phys)
+{
+  struct warping_engine_mem_chunk *chunk;
+
+  list_for_each_entry(chunk, &dev->vidmem->chunks, list)
+  {
+    if(phys >= chunk->phys && phys < chunk->phys + chunk->size)
+      return chunk;
+  }
+
+  return NULL;
+}
+
+/* check that [addr, addr+size) lies within one video memory block */
+bool warping_engine_mem_contains(struct warping_engine_dev *dev, u32 addr, u64 size)
+{
+  struct warping_engine_mem_chunk *chunk;
+  bool result;
+
+  mutex_lock(&dev->mem_lock);
+  chunk = warping_engine_mem_find_chunk(dev, addr);
+  result = chunk && (u64)addr + size <= (u64)chunk->phys + chunk->size;
+  mutex_unlock(&dev->mem_lock);
+
+  return result;
+}
+
+/* kernel address of [addr, addr+size) if it lies within one video memory
+ * block, NULL otherwise. Blocks stay mapped until the driver is removed */
+void *warping_engine_mem_virt(struct warping_engine_dev *dev, u32 addr, u64 size)
+{
+  struct warping_engine_mem_chunk *chunk;
+  void *virt = NULL;
+
+  mutex_lock(&dev->mem_lock);
+  chunk = warping_engine_mem_find_chunk(dev, addr);
+  if(chunk && (u64)addr + size <= (u64)chunk->phys + chunk->size)
+    virt = chunk->virt + (addr - chunk->phys);
+  mutex_unlock(&dev->mem_lock);
+
+  return virt;
+}
+
+void warping_engine_bo_init_ctx(struct warping_engine_ctx *ctx)
+{
+  mutex_init(&ctx->bo_lock);
+  idr_init(&ctx->bo_idr);
+}
+
+static void warping_engine_bo_destroy(struct kref *ref)
+{
+  struct warping_engine_bo *bo = container_of(ref, struct warping_engine_bo, ref);
+
+  if(bo->import)
+  {
+    warping_engine_dmabuf_detach(bo);
+  }
+  else
+  {
+    if(bo->pages)
+    {
+      dma_unmap_page(bo->vidmem->device, bo->phys, bo->size, DMA_BIDIRECTIONAL);
+      __free_pages(bo->pages, get_order(bo->size));
+    }
+    else
+    {
+      gen_pool_free(bo->vidmem->pool, (unsigned long) bo->virt, bo->size);
+    }
+    warping_engine_vidmem_put(bo->vidmem);
+  }
+  kfree(bo);
+}
+
+void warping_engine_bo_put(struct warping_engine_bo *bo)
+{
+  kref_put(&bo->ref, warping_engine_bo_destroy);
+}
+
+static void warping_engine_bo_reap(struct work_struct *work)
+{
+  struct warping_engine_bo *bo, *tmp;
+  struct llist_node *list;
+
+  list = llist_del_all(&warping_engine_bo_graveyard);
+  llist_for_each_entry_safe(bo, tmp, list, free_node)
+    warping_engine_bo_destroy(&bo->ref);
+}
+
+static void warping_engine_bo_destroy_later(struct kref *ref)
+{
+  struct warping_engine_bo *bo = container_of(ref, struct warping_engine_bo, ref);
+
+  if(llist_add(&bo->free_node, &warping_engine_bo_graveyard))
+    schedule_work(&warping_engine_bo_reaper);
+}
+
+/* drop a reference in atomic context */
+void warping_engine_bo_put_atomic(struct warping_engine_bo *bo)
+{
+  kref_put(&bo->ref, warping_engine_bo_destroy_later);
+}
+
+/* drop the buffer references of a finished or dropped job, may be called
+ * in atomic context */
+void warping_engine_bo_put_job(struct warping_engine_bo *bos[WARPING_ENGINE_JOB_BOS])
+{
+  unsigned int i;
+
+  for(i = 0; i < WARPING_ENGINE_JOB_BOS; i++)
+  {
+    if(bos[i])
+      warping_engine_bo_put_atomic(bos[i]);
+    bos[i] = NULL;
+  }
+}
+
+/* look up a buffer of the file and take a reference on it */
+struct warping_engine_bo *warping_engine_bo_lookup(struct warping_engine_ctx *ctx, u32 handle)
+{
+  struct warping_engine_bo *bo;
+
+  mutex_lock(&ctx->bo_lock);
+  bo = idr_find(&ctx->bo_idr, handle);
+  if(bo)
+    kref_get(&bo->ref);
+  mutex_unlock(&ctx->bo_lock);
+
+  return bo;
+}
+
+/* hand the initial reference of a new buffer over to the file */
+int warping_engine_bo_add_handle(struct warping_engine_ctx *ctx, struct warping_engine_bo *bo)
+{
+  int result;
+
+  mutex_lock(&ctx->bo_lock);
+  result = idr_alloc(&ctx->bo_idr, bo, WARPING_ENGINE_BO_HANDLE_MIN,
+                     WARPING_ENGINE_BO_HANDLE_MAX, GFP_KERNEL);
+  if(result >= 0)
+    bo->handle = result;
+  mutex_unlock(&ctx->bo_lock);
+
+  if(result < 0)
+  {
+    warping_engine_bo_put(bo);
+    return result;
+  }
+
+  return 0;
+}
+
+/* find the buffer of the file [addr, addr+size) lies within and take a
+ * reference on it, NULL if there is none */
+struct warping_engine_bo *warping_engine_bo_find(struct warping_engine_ctx *ctx, u32 addr, u64 size)
+{
+  struct warping_engine_bo *bo, *found = NULL;
+  int id;
+
+  mutex_lock(&ctx->bo_lock);
+  idr_for_each_entry(&ctx->bo_idr, bo, id)
+  {
+    if(addr >= bo->phys && (u64)addr + size <= (u64)bo->phys + bo->size)
+    {
+      kref_get(&bo->ref);
+      found = bo;
+      break;
+    }
+  }
+  mutex_unlock(&ctx->bo_lock);
+
+  return found;
+}
+
+static int warping_engine_bo_release_one(int id, void *p, void *data)
+{
+  warping_engine_bo_put(p);
+  return 0;
+}
+
+/* drop all buffer handles of a closed file */
+void warping_engine_bo_release_ctx(struct warping_engine_ctx *ctx)
+{
+  idr_for_each(&ctx->bo_idr, warping_engine_bo_release_one, NULL);
+  idr_destroy(&ctx->bo_idr);
+}
+
+/* carve a write combined buffer out of the video memory, growing it if
+ * allowed */
+static int warping_engine_bo_alloc_vidmem(struct warping_engine_dev *dev, struct warping_engine_bo *bo, u32 align)
+{
+  struct genpool_data_align data = { .align = align };
+  unsigned long virt;
+
+  mutex_lock(&dev->mem_lock);
+  virt = gen_pool_alloc_algo(dev->vidmem->pool, bo->size, gen_pool_first_fit_align, &data);
+  if(!virt && dev->mem_total < dev->mem_max)
+  {
+    /* grow by at least one chunk, large enough for the aligned buffer */
+    size_t grow = max_t(size_t, dev->mem_chunk, PAGE_ALIGN(bo->size + align - PAGE_SIZE));
+
+    if(dev->mem_total + grow <= dev->mem_max && warping_engine_mem_add_chunk(dev, grow))
+      virt = gen_pool_alloc_algo(dev->vidmem->pool, bo->size, gen_pool_first_fit_align, &data);
+  }
+  if(virt)
+  {
+    bo->virt = (void *) virt;
+    bo->phys = gen_pool_virt_to_phys(dev->vidmem->pool, virt);
+    bo->chunk = warping_engine_mem_find_chunk(dev, bo->phys);
+  }
+  mutex_unlock(&dev->mem_lock);
+
+  return virt ? 0 : -ENOMEM;
+}
+
+/* cached buffers get their own pages with a streaming DMA mapping. The
+ * video memory is mapped write combined in the kernel, a cacheable user
+ * mapping of it would alias that mapping */
+static int warping_engine_bo_alloc_pages(struct warping_engine_dev *dev, struct warping_engine_bo *bo, u32 align)
+{
+  unsigned int order = get_order(bo->size);
+
+  if(order >= MAX_ORDER)
+    return -ENOMEM;
+
+  bo->pages = alloc_pages(GFP_KERNEL | GFP_DMA32 | __GFP_ZERO | __GFP_NOWARN, order);
+  if(!bo->pages)
+    return -ENOMEM;
+
+  bo->phys = dma_map_page(dev->device, bo->pages, 0, bo->size, DMA_BIDIRECTIONAL);
+  if(dma_mapping_error(dev->device, bo->phys))
+    goto MAP_FAILED;
+
+  /* the engine takes 32 bit addresses */
+  if((u64)bo->phys + bo->size > BIT_ULL(32) || (bo->phys & (align - 1)))
+    goto RANGE_FAILED;
+
+  bo->virt = page_address(bo->pages);
+
+  return 0;
+
+RANGE_FAILED:
+  dma_unmap_page(dev->device, bo->phys, bo->size, DMA_BIDIRECTIONAL);
+MAP_FAILED:
+  __free_pages(bo->pages, order);
+  bo->pages = NULL;
+  return -ENOMEM;
+}
+
+int warping_engine_bo_alloc(struct warping_engine_ctx *ctx, unsigned long arg)
+{
+  struct warping_engine_dev *dev = ctx->dev;
+  struct warping_engine_bo *bo;
+  warping_engine_bo req;
+  u32 align;
+  int result;
+
+  if(copy_from_user(&req, (void __user *) arg, sizeof(req)))
+    return -EFAULT;
+
+  if(!req.size || (req.flags & ~WARPING_ENGINE_BO_CACHED) || (req.align & (req.align - 1)))
+    return -EINVAL;
+
+  bo = kzalloc(sizeof(*bo), GFP_KERNEL);
+  if(!bo)
+    return -ENOMEM;
+
+  kref_init(&bo->ref);
+  bo->cached = req.flags & WARPING_ENGINE_BO_CACHED;
+  /* whole pages only, so a mapping never exposes a neighbouring buffer */
+  bo->size = PAGE_ALIGN(req.size);
+  align = max_t(u32, req.align, PAGE_SIZE);
+
+  if(bo->cached)
+    result = warping_engine_bo_alloc_pages(dev, bo, align);
+  else
+    result = warping_engine_bo_alloc_vidmem(dev, bo, align);
+  if(result)
+  {
+    kfree(bo);
+    return result;
+  }
+  bo->vidmem = dev->vidmem;
+  kref_get(&bo->vidmem->ref);
+
+  result = warping_engine_bo_add_handle(ctx, bo);
+  if(result)
+    return result;
+
+  req.handle = bo->handle;
+  req.phys = bo->phys;
+  req.mmap_offset = bo->handle << PAGE_SHIFT;
+  if(copy_to_user((void __user *) arg, &req, sizeof(req)))
+  {
+    warping_engine_bo_free(ctx, req.handle);
+    return -EFAULT;
+  }
+
+  return 0;
+}
+
+int warping_engine_bo_free(struct warping_engine_ctx *ctx, u32 handle)
+{
+  struct warping_engine_bo *bo;
+
+  mutex_lock(&ctx->bo_lock);
+  bo = idr_remove(&ctx->bo_idr, handle);
+  mutex_unlock(&ctx->bo_lock);
+
+  if(!bo)
+    return -EINVAL;
+
+  /* exported buffers live on until the last dma-buf user is gone */
+  warping_engine_bo_put(bo);
+
+  return 0;
+}
+
+/* user space mappings keep the buffer alive */
+static void warping_engine_bo_vm_open(struct vm_area_struct *vma)
+{
+  struct warping_engine_bo *bo = vma->vm_private_data;
+
+  kref_get(&bo->ref);
+}
+
+static void warping_engine_bo_vm_close(struct vm_area_struct *vma)
+{
+  warping_engine_bo_put(vma->vm_private_data);
+}
+
+static const struct vm_operations_struct warping_engine_bo_vm_ops = {
+  .open = warping_engine_bo_vm_open,
+  .close = warping_engine_bo_vm_close,
+};
+
+/* map a buffer into user space, vm_pgoff is the page offset into it */
+int warping_engine_bo_map_vma(struct warping_engine_bo *bo, struct vm_area_struct *vma)
+{
+  unsigned long pages = vma_pages(vma);
+  int result;
+
+  if(vma->vm_pgoff + pages > bo->size >> PAGE_SHIFT)
+    return -EINVAL;
+
+  if(bo->import)
+    return dma_buf_mmap(bo->import, vma, vma->vm_pgoff);
+
+  if(bo->cached)
+  {
+    /* keep the default cacheable protection, see warping_engine_bo_sync() */
+    result = remap_pfn_range(vma, vma->vm_start, page_to_pfn(bo->pages) + vma->vm_pgoff,
+                             vma->vm_end - vma->vm_start, vma->vm_page_prot);
+  }
+  else
+  {
+    /* map relative to the vidmem block the buffer was carved from */
+    vma->vm_flags &= ~VM_PFNMAP;
+    vma->vm_pgoff += (bo->phys - bo->chunk->phys) >> PAGE_SHIFT;
+
+    result = dma_mmap_writecombine(bo->vidmem->device, vma,
+              bo->chunk->virt, bo->chunk->phys, bo->chunk->size);
+  }
+  if(result)
+    return result;
+
+  vma->vm_private_data = bo;
+  vma->vm_ops = &warping_engine_bo_vm_ops;
+  warping_engine_bo_vm_open(vma);
+
+  return 0;
+}
+
+int warping_engine_bo_mmap(struct warping_engine_ctx *ctx, struct vm_area_struct *vma)
+{
+  struct warping_engine_bo *bo;
+  int result;
+
+  bo = warping_engine_bo_lookup(ctx, vma->vm_pgoff);
+  if(!bo)
+    return -EINVAL;
+
+  vma->vm_pgoff = 0;
+  result = warping_engine_bo_map_vma(bo, vma);
+  warping_engine_bo_put(bo);
+
+  return result;
+}
+
+/* cache maintenance around CPU accesses to a buffer. Write combined
+ * mappings only need their write buffers drained */
+int warping_engine_bo_sync(struct warping_engine_bo *bo, u32 flags, u32 offset, u32 size)
+{
+  enum dma_data_direction dir;
+
+  if(flags & ~(WARPING_ENGINE_BO_SYNC_READ | WARPING_ENGINE_BO_SYNC_WRITE | WARPING_ENGINE_BO_SYNC_END))
+    return -EINVAL;
+
+  switch(flags & (WARPING_ENGINE_BO_SYNC_READ | WARPING_ENGINE_BO_SYNC_WRITE))
+  {
+    case WARPING_ENGINE_BO_SYNC_READ:
+      dir = DMA_FROM_DEVICE;
+      break;
+    case WARPING_ENGINE_BO_SYNC_WRITE:
+      dir = DMA_TO_DEVICE;
+      break;
+    case WARPING_ENGINE_BO_SYNC_READ | WARPING_ENGINE_BO_SYNC_WRITE:
+      dir = DMA_BIDIRECTIONAL;
+      break;
+    default:
+      return -EINVAL;
+  }
+
+  if(!size)
+    size = offset < bo->size ? bo->size - offset : 0;
+  if(!size || (u64)offset + size > bo->size)
+    return -EINVAL;
+
+  if(bo->import)
+  {
+    if(flags & WARPING_ENGINE_BO_SYNC_END)
+      return dma_buf_end_cpu_access(bo->import, dir);
+    return dma_buf_begin_cpu_access(bo->import, dir);
+  }
+
+  if(!bo->cached)
+  {
+    if(flags & WARPING_ENGINE_BO_SYNC_END)
+      wmb();
+    return 0;
+  }
+
+  /* bo->phys is the handle of the streaming mapping of the pages */
+  if(flags & WARPING_ENGINE_BO_SYNC_END)
+    dma_sync_single_range_for_device(bo->vidmem->device, bo->phys, offset, size, dir);
+  else
+    dma_sync_single_range_for_cpu(bo->vidmem->device, bo->phys, offset, size, dir);
+
+  return 0;
+}
+
+int warping_engine_bo_sync_ioctl(struct warping_engine_ctx *ctx, unsigned long arg)
+{
+  struct warping_engine_bo *bo;
+  warping_engine_bo_sync req;
+  int result;
+
+  if(copy_from_user(&req, (void __user *) arg, sizeof(req)))
+    return -EFAULT;
+
+  bo = warping_engine_bo_lookup(ctx, req.handle);
+  if(!bo)
+    return -EINVAL;
+
+  result = warping_engine_bo_sync(bo, req.flags, req.offset, req.size);
+  warping_engine_bo_put(bo);
+
+  return result;
+}
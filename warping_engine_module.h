@@ -17,20 +17,101 @@
 #include <linux/device.h>
 #include <linux/cdev.h>
 #include <linux/spinlock.h>
+#include <linux/eventfd.h>
+#include <linux/genalloc.h>
+#include <linux/idr.h>
+#include <linux/mutex.h>
+#include <linux/kref.h>
+#include <linux/llist.h>
+#include <linux/dma-buf.h>
+#include <linux/interrupt.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include <linux/timer.h>
+#include "warping_engine_base.h"
 
 /* Linux character device config */
 #define WARPING_ENGINE_DEVICE_NAME          "warpingengine"
 #define WARPING_ENGINE_DEVICE_CLASS       "warpingengine"
-#define WARPING_ENGINE_DEVICE_CNT         1u
+#define WARPING_ENGINE_DEVICE_CNT         8u
+/* the last minor is the aggregate device, the others are instances */
+#define WARPING_ENGINE_AGGREGATE_MINOR    (WARPING_ENGINE_DEVICE_CNT - 1)
+#define WARPING_ENGINE_AGGREGATE_NAME     "warpingengine-all"
+
+/* Job queue: maximum number of jobs in flight per open file (queued,
+ * running or finished but not yet read) */
+#define WARPING_ENGINE_QUEUE_DEPTH          16u
 
 /* device tree node */
 #define WARPING_ENGINE_OF_COMPATIBLE        "tes,warp-1.0"
 
+/* Latency histograms: bucket n counts latencies below 2^n ns */
+#define WARPING_ENGINE_HIST_BUCKETS         40
+
+enum warping_engine_stage
+{
+  WARPING_ENGINE_STAGE_QUEUE,       /* submit to hardware start         */
+  WARPING_ENGINE_STAGE_EXEC,        /* hardware start to IRQ entry      */
+  WARPING_ENGINE_STAGE_IRQ,         /* IRQ entry to completion recorded */
+  WARPING_ENGINE_STAGE_WAKEUP,      /* IRQ entry to read() of the record*/
+  WARPING_ENGINE_STAGE_SPIN,        /* busy poll until the job finished */
+  WARPING_ENGINE_STAGE_CNT
+};
+
+struct warping_engine_hist
+{
+  u64 count;
+  u64 sum_ns;
+  u64 max_ns;
+  u64 buckets[WARPING_ENGINE_HIST_BUCKETS];
+};
+
+/* busy poll outcomes, a spin hits when the job finishes within budget */
+struct warping_engine_poll_stats
+{
+  u64 spins;
+  u64 hits;
+  u64 spin_ns;
+};
+
+/* jobs the watchdog found hung, each one was retried or failed */
+struct warping_engine_hang_stats
+{
+  u64 hangs;
+  u64 retries;
+  u64 failures;
+};
+
+/* simulated device, registered with the module parameter "sim" */
+#define WARPING_ENGINE_SIM_NAME             "warpingengine-sim"
+
 /* Register access macros */
 #define WARPING_ENGINE_IO_WREG(addr,data)       iowrite32(data,addr)
 #define WARPING_ENGINE_IO_RREG(addr)        ioread32(addr)
 #define WARPING_ENGINE_IO_RADDR(base,reg)     ((void*)((unsigned long)base|((unsigned long)reg)<<2))
 
+struct warping_engine_ctx;
+struct warping_engine_v4l2;
+struct warping_engine_sim;
+struct warping_engine_agg;
+
+/* buffer objects a job of a file can use: coordinates, input and output */
+#define WARPING_ENGINE_JOB_BOS            3
+
+struct warping_engine_kjob
+{
+  struct list_head list;
+  struct warping_engine_ctx *ctx;   /* owner, NULL once the file is closed */
+  warping_engine_job job;
+  /* references on the buffers of the job, NULL for plain video memory */
+  struct warping_engine_bo *bos[WARPING_ENGINE_JOB_BOS];
+  ktime_t submitted;
+  ktime_t started;
+  unsigned int retries;             /* restarts after a hang            */
+  bool trusted;                     /* queued by a kernel client        */
+  warping_engine_completion record; /* filled on completion */
+};
+
 struct warping_engine_dev
 {
   unsigned long base_phys;
@@ -39,13 +120,184 @@ struct warping_engine_dev
   size_t mem_span;          /* Vidmem memory span           */
   void *base_virt;
   void *mem_base_virt;      /* Vidmem base virtual addr     */
+  struct warping_engine_vidmem *vidmem; /* buffer object allocator */
+  struct mutex mem_lock;    /* protects the chunk list      */
+  size_t mem_total;         /* size of all Vidmem blocks    */
+  size_t mem_max;           /* limit for lazy growth        */
+  size_t mem_chunk;         /* granularity of lazy growth   */
   unsigned int irq_no;
-  unsigned int irq_stat;
   spinlock_t irq_slck;
-  wait_queue_head_t irq_waitq;
+  /* scheduler state, protected by irq_slck */
+  struct list_head ctx_list;        /* open files, round robin order    */
+  struct warping_engine_kjob *job_active;
   dev_t dev;
   struct cdev cdev;
-  struct device *device;
+  struct device *device;    /* platform device, used for DMA */
+  struct device *chr_device;
+  struct warping_engine_sim *sim; /* set instead of base_virt when simulated */
+  struct warping_engine_v4l2 *v4l2;
+  struct warping_engine_hist hist[WARPING_ENGINE_STAGE_CNT]; /* protected by irq_slck */
+  struct warping_engine_poll_stats poll_stats;                /* protected by irq_slck */
+  struct warping_engine_hang_stats hang_stats;                /* protected by irq_slck */
+  struct timer_list watchdog;       /* fires when the active job hangs  */
+  ktime_t watchdog_deadline;        /* protected by irq_slck            */
+  struct dentry *debugfs;
+  struct list_head agg_list;        /* entry in the aggregate's list    */
+};
+
+/* per open file context */
+struct warping_engine_ctx
+{
+  struct warping_engine_dev *dev;
+  struct list_head list;            /* entry in dev->ctx_list           */
+  wait_queue_head_t waitq;
+  /* members below are protected by dev->irq_slck */
+  unsigned int irq_stat;            /* raw IRQ status for 4 byte reads  */
+  struct list_head job_queue;       /* jobs waiting for the engine      */
+  unsigned int job_inflight;
+  u32 job_seq;
+  warping_engine_completion completions[WARPING_ENGINE_QUEUE_DEPTH];
+  unsigned int completion_head;
+  unsigned int completion_cnt;
+  struct eventfd_ctx *eventfd;      /* signalled on job completion      */
+  unsigned int callback_pending;    /* job_done calls in progress       */
+  unsigned int busy_poll_us;        /* spin budget of blocking waits    */
+  /* kernel clients: completion callback, called from IRQ context */
+  void (*job_done)(struct warping_engine_ctx *ctx, const warping_engine_job *job,
+                   const warping_engine_completion *record);
+  void *priv;
+  struct warping_engine_agg *agg;   /* file of the aggregate device     */
+  /* buffer objects, protected by bo_lock */
+  struct mutex bo_lock;
+  struct idr bo_idr;
+};
+
+/* contiguous block of video memory */
+struct warping_engine_mem_chunk
+{
+  struct list_head list;
+  void *virt;
+  dma_addr_t phys;
+  size_t size;
 };
 
+/* video memory blocks and their allocator. Exported buffers can outlive
+ * the device, every buffer allocated from the pool holds a reference */
+struct warping_engine_vidmem
+{
+  struct kref ref;
+  struct device *device;            /* platform device, referenced      */
+  struct gen_pool *pool;
+  struct list_head chunks;          /* first is mem_base                */
+};
+
+/* buffer object allocated from the video memory or imported dma-buf */
+struct warping_engine_bo
+{
+  struct kref ref;
+  struct llist_node free_node;      /* released from atomic context    */
+  struct warping_engine_vidmem *vidmem; /* allocated buffers only      */
+  u32 handle;
+  size_t size;
+  dma_addr_t phys;
+  void *virt;
+  struct warping_engine_mem_chunk *chunk; /* write combined buffers  */
+  struct page *pages;               /* cached buffers, not in vidmem   */
+  bool cached;                      /* cacheable user space mappings  */
+  /* imported buffers only */
+  struct dma_buf *import;
+  struct dma_buf_attachment *attach;
+  struct sg_table *sgt;
+};
+
+/* warping_engine_sim.c: register access of the simulated device */
+void warping_engine_sim_write(struct warping_engine_sim *sim, unsigned int reg, u32 value);
+u32 warping_engine_sim_read(struct warping_engine_sim *sim, unsigned int reg);
+
+static inline void warping_engine_write_reg(struct warping_engine_dev *dev, unsigned int reg, u32 value)
+{
+  if(dev->sim)
+    warping_engine_sim_write(dev->sim, reg, value);
+  else
+    WARPING_ENGINE_IO_WREG(WARPING_ENGINE_IO_RADDR(dev->base_virt, reg), value);
+}
+
+static inline u32 warping_engine_read_reg(struct warping_engine_dev *dev, unsigned int reg)
+{
+  if(dev->sim)
+    return warping_engine_sim_read(dev->sim, reg);
+  return WARPING_ENGINE_IO_RREG(WARPING_ENGINE_IO_RADDR(dev->base_virt, reg));
+}
+
+/* warping_engine_driver.c */
+struct warping_engine_ctx *warping_engine_ctx_create(struct warping_engine_dev *dev);
+void warping_engine_ctx_destroy(struct warping_engine_ctx *ctx);
+int warping_engine_queue_job(struct warping_engine_ctx *ctx, const warping_engine_job *job);
+int warping_engine_validate_job(struct warping_engine_ctx *ctx, const warping_engine_job *job,
+                                struct warping_engine_bo *bos[WARPING_ENGINE_JOB_BOS]);
+int warping_engine_wait_slot(struct warping_engine_ctx *ctx, struct file *fp, unsigned long *flags);
+void warping_engine_ctx_complete(struct warping_engine_ctx *ctx, const warping_engine_completion *record);
+unsigned int warping_engine_dev_load(struct warping_engine_dev *dev);
+
+/* warping_engine_mem.c */
+int warping_engine_mem_init(struct warping_engine_dev *dev);
+void warping_engine_mem_exit(struct warping_engine_dev *dev);
+bool warping_engine_mem_contains(struct warping_engine_dev *dev, u32 addr, u64 size);
+void *warping_engine_mem_virt(struct warping_engine_dev *dev, u32 addr, u64 size);
+void warping_engine_bo_init_ctx(struct warping_engine_ctx *ctx);
+void warping_engine_bo_release_ctx(struct warping_engine_ctx *ctx);
+int warping_engine_bo_alloc(struct warping_engine_ctx *ctx, unsigned long arg);
+int warping_engine_bo_free(struct warping_engine_ctx *ctx, u32 handle);
+int warping_engine_bo_mmap(struct warping_engine_ctx *ctx, struct vm_area_struct *vma);
+int warping_engine_bo_map_vma(struct warping_engine_bo *bo, struct vm_area_struct *vma);
+struct warping_engine_bo *warping_engine_bo_lookup(struct warping_engine_ctx *ctx, u32 handle);
+int warping_engine_bo_add_handle(struct warping_engine_ctx *ctx, struct warping_engine_bo *bo);
+struct warping_engine_bo *warping_engine_bo_find(struct warping_engine_ctx *ctx, u32 addr, u64 size);
+void warping_engine_bo_put(struct warping_engine_bo *bo);
+void warping_engine_bo_put_atomic(struct warping_engine_bo *bo);
+void warping_engine_bo_put_job(struct warping_engine_bo *bos[WARPING_ENGINE_JOB_BOS]);
+int warping_engine_bo_sync(struct warping_engine_bo *bo, u32 flags, u32 offset, u32 size);
+int warping_engine_bo_sync_ioctl(struct warping_engine_ctx *ctx, unsigned long arg);
+
+/* warping_engine_dmabuf.c */
+int warping_engine_dmabuf_export(struct warping_engine_ctx *ctx, unsigned long arg);
+int warping_engine_dmabuf_import(struct warping_engine_ctx *ctx, unsigned long arg);
+struct warping_engine_bo *warping_engine_dmabuf_import_fd(struct warping_engine_dev *dev, int fd);
+void warping_engine_dmabuf_detach(struct warping_engine_bo *bo);
+
+/* warping_engine_sim.c */
+int warping_engine_sim_init(struct warping_engine_dev *dev, irq_handler_t irq_handler);
+void warping_engine_sim_stop(struct warping_engine_dev *dev);
+void warping_engine_sim_exit(struct warping_engine_dev *dev);
+int warping_engine_sim_mmap(struct warping_engine_sim *sim, struct vm_area_struct *vma);
+int warping_engine_sim_register(void);
+void warping_engine_sim_unregister(void);
+
+/* warping_engine_debugfs.c */
+void warping_engine_hist_add(struct warping_engine_dev *dev, enum warping_engine_stage stage,
+                             ktime_t from, ktime_t to);
+void warping_engine_debugfs_init(struct warping_engine_dev *dev);
+void warping_engine_debugfs_exit(struct warping_engine_dev *dev);
+void warping_engine_debugfs_register(void);
+void warping_engine_debugfs_unregister(void);
+
+/* warping_engine_aggregate.c */
+int warping_engine_agg_register(struct class *class, dev_t devt, const struct file_operations *fops);
+void warping_engine_agg_unregister(void);
+void warping_engine_agg_add_dev(struct warping_engine_dev *dev);
+void warping_engine_agg_remove_dev(struct warping_engine_dev *dev);
+int warping_engine_agg_open(struct file *fp);
+void warping_engine_agg_release(struct warping_engine_agg *agg);
+int warping_engine_agg_submit(struct warping_engine_ctx *ctx, struct file *fp, unsigned long arg);
+int warping_engine_agg_set_bands(struct warping_engine_agg *agg, int bands);
+
+/* warping_engine_v4l2.c */
+#ifdef WARPING_ENGINE_V4L2
+int warping_engine_v4l2_register(struct warping_engine_dev *dev);
+void warping_engine_v4l2_unregister(struct warping_engine_dev *dev);
+#else
+static inline int warping_engine_v4l2_register(struct warping_engine_dev *dev) { return 0; }
+static inline void warping_engine_v4l2_unregister(struct warping_engine_dev *dev) { }
+#endif
+
 #endif /* TES_WE_MODULE_H_ */
@@ -0,0 +1,89 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Reference model of the engine's pixel pipeline. Shared by the
+ *            simulation backend and CPU implementations, which have to
+ *            produce bit exact results.
+ ****************************************************************************/
+
+#ifndef WARPING_ENGINE_SAMPLE_H_
+#define WARPING_ENGINE_SAMPLE_H_
+
+#include "warping_engine.h"
+
+/* Coordinates table: one entry per output pixel in raster order. The entry
+ * holds the source position of the pixel center as signed 15.16 fixed
+ * point values. Output pixels beyond coordinates_count get the outside
+ * color. */
+typedef struct
+{
+  int x;
+  int y;
+} warping_engine_coordinate;
+
+#define WARPING_ENGINE_COORD_SHIFT          (16)
+#define WARPING_ENGINE_COORD_ONE            (1 << WARPING_ENGINE_COORD_SHIFT)
+/* bilinear weights use the upper 8 fraction bits */
+#define WARPING_ENGINE_WEIGHT_BITS          (8)
+#define WARPING_ENGINE_WEIGHT_ONE           (1 << WARPING_ENGINE_WEIGHT_BITS)
+
+/* Texel fetch: taps outside the input image read the outside color */
+static inline warping_engine_uint32 warping_engine_texel(const warping_engine_uint32 *image,
+                                                         warping_engine_uint32 pitch,
+                                                         warping_engine_uint32 width,
+                                                         warping_engine_uint32 height,
+                                                         int x, int y,
+                                                         warping_engine_uint32 outside)
+{
+  if((warping_engine_uint32)x >= width || (warping_engine_uint32)y >= height)
+    return outside;
+  return image[(warping_engine_uint32)y * pitch + (warping_engine_uint32)x];
+}
+
+/* Blend four texels with 8 bit weights, each of the four 8 bit channels
+ * separately, rounding to nearest */
+static inline warping_engine_uint32 warping_engine_blend(warping_engine_uint32 t00, warping_engine_uint32 t10,
+                                                         warping_engine_uint32 t01, warping_engine_uint32 t11,
+                                                         warping_engine_uint32 fx, warping_engine_uint32 fy)
+{
+  warping_engine_uint32 w00 = (WARPING_ENGINE_WEIGHT_ONE - fx) * (WARPING_ENGINE_WEIGHT_ONE - fy);
+  warping_engine_uint32 w10 = fx * (WARPING_ENGINE_WEIGHT_ONE - fy);
+  warping_engine_uint32 w01 = (WARPING_ENGINE_WEIGHT_ONE - fx) * fy;
+  warping_engine_uint32 w11 = fx * fy;
+  warping_engine_uint32 result = 0;
+  unsigned int shift;
+
+  for(shift = 0; shift < 32; shift += 8)
+  {
+    warping_engine_uint32 c = ((t00 >> shift) & 0xff) * w00 +
+                              ((t10 >> shift) & 0xff) * w10 +
+                              ((t01 >> shift) & 0xff) * w01 +
+                              ((t11 >> shift) & 0xff) * w11;
+    result |= ((c + (1u << (2 * WARPING_ENGINE_WEIGHT_BITS - 1))) >> (2 * WARPING_ENGINE_WEIGHT_BITS)) << shift;
+  }
+
+  return result;
+}
+
+/* Sample the input image (pitch in pixels) at a 15.16 source position */
+static inline warping_engine_uint32 warping_engine_sample(const warping_engine_uint32 *image,
+                                                          warping_engine_uint32 pitch,
+                                                          warping_engine_uint32 width,
+                                                          warping_engine_uint32 height,
+                                                          warping_engine_coordinate pos,
+                                                          warping_engine_uint32 outside)
+{
+  int x0 = pos.x >> WARPING_ENGINE_COORD_SHIFT;
+  int y0 = pos.y >> WARPING_ENGINE_COORD_SHIFT;
+  warping_engine_uint32 fx = (pos.x >> (WARPING_ENGINE_COORD_SHIFT - WARPING_ENGINE_WEIGHT_BITS)) & (WARPING_ENGINE_WEIGHT_ONE - 1);
+  warping_engine_uint32 fy = (pos.y >> (WARPING_ENGINE_COORD_SHIFT - WARPING_ENGINE_WEIGHT_BITS)) & (WARPING_ENGINE_WEIGHT_ONE - 1);
+
+  return warping_engine_blend(warping_engine_texel(image, pitch, width, height, x0,     y0,     outside),
+                              warping_engine_texel(image, pitch, width, height, x0 + 1, y0,     outside),
+                              warping_engine_texel(image, pitch, width, height, x0,     y0 + 1, outside),
+                              warping_engine_texel(image, pitch, width, height, x0 + 1, y0 + 1, outside),
+                              fx, fy);
+}
+
+#endif // WARPING_ENGINE_SAMPLE_H_
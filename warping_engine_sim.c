@@ -0,0 +1,437 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Simulated engine for machines without the hardware. Implements
+ *            the register map, warps frames on the CPU with the reference
+ *            pixel pipeline, raises the finished interrupt and models the
+ *            performance counters.
+ ****************************************************************************/
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/io.h>
+#include <linux/ktime.h>
+#include <linux/delay.h>
+#include <linux/sched.h>
+#include <linux/workqueue.h>
+#include <linux/interrupt.h>
+#include <linux/dma-mapping.h>
+#include <linux/platform_device.h>
+#include "warping_engine_module.h"
+#include "warping_engine_base.h"
+#include "warping_engine_cache.h"
+
+#define WARPING_ENGINE_SIM_REVISION         0x00010000
+#define WARPING_ENGINE_SIM_PFC_CNT          32
+#define WARPING_ENGINE_SIM_REG_CNT          (WARPING_ENGINE_PFC_VALUE_REG_BASE + WARPING_ENGINE_SIM_PFC_CNT)
+#define WARPING_ENGINE_SIM_EVENT_CNT        (WARPING_ENGINE_PFC_EVENT_CLOCK + 1)
+
+static bool sim;
+module_param(sim, bool, 0444);
+MODULE_PARM_DESC(sim, "Register a simulated engine device (default: off)");
+
+static unsigned int sim_clock_mhz;
+module_param(sim_clock_mhz, uint, 0644);
+MODULE_PARM_DESC(sim_clock_mhz, "Simulated engine clock, frames take at least their modelled cycles (default 0: as fast as possible)");
+
+struct warping_engine_sim
+{
+  struct warping_engine_dev *dev;
+  irq_handler_t irq_handler;
+  spinlock_t lock;                  /* protects regs, busy, generation  */
+  u32 *regs;                        /* own page, mapped to user space   */
+  u32 generation;                   /* bumped by a pipeline reset       */
+  bool busy;
+  bool stopped;
+  struct work_struct work;
+  /* frame state, only used by the work */
+  warping_engine_cache cache;       /* see warping_engine_cache.h      */
+  u64 events[WARPING_ENGINE_SIM_EVENT_CNT];
+};
+
+static struct platform_device *warping_engine_sim_pdev;
+
+struct warping_engine_sim_view
+{
+  void *virt;
+  bool remapped;                    /* memremap()ed, undone by unmap    */
+  struct warping_engine_bo *bo;     /* reference held while mapped      */
+};
+
+/* Memory seen by the engine: the video memory and the buffers the active
+ * job holds. Jobs of kernel clients are trusted with any system memory.
+ * Everything else, in particular addresses of raw register writes, is
+ * refused */
+static bool warping_engine_sim_map(struct warping_engine_sim *sim, u32 addr, u64 size,
+                                   struct warping_engine_sim_view *view)
+{
+  struct warping_engine_dev *dev = sim->dev;
+  struct warping_engine_kjob *kjob;
+  struct warping_engine_bo *bo;
+  unsigned long flags;
+  bool trusted = false;
+  unsigned int i;
+
+  memset(view, 0, sizeof(*view));
+  view->virt = warping_engine_mem_virt(dev, addr, size);
+  if(view->virt)
+    return true;
+
+  spin_lock_irqsave(&dev->irq_slck, flags);
+  kjob = dev->job_active;
+  if(kjob)
+  {
+    trusted = kjob->trusted;
+    for(i = 0; i < WARPING_ENGINE_JOB_BOS && !view->bo; i++)
+    {
+      bo = kjob->bos[i];
+      if(bo && addr >= bo->phys && (u64)addr + size <= (u64)bo->phys + bo->size)
+      {
+        kref_get(&bo->ref);
+        view->bo = bo;
+      }
+    }
+  }
+  spin_unlock_irqrestore(&dev->irq_slck, flags);
+
+  if(!view->bo && !trusted)
+    return false;
+  /* cached buffers are in the linear map, imports are remapped */
+  if(view->bo && view->bo->virt)
+  {
+    view->virt = view->bo->virt + (addr - view->bo->phys);
+    return true;
+  }
+
+  view->virt = memremap(addr, size, MEMREMAP_WB);
+  view->remapped = view->virt != NULL;
+  return view->virt != NULL;
+}
+
+static void warping_engine_sim_unmap(struct warping_engine_sim_view *view)
+{
+  if(view->remapped)
+    memunmap(view->virt);
+  if(view->bo)
+    warping_engine_bo_put(view->bo);
+}
+
+/* events without a model stay 0 */
+static void warping_engine_sim_fetch(struct warping_engine_sim *sim, warping_engine_coordinate pos,
+                                     u32 width, u32 height, u32 pitch)
+{
+  unsigned int misses = warping_engine_cache_fetch(&sim->cache, pos, width, height, pitch, NULL);
+
+  sim->events[WARPING_ENGINE_PFC_EVENT_TXC_PIXEL_READ]++;
+  if(!misses)
+  {
+    sim->events[WARPING_ENGINE_PFC_EVENT_TXC_PIXEL_READ_HIT]++;
+    return;
+  }
+
+  sim->events[WARPING_ENGINE_PFC_EVENT_TXS_PREFETCH_MISS] += misses;
+  sim->events[WARPING_ENGINE_PFC_EVENT_TXC_BURST_READ] += misses;
+  sim->events[WARPING_ENGINE_PFC_EVENT_TXC_WORD_READ] += misses * WARPING_ENGINE_CACHE_LINE_PIXELS;
+  sim->events[WARPING_ENGINE_PFC_EVENT_TXC_PIXEL_READ_FETCH_WAIT] += misses * WARPING_ENGINE_CACHE_MISS_CYCLES;
+}
+
+/* process one frame from a snapshot of the job registers. Output is written
+ * stripe by stripe like the engine does, which drives the cache model.
+ * Returns false if the job names memory the engine may not access */
+static bool warping_engine_sim_frame(struct warping_engine_sim *sim, const u32 *regs)
+{
+  u32 in_w = WARPING_ENGINE_SIZE_WIDTH(regs[WARPING_ENGINE_INPUT_SIZE_REG]);
+  u32 in_h = WARPING_ENGINE_SIZE_HEIGHT(regs[WARPING_ENGINE_INPUT_SIZE_REG]);
+  u32 out_w = WARPING_ENGINE_SIZE_WIDTH(regs[WARPING_ENGINE_OUTPUT_SIZE_REG]);
+  u32 out_h = WARPING_ENGINE_SIZE_HEIGHT(regs[WARPING_ENGINE_OUTPUT_SIZE_REG]);
+  u32 in_pitch = regs[WARPING_ENGINE_INPUT_PITCH_REG];
+  u32 out_pitch = regs[WARPING_ENGINE_OUTPUT_PITCH_REG];
+  u32 outside = regs[WARPING_ENGINE_OUTSIDE_COLOR_REG];
+  u32 stripe = regs[WARPING_ENGINE_STRIPE_WIDTH_REG] ? regs[WARPING_ENGINE_STRIPE_WIDTH_REG] : out_w;
+  u32 count = min_t(u64, regs[WARPING_ENGINE_COORDINATES_COUNT_REG], (u64)out_w * out_h);
+  struct warping_engine_sim_view coords_view, input_view, output_view;
+  warping_engine_coordinate *coords;
+  u32 *input, *output;
+  bool mapped = true;
+  u32 sx, x, y, end, idx, pixel;
+
+  if(!out_w || !out_h)
+    return true;
+
+  memset(&coords_view, 0, sizeof(coords_view));
+  memset(&input_view, 0, sizeof(input_view));
+  if(count)
+    mapped &= warping_engine_sim_map(sim, regs[WARPING_ENGINE_COORDINATES_ADDRESS_REG],
+                                     (u64)count * sizeof(*coords), &coords_view);
+  if(in_w && in_h)
+    mapped &= warping_engine_sim_map(sim, regs[WARPING_ENGINE_INPUT_ADDRESS_REG],
+                                     (u64)in_pitch * in_h * BYTES_PER_PIXEL, &input_view);
+  mapped &= warping_engine_sim_map(sim, regs[WARPING_ENGINE_OUTPUT_ADDRESS_REG],
+                                   (u64)out_pitch * out_h * BYTES_PER_PIXEL, &output_view);
+  if(!mapped)
+  {
+    dev_warn_ratelimited(sim->dev->device, "sim: job accesses unmapped memory, frame dropped\n");
+    goto UNMAP;
+  }
+  coords = coords_view.virt;
+  input = input_view.virt;
+  output = output_view.virt;
+  /* no input image, every tap is outside */
+  if(!input)
+    in_w = in_h = 0;
+
+  warping_engine_cache_reset(&sim->cache);
+
+  for(sx = 0; sx < out_w; sx += stripe)
+  {
+    end = min(sx + stripe, out_w);
+    for(y = 0; y < out_h; y++)
+    {
+      for(x = sx; x < end; x++)
+      {
+        idx = y * out_w + x;
+        pixel = outside;
+        if(idx < count)
+        {
+          pixel = warping_engine_sample(input, in_pitch, in_w, in_h, coords[idx], outside);
+          warping_engine_sim_fetch(sim, coords[idx], in_w, in_h, in_pitch);
+        }
+        output[y * out_pitch + x] = pixel;
+      }
+      sim->events[WARPING_ENGINE_PFC_EVENT_WRITE_ASSEMBLY_BURST_WRITE] +=
+        DIV_ROUND_UP(end - sx, WARPING_ENGINE_MBI_BURST_WORDS);
+    }
+    cond_resched();
+  }
+
+  sim->events[WARPING_ENGINE_PFC_EVENT_WRITE_ASSEMBLY_WORD_WRITE] += (u64)out_w * out_h;
+  sim->events[WARPING_ENGINE_PFC_EVENT_COORDINATES_READ_WORD_READ] += (u64)count * 2;
+  sim->events[WARPING_ENGINE_PFC_EVENT_COORDINATES_READ_BURST_READ] +=
+    DIV_ROUND_UP((u64)count * 2, WARPING_ENGINE_MBI_BURST_WORDS);
+  /* one pixel per cycle plus cache stalls */
+  sim->events[WARPING_ENGINE_PFC_EVENT_CLOCK] += (u64)out_w * out_h +
+    sim->events[WARPING_ENGINE_PFC_EVENT_TXC_PIXEL_READ_FETCH_WAIT];
+
+UNMAP:
+  warping_engine_sim_unmap(&output_view);
+  warping_engine_sim_unmap(&input_view);
+  warping_engine_sim_unmap(&coords_view);
+
+  return mapped;
+}
+
+static void warping_engine_sim_work(struct work_struct *work)
+{
+  struct warping_engine_sim *sim = container_of(work, struct warping_engine_sim, work);
+  u32 regs[WARPING_ENGINE_STRIPE_WIDTH_REG + 1];
+  unsigned long flags;
+  u32 generation, status;
+  bool mapped;
+  ktime_t start;
+  s64 remaining;
+  unsigned int i;
+  u32 event;
+
+  spin_lock_irqsave(&sim->lock, flags);
+  memcpy(regs, sim->regs, sizeof(regs));
+  generation = sim->generation;
+  spin_unlock_irqrestore(&sim->lock, flags);
+
+  start = ktime_get();
+  memset(sim->events, 0, sizeof(sim->events));
+  mapped = warping_engine_sim_frame(sim, regs);
+
+  if(sim_clock_mhz)
+  {
+    remaining = div_u64(sim->events[WARPING_ENGINE_PFC_EVENT_CLOCK] * 1000, sim_clock_mhz) -
+                ktime_to_ns(ktime_sub(ktime_get(), start));
+    if(remaining > 0)
+      usleep_range(div_s64(remaining, 1000), div_s64(remaining, 1000) + 50);
+  }
+
+  spin_lock_irqsave(&sim->lock, flags);
+  /* a pipeline reset dropped the frame */
+  if(generation != sim->generation)
+  {
+    spin_unlock_irqrestore(&sim->lock, flags);
+    return;
+  }
+
+  for(i = 0; i < WARPING_ENGINE_SIM_PFC_CNT; i++)
+  {
+    if(!(sim->regs[WARPING_ENGINE_PFC_ENABLE_REG] & BIT(i)))
+      continue;
+    event = sim->regs[WARPING_ENGINE_PFC_EVENT_SELECT_REG_BASE + i];
+    if(event < WARPING_ENGINE_SIM_EVENT_CNT)
+      sim->regs[WARPING_ENGINE_PFC_VALUE_REG_BASE + i] += (u32) sim->events[event];
+  }
+
+  sim->busy = false;
+  sim->regs[WARPING_ENGINE_IRQ_STATUS_REG] |= mapped ? WARPING_ENGINE_IRQ_WARPING_FINISHED : WARPING_ENGINE_STATUS_FAULT;
+  status = sim->regs[WARPING_ENGINE_IRQ_STATUS_REG] &
+           (sim->regs[WARPING_ENGINE_IRQ_ENABLE_REG] | WARPING_ENGINE_STATUS_FAULT);
+  spin_unlock_irqrestore(&sim->lock, flags);
+
+  /* the handler expects hard IRQ context */
+  if(status)
+  {
+    local_irq_save(flags);
+    sim->irq_handler(0, sim->dev);
+    local_irq_restore(flags);
+  }
+}
+
+void warping_engine_sim_write(struct warping_engine_sim *sim, unsigned int reg, u32 value)
+{
+  unsigned long flags;
+  unsigned int i;
+
+  if(reg >= WARPING_ENGINE_SIM_REG_CNT)
+    return;
+
+  spin_lock_irqsave(&sim->lock, flags);
+  switch(reg)
+  {
+    case WARPING_ENGINE_H_W_REVISION_REG:
+    case WARPING_ENGINE_IRQ_STATUS_REG:
+      break;
+
+    case WARPING_ENGINE_IRQ_CLEAR_REG:
+      sim->regs[WARPING_ENGINE_IRQ_STATUS_REG] &= ~value;
+      break;
+
+    case WARPING_ENGINE_RESET_PIPE_REG:
+      if(value)
+      {
+        sim->generation++;
+        sim->busy = false;
+        sim->regs[WARPING_ENGINE_IRQ_STATUS_REG] = 0;
+      }
+      break;
+
+    case WARPING_ENGINE_PFC_CLEAR_REG:
+      for(i = 0; i < WARPING_ENGINE_SIM_PFC_CNT; i++)
+      {
+        if(value & BIT(i))
+          sim->regs[WARPING_ENGINE_PFC_VALUE_REG_BASE + i] = 0;
+      }
+      break;
+
+    case WARPING_ENGINE_CONFIG_REG:
+      sim->regs[reg] = value;
+      if(!sim->busy && !sim->stopped)
+      {
+        sim->busy = true;
+        queue_work(system_unbound_wq, &sim->work);
+      }
+      break;
+
+    default:
+      if(reg < WARPING_ENGINE_PFC_VALUE_REG_BASE)
+        sim->regs[reg] = value;
+      break;
+  }
+  spin_unlock_irqrestore(&sim->lock, flags);
+}
+
+u32 warping_engine_sim_read(struct warping_engine_sim *sim, unsigned int reg)
+{
+  unsigned long flags;
+  u32 value;
+
+  if(reg >= WARPING_ENGINE_SIM_REG_CNT)
+    return 0;
+
+  spin_lock_irqsave(&sim->lock, flags);
+  value = sim->regs[reg];
+  spin_unlock_irqrestore(&sim->lock, flags);
+
+  return value;
+}
+
+int warping_engine_sim_init(struct warping_engine_dev *dev, irq_handler_t irq_handler)
+{
+  struct warping_engine_sim *sim;
+
+  sim = kzalloc(sizeof(*sim), GFP_KERNEL);
+  if(!sim)
+    return -ENOMEM;
+  BUILD_BUG_ON(WARPING_ENGINE_SIM_REG_CNT * sizeof(u32) > PAGE_SIZE);
+  sim->regs = (u32 *) get_zeroed_page(GFP_KERNEL);
+  if(!sim->regs)
+  {
+    kfree(sim);
+    return -ENOMEM;
+  }
+
+  sim->dev = dev;
+  sim->irq_handler = irq_handler;
+  spin_lock_init(&sim->lock);
+  INIT_WORK(&sim->work, warping_engine_sim_work);
+  sim->regs[WARPING_ENGINE_H_W_REVISION_REG] = WARPING_ENGINE_SIM_REVISION;
+  dev->sim = sim;
+
+  dev_info(dev->device, "using the simulated engine\n");
+
+  return 0;
+}
+
+/* no interrupts after this, like free_irq() */
+void warping_engine_sim_stop(struct warping_engine_dev *dev)
+{
+  unsigned long flags;
+
+  spin_lock_irqsave(&dev->sim->lock, flags);
+  dev->sim->stopped = true;
+  spin_unlock_irqrestore(&dev->sim->lock, flags);
+
+  cancel_work_sync(&dev->sim->work);
+}
+
+/* read-only mapping of the register page, see warping_engine_regs_mmap() */
+int warping_engine_sim_mmap(struct warping_engine_sim *sim, struct vm_area_struct *vma)
+{
+  if(vma->vm_end - vma->vm_start > PAGE_SIZE)
+    return -EINVAL;
+
+  return remap_pfn_range(vma, vma->vm_start, PHYS_PFN(virt_to_phys(sim->regs)),
+                         vma->vm_end - vma->vm_start, vma->vm_page_prot);
+}
+
+void warping_engine_sim_exit(struct warping_engine_dev *dev)
+{
+  free_page((unsigned long) dev->sim->regs);
+  kfree(dev->sim);
+  dev->sim = NULL;
+}
+
+/* the simulated device binds to the platform driver like a device tree node */
+int warping_engine_sim_register(void)
+{
+  struct platform_device_info info = {
+    .name = WARPING_ENGINE_SIM_NAME,
+    .id = PLATFORM_DEVID_NONE,
+    .dma_mask = DMA_BIT_MASK(32),
+  };
+
+  if(!sim)
+    return 0;
+
+  warping_engine_sim_pdev = platform_device_register_full(&info);
+  if(IS_ERR(warping_engine_sim_pdev))
+  {
+    pr_err("%s: cannot register simulated device\n", WARPING_ENGINE_DEVICE_NAME);
+    return PTR_ERR(warping_engine_sim_pdev);
+  }
+
+  return 0;
+}
+
+void warping_engine_sim_unregister(void)
+{
+  if(!IS_ERR_OR_NULL(warping_engine_sim_pdev))
+    platform_device_unregister(warping_engine_sim_pdev);
+  warping_engine_sim_pdev = NULL;
+}
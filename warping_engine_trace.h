@@ -0,0 +1,85 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Tracepoints along the job path: submit, hardware start, IRQ
+ *            entry, completion and reader wakeup. Timestamps are
+ *            CLOCK_MONOTONIC nanoseconds.
+ ****************************************************************************/
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM warping_engine
+
+#if !defined(_WARPING_ENGINE_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define _WARPING_ENGINE_TRACE_H_
+
+#include <linux/tracepoint.h>
+#include <linux/device.h>
+
+DECLARE_EVENT_CLASS(warping_engine_job_event,
+  TP_PROTO(struct device *dev, const void *ctx, u32 seq, u64 ts),
+  TP_ARGS(dev, ctx, seq, ts),
+
+  TP_STRUCT__entry(
+    __string(dev, dev_name(dev))
+    __field(const void *, ctx)
+    __field(u32, seq)
+    __field(u64, ts)
+  ),
+
+  TP_fast_assign(
+    __assign_str(dev, dev_name(dev));
+    __entry->ctx = ctx;
+    __entry->seq = seq;
+    __entry->ts = ts;
+  ),
+
+  TP_printk("%s ctx=%p seq=%u ts=%llu", __get_str(dev), __entry->ctx, __entry->seq, __entry->ts)
+);
+
+DEFINE_EVENT(warping_engine_job_event, warping_engine_submit,
+  TP_PROTO(struct device *dev, const void *ctx, u32 seq, u64 ts),
+  TP_ARGS(dev, ctx, seq, ts)
+);
+
+DEFINE_EVENT(warping_engine_job_event, warping_engine_start,
+  TP_PROTO(struct device *dev, const void *ctx, u32 seq, u64 ts),
+  TP_ARGS(dev, ctx, seq, ts)
+);
+
+DEFINE_EVENT(warping_engine_job_event, warping_engine_complete,
+  TP_PROTO(struct device *dev, const void *ctx, u32 seq, u64 ts),
+  TP_ARGS(dev, ctx, seq, ts)
+);
+
+DEFINE_EVENT(warping_engine_job_event, warping_engine_wakeup,
+  TP_PROTO(struct device *dev, const void *ctx, u32 seq, u64 ts),
+  TP_ARGS(dev, ctx, seq, ts)
+);
+
+TRACE_EVENT(warping_engine_irq,
+  TP_PROTO(struct device *dev, u32 status, u64 ts),
+  TP_ARGS(dev, status, ts),
+
+  TP_STRUCT__entry(
+    __string(dev, dev_name(dev))
+    __field(u32, status)
+    __field(u64, ts)
+  ),
+
+  TP_fast_assign(
+    __assign_str(dev, dev_name(dev));
+    __entry->status = status;
+    __entry->ts = ts;
+  ),
+
+  TP_printk("%s status=0x%x ts=%llu", __get_str(dev), __entry->status, __entry->ts)
+);
+
+#endif /* _WARPING_ENGINE_TRACE_H_ */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE warping_engine_trace
+#include <trace/define_trace.h>
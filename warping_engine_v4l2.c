@@ -0,0 +1,661 @@
+/****************************************************************************
+ *  License : All rights reserved for TES Electronic Solutions GmbH
+ *        See included /docs/license.txt for details
+ *  Project : WARPING_ENGINE
+ *  Purpose : Optional V4L2 mem2mem front end. Source images are queued on
+ *            the OUTPUT queue, warped images dequeued from the CAPTURE
+ *            queue, the coordinates table is passed as dma-buf control.
+ ****************************************************************************/
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/dma-buf.h>
+#include <media/v4l2-device.h>
+#include <media/v4l2-ioctl.h>
+#include <media/v4l2-ctrls.h>
+#include <media/v4l2-event.h>
+#include <media/v4l2-mem2mem.h>
+#include <media/videobuf2-dma-contig.h>
+#include "warping_engine_module.h"
+#include "warping_engine_base.h"
+#include "warping_engine_sample.h"
+
+#define WARPING_ENGINE_V4L2_NAME            "warpingengine-m2m"
+#define WARPING_ENGINE_V4L2_MAX_SIZE        8192u
+#define WARPING_ENGINE_V4L2_DEF_WIDTH       640u
+#define WARPING_ENGINE_V4L2_DEF_HEIGHT      480u
+
+struct warping_engine_v4l2
+{
+  struct warping_engine_dev *dev;
+  struct v4l2_device v4l2_dev;
+  struct video_device vfd;
+  struct v4l2_m2m_dev *m2m_dev;
+  struct mutex lock;
+};
+
+/* per open file context */
+struct warping_engine_v4l2_ctx
+{
+  struct v4l2_fh fh;
+  struct warping_engine_v4l2 *wv;
+  struct warping_engine_ctx *core;  /* client of the job queue          */
+  struct v4l2_ctrl_handler hdl;
+  struct v4l2_ctrl *ctrl_count;
+  struct v4l2_ctrl *ctrl_color;
+  struct v4l2_ctrl *ctrl_stripe;
+  struct v4l2_ctrl *ctrl_config;
+  struct v4l2_pix_format fmt_out;   /* OUTPUT queue: source image       */
+  struct v4l2_pix_format fmt_cap;   /* CAPTURE queue: warped image      */
+  struct warping_engine_bo *mesh;   /* coordinates table                */
+};
+
+/* the engine processes any 4 byte pixel format, channels are not touched */
+static const u32 warping_engine_v4l2_formats[] = {
+  V4L2_PIX_FMT_ABGR32,
+  V4L2_PIX_FMT_ARGB32,
+  V4L2_PIX_FMT_XBGR32,
+  V4L2_PIX_FMT_XRGB32,
+};
+
+static inline struct warping_engine_v4l2_ctx *fh_to_ctx(struct v4l2_fh *fh)
+{
+  return container_of(fh, struct warping_engine_v4l2_ctx, fh);
+}
+
+static struct v4l2_pix_format *warping_engine_v4l2_fmt(struct warping_engine_v4l2_ctx *ctx,
+                                                       enum v4l2_buf_type type)
+{
+  return V4L2_TYPE_IS_OUTPUT(type) ? &ctx->fmt_out : &ctx->fmt_cap;
+}
+
+static void warping_engine_v4l2_fill_fmt(struct v4l2_pix_format *pix)
+{
+  unsigned int i;
+
+  for(i = 0; i < ARRAY_SIZE(warping_engine_v4l2_formats); i++)
+  {
+    if(pix->pixelformat == warping_engine_v4l2_formats[i])
+      break;
+  }
+  if(i == ARRAY_SIZE(warping_engine_v4l2_formats))
+    pix->pixelformat = warping_engine_v4l2_formats[0];
+
+  pix->width = clamp(pix->width, 1u, WARPING_ENGINE_V4L2_MAX_SIZE);
+  pix->height = clamp(pix->height, 1u, WARPING_ENGINE_V4L2_MAX_SIZE);
+  pix->field = V4L2_FIELD_NONE;
+  /* pitches are programmed in pixels, keep them a whole number of pixels */
+  pix->bytesperline = clamp(ALIGN(pix->bytesperline, BYTES_PER_PIXEL),
+                            pix->width * BYTES_PER_PIXEL,
+                            WARPING_ENGINE_V4L2_MAX_SIZE * BYTES_PER_PIXEL);
+  pix->sizeimage = pix->bytesperline * pix->height;
+  if(pix->colorspace == V4L2_COLORSPACE_DEFAULT)
+    pix->colorspace = V4L2_COLORSPACE_SRGB;
+  pix->priv = 0;
+}
+
+/* job completion: called from the job queue or on submission errors */
+static void warping_engine_v4l2_finish(struct warping_engine_v4l2_ctx *ctx, enum vb2_buffer_state state)
+{
+  struct vb2_v4l2_buffer *src, *dst;
+
+  src = v4l2_m2m_src_buf_remove(ctx->fh.m2m_ctx);
+  dst = v4l2_m2m_dst_buf_remove(ctx->fh.m2m_ctx);
+
+  if(src && dst)
+  {
+    dst->vb2_buf.timestamp = src->vb2_buf.timestamp;
+    dst->flags &= ~(V4L2_BUF_FLAG_TSTAMP_SRC_MASK | V4L2_BUF_FLAG_TIMECODE);
+    dst->flags |= src->flags & (V4L2_BUF_FLAG_TSTAMP_SRC_MASK | V4L2_BUF_FLAG_TIMECODE);
+    dst->timecode = src->timecode;
+  }
+  if(src)
+    v4l2_m2m_buf_done(src, state);
+  if(dst)
+    v4l2_m2m_buf_done(dst, state);
+
+  v4l2_m2m_job_finish(ctx->wv->m2m_dev, ctx->fh.m2m_ctx);
+}
+
+static void warping_engine_v4l2_job_done(struct warping_engine_ctx *core, const warping_engine_job *job,
+                                         const warping_engine_completion *record)
+{
+  warping_engine_v4l2_finish(core->priv, (record->status & WARPING_ENGINE_IRQ_WARPING_FINISHED) ?
+                                         VB2_BUF_STATE_DONE : VB2_BUF_STATE_ERROR);
+}
+
+/* mem2mem ops */
+/* jobs of the front end bypass warping_engine_validate_job(): the table
+ * has to fit the mesh buffer and the images their planes */
+static bool warping_engine_v4l2_job_valid(struct warping_engine_v4l2_ctx *ctx, const warping_engine_job *job,
+                                          struct vb2_v4l2_buffer *src, struct vb2_v4l2_buffer *dst)
+{
+  u32 in_h = WARPING_ENGINE_SIZE_HEIGHT(job->input_size);
+  u32 out_h = WARPING_ENGINE_SIZE_HEIGHT(job->output_size);
+
+  if(!job->coordinates_count ||
+     (u64)job->coordinates_count * sizeof(warping_engine_coordinate) > ctx->mesh->size)
+    return false;
+
+  return (u64)job->input_byte_pitch * in_h <= vb2_plane_size(&src->vb2_buf, 0) &&
+         (u64)job->output_pitch * out_h * BYTES_PER_PIXEL <= vb2_plane_size(&dst->vb2_buf, 0);
+}
+
+static void warping_engine_v4l2_device_run(void *priv)
+{
+  struct warping_engine_v4l2_ctx *ctx = priv;
+  struct vb2_v4l2_buffer *src, *dst;
+  warping_engine_job job;
+
+  src = v4l2_m2m_next_src_buf(ctx->fh.m2m_ctx);
+  dst = v4l2_m2m_next_dst_buf(ctx->fh.m2m_ctx);
+
+  memset(&job, 0, sizeof(job));
+  job.coordinates_address = ctx->mesh->phys;
+  job.coordinates_count = ctx->ctrl_count->val ? ctx->ctrl_count->val :
+                          ctx->fmt_cap.width * ctx->fmt_cap.height;
+  job.input_address = vb2_dma_contig_plane_dma_addr(&src->vb2_buf, 0);
+  job.input_size = WARPING_ENGINE_MAKE_SIZE(ctx->fmt_out.width, ctx->fmt_out.height);
+  job.input_pitch = ctx->fmt_out.bytesperline / BYTES_PER_PIXEL;
+  job.input_byte_pitch = ctx->fmt_out.bytesperline;
+  job.outside_color = (u32) ctx->ctrl_color->val;
+  job.output_address = vb2_dma_contig_plane_dma_addr(&dst->vb2_buf, 0);
+  job.output_size = WARPING_ENGINE_MAKE_SIZE(ctx->fmt_cap.width, ctx->fmt_cap.height);
+  job.output_pitch = ctx->fmt_cap.bytesperline / BYTES_PER_PIXEL;
+  job.stripe_width = ctx->ctrl_stripe->val;
+  job.config = (u32) ctx->ctrl_config->val;
+
+  if(!warping_engine_v4l2_job_valid(ctx, &job, src, dst))
+  {
+    dev_dbg(ctx->core->dev->device, "rejected invalid job\n");
+    warping_engine_v4l2_finish(ctx, VB2_BUF_STATE_ERROR);
+    return;
+  }
+
+  if(warping_engine_queue_job(ctx->core, &job) < 0)
+    warping_engine_v4l2_finish(ctx, VB2_BUF_STATE_ERROR);
+}
+
+static int warping_engine_v4l2_job_ready(void *priv)
+{
+  struct warping_engine_v4l2_ctx *ctx = priv;
+
+  return ctx->mesh != NULL;
+}
+
+static void warping_engine_v4l2_job_abort(void *priv)
+{
+  /* a started job cannot be stopped, it finishes through job_done */
+}
+
+static const struct v4l2_m2m_ops warping_engine_v4l2_m2m_ops = {
+  .device_run = warping_engine_v4l2_device_run,
+  .job_ready = warping_engine_v4l2_job_ready,
+  .job_abort = warping_engine_v4l2_job_abort,
+};
+
+/* videobuf2 ops */
+static int warping_engine_v4l2_queue_setup(struct vb2_queue *vq, unsigned int *nbuffers,
+                                           unsigned int *nplanes, unsigned int sizes[],
+                                           struct device *alloc_devs[])
+{
+  struct warping_engine_v4l2_ctx *ctx = vb2_get_drv_priv(vq);
+  struct v4l2_pix_format *pix = warping_engine_v4l2_fmt(ctx, vq->type);
+
+  if(*nplanes)
+    return sizes[0] < pix->sizeimage ? -EINVAL : 0;
+
+  *nplanes = 1;
+  sizes[0] = pix->sizeimage;
+
+  return 0;
+}
+
+static int warping_engine_v4l2_buf_prepare(struct vb2_buffer *vb)
+{
+  struct warping_engine_v4l2_ctx *ctx = vb2_get_drv_priv(vb->vb2_queue);
+  struct v4l2_pix_format *pix = warping_engine_v4l2_fmt(ctx, vb->vb2_queue->type);
+  struct vb2_v4l2_buffer *vbuf = to_vb2_v4l2_buffer(vb);
+
+  if(vb2_plane_size(vb, 0) < pix->sizeimage)
+    return -EINVAL;
+
+  if(V4L2_TYPE_IS_OUTPUT(vb->vb2_queue->type))
+  {
+    if(vbuf->field == V4L2_FIELD_ANY)
+      vbuf->field = V4L2_FIELD_NONE;
+    if(vbuf->field != V4L2_FIELD_NONE)
+      return -EINVAL;
+  }
+  else
+  {
+    vb2_set_plane_payload(vb, 0, pix->sizeimage);
+  }
+
+  return 0;
+}
+
+static void warping_engine_v4l2_buf_queue(struct vb2_buffer *vb)
+{
+  struct warping_engine_v4l2_ctx *ctx = vb2_get_drv_priv(vb->vb2_queue);
+
+  v4l2_m2m_buf_queue(ctx->fh.m2m_ctx, to_vb2_v4l2_buffer(vb));
+}
+
+static void warping_engine_v4l2_stop_streaming(struct vb2_queue *vq)
+{
+  struct warping_engine_v4l2_ctx *ctx = vb2_get_drv_priv(vq);
+  struct vb2_v4l2_buffer *vbuf;
+
+  for(;;)
+  {
+    if(V4L2_TYPE_IS_OUTPUT(vq->type))
+      vbuf = v4l2_m2m_src_buf_remove(ctx->fh.m2m_ctx);
+    else
+      vbuf = v4l2_m2m_dst_buf_remove(ctx->fh.m2m_ctx);
+    if(!vbuf)
+      break;
+    v4l2_m2m_buf_done(vbuf, VB2_BUF_STATE_ERROR);
+  }
+}
+
+static const struct vb2_ops warping_engine_v4l2_qops = {
+  .queue_setup = warping_engine_v4l2_queue_setup,
+  .buf_prepare = warping_engine_v4l2_buf_prepare,
+  .buf_queue = warping_engine_v4l2_buf_queue,
+  .stop_streaming = warping_engine_v4l2_stop_streaming,
+  .wait_prepare = vb2_ops_wait_prepare,
+  .wait_finish = vb2_ops_wait_finish,
+};
+
+static int warping_engine_v4l2_queue_init(void *priv, struct vb2_queue *src_vq, struct vb2_queue *dst_vq)
+{
+  struct warping_engine_v4l2_ctx *ctx = priv;
+  int result;
+
+  src_vq->type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+  src_vq->io_modes = VB2_MMAP | VB2_DMABUF;
+  src_vq->drv_priv = ctx;
+  src_vq->buf_struct_size = sizeof(struct v4l2_m2m_buffer);
+  src_vq->ops = &warping_engine_v4l2_qops;
+  src_vq->mem_ops = &vb2_dma_contig_memops;
+  src_vq->timestamp_flags = V4L2_BUF_FLAG_TIMESTAMP_COPY;
+  src_vq->lock = &ctx->wv->lock;
+  src_vq->dev = ctx->wv->dev->device;
+
+  result = vb2_queue_init(src_vq);
+  if(result)
+    return result;
+
+  dst_vq->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  dst_vq->io_modes = VB2_MMAP | VB2_DMABUF;
+  dst_vq->drv_priv = ctx;
+  dst_vq->buf_struct_size = sizeof(struct v4l2_m2m_buffer);
+  dst_vq->ops = &warping_engine_v4l2_qops;
+  dst_vq->mem_ops = &vb2_dma_contig_memops;
+  dst_vq->timestamp_flags = V4L2_BUF_FLAG_TIMESTAMP_COPY;
+  dst_vq->lock = &ctx->wv->lock;
+  dst_vq->dev = ctx->wv->dev->device;
+
+  return vb2_queue_init(dst_vq);
+}
+
+/* controls */
+static int warping_engine_v4l2_s_ctrl(struct v4l2_ctrl *ctrl)
+{
+  struct warping_engine_v4l2_ctx *ctx = container_of(ctrl->handler, struct warping_engine_v4l2_ctx, hdl);
+  struct warping_engine_bo *mesh = NULL;
+
+  if(ctrl->id != WARPING_ENGINE_CID_MESH_FD)
+    return 0;
+
+  /* the engine may be reading the current table */
+  if(ctx->fh.m2m_ctx &&
+     (vb2_is_streaming(v4l2_m2m_get_src_vq(ctx->fh.m2m_ctx)) ||
+      vb2_is_streaming(v4l2_m2m_get_dst_vq(ctx->fh.m2m_ctx))))
+    return -EBUSY;
+
+  if(ctrl->val >= 0)
+  {
+    mesh = warping_engine_dmabuf_import_fd(ctx->wv->dev, ctrl->val);
+    if(IS_ERR(mesh))
+      return PTR_ERR(mesh);
+  }
+
+  if(ctx->mesh)
+    warping_engine_bo_put(ctx->mesh);
+  ctx->mesh = mesh;
+
+  return 0;
+}
+
+static const struct v4l2_ctrl_ops warping_engine_v4l2_ctrl_ops = {
+  .s_ctrl = warping_engine_v4l2_s_ctrl,
+};
+
+static const struct v4l2_ctrl_config warping_engine_v4l2_ctrls[] = {
+  {
+    .ops = &warping_engine_v4l2_ctrl_ops,
+    .id = WARPING_ENGINE_CID_MESH_FD,
+    .name = "Coordinates Table dma-buf",
+    .type = V4L2_CTRL_TYPE_INTEGER,
+    .min = -1, .max = INT_MAX, .step = 1, .def = -1,
+    .flags = V4L2_CTRL_FLAG_EXECUTE_ON_WRITE,
+  },
+  {
+    .ops = &warping_engine_v4l2_ctrl_ops,
+    .id = WARPING_ENGINE_CID_COORDINATES_COUNT,
+    .name = "Coordinates Count",
+    .type = V4L2_CTRL_TYPE_INTEGER,
+    .min = 0, .max = INT_MAX, .step = 1, .def = 0,
+  },
+  {
+    .ops = &warping_engine_v4l2_ctrl_ops,
+    .id = WARPING_ENGINE_CID_OUTSIDE_COLOR,
+    .name = "Outside Color",
+    .type = V4L2_CTRL_TYPE_INTEGER,
+    .min = INT_MIN, .max = INT_MAX, .step = 1, .def = 0,
+  },
+  {
+    .ops = &warping_engine_v4l2_ctrl_ops,
+    .id = WARPING_ENGINE_CID_STRIPE_WIDTH,
+    .name = "Stripe Width",
+    .type = V4L2_CTRL_TYPE_INTEGER,
+    .min = 1, .max = 0xffff, .step = 1, .def = 64,
+  },
+  {
+    .ops = &warping_engine_v4l2_ctrl_ops,
+    .id = WARPING_ENGINE_CID_CONFIG,
+    .name = "Config Register",
+    .type = V4L2_CTRL_TYPE_INTEGER,
+    .min = INT_MIN, .max = INT_MAX, .step = 1, .def = 1,
+  },
+};
+
+/* ioctls */
+static int warping_engine_v4l2_querycap(struct file *file, void *priv, struct v4l2_capability *cap)
+{
+  strlcpy(cap->driver, WARPING_ENGINE_DEVICE_NAME, sizeof(cap->driver));
+  strlcpy(cap->card, "TES Warping Engine", sizeof(cap->card));
+  snprintf(cap->bus_info, sizeof(cap->bus_info), "platform:%s", WARPING_ENGINE_DEVICE_NAME);
+  cap->device_caps = V4L2_CAP_VIDEO_M2M | V4L2_CAP_STREAMING;
+  cap->capabilities = cap->device_caps | V4L2_CAP_DEVICE_CAPS;
+
+  return 0;
+}
+
+static int warping_engine_v4l2_enum_fmt(struct file *file, void *priv, struct v4l2_fmtdesc *f)
+{
+  if(f->index >= ARRAY_SIZE(warping_engine_v4l2_formats))
+    return -EINVAL;
+
+  f->pixelformat = warping_engine_v4l2_formats[f->index];
+
+  return 0;
+}
+
+static int warping_engine_v4l2_g_fmt(struct file *file, void *priv, struct v4l2_format *f)
+{
+  struct warping_engine_v4l2_ctx *ctx = fh_to_ctx(priv);
+
+  f->fmt.pix = *warping_engine_v4l2_fmt(ctx, f->type);
+
+  return 0;
+}
+
+static int warping_engine_v4l2_try_fmt_out(struct file *file, void *priv, struct v4l2_format *f)
+{
+  warping_engine_v4l2_fill_fmt(&f->fmt.pix);
+
+  return 0;
+}
+
+static int warping_engine_v4l2_try_fmt_cap(struct file *file, void *priv, struct v4l2_format *f)
+{
+  struct warping_engine_v4l2_ctx *ctx = fh_to_ctx(priv);
+
+  /* pixels are copied unchanged, the format follows the source */
+  f->fmt.pix.pixelformat = ctx->fmt_out.pixelformat;
+  f->fmt.pix.colorspace = ctx->fmt_out.colorspace;
+  warping_engine_v4l2_fill_fmt(&f->fmt.pix);
+  f->fmt.pix.ycbcr_enc = ctx->fmt_out.ycbcr_enc;
+  f->fmt.pix.quantization = ctx->fmt_out.quantization;
+  f->fmt.pix.xfer_func = ctx->fmt_out.xfer_func;
+
+  return 0;
+}
+
+static int warping_engine_v4l2_s_fmt_out(struct file *file, void *priv, struct v4l2_format *f)
+{
+  struct warping_engine_v4l2_ctx *ctx = fh_to_ctx(priv);
+  struct vb2_queue *vq = v4l2_m2m_get_vq(ctx->fh.m2m_ctx, f->type);
+
+  if(vb2_is_busy(vq))
+    return -EBUSY;
+
+  warping_engine_v4l2_try_fmt_out(file, priv, f);
+  ctx->fmt_out = f->fmt.pix;
+
+  /* propagate format and colorimetry to the warped image */
+  vq = v4l2_m2m_get_vq(ctx->fh.m2m_ctx, V4L2_BUF_TYPE_VIDEO_CAPTURE);
+  if(!vb2_is_busy(vq))
+  {
+    ctx->fmt_cap.pixelformat = ctx->fmt_out.pixelformat;
+    ctx->fmt_cap.colorspace = ctx->fmt_out.colorspace;
+    ctx->fmt_cap.ycbcr_enc = ctx->fmt_out.ycbcr_enc;
+    ctx->fmt_cap.quantization = ctx->fmt_out.quantization;
+    ctx->fmt_cap.xfer_func = ctx->fmt_out.xfer_func;
+  }
+
+  return 0;
+}
+
+static int warping_engine_v4l2_s_fmt_cap(struct file *file, void *priv, struct v4l2_format *f)
+{
+  struct warping_engine_v4l2_ctx *ctx = fh_to_ctx(priv);
+  struct vb2_queue *vq = v4l2_m2m_get_vq(ctx->fh.m2m_ctx, f->type);
+
+  if(vb2_is_busy(vq))
+    return -EBUSY;
+
+  warping_engine_v4l2_try_fmt_cap(file, priv, f);
+  ctx->fmt_cap = f->fmt.pix;
+
+  return 0;
+}
+
+static const struct v4l2_ioctl_ops warping_engine_v4l2_ioctl_ops = {
+  .vidioc_querycap = warping_engine_v4l2_querycap,
+
+  .vidioc_enum_fmt_vid_cap = warping_engine_v4l2_enum_fmt,
+  .vidioc_g_fmt_vid_cap = warping_engine_v4l2_g_fmt,
+  .vidioc_try_fmt_vid_cap = warping_engine_v4l2_try_fmt_cap,
+  .vidioc_s_fmt_vid_cap = warping_engine_v4l2_s_fmt_cap,
+
+  .vidioc_enum_fmt_vid_out = warping_engine_v4l2_enum_fmt,
+  .vidioc_g_fmt_vid_out = warping_engine_v4l2_g_fmt,
+  .vidioc_try_fmt_vid_out = warping_engine_v4l2_try_fmt_out,
+  .vidioc_s_fmt_vid_out = warping_engine_v4l2_s_fmt_out,
+
+  .vidioc_reqbufs = v4l2_m2m_ioctl_reqbufs,
+  .vidioc_querybuf = v4l2_m2m_ioctl_querybuf,
+  .vidioc_qbuf = v4l2_m2m_ioctl_qbuf,
+  .vidioc_dqbuf = v4l2_m2m_ioctl_dqbuf,
+  .vidioc_prepare_buf = v4l2_m2m_ioctl_prepare_buf,
+  .vidioc_create_bufs = v4l2_m2m_ioctl_create_bufs,
+  .vidioc_expbuf = v4l2_m2m_ioctl_expbuf,
+  .vidioc_streamon = v4l2_m2m_ioctl_streamon,
+  .vidioc_streamoff = v4l2_m2m_ioctl_streamoff,
+
+  .vidioc_subscribe_event = v4l2_ctrl_subscribe_event,
+  .vidioc_unsubscribe_event = v4l2_event_unsubscribe,
+};
+
+/* file operations */
+static int warping_engine_v4l2_open(struct file *file)
+{
+  struct warping_engine_v4l2 *wv = video_drvdata(file);
+  struct warping_engine_v4l2_ctx *ctx;
+  unsigned int i;
+  int result;
+
+  if(mutex_lock_interruptible(&wv->lock))
+    return -ERESTARTSYS;
+
+  ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+  if(!ctx)
+  {
+    result = -ENOMEM;
+    goto ALLOC_FAILED;
+  }
+
+  v4l2_fh_init(&ctx->fh, video_devdata(file));
+  file->private_data = &ctx->fh;
+  ctx->wv = wv;
+
+  ctx->fmt_out.width = WARPING_ENGINE_V4L2_DEF_WIDTH;
+  ctx->fmt_out.height = WARPING_ENGINE_V4L2_DEF_HEIGHT;
+  warping_engine_v4l2_fill_fmt(&ctx->fmt_out);
+  ctx->fmt_cap = ctx->fmt_out;
+
+  v4l2_ctrl_handler_init(&ctx->hdl, ARRAY_SIZE(warping_engine_v4l2_ctrls));
+  for(i = 0; i < ARRAY_SIZE(warping_engine_v4l2_ctrls); i++)
+    v4l2_ctrl_new_custom(&ctx->hdl, &warping_engine_v4l2_ctrls[i], NULL);
+  if(ctx->hdl.error)
+  {
+    result = ctx->hdl.error;
+    goto CTRL_FAILED;
+  }
+  ctx->ctrl_count = v4l2_ctrl_find(&ctx->hdl, WARPING_ENGINE_CID_COORDINATES_COUNT);
+  ctx->ctrl_color = v4l2_ctrl_find(&ctx->hdl, WARPING_ENGINE_CID_OUTSIDE_COLOR);
+  ctx->ctrl_stripe = v4l2_ctrl_find(&ctx->hdl, WARPING_ENGINE_CID_STRIPE_WIDTH);
+  ctx->ctrl_config = v4l2_ctrl_find(&ctx->hdl, WARPING_ENGINE_CID_CONFIG);
+  ctx->fh.ctrl_handler = &ctx->hdl;
+
+  ctx->core = warping_engine_ctx_create(wv->dev);
+  if(!ctx->core)
+  {
+    result = -ENOMEM;
+    goto CTRL_FAILED;
+  }
+  ctx->core->priv = ctx;
+  ctx->core->job_done = warping_engine_v4l2_job_done;
+
+  ctx->fh.m2m_ctx = v4l2_m2m_ctx_init(wv->m2m_dev, ctx, warping_engine_v4l2_queue_init);
+  if(IS_ERR(ctx->fh.m2m_ctx))
+  {
+    result = PTR_ERR(ctx->fh.m2m_ctx);
+    goto M2M_FAILED;
+  }
+
+  v4l2_fh_add(&ctx->fh);
+  mutex_unlock(&wv->lock);
+
+  return 0;
+
+M2M_FAILED:
+  warping_engine_ctx_destroy(ctx->core);
+CTRL_FAILED:
+  v4l2_ctrl_handler_free(&ctx->hdl);
+  v4l2_fh_exit(&ctx->fh);
+  kfree(ctx);
+ALLOC_FAILED:
+  mutex_unlock(&wv->lock);
+  return result;
+}
+
+static int warping_engine_v4l2_release(struct file *file)
+{
+  struct warping_engine_v4l2_ctx *ctx = fh_to_ctx(file->private_data);
+  struct warping_engine_v4l2 *wv = ctx->wv;
+
+  v4l2_fh_del(&ctx->fh);
+  v4l2_fh_exit(&ctx->fh);
+
+  /* waits for a running job */
+  mutex_lock(&wv->lock);
+  v4l2_m2m_ctx_release(ctx->fh.m2m_ctx);
+  mutex_unlock(&wv->lock);
+
+  v4l2_ctrl_handler_free(&ctx->hdl);
+  if(ctx->mesh)
+    warping_engine_bo_put(ctx->mesh);
+  warping_engine_ctx_destroy(ctx->core);
+  kfree(ctx);
+
+  return 0;
+}
+
+static const struct v4l2_file_operations warping_engine_v4l2_fops = {
+  .owner = THIS_MODULE,
+  .open = warping_engine_v4l2_open,
+  .release = warping_engine_v4l2_release,
+  .poll = v4l2_m2m_fop_poll,
+  .unlocked_ioctl = video_ioctl2,
+  .mmap = v4l2_m2m_fop_mmap,
+};
+
+int warping_engine_v4l2_register(struct warping_engine_dev *dev)
+{
+  struct warping_engine_v4l2 *wv;
+  int result;
+
+  wv = devm_kzalloc(dev->device, sizeof(*wv), GFP_KERNEL);
+  if(!wv)
+    return -ENOMEM;
+
+  wv->dev = dev;
+  mutex_init(&wv->lock);
+
+  result = v4l2_device_register(dev->device, &wv->v4l2_dev);
+  if(result)
+    return result;
+
+  wv->m2m_dev = v4l2_m2m_init(&warping_engine_v4l2_m2m_ops);
+  if(IS_ERR(wv->m2m_dev))
+  {
+    result = PTR_ERR(wv->m2m_dev);
+    goto M2M_FAILED;
+  }
+
+  strlcpy(wv->vfd.name, WARPING_ENGINE_V4L2_NAME, sizeof(wv->vfd.name));
+  wv->vfd.vfl_dir = VFL_DIR_M2M;
+  wv->vfd.fops = &warping_engine_v4l2_fops;
+  wv->vfd.ioctl_ops = &warping_engine_v4l2_ioctl_ops;
+  wv->vfd.release = video_device_release_empty;
+  wv->vfd.lock = &wv->lock;
+  wv->vfd.v4l2_dev = &wv->v4l2_dev;
+  video_set_drvdata(&wv->vfd, wv);
+
+  result = video_register_device(&wv->vfd, VFL_TYPE_GRABBER, -1);
+  if(result)
+  {
+    v4l2_err(&wv->v4l2_dev, "failed to register video device\n");
+    goto VIDEO_FAILED;
+  }
+
+  dev->v4l2 = wv;
+  v4l2_info(&wv->v4l2_dev, "mem2mem device registered as %s\n", video_device_node_name(&wv->vfd));
+
+  return 0;
+
+VIDEO_FAILED:
+  v4l2_m2m_release(wv->m2m_dev);
+M2M_FAILED:
+  v4l2_device_unregister(&wv->v4l2_dev);
+  return result;
+}
+
+void warping_engine_v4l2_unregister(struct warping_engine_dev *dev)
+{
+  struct warping_engine_v4l2 *wv = dev->v4l2;
+
+  if(!wv)
+    return;
+
+  video_unregister_device(&wv->vfd);
+  v4l2_m2m_release(wv->m2m_dev);
+  v4l2_device_unregister(&wv->v4l2_dev);
+  dev->v4l2 = NULL;
+}